@@ -0,0 +1,963 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: psysBench.cpp
+//
+// Author: William Cheung
+//
+// Desc: Headless benchmark suite of the particle system core.  Drives snow systems
+//       the way psys::Snowfall does (same chunking, kernels and random streams) without
+//       a Direct3D device, through fixed scenarios:
+//
+//         steady   flakes falling through the box, the few that leave it respawned
+//         respawn  every flake respawned every frame, as after a reset or a burst
+//         wind     steady, with the flakes blown about by a WindField
+//         fused    steady, with the vertices written by update (fused packing), so
+//                  that packing is only the copy out of the store
+//
+//         sort     steady, with the flakes sorted back to front for a camera circling
+//                  the box, as psys::ParticleSim::collect does with sorting on
+//         coherent sort, but for flakes drifting in nearly still air and a camera
+//                  walking slowly toward them, so that the order changes little
+//                  from frame to frame and the sorter finishes the last one
+//
+//       at 10k, 100k and 1M flakes, and reports the cost of update, respawn, vertex
+//       packing and sorting in ns per particle.  Every run starts from the same seed,
+//       so the checksum of the final state must not change between runs or builds;
+//       steady, fused and sort run the same simulation and have the same checksum.
+//
+//       Before them, IntegrateParticles is run at every instruction set the CPU
+//       has on the same flakes, which must end up with the same bits and leave
+//       the box in the same order, or the exit code is 3.  Then 50 frames are
+//       recorded with psys::Recorder, with respawns, a change of color, a change
+//       of count and a reshuffle among them, and played back with psys::Replayer
+//       in order and out of it; each frame must come back within half a delta
+//       quantum, or the exit code is 4.
+//
+//       The coherent sort of the largest size must keep to the last order and
+//       stay within a budget of -sortBudget ms per frame, or the exit code is 2.
+//       The default of 8 ms is for 4 threads or more and is stretched for fewer.
+//
+//       usage: psysBench [-threads n] [-frames n] [-seed n] [-sizes a,b,...]
+//                        [-json file|-] [-scaling] [-sortBudget ms]
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleStore.h"
+#include "particleKernels.h"
+#include "jobPool.h"
+#include "random.h"
+#include "windField.h"
+#include "particleSort.h"
+#include "particleRecord.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace psys;
+
+static const int   CHUNK_SIZE = 4096;   // psys::ParticleSim::CHUNK_SIZE
+static const float TIME_DELTA = 1.0f / 60.0f;
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// The core of psys::Snowfall, with knobs for the scenarios
+//
+
+struct SnowSim
+{
+	ParticleStore              particles;
+	std::vector<int>           escaped;
+	std::vector<int>           expired;
+	std::vector<int>           indices;
+	std::vector<PackedParticle> staging;
+	std::vector<int>           chunkCounts;
+	std::vector<float>         windX, windY, windZ;
+	std::vector<unsigned short> sortKeys;
+	std::vector<float>         chunkDepth;
+	DepthSorter                sorter;
+	const int*                 sorted;  // the order of the last sort
+	WindField*                 wind;
+	bool                       fused;
+	float                      speed;  // of the flakes, 1 as they fall
+	float                      boxMin[3];
+	float                      boxMax[3];
+	unsigned long long         seed;
+	unsigned int               frame;
+
+	SnowSim(int numParticles, unsigned long long seed, bool fused = false, float speed = 1.0f)
+	{
+		boxMin[0] = -50.0f; boxMin[1] = -20.0f; boxMin[2] = -50.0f;
+		boxMax[0] =  50.0f; boxMax[1] =  50.0f; boxMax[2] =  50.0f;
+		this->seed = seed;
+		frame = 0;
+		wind  = 0;
+		sorted = 0;
+		this->fused = fused;
+		this->speed = speed;
+
+		particles.reserve(numParticles);
+		escaped.resize(numParticles);
+		expired.resize(numParticles);
+		indices.resize(numParticles);
+
+		int numChunks = (numParticles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		staging.resize(numChunks * CHUNK_SIZE);
+		chunkCounts.resize(numChunks);
+
+		// spread the flakes over the whole box like a system that has been
+		// running for a while
+		rng::Random random(seed);
+		for(int i = 0; i < numParticles; i++)
+		{
+			int k = particles.add();
+			spawn(k, random);
+			particles._posY[k] = random.nextFloat(boxMin[1], boxMax[1]);
+			indices[k] = k;
+		}
+
+		particles.setPacked(fused);
+	}
+
+	// mirrors psys::ParticleSim::chunkStream
+	rng::Random chunkStream(int chunk)
+	{
+		return rng::Random(seed, ((unsigned long long)frame << 32) | (unsigned int)chunk);
+	}
+
+	// a flake of psys::Snowfall::respawnParticles, one at a time
+	void spawn(int i, rng::Random& random)
+	{
+		particles._posX[i]  = random.nextFloat(boxMin[0], boxMax[0]);
+		particles._posY[i]  = boxMax[1];
+		particles._posZ[i]  = random.nextFloat(boxMin[2], boxMax[2]);
+		particles._velX[i]  = random.nextFloat(-3.0f, 0.0f) * speed;
+		particles._velY[i]  = random.nextFloat(-10.0f, 0.0f) * speed;
+		particles._velZ[i]  = 0.0f;
+		particles._color[i] = 0xffffffff;
+		particles._age[i]   = 0.0f;
+		particles._lifeTime[i] = 0.0f;
+	}
+
+	// mirrors psys::Snowfall::respawnParticles
+	void respawn(const int* indices, int count, rng::Random& random)
+	{
+		const int BLOCK = 256;
+		float x[BLOCK], z[BLOCK], vx[BLOCK], vy[BLOCK];
+
+		for(int first = 0; first < count; first += BLOCK)
+		{
+			int n = count - first < BLOCK ? count - first : BLOCK;
+
+			rng::FillFloats(random, x,  n, boxMin[0], boxMax[0]);
+			rng::FillFloats(random, z,  n, boxMin[2], boxMax[2]);
+			rng::FillFloats(random, vx, n, -3.0f,  0.0f);
+			rng::FillFloats(random, vy, n, -10.0f, 0.0f);
+
+			for(int k = 0; k < n; k++)
+			{
+				int i = indices[first + k];
+
+				particles._posX[i]  = x[k];
+				particles._posY[i]  = boxMax[1];
+				particles._posZ[i]  = z[k];
+				particles._velX[i]  = vx[k] * speed;
+				particles._velY[i]  = vy[k] * speed;
+				particles._velZ[i]  = 0.0f;
+				particles._color[i] = 0xffffffff;
+				particles._age[i]   = 0.0f;
+				particles._lifeTime[i] = 0.0f;
+			}
+		}
+	}
+
+	// mirrors the wind of psys::Snowfall
+	void setWind(WindField* field)
+	{
+		wind = field;
+		windX.resize(particles.capacity());
+		windY.resize(particles.capacity());
+		windZ.resize(particles.capacity());
+	}
+
+	// mirrors psys::Snowfall::update without distance bands and terrain
+	void update(JobPool& pool)
+	{
+		if( wind )
+			wind->update(TIME_DELTA);
+
+		pool.parallelFor(0, particles.size(), CHUNK_SIZE, [this](int chunk, int begin, int end)
+		{
+			if( wind )
+			{
+				wind->sample(
+					&particles._posX[begin], &particles._posY[begin], &particles._posZ[begin],
+					end - begin, &windX[begin], &windY[begin], &windZ[begin]);
+
+				ApplyWind(particles, begin, end,
+					&windX[begin], &windY[begin], &windZ[begin], 1.5f, 0.5f, TIME_DELTA);
+			}
+
+			int* out = &escaped[begin];
+			int n = IntegrateParticles(particles, begin, end, TIME_DELTA, boxMin, boxMax, out);
+
+			if( n )
+			{
+				rng::Random random = chunkStream(chunk);
+				respawn(out, n, random);
+			}
+
+			// flakes are immortal, but the pass is part of every update
+			AgeParticles(particles, begin, end, TIME_DELTA, &expired[begin]);
+
+			// mirrors psys::ParticleSim::repackParticles
+			if( fused )
+				PackParticles(particles, begin, end, particles._packed + begin);
+		});
+		frame++;
+	}
+
+	// every flake respawned, each chunk from its own stream
+	void respawnAll(JobPool& pool)
+	{
+		pool.parallelFor(0, particles.size(), CHUNK_SIZE, [this](int chunk, int begin, int end)
+		{
+			rng::Random random = chunkStream(chunk);
+			respawn(&indices[begin], end - begin, random);
+		});
+		frame++;
+	}
+
+	// psys::ParticleSim::collect packs into staging, or with fused packing copies
+	// the store's vertices, as it does into the vertex buffer
+	void pack(JobPool& pool)
+	{
+		pool.parallelFor(0, particles.size(), CHUNK_SIZE, [this](int chunk, int begin, int end)
+		{
+			PackedParticle* out = &staging[chunk * CHUNK_SIZE];
+
+			if( fused )
+			{
+				memcpy(out, particles._packed + begin, (end - begin) * sizeof(PackedParticle));
+				chunkCounts[chunk] = end - begin;
+			}
+			else
+			{
+				chunkCounts[chunk] = PackParticles(particles, begin, end, out);
+			}
+		});
+	}
+
+	// mirrors psys::ParticleSim::sortRange for a single range with every chunk in view
+	void sortByDepth(JobPool& pool, const float axis[4])
+	{
+		int numParticles = particles.size();
+		int numChunks    = (numParticles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+		sortKeys.resize(numParticles);
+		chunkDepth.resize(numChunks * 2);
+
+		pool.parallelFor(0, numParticles, CHUNK_SIZE, [&](int chunk, int begin, int end)
+		{
+			float lo[3], hi[3];
+			ComputeBounds(particles, begin, end, lo, hi);
+
+			float nearDepth = axis[3], farDepth = axis[3];
+			for(int a = 0; a < 3; a++)
+			{
+				float l = lo[a] * axis[a], h = hi[a] * axis[a];
+				nearDepth += l < h ? l : h;
+				farDepth  += l < h ? h : l;
+			}
+			chunkDepth[chunk * 2]     = nearDepth;
+			chunkDepth[chunk * 2 + 1] = farDepth;
+		});
+
+		float nearDepth = FLT_MAX, farDepth = -FLT_MAX;
+		for(int chunk = 0; chunk < numChunks; chunk++)
+		{
+			nearDepth = std::min(nearDepth, chunkDepth[chunk * 2]);
+			farDepth  = std::max(farDepth,  chunkDepth[chunk * 2 + 1]);
+		}
+
+		pool.parallelFor(0, numParticles, CHUNK_SIZE, [&](int /*chunk*/, int begin, int end)
+		{
+			ComputeDepthKeys(particles, begin, end, axis, nearDepth, farDepth, &sortKeys[begin]);
+		});
+
+		const int* order = sorter.sort(&sortKeys[0], numParticles, &pool);
+		sorted = order;
+
+		pool.parallelFor(0, numParticles, CHUNK_SIZE, [&](int chunk, int begin, int end)
+		{
+			// one cache miss per particle out of the packed vertices, four out
+			// of the arrays
+			PackedParticle* out = &staging[chunk * CHUNK_SIZE];
+			for(int k = begin; k < end; k++)
+			{
+				int i = order[k];
+				if( fused )
+				{
+					out[k - begin] = particles._packed[i];
+				}
+				else
+				{
+					out[k - begin]._x     = particles._posX[i];
+					out[k - begin]._y     = particles._posY[i];
+					out[k - begin]._z     = particles._posZ[i];
+					out[k - begin]._color = particles._color[i];
+				}
+			}
+			chunkCounts[chunk] = end - begin;
+		});
+	}
+
+	// FNV-1a over the bits of the positions and velocities
+	unsigned long long checksum() const
+	{
+		unsigned long long h = 14695981039346656037ULL;
+		const float* arrays[] = {
+			particles._posX, particles._posY, particles._posZ,
+			particles._velX, particles._velY, particles._velZ };
+
+		for(int a = 0; a < 6; a++)
+		{
+			const unsigned char* p = (const unsigned char*)arrays[a];
+			size_t numBytes = (size_t)particles.size() * sizeof(float);
+			for(size_t k = 0; k < numBytes; k++)
+				h = (h ^ p[k]) * 1099511628211ULL;
+		}
+		return h;
+	}
+};
+
+//
+// Measurement
+//
+
+// Desc: Per frame timings of one phase, kept so that the median can be reported;
+//       the median hides the odd frame lost to the scheduler.
+struct Timings
+{
+	std::vector<double> seconds;
+
+	template<class Func> void measure(Func func)
+	{
+		double t0 = now();
+		func();
+		seconds.push_back(now() - t0);
+	}
+
+	double medianNs(int numParticles) const
+	{
+		if( seconds.empty() || numParticles <= 0 )
+			return 0.0;
+		std::vector<double> s(seconds);
+		std::sort(s.begin(), s.end());
+		return s[s.size() / 2] * 1e9 / numParticles;
+	}
+
+	double meanNs(int numParticles) const
+	{
+		if( seconds.empty() || numParticles <= 0 )
+			return 0.0;
+		double sum = 0.0;
+		for(size_t i = 0; i < seconds.size(); i++)
+			sum += seconds[i];
+		return sum / seconds.size() * 1e9 / numParticles;
+	}
+};
+
+struct Result
+{
+	std::string        scenario;
+	int                numParticles;
+	int                numFrames;
+	Timings            update;
+	Timings            respawn;
+	Timings            pack;
+	Timings            sort;
+	int                numResorted;  // frames the sorter fell back to a full radix sort
+	bool               misordered;   // a sort that did not order the depths
+	unsigned long long checksum;
+
+	Result() : numParticles(0), numFrames(0), numResorted(0), misordered(false), checksum(0) {}
+};
+
+static void runSteady(Result& result, JobPool& pool, unsigned long long seed,
+	bool windy = false, bool fused = false)
+{
+	SnowSim   sim(result.numParticles, seed, fused);
+	WindField wind;
+
+	// the field main.cpp sets up
+	if( windy )
+	{
+		float base[3] = { -1.5f, 0.0f, 0.0f };
+		wind.setWind(base, 4.0f, 40.0f, 0.5f);
+		wind.setSeed((unsigned int)seed);
+		wind.init(sim.boxMin, sim.boxMax, 16, 8, 16);
+		sim.setWind(&wind);
+	}
+
+	// warm up caches and wake the workers once
+	sim.update(pool);
+	sim.pack(pool);
+
+	for(int f = 0; f < result.numFrames; f++)
+	{
+		result.update.measure([&]() { sim.update(pool); });
+		result.pack.measure([&]() { sim.pack(pool); });
+	}
+
+	result.checksum = sim.checksum();
+}
+
+// the depths of the sorted flakes must not decrease
+static bool isSorted(const SnowSim& sim)
+{
+	for(size_t k = 1; k < sim.sortKeys.size(); k++)
+		if( sim.sortKeys[sim.sorted[k]] < sim.sortKeys[sim.sorted[k - 1]] )
+			return false;
+	return true;
+}
+
+static void runSort(Result& result, JobPool& pool, unsigned long long seed, bool coherent = false)
+{
+	// with fused packing, as sorting is meant to be run; coherent snow
+	// drifts at a five hundredth of the speed it falls at
+	SnowSim sim(result.numParticles, seed, true, coherent ? 0.002f : 1.0f);
+
+	// a camera circling the box at 80 units, looking at its center, one turn
+	// in about ten seconds; or looking along x, walking toward the box at a
+	// unit a second
+	float angle = 0.0f;
+	float walk  = 0.0f;
+	auto  axis  = [&](float out[4])
+	{
+		float eye[3] = { 80.0f * cosf(angle) - walk, 10.0f, 80.0f * sinf(angle) };
+		float dir[3] = { -80.0f * cosf(angle), 15.0f - eye[1], -80.0f * sinf(angle) };
+		float len    = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+		for(int a = 0; a < 3; a++)
+			out[a] = dir[a] / len;
+		out[3] = -(eye[0] * out[0] + eye[1] * out[1] + eye[2] * out[2]);
+	};
+
+	float a[4];
+	axis(a);
+	sim.update(pool);
+	sim.sortByDepth(pool, a);
+
+	// the sorter only retries the last order every few frames after a
+	// full sort, wait for it
+	for(int f = 0; coherent && f < 32 && sim.sorter.getLastMethod() != DepthSorter::INCREMENTAL; f++)
+	{
+		walk += TIME_DELTA;
+		axis(a);
+		sim.update(pool);
+		sim.sortByDepth(pool, a);
+	}
+
+	for(int f = 0; f < result.numFrames; f++)
+	{
+		if( coherent )
+			walk += TIME_DELTA;
+		else
+			angle += 0.01f;
+		axis(a);
+
+		result.update.measure([&]() { sim.update(pool); });
+		result.sort.measure([&]() { sim.sortByDepth(pool, a); });
+
+		if( sim.sorter.getLastMethod() == DepthSorter::RADIX )
+			result.numResorted++;
+		if( !isSorted(sim) )
+			result.misordered = true;
+	}
+
+	result.checksum = sim.checksum();
+}
+
+static void runRespawn(Result& result, JobPool& pool, unsigned long long seed)
+{
+	SnowSim sim(result.numParticles, seed);
+
+	sim.respawnAll(pool);
+
+	for(int f = 0; f < result.numFrames; f++)
+	{
+		result.respawn.measure([&]() { sim.respawnAll(pool); });
+		result.update.measure([&]() { sim.update(pool); });
+	}
+
+	result.checksum = sim.checksum();
+}
+
+// Desc: Runs the flakes of seed through numFrames integrations at level, the
+//       flakes that leave the box respawned, and returns the checksum of the
+//       end state.  Every escaped list is appended to escaped.
+static unsigned long long integrateAt(simd::Level level, int numParticles, int numFrames,
+	unsigned long long seed, std::vector<int>& escaped)
+{
+	SnowSim sim(numParticles, seed);
+
+	for(int f = 0; f < numFrames; f++)
+	{
+		for(int begin = 0, chunk = 0; begin < numParticles; begin += CHUNK_SIZE, chunk++)
+		{
+			int  end = begin + CHUNK_SIZE < numParticles ? begin + CHUNK_SIZE : numParticles;
+			int* out = &sim.escaped[begin];
+			int  n   = IntegrateParticles(level, sim.particles, begin, end, TIME_DELTA, sim.boxMin, sim.boxMax, out);
+
+			escaped.insert(escaped.end(), out, out + n);
+
+			rng::Random random = sim.chunkStream(chunk);
+			sim.respawn(out, n, random);
+		}
+		sim.frame++;
+	}
+
+	return sim.checksum();
+}
+
+// the vector integrations against the scalar one, on a size that leaves a
+// tail past the last full vector of every chunk
+static bool checkIntegration(unsigned long long seed)
+{
+	const int NUM_PARTICLES = 3 * CHUNK_SIZE + 1003;
+	const int NUM_FRAMES    = 120;
+
+	const char* names[] = { "scalar", "sse2", "avx2" };
+
+	std::vector<int>   expected;
+	unsigned long long checksum = integrateAt(simd::LEVEL_SCALAR, NUM_PARTICLES, NUM_FRAMES, seed, expected);
+
+	bool same = true;
+	for(int level = simd::LEVEL_SCALAR + 1; level <= simd::DetectLevel(); level++)
+	{
+		std::vector<int>   escaped;
+		unsigned long long c = integrateAt((simd::Level)level, NUM_PARTICLES, NUM_FRAMES, seed, escaped);
+
+		if( c != checksum || escaped != expected )
+		{
+			fprintf(stderr, "psysBench: %s integration differs from scalar: checksum %016llx, not %016llx; %d escaped, not %d\n",
+				names[level], c, checksum, (int)escaped.size(), (int)expected.size());
+			same = false;
+		}
+	}
+	return same;
+}
+
+// the frame's particles as recorded, to check a replay against
+struct RecordedFrame
+{
+	std::vector<float>        x, y, z;
+	std::vector<unsigned int> color;
+	CameraPose                pose;
+	float                     timeDelta;
+};
+
+static bool matches(const RecordedFrame& expected, const ParticleStore& store,
+	const CameraPose& pose, float timeDelta, float tolerance)
+{
+	int n = (int)expected.x.size();
+	if( store.size() != n || timeDelta != expected.timeDelta ||
+		memcmp(&pose, &expected.pose, sizeof(pose)) != 0 )
+		return false;
+
+	for(int i = 0; i < n; i++)
+	{
+		if( fabsf(store._posX[i] - expected.x[i]) > tolerance ||
+			fabsf(store._posY[i] - expected.y[i]) > tolerance ||
+			fabsf(store._posZ[i] - expected.z[i]) > tolerance ||
+			store._color[i] != expected.color[i] )
+			return false;
+	}
+	return true;
+}
+
+// a record and replay round trip through a file, in the current directory
+static bool checkRecording(JobPool& pool, unsigned long long seed)
+{
+	const int   NUM_PARTICLES = 5000;
+	const int   NUM_FRAMES    = 50;
+	const char* PATH          = "psysBench.rec";
+
+	// half the quantum a delta is stored to, and a little for the rounding
+	// of the replayer's sums
+	const float TOLERANCE = 0.5f / 1024.0f * 1.01f;
+
+	SnowSim sim(NUM_PARTICLES, seed);
+	std::vector<RecordedFrame> frames(NUM_FRAMES);
+
+	Recorder recorder;
+	if( !recorder.open(PATH) )
+	{
+		fprintf(stderr, "psysBench: can't write %s\n", PATH);
+		return false;
+	}
+
+	for(int f = 0; f < NUM_FRAMES; f++)
+	{
+		// respawns jump further than a delta can say
+		sim.update(pool);
+
+		ParticleStore& p = sim.particles;
+
+		// two in five jump, a delta is still smaller than a snapshot
+		if( f == 20 )
+			for(int i = 0; i < p.size(); i += 5)
+				p._color[i] = p._color[i + 1] = 0x80ffffff;
+
+		if( f == 30 )
+			p.resize(p.size() - 100);
+
+		// all but a few move, a snapshot is smaller than the jumps
+		if( f == 40 )
+			for(int i = 0, j = p.size() - 1; i < j; i++, j--)
+				p.swap(i, j);
+
+		RecordedFrame& r = frames[f];
+		r.x.assign(p._posX, p._posX + p.size());
+		r.y.assign(p._posY, p._posY + p.size());
+		r.z.assign(p._posZ, p._posZ + p.size());
+		r.color.assign(p._color, p._color + p.size());
+		r.timeDelta = TIME_DELTA * (1.0f + f * 0.01f);
+
+		float* pose = &r.pose._position[0];
+		for(int k = 0; k < 12; k++)
+			pose[k] = (float)(f * 12 + k);
+
+		if( !recorder.writeFrame(p, r.pose, r.timeDelta) )
+		{
+			fprintf(stderr, "psysBench: can't write %s\n", PATH);
+			return false;
+		}
+	}
+	recorder.close();
+
+	Replayer replayer;
+	bool     ok = replayer.open(PATH) && replayer.getFrameCount() == NUM_FRAMES;
+
+	// the first frame, the change of count and the reshuffle are snapshots,
+	// the frames of respawns and of the change of color deltas
+	ok = ok && replayer.isSnapshot(0) && replayer.isSnapshot(30) && replayer.isSnapshot(40) &&
+		!replayer.isSnapshot(10) && !replayer.isSnapshot(20) && !replayer.isSnapshot(41);
+
+	// in order, then seeking back and forth
+	ParticleStore store;
+	CameraPose    pose;
+	float         timeDelta;
+	for(int f = 0; ok && f < NUM_FRAMES; f++)
+		ok = replayer.readFrame(f, &store, &pose, &timeDelta) &&
+			matches(frames[f], store, pose, timeDelta, TOLERANCE);
+
+	const int seeks[] = { 45, 3, 29, 31, 30, 12, 49, 0, 39, 40 };
+	for(int k = 0; ok && k < (int)(sizeof(seeks) / sizeof(seeks[0])); k++)
+		ok = replayer.readFrame(seeks[k], &store, &pose, &timeDelta) &&
+			matches(frames[seeks[k]], store, pose, timeDelta, TOLERANCE);
+
+	replayer.close();
+	remove(PATH);
+
+	if( !ok )
+		fprintf(stderr, "psysBench: a recording did not play back as it was recorded\n");
+	return ok;
+}
+
+//
+// Reporting
+//
+
+// one column of the table, "-" for a phase the scenario does not run
+static void printPhase(const Timings& t, int numParticles)
+{
+	if( t.seconds.empty() )
+		printf(" %14s", "-");
+	else
+		printf(" %14.3f", t.medianNs(numParticles));
+}
+
+static void printTable(const std::vector<Result>& results)
+{
+	printf("%-8s %10s %14s %14s %14s %14s  %s\n",
+		"scenario", "particles", "update ns/p", "respawn ns/p", "pack ns/p", "sort ns/p", "checksum");
+
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		printf("%-8s %10d", r.scenario.c_str(), r.numParticles);
+		printPhase(r.update,  r.numParticles);
+		printPhase(r.respawn, r.numParticles);
+		printPhase(r.pack,    r.numParticles);
+		printPhase(r.sort,    r.numParticles);
+		printf("  %016llx\n", r.checksum);
+	}
+}
+
+static void writePhase(FILE* f, const char* name, const Timings& t, int numParticles, bool last)
+{
+	if( t.seconds.empty() )
+		fprintf(f, "        \"%s\": null%s\n", name, last ? "" : ",");
+	else
+		fprintf(f, "        \"%s\": { \"medianNsPerParticle\": %.4f, \"meanNsPerParticle\": %.4f }%s\n",
+			name, t.medianNs(numParticles), t.meanNs(numParticles), last ? "" : ",");
+}
+
+static void writeJson(FILE* f, const std::vector<Result>& results,
+	unsigned long long seed, int numThreads)
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"seed\": %llu,\n", seed);
+	fprintf(f, "  \"threads\": %d,\n", numThreads);
+	fprintf(f, "  \"simdLevel\": %d,\n", (int)simd::GetLevel());
+	fprintf(f, "  \"chunkSize\": %d,\n", CHUNK_SIZE);
+	fprintf(f, "  \"results\": [\n");
+
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(f, "    {\n");
+		fprintf(f, "        \"scenario\": \"%s\",\n", r.scenario.c_str());
+		fprintf(f, "        \"particles\": %d,\n", r.numParticles);
+		fprintf(f, "        \"frames\": %d,\n", r.numFrames);
+		fprintf(f, "        \"checksum\": \"%016llx\",\n", r.checksum);
+		writePhase(f, "update",  r.update,  r.numParticles, false);
+		writePhase(f, "respawn", r.respawn, r.numParticles, false);
+		writePhase(f, "pack",    r.pack,    r.numParticles, false);
+		writePhase(f, "sort",    r.sort,    r.numParticles, true);
+		fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+// how the steady state frame time scales with threads
+static void runScaling(int numParticles, int maxThreads, int numFrames, unsigned long long seed)
+{
+	printf("particles: %d, frames: %d, simd level: %d\n",
+		numParticles, numFrames, (int)simd::GetLevel());
+	printf("%8s %12s %12s %10s\n", "threads", "update ms", "pack ms", "speedup");
+
+	double baseline = 0.0;
+
+	for(int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobPool pool(threads);
+		Result  result;
+		result.numParticles = numParticles;
+		result.numFrames    = numFrames;
+		runSteady(result, pool, seed);
+
+		double updateMs = result.update.medianNs(1) * 1e-6;
+		double packMs   = result.pack.medianNs(1) * 1e-6;
+
+		if( threads == 1 )
+			baseline = updateMs + packMs;
+
+		printf("%8d %12.3f %12.3f %9.2fx\n",
+			threads, updateMs, packMs, baseline / (updateMs + packMs));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int                numThreads = 1;
+	int                numFrames  = 60;
+	unsigned long long seed       = 12345;
+	const char*        jsonPath   = 0;
+	bool               scaling    = false;
+	double             sortBudget = 0.0;  // ms per frame
+	std::vector<int>   sizes;
+
+	for(int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if( !strcmp(argv[i], "-threads") && hasValue )
+			numThreads = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-frames") && hasValue )
+			numFrames = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-seed") && hasValue )
+			seed = strtoull(argv[++i], 0, 10);
+		else if( !strcmp(argv[i], "-json") && hasValue )
+			jsonPath = argv[++i];
+		else if( !strcmp(argv[i], "-scaling") )
+			scaling = true;
+		else if( !strcmp(argv[i], "-sortBudget") && hasValue )
+			sortBudget = atof(argv[++i]);
+		else if( !strcmp(argv[i], "-sizes") && hasValue )
+		{
+			for(char* s = argv[++i]; *s; )
+			{
+				sizes.push_back(atoi(s));
+				while( *s && *s != ',' )
+					s++;
+				if( *s == ',' )
+					s++;
+			}
+		}
+		else
+		{
+			fprintf(stderr,
+				"usage: psysBench [-threads n] [-frames n] [-seed n] [-sizes a,b,...]\n"
+				"                 [-json file|-] [-scaling] [-sortBudget ms]\n");
+			return 1;
+		}
+	}
+
+	if( numThreads <= 0 )
+		numThreads = (int)std::thread::hardware_concurrency();
+	if( numThreads <= 0 )
+		numThreads = 1;
+	if( numFrames <= 0 )
+		numFrames = 1;
+
+	// half a frame at 60 Hz on 4 threads, as much more as there are fewer
+	if( sortBudget <= 0.0 )
+		sortBudget = 8.0 * 4 / (numThreads < 4 ? numThreads : 4);
+
+	if( sizes.empty() )
+	{
+		sizes.push_back(10000);
+		sizes.push_back(100000);
+		sizes.push_back(1000000);
+	}
+
+	if( scaling )
+	{
+		runScaling(sizes.back(), numThreads, numFrames, seed);
+		return 0;
+	}
+
+	if( !checkIntegration(seed) )
+		return 3;
+
+	std::vector<Result> results;
+	JobPool pool(numThreads);
+
+	if( !checkRecording(pool, seed) )
+		return 4;
+
+	for(size_t s = 0; s < sizes.size(); s++)
+	{
+		if( sizes[s] <= 0 )
+			continue;
+
+		Result steady;
+		steady.scenario     = "steady";
+		steady.numParticles = sizes[s];
+		steady.numFrames    = numFrames;
+		runSteady(steady, pool, seed);
+		results.push_back(steady);
+
+		Result respawn;
+		respawn.scenario     = "respawn";
+		respawn.numParticles = sizes[s];
+		respawn.numFrames    = numFrames;
+		runRespawn(respawn, pool, seed);
+		results.push_back(respawn);
+
+		Result windy;
+		windy.scenario     = "wind";
+		windy.numParticles = sizes[s];
+		windy.numFrames    = numFrames;
+		runSteady(windy, pool, seed, true);
+		results.push_back(windy);
+
+		Result fused;
+		fused.scenario     = "fused";
+		fused.numParticles = sizes[s];
+		fused.numFrames    = numFrames;
+		runSteady(fused, pool, seed, false, true);
+		results.push_back(fused);
+
+		Result sorted;
+		sorted.scenario     = "sort";
+		sorted.numParticles = sizes[s];
+		sorted.numFrames    = numFrames;
+		runSort(sorted, pool, seed);
+		results.push_back(sorted);
+
+		Result coherent;
+		coherent.scenario     = "coherent";
+		coherent.numParticles = sizes[s];
+		coherent.numFrames    = numFrames;
+		runSort(coherent, pool, seed, true);
+		results.push_back(coherent);
+	}
+
+	bool jsonToStdout = jsonPath && !strcmp(jsonPath, "-");
+
+	if( !jsonToStdout )
+	{
+		printf("threads: %d, frames: %d, seed: %llu, simd level: %d\n",
+			numThreads, numFrames, seed, (int)simd::GetLevel());
+		printf("integration: the same at simd levels 0 to %d\n", (int)simd::DetectLevel());
+		printf("recording: played back in order and seeking within half a quantum\n");
+		printTable(results);
+	}
+
+	// the sorts of the largest size; the coherent one must keep to the last
+	// order and to the budget, and every sort must order the depths
+	const Result* circling = 0;
+	const Result* budgeted = 0;
+	bool          ordered  = true;
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		if( results[i].scenario == "sort" )
+			circling = &results[i];
+		if( results[i].scenario == "coherent" )
+			budgeted = &results[i];
+		if( results[i].misordered )
+			ordered = false;
+	}
+
+	if( circling && !jsonToStdout )
+		printf("sort: %.3f ms per frame at %d particles, %d of %d frames fully resorted\n",
+			circling->sort.medianNs(1) * 1e-6, circling->numParticles, circling->numResorted, circling->numFrames);
+
+	bool withinBudget = ordered;
+	if( budgeted )
+	{
+		double ms          = budgeted->sort.medianNs(1) * 1e-6;
+		bool   incremental = budgeted->numResorted * 10 <= budgeted->numFrames;
+		withinBudget = withinBudget && incremental && ms <= sortBudget;
+
+		if( !jsonToStdout )
+			printf("coherent: %.3f ms per frame at %d particles, budget %.3f ms, %d of %d frames fully resorted: %s\n",
+				ms, budgeted->numParticles, sortBudget, budgeted->numResorted, budgeted->numFrames,
+				!incremental ? "NOT INCREMENTAL" : ms > sortBudget ? "OVER BUDGET" : "ok");
+	}
+
+	if( !ordered )
+		fprintf(stderr, "psysBench: a sort left the depths out of order\n");
+
+	if( jsonPath )
+	{
+		FILE* f = jsonToStdout ? stdout : fopen(jsonPath, "w");
+		if( !f )
+		{
+			fprintf(stderr, "psysBench: can't write %s\n", jsonPath);
+			return 1;
+		}
+		writeJson(f, results, seed, numThreads);
+		if( f != stdout )
+			fclose(f);
+	}
+
+	return withinBudget ? 0 : 2;
+}
@@ -0,0 +1,533 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: rasterBench.cpp
+//
+// Author: William Cheung
+//
+// Desc: Headless rendering of the snow scene with SoftRaster, for frame times and
+//       golden image tests without a Direct3D device.  The scene is built with
+//       the project's own code wherever it does not need the device: the terrain
+//       is read by HeightmapFile into a HeightField, meshed by TerrainTree and
+//       lit from the field's normals as Terrain does, here at the heightmap's
+//       full resolution; the snow is a psys::Snowfall with the application's
+//       render setup and wind, settling on the terrain, collected into runs as
+//       ParticleWorld draws it.  Only the crate is made up.  The camera circles
+//       the scene.
+//
+//       Every frame depends only on its number and the seed, never on the clock,
+//       the number of threads or the instruction set, so the last frame can be
+//       compared with a golden image: -golden fails with exit code 3 when more
+//       than -maxDiff of the pixels differ by more than -tolerance in a channel.
+//       -out writes the last frame.  Without the heightmap the terrain is flat.
+//       The snow is left to fall for -warmup updates before the first frame.
+//       -simd forces an instruction set, to check that they draw the same.
+//
+//       usage: rasterBench [-threads n] [-frames n] [-seed n] [-size w h]
+//                          [-flakes n] [-warmup n] [-heightmap file]
+//                          [-out file.tga] [-golden file.tga] [-tolerance n]
+//                          [-maxDiff fraction] [-simd 0|1|2]
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "softRaster.h"
+#include "snowfall.h"
+#include "heightField.h"
+#include "heightmapFile.h"
+#include "terrainTree.h"
+#include "windField.h"
+#include "frameTimer.h"
+#include "jobPool.h"
+#include "random.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace psys;
+
+static const float TIME_DELTA = 1.0f / 60.0f;
+
+// as main.cpp sets the scene up, but for the terrain's resolution
+static const int   TERRAIN_VERTS   = 257;
+static const int   TERRAIN_SPACING = 1;
+static const float TERRAIN_OFFSET  = -12.5f;
+static const float HEIGHT_SCALE    = 0.05f;
+
+//
+// Matrices, laid out like D3DXMATRIX
+//
+
+static void identity(float* m)
+{
+	for(int i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+static void translation(float* m, float x, float y, float z)
+{
+	identity(m);
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+}
+
+// D3DXMatrixLookAtLH
+static void lookAt(float* m, const float* eye, const float* at)
+{
+	float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	float l = sqrtf(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+	z[0] /= l; z[1] /= l; z[2] /= l;
+
+	// up is +y
+	float x[3] = { z[2], 0.0f, -z[0] };
+	l = sqrtf(x[0] * x[0] + x[2] * x[2]);
+	x[0] /= l; x[2] /= l;
+
+	float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	identity(m);
+	for(int i = 0; i < 3; i++)
+	{
+		m[i * 4 + 0] = x[i];
+		m[i * 4 + 1] = y[i];
+		m[i * 4 + 2] = z[i];
+	}
+	m[12] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+	m[13] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+	m[14] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+}
+
+// D3DXMatrixPerspectiveFovLH
+static void perspective(float* m, float fovY, float aspect, float zn, float zf)
+{
+	float yScale = 1.0f / tanf(fovY * 0.5f);
+
+	for(int i = 0; i < 16; i++)
+		m[i] = 0.0f;
+	m[0]  = yScale / aspect;
+	m[5]  = yScale;
+	m[10] = zf / (zf - zn);
+	m[11] = 1.0f;
+	m[14] = -zn * zf / (zf - zn);
+}
+
+//
+// Scene
+//
+
+struct Mesh
+{
+	std::vector<SoftRaster::Vertex> vertices;
+	std::vector<unsigned int>       indices;
+};
+
+// Terrain::makeVertex over the grid, and the indices of all of the tree's chunks
+static void buildTerrain(const HeightField& heights, const TerrainTree& tree, Mesh* mesh)
+{
+	int numRows  = heights.getNumRows();
+	int numCols  = heights.getNumCols();
+	int width    = (numCols - 1) * TERRAIN_SPACING;
+	int depth    = (numRows - 1) * TERRAIN_SPACING;
+
+	mesh->vertices.resize(numRows * numCols);
+
+	for(int i = 0; i < numRows; i++)
+	{
+		for(int j = 0; j < numCols; j++)
+		{
+			SoftRaster::Vertex& v = mesh->vertices[i * numCols + j];
+			v._x  = (float)(-width / 2 + j * TERRAIN_SPACING);
+			v._y  = heights.getHeight(i, j);
+			v._z  = (float)( depth / 2 - i * TERRAIN_SPACING);
+			v._nx = 0.0f; v._ny = 1.0f; v._nz = 0.0f;
+			v._u  = (float)j * (1.0f / (float)(numCols - 1));
+			v._v  = (float)i * (1.0f / (float)(numRows - 1));
+		}
+	}
+
+	for(int k = 0; k < tree.getNumChunks(); k++)
+	{
+		size_t first = mesh->indices.size();
+		mesh->indices.resize(first + tree.getNumChunkIndices(k));
+		tree.writeIndices(k, false, &mesh->indices[first]);
+	}
+}
+
+// Terrain::genTexture: a white texel per cell, lit from the cell's normal as
+// Terrain::relightCells does without snow
+static void buildTerrainTexture(HeightField* heights, const float* toLight, JobPool* pool, SoftRaster::Texture* tex)
+{
+	int numRows = heights->getNumRows() - 1;
+	int numCols = heights->getNumCols() - 1;
+
+	heights->updateNormals(0, 0, numRows - 1, numCols - 1, pool);
+
+	std::vector<float> shades(numRows * numCols);
+	heights->shade(toLight, 0, 0, numRows, numCols, &shades[0], numCols);
+
+	tex->_width  = numCols;
+	tex->_height = numRows;
+	tex->_texels.resize(numRows * numCols);
+
+	for(int i = 0; i < numRows * numCols; i++)
+	{
+		// D3DXCOLOR to D3DCOLOR, the texture having no alpha
+		float        c = shades[i];
+		unsigned int b = c >= 1.0f ? 0xff : c <= 0.0f ? 0x00 : (unsigned int)(c * 255.0f + 0.5f);
+		tex->_texels[i] = 0xff000000 | (b << 16) | (b << 8) | b;
+	}
+}
+
+// a box from -1 to 1 with a face per side, wound clockwise seen from outside
+static void buildCrate(Mesh* mesh)
+{
+	static const float FACES[6][3] = {
+		{ 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+
+	for(int f = 0; f < 6; f++)
+	{
+		const float* n = FACES[f];
+
+		// two axes across the face
+		float u[3] = { n[1] + n[2], 0.0f, -n[0] };
+		if( n[1] != 0.0f ) { u[0] = 1.0f; u[1] = 0.0f; u[2] = 0.0f; }
+		float v[3] = { n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0] };
+
+		unsigned int base = (unsigned int)mesh->vertices.size();
+		for(int k = 0; k < 4; k++)
+		{
+			float su = (k == 1 || k == 2) ? 1.0f : -1.0f;
+			float sv = (k >= 2) ? -1.0f : 1.0f;
+
+			SoftRaster::Vertex vertex;
+			vertex._x  = n[0] + u[0] * su + v[0] * sv;
+			vertex._y  = n[1] + u[1] * su + v[1] * sv;
+			vertex._z  = n[2] + u[2] * su + v[2] * sv;
+			vertex._nx = n[0]; vertex._ny = n[1]; vertex._nz = n[2];
+			vertex._u  = su > 0.0f ? 1.0f : 0.0f;
+			vertex._v  = sv > 0.0f ? 0.0f : 1.0f;
+			mesh->vertices.push_back(vertex);
+		}
+
+		unsigned int quad[6] = { base, base + 2, base + 1, base, base + 3, base + 2 };
+		mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+	}
+}
+
+// wooden planks
+static void buildCrateTexture(SoftRaster::Texture* tex)
+{
+	tex->_width  = 64;
+	tex->_height = 64;
+	tex->_texels.resize(64 * 64);
+	for(int y = 0; y < 64; y++)
+	{
+		for(int x = 0; x < 64; x++)
+		{
+			bool edge = x < 4 || x >= 60 || y < 4 || y >= 60 || (y % 16) == 0;
+			tex->_texels[y * 64 + x] = edge ? 0xff5a3c1e : 0xffa0784a;
+		}
+	}
+}
+
+// a round flake, opaque in the middle and fading out to the rim
+static void buildFlakeTexture(SoftRaster::Texture* tex)
+{
+	tex->_width  = 32;
+	tex->_height = 32;
+	tex->_texels.resize(32 * 32);
+	for(int y = 0; y < 32; y++)
+	{
+		for(int x = 0; x < 32; x++)
+		{
+			float dx = (x + 0.5f) / 16.0f - 1.0f;
+			float dy = (y + 0.5f) / 16.0f - 1.0f;
+			float a  = 1.0f - sqrtf(dx * dx + dy * dy);
+			unsigned int alpha = a <= 0.0f ? 0 : (unsigned int)(a * 255.0f);
+			tex->_texels[y * 32 + x] = (alpha << 24) | 0x00ffffff;
+		}
+	}
+}
+
+// reads back what SoftRaster::writeTga writes
+static bool readTga(const char* fileName, int* width, int* height, std::vector<unsigned int>* pixels)
+{
+	FILE* file = fopen(fileName, "rb");
+	if( !file )
+		return false;
+
+	unsigned char header[18];
+	bool ok = fread(header, 1, 18, file) == 18 && header[2] == 2 && header[16] == 32;
+	if( ok )
+	{
+		*width  = header[12] | (header[13] << 8);
+		*height = header[14] | (header[15] << 8);
+
+		std::vector<unsigned char> data(*width * *height * 4);
+		ok = fread(&data[0], 1, data.size(), file) == data.size();
+
+		pixels->resize(*width * *height);
+		for(int i = 0; ok && i < *width * *height; i++)
+		{
+			// rows from the bottom unless the descriptor says otherwise
+			int y   = i / *width;
+			int row = (header[17] & 0x20) ? y : *height - 1 - y;
+			const unsigned char* p = &data[(row * *width + i % *width) * 4];
+			(*pixels)[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+		}
+	}
+
+	fclose(file);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	int                numThreads = 0;
+	int                numFrames  = 60;
+	unsigned long long seed       = 12345;
+	int                width      = 1280;
+	int                height     = 720;
+	int                numFlakes  = 100000;
+	int                numWarmup  = 300;
+	const char*        heightmap  = "../../bin/castlehm257.raw";
+	const char*        outPath    = 0;
+	const char*        goldenPath = 0;
+	int                tolerance  = 2;
+	double             maxDiff    = 0.001;
+
+	for(int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if( !strcmp(argv[i], "-threads") && hasValue )
+			numThreads = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-frames") && hasValue )
+			numFrames = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-seed") && hasValue )
+			seed = strtoull(argv[++i], 0, 10);
+		else if( !strcmp(argv[i], "-size") && i + 2 < argc )
+		{
+			width  = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "-flakes") && hasValue )
+			numFlakes = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-warmup") && hasValue )
+			numWarmup = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-heightmap") && hasValue )
+			heightmap = argv[++i];
+		else if( !strcmp(argv[i], "-out") && hasValue )
+			outPath = argv[++i];
+		else if( !strcmp(argv[i], "-golden") && hasValue )
+			goldenPath = argv[++i];
+		else if( !strcmp(argv[i], "-tolerance") && hasValue )
+			tolerance = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-maxDiff") && hasValue )
+			maxDiff = atof(argv[++i]);
+		else if( !strcmp(argv[i], "-simd") && hasValue )
+			simd::SetLevel((simd::Level)atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr,
+				"usage: rasterBench [-threads n] [-frames n] [-seed n] [-size w h]\n"
+				"                   [-flakes n] [-warmup n] [-heightmap file]\n"
+				"                   [-out file.tga] [-golden file.tga] [-tolerance n]\n"
+				"                   [-maxDiff fraction] [-simd 0|1|2]\n");
+			return 1;
+		}
+	}
+
+	if( numFrames <= 0 )
+		numFrames = 1;
+
+	JobPool    pool(numThreads);
+	SoftRaster raster;
+	if( !raster.init(width, height) )
+	{
+		fprintf(stderr, "bad size %d x %d\n", width, height);
+		return 1;
+	}
+	raster.setJobPool(&pool);
+
+	//
+	// Build the scene
+	//
+
+	// Terrain's constructor and genTexture
+	HeightmapFile file;
+	HeightField   heights;
+	file.open(heightmap);
+	if( !file.readField(TERRAIN_VERTS, TERRAIN_VERTS, HEIGHT_SCALE, &heights) )
+		printf("heightmap %s not found or too small, the terrain is flat\n", heightmap);
+
+	int terrainWidth = (TERRAIN_VERTS - 1) * TERRAIN_SPACING;
+	heights.setPlacement(-(float)terrainWidth / 2.0f, (float)terrainWidth / 2.0f, (float)TERRAIN_SPACING);
+
+	TerrainTree tree;
+	tree.build(heights, (float)TERRAIN_SPACING, (float)(-terrainWidth / 2), (float)(terrainWidth / 2));
+
+	float toLight[3] = { 0.5f, 1.0f, 0.5f };
+
+	Mesh terrain, crate;
+	buildTerrain(heights, tree, &terrain);
+	buildCrate(&crate);
+
+	SoftRaster::Texture terrainTex, crateTex, flakeTex;
+	buildTerrainTexture(&heights, toLight, &pool, &terrainTex);
+	buildCrateTexture(&crateTex);
+	buildFlakeTexture(&flakeTex);
+
+	// the snow and its wind as main.cpp makes them
+	rng::SetSeed(seed);
+
+	float boxMin[3] = { -50.0f, -20.0f, -50.0f };
+	float boxMax[3] = {  50.0f,  50.0f,  50.0f };
+
+	RenderSetup setup = Snowfall::defaultSetup();
+	setup._sorting = true;
+
+	Snowfall snow(boxMin, boxMax, numFlakes);
+	snow.setRenderSetup(setup);
+	snow.setJobPool(&pool);
+	snow.setGround(&heights, TERRAIN_OFFSET);
+
+	WindField wind;
+	float windBase[3] = { -1.5f, 0.0f, 0.0f };
+	wind.setWind(windBase, 4.0f, 40.0f, 0.5f);
+	wind.setSeed((unsigned int)rng::ThreadRandom().next());
+	wind.init(boxMin, boxMax, 16, 8, 16);
+	snow.setWind(&wind);
+
+	for(int i = 0; i < numWarmup; i++)
+	{
+		wind.update(TIME_DELTA);
+		snow.update(TIME_DELTA);
+	}
+
+	std::vector<DrawRun> runs;
+
+	float lightDir[3] = { -0.5f, -0.5f, -1.0f };
+	float white[3]    = { 1.0f, 1.0f, 1.0f };
+	float ambient[3]  = { 0.2f, 0.2f, 0.2f };
+	raster.setLight(lightDir, white, ambient);
+
+	float proj[16], identityM[16], terrainW[16], crateW[16];
+	perspective(proj, 3.14159265f / 4.0f, (float)width / height, 1.0f, 5000.0f);
+	identity(identityM);
+	translation(terrainW, 0.0f, TERRAIN_OFFSET, 0.0f);
+	translation(crateW, 10.0f, -1.0f, 15.0f);
+
+	//
+	// Render
+	//
+
+	timing::FrameHistogram frameTimes;
+	long long              snowNs = 0;
+
+	printf("%d x %d, %d flakes, %d terrain triangles, %d threads, simd level %d\n",
+		width, height, numFlakes, (int)terrain.indices.size() / 3, pool.getThreadCount(), (int)simd::GetLevel());
+
+	for(int frame = 0; frame < numFrames; frame++)
+	{
+		long long start = timing::NowNs();
+
+		// circle the scene
+		float angle  = frame * 0.02f;
+		float eye[3] = { 40.0f * sinf(angle), 5.0f, -40.0f * cosf(angle) };
+		float at[3]  = { 0.0f, -5.0f, 0.0f };
+		float view[16];
+		lookAt(view, eye, at);
+
+		wind.update(TIME_DELTA);
+		snow.update(TIME_DELTA);
+
+		runs.clear();
+		snow.collect(identityM, view, proj, &runs);
+		snowNs += timing::NowNs() - start;
+
+		raster.clear(0xff000000, 1.0f);
+
+		raster.setTransform(terrainW, view, proj);
+		raster.setLighting(false);
+		raster.setBlending(false);
+		raster.setTexture(&terrainTex);
+		raster.drawTriangles(&terrain.vertices[0], (int)terrain.vertices.size(), &terrain.indices[0], (int)terrain.indices.size() / 3);
+
+		raster.setTransform(crateW, view, proj);
+		raster.setLighting(true);
+		raster.setTexture(&crateTex);
+		raster.drawTriangles(&crate.vertices[0], (int)crate.vertices.size(), &crate.indices[0], (int)crate.indices.size() / 3);
+
+		// snow last, as PSystem::setPointStates sets the device up
+		raster.setTransform(identityM, view, proj);
+		raster.setLighting(false);
+		raster.setBlending(true);
+		raster.setTexture(&flakeTex);
+		for(int i = 0; i < (int)runs.size(); i++)
+			raster.drawPoints(runs[i]._vertices, runs[i]._count, runs[i]._size);
+
+		raster.flush();
+
+		frameTimes.add(timing::NowNs() - start);
+	}
+
+	const SoftRaster::Stats& stats = raster.getStats();
+	printf("frame ms: p50 %.3f  p99 %.3f  max %.3f  (snow update and collect %.3f)\n",
+		frameTimes.percentile(0.50) * 1e-6,
+		frameTimes.percentile(0.99) * 1e-6,
+		frameTimes.getMaxNs() * 1e-6,
+		snowNs * 1e-6 / numFrames);
+	printf("last frame: %d triangles, %d points, %d tile references\n",
+		stats._numTriangles, stats._numPoints, stats._numBinned);
+	printf("snow: %d flakes, %d submitted, %d culled, %d left out by distance\n",
+		snow.getStats()._numParticles, snow.getStats()._numSubmitted,
+		snow.getStats()._numCulled, snow.getStats()._numLodSkipped);
+
+	if( outPath )
+	{
+		if( !raster.writeTga(outPath) )
+		{
+			fprintf(stderr, "cannot write %s\n", outPath);
+			return 1;
+		}
+		printf("wrote %s\n", outPath);
+	}
+
+	if( goldenPath )
+	{
+		int w = 0, h = 0;
+		std::vector<unsigned int> golden;
+		if( !readTga(goldenPath, &w, &h, &golden) || w != width || h != height )
+		{
+			fprintf(stderr, "cannot read a %d x %d image from %s\n", width, height, goldenPath);
+			return 3;
+		}
+
+		const unsigned int* color = raster.getColorBuffer();
+		int numDiffering = 0;
+		for(int i = 0; i < w * h; i++)
+		{
+			for(int shift = 0; shift < 32; shift += 8)
+			{
+				int d = (int)((color[i] >> shift) & 0xff) - (int)((golden[i] >> shift) & 0xff);
+				if( d > tolerance || d < -tolerance )
+				{
+					numDiffering++;
+					break;
+				}
+			}
+		}
+
+		double fraction = (double)numDiffering / (w * h);
+		bool   pass     = fraction <= maxDiff;
+		printf("golden %s: %d pixels differ (%.4f%%): %s\n",
+			goldenPath, numDiffering, fraction * 100.0, pass ? "PASS" : "FAIL");
+		if( !pass )
+			return 3;
+	}
+
+	return 0;
+}
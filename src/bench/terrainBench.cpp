@@ -0,0 +1,1586 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainBench.cpp
+//
+// Author: William Cheung
+//
+// Desc: Headless benchmark of the terrain core, on maps far larger than the
+//       application draws (4097 x 4097 vertices by default).  Runs:
+//
+//         cull     a camera flying low over the map and then looking down on it
+//                  from high above; every frame the chunks are culled against
+//                  its frustum with TerrainTree, and the chunks found are checked
+//                  against testing every chunk on its own
+//
+//         indices  the index streams Terrain draws with, for grids of 20 x 20
+//                  (the application's), 257 x 257 (castlehm257.raw at full
+//                  resolution), 1000 x 1000 (chunks cut short on the far edges)
+//                  and -size x -size vertices: 16 bit
+//                  into the grid where it has at most 65536 vertices, 32 bit
+//                  into the grid, and 16 bit into each chunk's own vertices.
+//                  Every cell must be drawn by exactly its two triangles.
+//
+//         lod      the camera path of cull, with every chunk in view drawn at the
+//                  level of detail TerrainLod picks for an error of -pixelError
+//                  pixels, 2 by default, on a 720 pixel high screen.  Reports the
+//                  triangles per frame, and checks that every chunk's triangles
+//                  tile it and meet its neighbors' without cracks.
+//
+//         heights  the map's heights kept as Terrain keeps them, quantized to 16
+//                  bits in tiles with HeightField, against floats row by row:
+//                  the memory each takes, the largest error of the quantized
+//                  heights, and the time of a million height queries at random
+//                  points on the map with each and the cache lines they read.
+//
+//         queries  a million heights, with and without normals, at random points
+//                  over the map and around it, looked up in one call of
+//                  HeightField::sample with the scalar path and the AVX2 one;
+//                  bare ground and under a layer of snow.  The paths must agree
+//                  bitwise, and with the heights of the cells found one by one.
+//
+//         lighting the normals of the map's cells kept as Terrain keeps them for
+//                  lighting its texture, a byte a component, found on one thread
+//                  and over a JobPool, and checked against floats; every cell
+//                  shaded with the scalar path and the SSE2 one, which must agree
+//                  bitwise; then new snow on a 64 x 64 patch relit on its own
+//                  against the whole map, which must give the same shades.
+//
+//         edits    -frames frames of footprints and vehicle tracks pressed into
+//                  the snow and brushes raising, flattening and smoothing the
+//                  ground, edited with TerrainEdit; after each, the vertices of
+//                  its dirty rectangles are rewritten into vertex buffers laid
+//                  out as Terrain's, row by row and chunk by chunk, and the
+//                  chunks' boxes refitted.  At the end the buffers must match
+//                  ones filled from scratch, and the boxes a new tree's.
+//
+//         rays     a hundred thousand each of camera steps, lines of sight
+//                  across the map and falling particles cast at the surface
+//                  with HeightPyramid, on one thread and over a JobPool; every
+//                  hit must be on the surface, and where walking every cell
+//                  along the ray finds it, which is timed too.
+//
+//         stream   the map written as 16 and 8 bit RAW files and opened with
+//                  HeightmapFile; times the opening and the read of a 257 x 257
+//                  window in the middle, counts the tiles it touched, and checks
+//                  the samples read against those written.
+//
+//       Culls whose 99th percentile takes longer than -cullBudget ms, 1 by
+//       default, fail with exit code 2; a wrong result of any run fails with exit
+//       code 1.  The map is the upper left corner of -heightmap (8 or 16 bit RAW,
+//       at least -size x -size), or without it a generated one.
+//
+//       usage: terrainBench [-size n] [-chunk n] [-frames n] [-heightmap file]
+//                           [-cullBudget ms] [-pixelError pixels]
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "terrainTree.h"
+#include "terrainLod.h"
+#include "frustum.h"
+#include "heightField.h"
+#include "heightPyramid.h"
+#include "heightmapFile.h"
+#include "jobPool.h"
+#include "terrainEdit.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const float CELL_SPACING = 1.0f;
+static const float HEIGHT_SCALE = 0.5f;
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Matrices, laid out like D3DXMATRIX
+//
+
+static void identity(float* m)
+{
+	for(int i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+static void multiply(float* out, const float* a, const float* b)
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++)
+			out[i * 4 + j] = a[i * 4 + 0] * b[0 * 4 + j] + a[i * 4 + 1] * b[1 * 4 + j] +
+			                 a[i * 4 + 2] * b[2 * 4 + j] + a[i * 4 + 3] * b[3 * 4 + j];
+}
+
+// D3DXMatrixLookAtLH
+static void lookAt(float* m, const float* eye, const float* at)
+{
+	float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	float l = sqrtf(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+	z[0] /= l; z[1] /= l; z[2] /= l;
+
+	// up is +y, or +z looking straight down
+	float x[3] = { z[2], 0.0f, -z[0] };
+	l = sqrtf(x[0] * x[0] + x[2] * x[2]);
+	if( l > 0.0f )
+	{
+		x[0] /= l; x[2] /= l;
+	}
+	else
+	{
+		x[0] = 1.0f;
+	}
+
+	float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	identity(m);
+	for(int i = 0; i < 3; i++)
+	{
+		m[i * 4 + 0] = x[i];
+		m[i * 4 + 1] = y[i];
+		m[i * 4 + 2] = z[i];
+	}
+	m[12] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+	m[13] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+	m[14] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+}
+
+// D3DXMatrixPerspectiveFovLH
+static void perspective(float* m, float fovY, float aspect, float zn, float zf)
+{
+	float yScale = 1.0f / tanf(fovY * 0.5f);
+
+	for(int i = 0; i < 16; i++)
+		m[i] = 0.0f;
+	m[0]  = yScale / aspect;
+	m[5]  = yScale;
+	m[10] = zf / (zf - zn);
+	m[11] = 1.0f;
+	m[14] = -zn * zf / (zf - zn);
+}
+
+//
+// Map
+//
+
+struct Map
+{
+	int                size;    // vertices on a side
+	float              originX; // as Terrain lays the vertices out
+	float              originZ;
+	std::vector<float> heights; // row by row
+	HeightField        field;   // the same, as Terrain keeps them
+};
+
+static void loadMap(Map& map, const char* fileName, int size)
+{
+	map.size    = size;
+	map.originX = -(size - 1) * CELL_SPACING * 0.5f;
+	map.originZ =  (size - 1) * CELL_SPACING * 0.5f;
+	map.heights.resize((size_t)size * size);
+
+	// the upper left corner of the heightmap, as Terrain::loadHeightmap reads it,
+	// with 16 bit samples scaled to the range of 8 bit ones
+	HeightmapFile               file;
+	std::vector<unsigned short> samples;
+	float                       scale = HEIGHT_SCALE;
+
+	if( fileName )
+	{
+		if( file.open(fileName) && file.getWidth() >= size && file.getHeight() >= size )
+		{
+			samples.resize((size_t)size * size);
+			file.readRegion(0, 0, size, size, &samples[0], size);
+			scale = HEIGHT_SCALE * 255.0f / file.getMaxSample();
+		}
+		else
+		{
+			printf("heightmap %s is smaller than %d x %d, generating one\n", fileName, size, size);
+		}
+	}
+
+	for(int i = 0; i < size; i++)
+	{
+		for(int j = 0; j < size; j++)
+		{
+			float h;
+			if( samples.empty() )
+				h = HEIGHT_SCALE * (127.5f + 60.0f * sinf(i * 0.013f) * cosf(j * 0.017f) +
+				    40.0f * sinf((i + j) * 0.0051f) + 20.0f * sinf(i * 0.11f + j * 0.07f));
+			else
+				h = scale * samples[(size_t)i * size + j];
+			map.heights[(size_t)i * size + j] = h;
+		}
+	}
+
+	// over the range Terrain::loadHeightmap gives 8 bit samples
+	float range = HEIGHT_SCALE * 255.0f;
+	map.field.init(size, size, -0.5f * range, 1.5f * range);
+
+	for(int i = 0; i < size; i++)
+		for(int j = 0; j < size; j++)
+			map.field.setGround(i, j, map.heights[(size_t)i * size + j]);
+}
+
+//
+// Camera path: frames / 2 flying low along a diagonal, looking ahead and down,
+// then frames / 2 circling high above, looking at the middle of the map
+//
+
+static const float FOV_Y         = 0.785f;
+static const int   SCREEN_HEIGHT = 720;
+
+static void cameraAt(const Map& map, int frame, int numFrames, float* viewProj, float* eye)
+{
+	float extent = (map.size - 1) * CELL_SPACING;
+	float at[3];
+	float proj[16], view[16];
+
+	int half = numFrames / 2 > 0 ? numFrames / 2 : 1;
+	if( frame < half )
+	{
+		float t = (float)frame / half;
+		eye[0] = map.originX + extent * (0.1f + 0.8f * t);
+		eye[2] = map.originZ - extent * (0.1f + 0.8f * t);
+		eye[1] = 200.0f * HEIGHT_SCALE + 20.0f;
+
+		float heading = 0.5f * sinf(t * 6.0f);
+		at[0] = eye[0] + 100.0f * cosf(heading - 0.785f);
+		at[2] = eye[2] + 100.0f * sinf(heading - 0.785f);
+		at[1] = eye[1] - 20.0f;
+
+		perspective(proj, FOV_Y, 16.0f / 9.0f, 1.0f, 2000.0f);
+	}
+	else
+	{
+		float t = (float)(frame - half) / half * 6.2832f;
+		eye[0] = 0.3f * extent * cosf(t);
+		eye[2] = 0.3f * extent * sinf(t);
+		eye[1] = extent;
+		at[0]  = 0.0f;
+		at[1]  = 0.0f;
+		at[2]  = 0.0f;
+
+		perspective(proj, FOV_Y, 16.0f / 9.0f, 1.0f, 4.0f * extent);
+	}
+
+	lookAt(view, eye, at);
+	multiply(viewProj, view, proj);
+}
+
+//
+// Runs
+//
+
+static double percentile(std::vector<double> v, double p)
+{
+	if( v.empty() )
+		return 0.0;
+	std::sort(v.begin(), v.end());
+	size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+	return v[i];
+}
+
+// returns false if the tree disagrees with testing every chunk
+static bool runCull(const Map& map, int chunkCells, int numFrames, double* p99Ms)
+{
+	TerrainTree tree;
+
+	double t0 = now();
+	tree.build(map.field, CELL_SPACING, map.originX, map.originZ, chunkCells);
+	double buildMs = (now() - t0) * 1000.0;
+
+	printf("cull: %d x %d vertices, %d chunks of %d cells, built in %.1f ms\n",
+		map.size, map.size, tree.getNumChunks(), chunkCells, buildMs);
+
+	std::vector<int>    visible;
+	std::vector<double> times;
+	long long           sumInView = 0;
+	long long           sumTested = 0;
+	bool                ok        = true;
+
+	for(int frame = 0; frame < numFrames; frame++)
+	{
+		float viewProj[16], eye[3];
+		cameraAt(map, frame, numFrames, viewProj, eye);
+
+		Frustum frustum;
+		frustum.extract(viewProj);
+
+		TerrainTree::Stats stats;
+		double start = now();
+		tree.cull(frustum, &visible, &stats);
+		times.push_back((now() - start) * 1000.0);
+
+		sumInView += stats._numChunksInView;
+		sumTested += stats._numNodesTested;
+
+		// every chunk on its own
+		size_t n = 0;
+		for(int c = 0; c < tree.getNumChunks() && ok; c++)
+		{
+			const TerrainTree::Chunk& chunk = tree.getChunk(c);
+			if( frustum.testBox(chunk._min, chunk._max) == Frustum::OUTSIDE )
+				continue;
+			if( n >= visible.size() || visible[n] != c )
+			{
+				printf("cull: frame %d, chunk %d is in view but was culled\n", frame, c);
+				ok = false;
+			}
+			n++;
+		}
+		if( ok && n != visible.size() )
+		{
+			printf("cull: frame %d, %d chunks out of view were kept\n", frame, (int)(visible.size() - n));
+			ok = false;
+		}
+	}
+
+	*p99Ms = percentile(times, 0.99);
+
+	printf("cull: %d frames, %.1f chunks in view, %.1f nodes tested per frame\n",
+		numFrames, (double)sumInView / numFrames, (double)sumTested / numFrames);
+	printf("cull ms: p50 %.4f  p99 %.4f  max %.4f\n",
+		percentile(times, 0.5), *p99Ms, percentile(times, 1.0));
+
+	return ok;
+}
+
+// Follows the triangles of one chunk's indices back to the cells they draw.
+// Vertex v of the stream is (v / pitch + row, v % pitch + col) of the grid.
+template<class Index>
+static bool checkChunkIndices(const TerrainTree& tree, int k, const Index* indices,
+	int pitch, int row, int col, int numVertsPerRow, std::vector<unsigned char>& drawn)
+{
+	int numIndices = tree.getNumChunkIndices(k);
+
+	for(int t = 0; t < numIndices; t += 6)
+	{
+		int r[6], c[6];
+		for(int n = 0; n < 6; n++)
+		{
+			r[n] = (int)indices[t + n] / pitch + row;
+			c[n] = (int)indices[t + n] % pitch + col;
+		}
+
+		// upper left triangle then lower right one, of the cell at the first vertex
+		int cr = r[0], cc = c[0];
+		bool ok =
+			r[1] == cr     && c[1] == cc + 1 && r[2] == cr + 1 && c[2] == cc &&
+			r[3] == cr + 1 && c[3] == cc     && r[4] == cr     && c[4] == cc + 1 &&
+			r[5] == cr + 1 && c[5] == cc + 1;
+
+		const TerrainTree::Chunk& chunk = tree.getChunk(k);
+		if( !ok || cr < chunk._row || cr >= chunk._row + chunk._numRows ||
+			cc < chunk._col || cc >= chunk._col + chunk._numCols )
+		{
+			printf("indices: chunk %d, triangles %d and %d do not make a cell of it\n", k, t / 3, t / 3 + 1);
+			return false;
+		}
+
+		drawn[(size_t)cr * (numVertsPerRow - 1) + cc]++;
+	}
+	return true;
+}
+
+static bool runIndices(int size, int chunkCells)
+{
+	HeightField heights;
+	heights.init(size, size, 0.0f, 0.0f);
+
+	TerrainTree tree;
+	tree.build(heights, CELL_SPACING, 0.0f, 0.0f, chunkCells);
+
+	size_t numCells    = (size_t)(size - 1) * (size - 1);
+	size_t numVertices = (size_t)size * size;
+
+	for(int format = 0; format < 3; format++)
+	{
+		// 0: 16 bit into the grid, 1: 32 bit into the grid, 2: 16 bit per chunk
+		if( format == 0 && numVertices > 0x10000 )
+			continue;
+
+		static const char* names[] = { "16 bit", "32 bit", "16 bit per chunk" };
+
+		std::vector<unsigned char>  drawn(numCells, 0);
+		std::vector<unsigned short> narrow;
+		std::vector<unsigned int>   wide;
+		bool                        ok         = true;
+		long long                   numIndices = 0;
+		int                         maxIndex   = 0;
+
+		double start = now();
+		for(int k = 0; k < tree.getNumChunks() && ok; k++)
+		{
+			const TerrainTree::Chunk& chunk = tree.getChunk(k);
+			int n = tree.getNumChunkIndices(k);
+			numIndices += n;
+
+			if( format == 1 )
+			{
+				wide.resize(n);
+				tree.writeIndices(k, false, &wide[0]);
+				for(int i = 0; i < n; i++)
+					maxIndex = std::max(maxIndex, (int)wide[i]);
+				ok = checkChunkIndices(tree, k, &wide[0], size, 0, 0, size, drawn);
+			}
+			else
+			{
+				// written wide as well, to catch indices that do not fit 16 bits
+				narrow.resize(n);
+				wide.resize(n);
+				tree.writeIndices(k, format == 2, &narrow[0]);
+				tree.writeIndices(k, format == 2, &wide[0]);
+				for(int i = 0; i < n && ok; i++)
+				{
+					maxIndex = std::max(maxIndex, (int)wide[i]);
+					if( narrow[i] != wide[i] )
+					{
+						printf("indices: chunk %d, index %u does not fit 16 bits\n", k, wide[i]);
+						ok = false;
+					}
+				}
+				if( ok && format == 0 )
+					ok = checkChunkIndices(tree, k, &narrow[0], size, 0, 0, size, drawn);
+				if( ok && format == 2 )
+					ok = checkChunkIndices(tree, k, &narrow[0], chunk._numCols + 1, chunk._row, chunk._col, size, drawn);
+			}
+		}
+		double ms = (now() - start) * 1000.0;
+
+		for(size_t c = 0; c < numCells && ok; c++)
+		{
+			if( drawn[c] != 1 )
+			{
+				printf("indices: cell (%d, %d) drawn %d times\n",
+					(int)(c / (size - 1)), (int)(c % (size - 1)), (int)drawn[c]);
+				ok = false;
+			}
+		}
+
+		printf("indices: %d x %d, %-16s %s  %lld indices, largest %d, %.1f ms\n",
+			size, size, names[format], ok ? "ok  " : "FAIL", numIndices, maxIndex, ms);
+
+		if( !ok )
+			return false;
+	}
+
+	return true;
+}
+
+// The border vertices of a chunk's triangles, by side, as positions along it.
+struct Borders
+{
+	std::vector<int> side[4]; // above, below, left, right
+
+	void add(const TerrainTree::Chunk& chunk, int r, int c)
+	{
+		if( r == chunk._row )                  side[0].push_back(c);
+		if( r == chunk._row + chunk._numRows ) side[1].push_back(c);
+		if( c == chunk._col )                  side[2].push_back(r);
+		if( c == chunk._col + chunk._numCols ) side[3].push_back(r);
+	}
+
+	void finish()
+	{
+		for(int s = 0; s < 4; s++)
+		{
+			std::sort(side[s].begin(), side[s].end());
+			side[s].erase(std::unique(side[s].begin(), side[s].end()), side[s].end());
+		}
+	}
+};
+
+// returns false if a chunk's triangles do not tile it or leave a crack
+static bool runLod(const Map& map, int chunkCells, int numFrames, float maxPixelError)
+{
+	TerrainTree tree;
+	TerrainLod  lod;
+
+	tree.build(map.field, CELL_SPACING, map.originX, map.originZ, chunkCells);
+
+	double t0 = now();
+	lod.build(&tree, map.field);
+	double buildMs = (now() - t0) * 1000.0;
+
+	printf("lod: %d chunks, errors found in %.1f ms, budget %.1f pixels of %d\n",
+		tree.getNumChunks(), buildMs, maxPixelError, SCREEN_HEIGHT);
+
+	float screenScale = 0.5f * SCREEN_HEIGHT / tanf(FOV_Y * 0.5f);
+
+	std::vector<int>          visible;
+	std::vector<unsigned int> indices;
+	std::vector<int>          start;
+	std::vector<Borders>      borders;
+	std::vector<int>          slot(tree.getNumChunks(), -1);
+	std::vector<double>       times;
+	std::vector<double>       triangles;
+	std::vector<double>       fullTriangles;
+	long long                 atLevel[TerrainLod::MAX_LEVELS] = { 0 };
+
+	for(int frame = 0; frame < numFrames; frame++)
+	{
+		float viewProj[16], eye[3];
+		cameraAt(map, frame, numFrames, viewProj, eye);
+
+		Frustum frustum;
+		frustum.extract(viewProj);
+		tree.cull(frustum, &visible);
+
+		// as Terrain::fillLodIndices does
+		double begin = now();
+		lod.select(visible, eye, screenScale, maxPixelError);
+
+		int numIndices = 0;
+		for(size_t i = 0; i < visible.size(); i++)
+			numIndices += lod.getMaxIndices(visible[i]);
+		indices.resize(numIndices > 0 ? numIndices : 1);
+		start.resize(visible.size() + 1);
+
+		start[0] = 0;
+		for(size_t i = 0; i < visible.size(); i++)
+			start[i + 1] = start[i] + lod.writeIndices(visible[i], false, &indices[start[i]]);
+		times.push_back((now() - begin) * 1000.0);
+
+		int numTriangles = start[visible.size()] / 3;
+		triangles.push_back(numTriangles);
+
+		const TerrainLod::Stats& stats = lod.getStats();
+		for(int l = 0; l < TerrainLod::MAX_LEVELS; l++)
+			atLevel[l] += stats._numAtLevel[l];
+
+		int full = 0;
+		for(size_t i = 0; i < visible.size(); i++)
+			full += tree.getNumChunkIndices(visible[i]) / 3;
+		fullTriangles.push_back(full);
+
+		if( frame % (numFrames / 10 > 0 ? numFrames / 10 : 1) == 0 )
+			printf("lod: frame %4d  %5d chunks  %8d triangles  (%d at full detail)\n",
+				frame, (int)visible.size(), numTriangles, full);
+
+		// every chunk's triangles must face up and cover it exactly once, and
+		// meet its neighbors' at the same vertices
+		borders.assign(visible.size(), Borders());
+		for(size_t i = 0; i < visible.size(); i++)
+		{
+			int k = visible[i];
+			const TerrainTree::Chunk& chunk = tree.getChunk(k);
+			slot[k] = (int)i;
+
+			long long area = 0;
+			for(int t = start[i]; t < start[i + 1]; t += 3)
+			{
+				int r[3], c[3];
+				for(int n = 0; n < 3; n++)
+				{
+					r[n] = (int)(indices[t + n] / map.size);
+					c[n] = (int)(indices[t + n] % map.size);
+					borders[i].add(chunk, r[n], c[n]);
+				}
+
+				long long cross = (long long)(c[1] - c[0]) * (r[2] - r[0]) - (long long)(r[1] - r[0]) * (c[2] - c[0]);
+				if( cross <= 0 )
+				{
+					printf("lod: frame %d, chunk %d has a flipped or flat triangle\n", frame, k);
+					return false;
+				}
+				area += cross;
+			}
+			borders[i].finish();
+
+			if( area != 2LL * chunk._numRows * chunk._numCols )
+			{
+				printf("lod: frame %d, chunk %d at level %d covers %lld half cells of %d\n",
+					frame, k, lod.getLevel(k), area, 2 * chunk._numRows * chunk._numCols);
+				return false;
+			}
+		}
+
+		for(size_t i = 0; i < visible.size(); i++)
+		{
+			int k = visible[i];
+			const TerrainTree::Chunk& chunk = tree.getChunk(k);
+
+			int below = tree.getChunkAt(chunk._row + chunk._numRows, chunk._col);
+			int right = tree.getChunkAt(chunk._row, chunk._col + chunk._numCols);
+
+			if( below >= 0 && slot[below] >= 0 && borders[i].side[1] != borders[slot[below]].side[0] )
+			{
+				printf("lod: frame %d, crack between chunk %d (level %d) and chunk %d below (level %d)\n",
+					frame, k, lod.getLevel(k), below, lod.getLevel(below));
+				return false;
+			}
+			if( right >= 0 && slot[right] >= 0 && borders[i].side[3] != borders[slot[right]].side[2] )
+			{
+				printf("lod: frame %d, crack between chunk %d (level %d) and chunk %d right (level %d)\n",
+					frame, k, lod.getLevel(k), right, lod.getLevel(right));
+				return false;
+			}
+		}
+
+		for(size_t i = 0; i < visible.size(); i++)
+			slot[visible[i]] = -1;
+	}
+
+	printf("lod: triangles per frame: min %.0f  p50 %.0f  max %.0f\n",
+		percentile(triangles, 0.0), percentile(triangles, 0.5), percentile(triangles, 1.0));
+	printf("lod: at full detail:      min %.0f  p50 %.0f  max %.0f\n",
+		percentile(fullTriangles, 0.0), percentile(fullTriangles, 0.5), percentile(fullTriangles, 1.0));
+
+	printf("lod: chunks by level:");
+	for(int l = 0; l < TerrainLod::MAX_LEVELS; l++)
+		if( atLevel[l] > 0 )
+			printf("  %d: %.1f", l, (double)atLevel[l] / numFrames);
+	printf("\n");
+
+	printf("lod ms (select and write indices): p50 %.4f  p99 %.4f  max %.4f\n",
+		percentile(times, 0.5), percentile(times, 0.99), percentile(times, 1.0));
+
+	return true;
+}
+
+// the height dx, dz of the way across a cell with corners A, B, C and D, as
+// Terrain::getHeight finds it
+static float interpolate(float A, float B, float C, float D, float dx, float dz)
+{
+	if( dz < 1.0f - dx )
+		return A + (B - A) * dx + (C - A) * dz;
+	return D + (C - D) * (1.0f - dx) + (B - D) * (1.0f - dz);
+}
+
+// returns false if a quantized height is off by more than half a step
+static bool runHeights(const Map& map, int numQueries)
+{
+	const HeightField& field = map.field;
+
+	float worst = 0.0f;
+	for(int i = 0; i < map.size; i++)
+	{
+		for(int j = 0; j < map.size; j++)
+		{
+			float error = fabsf(field.getHeight(i, j) - map.heights[(size_t)i * map.size + j]);
+			if( error > worst )
+				worst = error;
+		}
+	}
+
+	// half a step, and the rounding of a float at the heights
+	bool ok = worst <= field.getScale() * 0.51f;
+
+	printf("heights: %d x %d, floats row by row %.1f MB, quantized in tiles %.1f MB; "
+	       "largest error %.5f of a step of %.5f  %s\n",
+		map.size, map.size, map.heights.size() * sizeof(float) / (1024.0 * 1024.0),
+		field.getMemoryUsed() / (1024.0 * 1024.0), worst, field.getScale(), ok ? "ok" : "FAIL");
+
+	if( !ok )
+		return false;
+
+	// the same random points, in cells, for both
+	std::vector<float> px(numQueries), pz(numQueries);
+	unsigned int seed = 12345;
+	for(int k = 0; k < numQueries; k++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		px[k] = (seed >> 8) * (1.0f / 16777216.0f) * (map.size - 1);
+		seed = seed * 1664525u + 1013904223u;
+		pz[k] = (seed >> 8) * (1.0f / 16777216.0f) * (map.size - 1);
+	}
+
+	int          pitch  = map.size;
+	int          last   = map.size - 2;
+	const float* floats = &map.heights[0];
+	double       sum[2] = { 0.0, 0.0 };
+	double       ms[2]  = { 1e30, 1e30 };
+
+	// the best of a few runs of each, taken in turn
+	for(int run = 0; run < 10; run++)
+	{
+		int pass = run & 1;
+		sum[pass] = 0.0;
+
+		double t0 = now();
+		for(int k = 0; k < numQueries; k++)
+		{
+			int col = (int)px[k] < last ? (int)px[k] : last;
+			int row = (int)pz[k] < last ? (int)pz[k] : last;
+
+			float c[4];
+			if( pass == 0 )
+			{
+				const float* cell = floats + (size_t)row * pitch + col;
+				c[0] = cell[0];
+				c[1] = cell[1];
+				c[2] = cell[pitch];
+				c[3] = cell[pitch + 1];
+			}
+			else
+			{
+				field.getCell(row, col, c);
+			}
+
+			sum[pass] += interpolate(c[0], c[1], c[2], c[3], px[k] - col, pz[k] - row);
+		}
+		ms[pass] = std::min(ms[pass], (now() - t0) * 1000.0);
+	}
+
+	ok = fabs(sum[0] - sum[1]) <= numQueries * field.getScale();
+
+	// the cache lines the corners of each query's cell are on; the field's
+	// tiles start on a line, the floats wherever they were allocated
+	long long lines[2] = { 0, 0 };
+	for(int k = 0; k < numQueries; k++)
+	{
+		int col = (int)px[k] < last ? (int)px[k] : last;
+		int row = (int)pz[k] < last ? (int)pz[k] : last;
+
+		size_t line[2][4];
+		for(int n = 0; n < 4; n++)
+		{
+			int r = row + (n >> 1);
+			int c = col + (n & 1);
+			line[0][n] = (size_t)(floats + (size_t)r * pitch + c) / HeightField::CACHE_LINE;
+			line[1][n] = field.index(r, c) * sizeof(unsigned short) / HeightField::CACHE_LINE;
+		}
+
+		for(int pass = 0; pass < 2; pass++)
+		{
+			std::sort(line[pass], line[pass] + 4);
+			lines[pass] += std::unique(line[pass], line[pass] + 4) - line[pass];
+		}
+	}
+
+	printf("heights: %d random queries, floats row by row %.2f ms (%.1f ns, %.2f cache lines each), "
+	       "quantized in tiles %.2f ms (%.1f ns, %.2f cache lines each)  %s\n",
+		numQueries, ms[0], ms[0] * 1e6 / numQueries, (double)lines[0] / numQueries,
+		ms[1], ms[1] * 1e6 / numQueries, (double)lines[1] / numQueries, ok ? "ok" : "FAIL");
+
+	return ok;
+}
+
+// returns false if the paths of HeightField::sample disagree
+static bool runQueries(Map& map, int numQueries)
+{
+	HeightField& field = map.field;
+	field.setPlacement(map.originX, map.originZ, CELL_SPACING);
+
+	// a tenth of the map's width on every side of it
+	float extent = (map.size - 1) * CELL_SPACING;
+	std::vector<float> x(numQueries), z(numQueries);
+	unsigned int seed = 54321;
+	for(int k = 0; k < numQueries; k++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		x[k] = map.originX + ((seed >> 8) * (1.0f / 16777216.0f) * 1.2f - 0.1f) * extent;
+		seed = seed * 1664525u + 1013904223u;
+		z[k] = map.originZ - ((seed >> 8) * (1.0f / 16777216.0f) * 1.2f - 0.1f) * extent;
+	}
+
+	simd::Level best = simd::DetectLevel();
+	printf("queries: %d points, %s\n", numQueries,
+		best == simd::LEVEL_AVX2 ? "AVX2" : "no AVX2, both paths scalar");
+
+	// 0: scalar, 1: AVX2; heights and normals
+	std::vector<float> h[2], n[2][3];
+	for(int p = 0; p < 2; p++)
+	{
+		h[p].resize(numQueries);
+		for(int a = 0; a < 3; a++)
+			n[p][a].resize(numQueries);
+	}
+
+	for(int snow = 0; snow < 2; snow++)
+	{
+		if( snow )
+		{
+			for(int i = 0; i < map.size; i++)
+				for(int j = 0; j < map.size; j++)
+					field.addLayer(i, j, 0.5f + 0.5f * sinf(i * 0.05f) * sinf(j * 0.07f));
+		}
+
+		for(int normals = 0; normals < 2; normals++)
+		{
+			double ms[2] = { 1e30, 1e30 };
+			for(int run = 0; run < 6; run++)
+			{
+				int p = run & 1;
+				simd::Level level = p ? simd::LEVEL_AVX2 : simd::LEVEL_SCALAR;
+
+				double t0 = now();
+				if( normals )
+					field.sample(level, &x[0], &z[0], numQueries, &h[p][0], &n[p][0][0], &n[p][1][0], &n[p][2][0]);
+				else
+					field.sample(level, &x[0], &z[0], numQueries, &h[p][0]);
+				ms[p] = std::min(ms[p], (now() - t0) * 1000.0);
+			}
+
+			bool ok = memcmp(&h[0][0], &h[1][0], numQueries * sizeof(float)) == 0;
+			for(int a = 0; a < 3 && normals; a++)
+				ok = ok && memcmp(&n[0][a][0], &n[1][a][0], numQueries * sizeof(float)) == 0;
+
+			// the scalar path against the cells looked up one at a time
+			int numOff = 0;
+			for(int k = 0; k < numQueries && ok; k++)
+			{
+				float px = (x[k] - map.originX) * (1.0f / CELL_SPACING);
+				float pz = (map.originZ - z[k]) * (1.0f / CELL_SPACING);
+				float col = floorf(px);
+				float row = floorf(pz);
+
+				if( !(col >= 0.0f && row >= 0.0f && col < map.size - 1 && row < map.size - 1) )
+				{
+					ok = h[0][k] == -FLT_MAX;
+					numOff++;
+					continue;
+				}
+
+				float c[4];
+				field.getCell((int)row, (int)col, c);
+				ok = h[0][k] == interpolate(c[0], c[1], c[2], c[3], px - col, pz - row);
+			}
+
+			printf("queries: %-6s %-12s scalar %7.2f ms (%5.1f ns each), AVX2 %7.2f ms (%5.1f ns each), "
+			       "%.1fx; %d off the map  %s\n",
+				snow ? "snow," : "ground,", normals ? "with normals" : "heights",
+				ms[0], ms[0] * 1e6 / numQueries, ms[1], ms[1] * 1e6 / numQueries, ms[0] / ms[1],
+				numOff, ok ? "ok" : "FAIL");
+
+			if( !ok )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// returns false if a kept normal is off, or the paths of HeightField::shade
+// disagree
+static bool runLighting(Map& map, int dirtySize)
+{
+	HeightField& field = map.field;
+	int numCells = map.size - 1;
+
+	// every normal, on one thread and over a pool
+	JobPool pool;
+	double  ms[2] = { 1e30, 1e30 };
+	for(int run = 0; run < 4; run++)
+	{
+		int p = run & 1;
+		double t0 = now();
+		field.updateNormals(0, 0, numCells - 1, numCells - 1, p ? &pool : 0);
+		ms[p] = std::min(ms[p], (now() - t0) * 1000.0);
+	}
+
+	// against the normals in floats; a byte a component keeps them to
+	// within about half of 1/127 each
+	float worst = 0.0f;
+	for(int i = 0; i < numCells; i++)
+	{
+		for(int j = 0; j < numCells; j++)
+		{
+			float c[4], n[3];
+			field.getCell(i, j, c);
+			field.getNormal(i, j, n);
+
+			float gx  = c[1] - c[0];
+			float gz  = c[2] - c[0];
+			float len = sqrtf(gx * gx + CELL_SPACING * CELL_SPACING + gz * gz);
+			float ref[3] = { -gx / len, CELL_SPACING / len, gz / len };
+
+			for(int a = 0; a < 3; a++)
+				worst = std::max(worst, fabsf(n[a] - ref[a]));
+		}
+	}
+
+	bool ok = worst <= 0.6f / 127.0f;
+
+	printf("lighting: normals of %d x %d cells, %.1f MB, one thread %.2f ms, %d threads %.2f ms; "
+	       "largest error %.5f  %s\n",
+		numCells, numCells, 3.0 * numCells * numCells / (1024.0 * 1024.0), ms[0],
+		pool.getThreadCount(), ms[1], worst, ok ? "ok" : "FAIL");
+
+	if( !ok )
+		return false;
+
+	// every cell lit, 0: scalar, 1: SSE2
+	const float toLight[3] = { 0.408f, 0.816f, 0.408f };
+	std::vector<float> shades[2];
+	ms[0] = ms[1] = 1e30;
+	for(int run = 0; run < 6; run++)
+	{
+		int p = run & 1;
+		shades[p].resize((size_t)numCells * numCells);
+
+		double t0 = now();
+		field.shade(p ? simd::LEVEL_SSE2 : simd::LEVEL_SCALAR, toLight,
+			0, 0, numCells, numCells, &shades[p][0], numCells);
+		ms[p] = std::min(ms[p], (now() - t0) * 1000.0);
+	}
+
+	ok = memcmp(&shades[0][0], &shades[1][0], shades[0].size() * sizeof(float)) == 0;
+
+	// and against n . toLight from the normals as kept
+	for(int i = 0; i < numCells && ok; i++)
+	{
+		for(int j = 0; j < numCells && ok; j++)
+		{
+			float n[3];
+			field.getNormal(i, j, n);
+			float cosine = n[0] * toLight[0] + n[1] * toLight[1] + n[2] * toLight[2];
+			ok = fabsf(shades[0][(size_t)i * numCells + j] - std::max(cosine, 0.0f)) <= 1e-5f;
+		}
+	}
+
+	printf("lighting: shade of every cell, scalar %.2f ms (%.2f ns each), SSE2 %.2f ms (%.2f ns each)  %s\n",
+		ms[0], ms[0] * 1e6 / shades[0].size(), ms[1], ms[1] * 1e6 / shades[0].size(), ok ? "ok" : "FAIL");
+
+	if( !ok )
+		return false;
+
+	// snow on a dirtySize x dirtySize patch of vertices in the middle: the
+	// normals of the cells touching it found again and the cells relit, as
+	// Terrain does, against relighting the whole map
+	int v0 = std::max(0, map.size / 2 - dirtySize / 2);
+	int v1 = std::min(map.size - 1, v0 + dirtySize - 1);
+	int r0 = std::max(0, v0 - 1);
+	int r1 = std::min(numCells - 1, v1);
+	double patchMs = 1e30;
+	for(int run = 0; run < 5; run++)
+	{
+		for(int i = v0; i <= v1; i++)
+			for(int j = v0; j <= v1; j++)
+				field.addLayer(i, j, 0.01f);
+
+		double t0 = now();
+		field.updateNormals(r0, r0, r1, r1, &pool);
+		field.shade(toLight, r0, r0, r1 - r0 + 1, r1 - r0 + 1, &shades[0][(size_t)r0 * numCells + r0], numCells);
+		patchMs = std::min(patchMs, (now() - t0) * 1000.0);
+	}
+
+	double fullMs = 1e30;
+	for(int run = 0; run < 3; run++)
+	{
+		double t0 = now();
+		field.updateNormals(0, 0, numCells - 1, numCells - 1, &pool);
+		field.shade(toLight, 0, 0, numCells, numCells, &shades[1][0], numCells);
+		fullMs = std::min(fullMs, (now() - t0) * 1000.0);
+	}
+
+	// the patch relit on its own must match the whole map relit
+	ok = memcmp(&shades[0][0], &shades[1][0], shades[0].size() * sizeof(float)) == 0;
+
+	printf("lighting: snow on %d x %d vertices, relit %.3f ms against %.2f ms for the whole map  %s\n",
+		v1 - v0 + 1, v1 - v0 + 1, patchMs, fullMs, ok ? "ok" : "FAIL");
+
+	return ok;
+}
+
+//
+// Edits
+//
+
+// a vertex as Terrain::makeVertex makes it: position and texture coordinates
+struct Vertex
+{
+	float x, y, z, u, v;
+};
+
+static Vertex makeVertex(const Map& map, int row, int col)
+{
+	Vertex v;
+	v.x = map.originX + col * CELL_SPACING;
+	v.y = map.field.getHeight(row, col);
+	v.z = map.originZ - row * CELL_SPACING;
+	v.u = (float)col / (float)(map.size - 1);
+	v.v = (float)row / (float)(map.size - 1);
+	return v;
+}
+
+// vertices of the grid row by row, or chunk by chunk when chunkVertex is given
+static void fillVertices(const Map& map, const TerrainTree& tree, const int* chunkVertex, std::vector<Vertex>& vb)
+{
+	if( !chunkVertex )
+	{
+		vb.resize((size_t)map.size * map.size);
+		for(int i = 0; i < map.size; i++)
+			for(int j = 0; j < map.size; j++)
+				vb[(size_t)i * map.size + j] = makeVertex(map, i, j);
+		return;
+	}
+
+	vb.resize(chunkVertex[tree.getNumChunks()]);
+	for(int k = 0; k < tree.getNumChunks(); k++)
+	{
+		const TerrainTree::Chunk& chunk = tree.getChunk(k);
+		Vertex* v = &vb[chunkVertex[k]];
+
+		for(int i = chunk._row; i <= chunk._row + chunk._numRows; i++)
+			for(int j = chunk._col; j <= chunk._col + chunk._numCols; j++)
+				*v++ = makeVertex(map, i, j);
+	}
+}
+
+// returns false if the spans of a rectangle leave the buffer
+static bool writeSpans(const Map& map, const std::vector<TerrainEdit::Span>& spans, std::vector<Vertex>& vb, long long* numWritten)
+{
+	for(int s = 0; s < (int)spans.size(); s++)
+	{
+		const TerrainEdit::Span& span = spans[s];
+		if( span._firstVertex < 0 || (size_t)span._firstVertex + span._numVertices > vb.size() ||
+			span._numVertices != (span._numRows - 1) * span._pitch + span._numCols )
+			return false;
+
+		for(int i = 0; i < span._numRows; i++)
+			for(int j = 0; j < span._numCols; j++)
+				vb[span._firstVertex + i * span._pitch + j] = makeVertex(map, span._row + i, span._col + j);
+
+		*numWritten += (long long)span._numRows * span._numCols;
+	}
+
+	return true;
+}
+
+// returns false if the vertex buffers brought up to date by the dirty
+// rectangles differ from ones filled again, or the chunks' boxes from a new
+// tree's
+static bool runEdits(Map& map, int chunkCells, int numFrames)
+{
+	HeightField& field = map.field;
+
+	TerrainTree tree;
+	tree.build(field, CELL_SPACING, map.originX, map.originZ, chunkCells);
+
+	std::vector<int> chunkVertex(tree.getNumChunks() + 1, 0);
+	for(int k = 0; k < tree.getNumChunks(); k++)
+		chunkVertex[k + 1] = chunkVertex[k] + tree.getNumChunkVertices(k);
+
+	// 0: the grid row by row, 1: every chunk its own vertices
+	std::vector<Vertex> vb[2];
+	fillVertices(map, tree, 0, vb[0]);
+	fillVertices(map, tree, &chunkVertex[0], vb[1]);
+
+	TerrainEdit edit;
+	edit.setField(&field);
+
+	// a foot, the snow packed 2 cm deep under its sole and 5 cm at its rim and
+	// left alone around it, and a wheel 3 vertices wide to the ground
+	const float foot[5 * 3] = {
+		1e9f, 0.05f, 1e9f,
+		0.05f, 0.02f, 0.05f,
+		0.05f, 0.02f, 0.05f,
+		0.05f, 0.02f, 0.05f,
+		1e9f, 0.05f, 1e9f };
+	const float wheel[3] = { 0.0f, 0.0f, 0.0f };
+
+	std::vector<TerrainEdit::Span> spans;
+	std::vector<double>            times;
+	long long written[2] = { 0, 0 };
+	long long numRects   = 0;
+	bool      ok         = true;
+	float     last       = (float)(map.size - 1);
+	int       footRow    = 0;
+	int       footCol    = 0;
+
+	for(int frame = 0; frame < numFrames && ok; frame++)
+	{
+		double t0 = now();
+
+		// someone walking across the map, a vehicle driving down it, and an
+		// editor's brushes here and there
+		float t = (float)frame / (float)numFrames;
+		footRow = (int)(0.3f * last) + ((frame & 1) ? 2 : -2);
+		footCol = (int)(t * last);
+		edit.stamp(TerrainEdit::TARGET_LAYER, TerrainEdit::STAMP_MIN, footRow - 2, footCol - 1, 5, 3, foot, 3);
+
+		for(int wheelCol = -4; wheelCol <= 4; wheelCol += 8)
+			for(int step = 0; step < 4; step++)
+				edit.stamp(TerrainEdit::TARGET_LAYER, TerrainEdit::STAMP_MIN,
+					(frame * 4 + step) % map.size, (int)(0.7f * last) + wheelCol - 1, 1, 3, wheel, 3);
+
+		float br = 0.5f * last + 0.3f * last * sinf(t * 6.283f);
+		float bc = 0.5f * last + 0.3f * last * cosf(t * 6.283f);
+		switch( frame % 3 )
+		{
+		case 0: edit.brush(TerrainEdit::TARGET_GROUND, TerrainEdit::BRUSH_RAISE,   br, bc, 6.0f, 0.5f);        break;
+		case 1: edit.brush(TerrainEdit::TARGET_GROUND, TerrainEdit::BRUSH_FLATTEN, br, bc, 6.0f, 0.5f, 60.0f); break;
+		case 2: edit.brush(TerrainEdit::TARGET_GROUND, TerrainEdit::BRUSH_SMOOTH,  br, bc, 6.0f, 1.0f);        break;
+		}
+
+		if( frame % 10 == 0 )
+			edit.setHeight(TerrainEdit::TARGET_GROUND, frame % map.size, (frame * 7) % map.size, 10.0f);
+
+		// the next frame's draw
+		const std::vector<TerrainEdit::Rect>& dirty = edit.getDirty();
+		numRects += dirty.size();
+
+		for(int r = 0; r < (int)dirty.size() && ok; r++)
+		{
+			const TerrainEdit::Rect& rect = dirty[r];
+			for(int layout = 0; layout < 2 && ok; layout++)
+			{
+				TerrainEdit::findSpans(rect, tree, layout ? &chunkVertex[0] : 0, &spans);
+				ok = writeSpans(map, spans, vb[layout], &written[layout]);
+			}
+			tree.refit(field, rect._minRow, rect._minCol, rect._maxRow, rect._maxCol);
+		}
+		edit.clearDirty();
+
+		times.push_back((now() - t0) * 1000.0);
+	}
+
+	if( !ok )
+	{
+		printf("edits: a span is off the vertex buffer  FAIL\n");
+		return false;
+	}
+
+	// every vertex as a buffer filled from scratch would have it
+	std::vector<Vertex> fresh;
+	for(int layout = 0; layout < 2 && ok; layout++)
+	{
+		fillVertices(map, tree, layout ? &chunkVertex[0] : 0, fresh);
+		ok = memcmp(&fresh[0], &vb[layout][0], fresh.size() * sizeof(Vertex)) == 0;
+	}
+
+	// and the boxes as a tree built from scratch would have them
+	TerrainTree rebuilt;
+	rebuilt.build(field, CELL_SPACING, map.originX, map.originZ, chunkCells);
+	for(int k = 0; k < tree.getNumChunks() && ok; k++)
+	{
+		const TerrainTree::Chunk& a = tree.getChunk(k);
+		const TerrainTree::Chunk& b = rebuilt.getChunk(k);
+		ok = memcmp(a._min, b._min, sizeof(a._min)) == 0 && memcmp(a._max, b._max, sizeof(a._max)) == 0;
+	}
+
+	// what the edits left: the snow under the last foot packed
+	ok = ok && field.getLayer(footRow, footCol) <= 0.02f;
+
+	printf("edits: %d frames of footprints, tracks and brushes, %.1f dirty rectangles a frame; "
+	       "vertices rewritten a frame %.0f row by row, %.0f chunk by chunk, of %d  %s\n",
+		numFrames, (double)numRects / numFrames, (double)written[0] / numFrames, (double)written[1] / numFrames,
+		map.size * map.size, ok ? "ok" : "FAIL");
+
+	printf("edits ms (edit, write spans, refit): p50 %.4f  p99 %.4f  max %.4f\n",
+		percentile(times, 0.5), percentile(times, 0.99), percentile(times, 1.0));
+
+	return ok;
+}
+
+//
+// Rays
+//
+
+// Where the ray first goes from above the surface to on or under it, found by
+// walking every cell it crosses, without the pyramid; FLT_MAX if never.
+static float castBruteForce(const Map& map, const HeightPyramid::Ray& ray)
+{
+	const HeightField& field = map.field;
+	int numCells = map.size - 1;
+
+	float u  = (ray._origin[0] - map.originX) / CELL_SPACING;
+	float v  = (map.originZ - ray._origin[2]) / CELL_SPACING;
+	float du =  ray._dir[0] / CELL_SPACING;
+	float dv = -ray._dir[2] / CELL_SPACING;
+
+	// clipped to the grid
+	float t0 = 0.0f, t1 = ray._maxT;
+	float o[2] = { u, v }, d[2] = { du, dv };
+	for(int a = 0; a < 2; a++)
+	{
+		if( d[a] == 0.0f )
+		{
+			if( o[a] < 0.0f || o[a] > numCells )
+				return FLT_MAX;
+			continue;
+		}
+		float ta = (0.0f - o[a]) / d[a];
+		float tb = ((float)numCells - o[a]) / d[a];
+		t0 = std::max(t0, std::min(ta, tb));
+		t1 = std::min(t1, std::max(ta, tb));
+	}
+	if( t0 > t1 )
+		return FLT_MAX;
+
+	// the cells along it, each against its two triangles
+	int i = std::min(std::max((int)floorf(v + dv * t0), 0), numCells - 1);
+	int j = std::min(std::max((int)floorf(u + du * t0), 0), numCells - 1);
+
+	float ta = t0;
+	for(;;)
+	{
+		float tRow = dv != 0.0f ? ((float)(i + (dv > 0.0f)) - v) / dv : FLT_MAX;
+		float tCol = du != 0.0f ? ((float)(j + (du > 0.0f)) - u) / du : FLT_MAX;
+		float tb   = std::max(ta, std::min(std::min(tRow, tCol), t1));
+
+		float c[4];
+		field.getCell(i, j, c);
+
+		// either side of the diagonal, the ray against the plane of each part
+		float cu = u - j, cv = v - i;
+		float ends[3] = { ta, tb, tb };
+		int   numEnds = 2;
+		if( du + dv != 0.0f )
+		{
+			float td = (1.0f - cu - cv) / (du + dv);
+			if( td > ta && td < tb )
+			{
+				ends[1] = td;
+				numEnds = 3;
+			}
+		}
+
+		for(int k = 0; k + 1 < numEnds; k++)
+		{
+			float a = ends[k], b = ends[k + 1];
+			float f[2];
+			for(int e = 0; e < 2; e++)
+			{
+				float te = e ? b : a;
+				float pu = cu + du * te, pv = cv + dv * te;
+				float mid = 0.5f * (a + b);
+				float h = (cu + du * mid) + (cv + dv * mid) < 1.0f ?
+					interpolate(c[0], c[1], c[2], c[3], pu, pv) :
+					c[3] + (c[2] - c[3]) * (1.0f - pu) + (c[1] - c[3]) * (1.0f - pv);
+				f[e] = ray._origin[1] + ray._dir[1] * te - h;
+			}
+
+			float y = ray._origin[1] + ray._dir[1] * a;
+			if( f[0] >= -1e-5f * (fabsf(y) + 1.0f) && f[1] <= 0.0f )
+				return f[0] > 0.0f ? a + (b - a) * (f[0] / (f[0] - f[1])) : a;
+		}
+
+		if( tb >= t1 )
+			return FLT_MAX;
+
+		if( tCol < tRow ) j += du > 0.0f ? 1 : -1;
+		else              i += dv > 0.0f ? 1 : -1;
+
+		if( i < 0 || j < 0 || i >= numCells || j >= numCells )
+			return FLT_MAX;
+
+		ta = tb;
+	}
+}
+
+// returns false if the pyramid's hits are not the brute force ones, or not
+// on the surface
+static bool runRays(Map& map, int numRays)
+{
+	HeightField& field = map.field;
+	field.setPlacement(map.originX, map.originZ, CELL_SPACING);
+
+	HeightPyramid pyramid;
+	double t0 = now();
+	pyramid.build(&field);
+	double buildMs = (now() - t0) * 1000.0;
+
+	printf("rays: pyramid of %d levels over %d x %d cells, %.1f MB, built in %.1f ms\n",
+		pyramid.getNumLevels(), map.size - 1, map.size - 1, pyramid.getMemoryUsed() / (1024.0 * 1024.0), buildMs);
+
+	JobPool pool;
+	float   extent = (map.size - 1) * CELL_SPACING;
+	bool    ok     = true;
+
+	const char* names[] = { "camera", "sight", "sweeps" };
+	for(int kind = 0; kind < 3 && ok; kind++)
+	{
+		// camera: 10 unit steps of a camera flying 2 above the surface, down
+		//         towards it as often as not
+		// sight:  from 2 above the surface at one point to 2 above it at
+		//         another anywhere on the map
+		// sweeps: particles up to 1 above the surface falling for a tick
+		std::vector<HeightPyramid::Ray> rays(numRays);
+		unsigned int seed = 777 + kind;
+		std::vector<float> px(2), pz(2), ph(2);
+		for(int k = 0; k < numRays; k++)
+		{
+			float r[6];
+			for(int n = 0; n < 6; n++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				r[n] = (seed >> 8) * (1.0f / 16777216.0f);
+			}
+
+			px[0] = map.originX + r[0] * extent;
+			pz[0] = map.originZ - r[1] * extent;
+			px[1] = kind == 1 ? map.originX + r[2] * extent : px[0] + (r[2] - 0.5f) * 14.0f;
+			pz[1] = kind == 1 ? map.originZ - r[3] * extent : pz[0] + (r[3] - 0.5f) * 14.0f;
+			field.sample(&px[0], &pz[0], 2, &ph[0]);
+
+			HeightPyramid::Ray& ray = rays[k];
+			ray._origin[0] = px[0];
+			ray._origin[2] = pz[0];
+			ray._maxT      = 1.0f;
+
+			if( kind == 2 )
+			{
+				ray._origin[1] = ph[0] + r[4];
+				ray._dir[0]    = (r[2] - 0.5f) * 0.2f;
+				ray._dir[1]    = -1.5f * r[5];
+				ray._dir[2]    = (r[3] - 0.5f) * 0.2f;
+			}
+			else
+			{
+				float end = ph[1] == -FLT_MAX ? ph[0] : ph[1];
+				ray._origin[1] = ph[0] + 2.0f;
+				ray._dir[0]    = px[1] - px[0];
+				ray._dir[1]    = end + 2.0f - ray._origin[1] - (kind == 0 ? 6.0f * r[4] : 0.0f);
+				ray._dir[2]    = pz[1] - pz[0];
+			}
+		}
+
+		// one thread, then over the pool
+		std::vector<float> t[2];
+		double ms[2] = { 1e30, 1e30 };
+		int    numHits = 0;
+		for(int run = 0; run < 6; run++)
+		{
+			int p = run & 1;
+			t[p].resize(numRays);
+			double start = now();
+			numHits = pyramid.intersect(&rays[0], numRays, &t[p][0], p ? &pool : 0);
+			ms[p] = std::min(ms[p], (now() - start) * 1000.0);
+		}
+
+		ok = memcmp(&t[0][0], &t[1][0], numRays * sizeof(float)) == 0;
+
+		HeightPyramid::Stats stats;
+		for(int k = 0; k < numRays; k++)
+		{
+			float tk;
+			pyramid.intersect(rays[k], &tk, &stats);
+		}
+
+		// hits on the surface
+		float worstHeight = 0.0f;
+		for(int k = 0; k < numRays && ok; k++)
+		{
+			if( t[0][k] == FLT_MAX )
+				continue;
+			const HeightPyramid::Ray& ray = rays[k];
+			float x = ray._origin[0] + ray._dir[0] * t[0][k];
+			float y = ray._origin[1] + ray._dir[1] * t[0][k];
+			float z = ray._origin[2] + ray._dir[2] * t[0][k];
+			float h;
+			field.sample(&x, &z, 1, &h);
+			worstHeight = std::max(worstHeight, fabsf(y - h));
+		}
+		ok = ok && worstHeight <= 1e-3f;
+
+		// and where the brute force finds them, on the same rays timed the
+		// same way
+		std::vector<float> ref(numRays);
+		double bruteMs = 1e30;
+		for(int run = 0; run < 3; run++)
+		{
+			double start = now();
+			for(int k = 0; k < numRays; k++)
+				ref[k] = castBruteForce(map, rays[k]);
+			bruteMs = std::min(bruteMs, (now() - start) * 1000.0);
+		}
+
+		int numWrong = 0;
+		for(int k = 0; k < numRays; k++)
+		{
+			const HeightPyramid::Ray& ray = rays[k];
+
+			float length = sqrtf(ray._dir[0] * ray._dir[0] + ray._dir[1] * ray._dir[1] + ray._dir[2] * ray._dir[2]);
+			bool  same   = ref[k] == FLT_MAX ? t[0][k] == FLT_MAX :
+				t[0][k] != FLT_MAX && fabsf(ref[k] - t[0][k]) * length <= 1e-3f;
+			if( !same )
+				numWrong++;
+		}
+		ok = ok && numWrong == 0;
+
+		printf("rays: %-6s %d, %d hit; one thread %.2f ms (%.2f us each), %d threads %.2f ms; "
+		       "%.1f blocks and %.1f cells a ray; brute force %.2f us each; %d of %d wrong  %s\n",
+			names[kind], numRays, numHits, ms[0], ms[0] * 1e3 / numRays, pool.getThreadCount(), ms[1],
+			(double)stats._numNodes / numRays, (double)stats._numCells / numRays,
+			bruteMs * 1e3 / numRays, numWrong, numRays, ok ? "ok" : "FAIL");
+	}
+
+	return ok;
+}
+
+// Writes the map as a RAW file of 8 or 16 bit samples, quantized the way
+// loadMap scales them back.
+static bool writeRaw(const Map& map, const char* fileName, int bytes, std::vector<unsigned short>* samples)
+{
+	float maxHeight = HEIGHT_SCALE * 255.0f;
+	int   maxSample = bytes == 1 ? 255 : 65535;
+
+	samples->resize(map.heights.size());
+	std::vector<unsigned char> raw(map.heights.size() * bytes);
+
+	for(size_t i = 0; i < map.heights.size(); i++)
+	{
+		float h = map.heights[i] / maxHeight;
+		h = h < 0.0f ? 0.0f : (h > 1.0f ? 1.0f : h);
+
+		unsigned short sample = (unsigned short)(h * maxSample + 0.5f);
+		(*samples)[i] = sample;
+
+		raw[i * bytes] = (unsigned char)sample;
+		if( bytes == 2 )
+			raw[i * bytes + 1] = (unsigned char)(sample >> 8);
+	}
+
+	FILE* file = fopen(fileName, "wb");
+	bool  ok   = file && fwrite(&raw[0], 1, raw.size(), file) == raw.size();
+	if( file )
+		fclose(file);
+	return ok;
+}
+
+// returns false if a heightmap reads back different from what was written
+static bool runStream(const Map& map, int windowSize)
+{
+	for(int bytes = 2; bytes >= 1; bytes--)
+	{
+		const char* fileName = bytes == 2 ? "terrainBench16.raw" : "terrainBench8.raw";
+
+		std::vector<unsigned short> written;
+		if( !writeRaw(map, fileName, bytes, &written) )
+		{
+			printf("stream: can not write %s\n", fileName);
+			return false;
+		}
+
+		HeightmapFile file;
+
+		double t0 = now();
+		bool   ok = file.open(fileName);
+		double openMs = (now() - t0) * 1000.0;
+
+		ok = ok && file.getWidth() == map.size && file.getHeight() == map.size &&
+			file.getFormat() == (bytes == 2 ? HeightmapFile::FORMAT_16 : HeightmapFile::FORMAT_8);
+		if( !ok )
+		{
+			printf("stream: %s did not open as %d x %d, %d bit\n", fileName, map.size, map.size, bytes * 8);
+			remove(fileName);
+			return false;
+		}
+
+		// a window in the middle, as a terrain streaming around its viewer reads
+		int n      = windowSize < map.size ? windowSize : map.size;
+		int corner = (map.size - n) / 2;
+		std::vector<unsigned short> window((size_t)n * n);
+
+		t0 = now();
+		file.readRegion(corner, corner, n, n, &window[0], n);
+		double readMs = (now() - t0) * 1000.0;
+
+		for(int i = 0; i < n && ok; i++)
+			for(int j = 0; j < n && ok; j++)
+				ok = window[(size_t)i * n + j] == written[(size_t)(corner + i) * map.size + corner + j] &&
+				     file.getSample(corner + i, corner + j) == window[(size_t)i * n + j];
+
+		printf("stream: %d x %d, %2d bit, %.1f MB opened in %.3f ms; %d x %d read in %.3f ms, "
+		       "%d of %d tiles touched  %s\n",
+			map.size, map.size, bytes * 8, written.size() * bytes / (1024.0 * 1024.0), openMs,
+			n, n, readMs, file.getNumTilesTouched(), file.getNumTiles(), ok ? "ok" : "FAIL");
+
+		// a file shorter than its samples is refused rather than read past
+		HeightmapFile larger;
+		if( ok && larger.open(fileName, map.size, map.size + 1, file.getFormat()) )
+		{
+			printf("stream: %s opened as larger than it is\n", fileName);
+			ok = false;
+		}
+
+		file.close();
+		remove(fileName);
+
+		if( !ok )
+			return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int         size       = 4097;
+	int         chunkCells = TerrainTree::CHUNK_CELLS;
+	int         numFrames  = 200;
+	const char* heightmap  = 0;
+	double      cullBudget = 1.0;
+	float       pixelError = 2.0f;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if( !strcmp(argv[i], "-size") && i + 1 < argc )
+			size = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-chunk") && i + 1 < argc )
+			chunkCells = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-frames") && i + 1 < argc )
+			numFrames = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-heightmap") && i + 1 < argc )
+			heightmap = argv[++i];
+		else if( !strcmp(argv[i], "-cullBudget") && i + 1 < argc )
+			cullBudget = atof(argv[++i]);
+		else if( !strcmp(argv[i], "-pixelError") && i + 1 < argc )
+			pixelError = (float)atof(argv[++i]);
+		else
+		{
+			printf("usage: terrainBench [-size n] [-chunk n] [-frames n] [-heightmap file]\n"
+			       "                    [-cullBudget ms] [-pixelError pixels]\n");
+			return 1;
+		}
+	}
+
+	if( size < 2 || chunkCells < 1 || numFrames < 1 )
+	{
+		printf("terrainBench: bad arguments\n");
+		return 1;
+	}
+
+	Map map;
+	loadMap(map, heightmap, size);
+
+	double cullMs = 0.0;
+	if( !runCull(map, chunkCells, numFrames, &cullMs) )
+		return 1;
+
+	int indexSizes[] = { 20, 257, 1000, size };
+	for(int i = 0; i < 4; i++)
+	{
+		if( !runIndices(indexSizes[i], chunkCells) )
+			return 1;
+	}
+
+	if( !runLod(map, chunkCells, numFrames, pixelError) )
+		return 1;
+
+	if( !runHeights(map, 1000000) )
+		return 1;
+
+	if( !runQueries(map, 1000000) )
+		return 1;
+
+	if( !runLighting(map, 64) )
+		return 1;
+
+	if( !runEdits(map, chunkCells, numFrames) )
+		return 1;
+
+	if( !runRays(map, 100000) )
+		return 1;
+
+	if( !runStream(map, 257) )
+		return 1;
+
+	if( cullMs > cullBudget )
+	{
+		printf("cull: %.4f ms is over the budget of %.4f ms\n", cullMs, cullBudget);
+		return 2;
+	}
+
+	return 0;
+}
@@ -1,303 +1,315 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: d3dUtility.cpp
-// 
-// Author: Frank Luna (C) All Rights Reserved
-//
-// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
-//
-// Desc: Provides utility functions for simplifying common tasks.
-//
-// * Modified by William Cheung
-//          
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#include "d3dUtility.h"
-
-// #include <algorithm> // for std::min, std::max
-
-// vertex formats
-const DWORD d3d::Vertex::FVF = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1;
-
-
-HWND d3d::InitD3D(
-	HINSTANCE hInstance,
-	int width, int height,
-	bool windowed,
-	D3DDEVTYPE deviceType,
-	IDirect3DDevice9** device)
-{
-	//
-	// Create the main application window.
-	//
-
-	WNDCLASS wc;
-
-	wc.style         = CS_HREDRAW | CS_VREDRAW;
-	wc.lpfnWndProc   = (WNDPROC)d3d::WndProc; 
-	wc.cbClsExtra    = 0;
-	wc.cbWndExtra    = 0;
-	wc.hInstance     = hInstance;
-	wc.hIcon         = LoadIcon(0, IDI_APPLICATION);
-	wc.hCursor       = LoadCursor(0, IDC_ARROW);
-	wc.hbrBackground = (HBRUSH)GetStockObject(WHITE_BRUSH);
-	wc.lpszMenuName  = 0;
-	wc.lpszClassName = "Direct3D9App";
-
-	if( !RegisterClass(&wc) ) 
-	{
-		::MessageBox(0, "RegisterClass() - FAILED", 0, 0);
-		return false;
-	}
-		
-	HWND hwnd = 0;
-	hwnd = ::CreateWindow("Direct3D9App", "Direct3D9App", 
-		WS_EX_TOPMOST,
-		0, 0, width, height,
-		0 /*parent hwnd*/, 0 /* menu */, hInstance, 0 /*extra*/); 
-
-	if( !hwnd )
-	{
-		::MessageBox(0, "CreateWindow() - FAILED", 0, 0);
-		return 0;
-	}
-
-	::ShowWindow(hwnd, SW_SHOW);
-	::UpdateWindow(hwnd);
-
-	//
-	// Init D3D: 
-	//
-
-	HRESULT hr = 0;
-
-	// Step 1: Create the IDirect3D9 object.
-
-	IDirect3D9* d3d9 = 0;
-    d3d9 = Direct3DCreate9(D3D_SDK_VERSION);
-
-    if( !d3d9 )
-	{
-		::MessageBox(0, "Direct3DCreate9() - FAILED", 0, 0);
-		return false;
-	}
-
-	// Step 2: Check for hardware vp.
-
-	D3DCAPS9 caps;
-	d3d9->GetDeviceCaps(D3DADAPTER_DEFAULT, deviceType, &caps);
-
-	int vp = 0;
-	if( caps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT )
-		vp = D3DCREATE_HARDWARE_VERTEXPROCESSING;
-	else
-		vp = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
-
-	// Step 3: Fill out the D3DPRESENT_PARAMETERS structure.
- 
-	D3DPRESENT_PARAMETERS d3dpp;
-	d3dpp.BackBufferWidth            = width;
-	d3dpp.BackBufferHeight           = height;
-	d3dpp.BackBufferFormat           = D3DFMT_A8R8G8B8;
-	d3dpp.BackBufferCount            = 1;
-	d3dpp.MultiSampleType            = D3DMULTISAMPLE_NONE;
-	d3dpp.MultiSampleQuality         = 0;
-	d3dpp.SwapEffect                 = D3DSWAPEFFECT_DISCARD; 
-	d3dpp.hDeviceWindow              = hwnd;
-	d3dpp.Windowed                   = windowed;
-	d3dpp.EnableAutoDepthStencil     = true; 
-	d3dpp.AutoDepthStencilFormat     = D3DFMT_D24S8;
-	d3dpp.Flags                      = 0;
-	d3dpp.FullScreen_RefreshRateInHz = D3DPRESENT_RATE_DEFAULT;
-	d3dpp.PresentationInterval       = D3DPRESENT_INTERVAL_IMMEDIATE;
-
-	// Step 4: Create the device.
-
-	hr = d3d9->CreateDevice(
-		D3DADAPTER_DEFAULT, // primary adapter
-		deviceType,         // device type
-		hwnd,               // window associated with device
-		vp,                 // vertex processing
-	    &d3dpp,             // present parameters
-	    device);            // return created device
-
-	if( FAILED(hr) )
-	{
-		// try again using a 16-bit depth buffer
-		d3dpp.AutoDepthStencilFormat = D3DFMT_D16;
-		
-		hr = d3d9->CreateDevice(
-			D3DADAPTER_DEFAULT,
-			deviceType,
-			hwnd,
-			vp,
-			&d3dpp,
-			device);
-
-		if( FAILED(hr) )
-		{
-			d3d9->Release(); // done with d3d9 object
-			::MessageBox(0, "CreateDevice() - FAILED", 0, 0);
-			return false;
-		}
-	}
-
-	d3d9->Release(); // done with d3d9 object
-	
-	return hwnd;
-}
-
-int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
-{
-	MSG msg;
-	::ZeroMemory(&msg, sizeof(MSG));
-
-	static float lastTime = (float)timeGetTime(); 
-
-	while(msg.message != WM_QUIT)
-	{
-		if(::PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
-		{
-			::TranslateMessage(&msg);
-			::DispatchMessage(&msg);
-		}
-		else
-        {	
-			float currTime  = (float)timeGetTime();
-			float timeDelta = (currTime - lastTime)*0.001f;
-
-			ptr_display(timeDelta);
-
-			lastTime = currTime;
-        }
-    }
-    return msg.wParam;
-}
-
-D3DLIGHT9 d3d::InitDirectionalLight(D3DXVECTOR3* direction, D3DXCOLOR* color)
-{
-	D3DLIGHT9 light;
-	::ZeroMemory(&light, sizeof(light));
-
-	light.Type      = D3DLIGHT_DIRECTIONAL;
-	light.Ambient   = *color * 0.4f;
-	light.Diffuse   = *color;
-	light.Specular  = *color * 0.6f;
-	light.Direction = *direction;
-
-	return light;
-}
-
-D3DLIGHT9 d3d::InitPointLight(D3DXVECTOR3* position, D3DXCOLOR* color)
-{
-	D3DLIGHT9 light;
-	::ZeroMemory(&light, sizeof(light));
-
-	light.Type      = D3DLIGHT_POINT;
-	light.Ambient   = *color * 0.4f;
-	light.Diffuse   = *color;
-	light.Specular  = *color * 0.6f;
-	light.Position  = *position;
-	light.Range        = 1000.0f;
-	light.Falloff      = 1.0f;
-	light.Attenuation0 = 1.0f;
-	light.Attenuation1 = 0.0f;
-	light.Attenuation2 = 0.0f;
-
-	return light;
-}
-
-D3DLIGHT9 d3d::InitSpotLight(D3DXVECTOR3* position, D3DXVECTOR3* direction, D3DXCOLOR* color)
-{
-	D3DLIGHT9 light;
-	::ZeroMemory(&light, sizeof(light));
-
-	light.Type      = D3DLIGHT_SPOT;
-	light.Ambient   = *color * 0.4f;
-	light.Diffuse   = *color;
-	light.Specular  = *color * 0.6f;
-	light.Position  = *position;
-	light.Direction = *direction;
-	light.Range        = 1000.0f;
-	light.Falloff      = 1.0f;
-	light.Attenuation0 = 1.0f;
-	light.Attenuation1 = 0.0f;
-	light.Attenuation2 = 0.0f;
-	light.Theta        = 0.5f;
-	light.Phi          = 0.7f;
-
-	return light;
-}
-
-D3DMATERIAL9 d3d::InitMtrl(D3DXCOLOR a, D3DXCOLOR d, D3DXCOLOR s, D3DXCOLOR e, float p)
-{
-	D3DMATERIAL9 mtrl;
-	mtrl.Ambient  = a;
-	mtrl.Diffuse  = d;
-	mtrl.Specular = s;
-	mtrl.Emissive = e;
-	mtrl.Power    = p;
-	return mtrl;
-}
-
-d3d::BoundingBox::BoundingBox()
-{
-	// infinite small 
-	_min.x = d3d::INF;
-	_min.y = d3d::INF;
-	_min.z = d3d::INF;
-
-	_max.x = -d3d::INF;
-	_max.y = -d3d::INF;
-	_max.z = -d3d::INF;
-}
-
-bool d3d::BoundingBox::isPointInside(D3DXVECTOR3& p)
-{
-	if( p.x >= _min.x && p.y >= _min.y && p.z >= _min.z &&
-		p.x <= _max.x && p.y <= _max.y && p.z <= _max.z )
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-}
-
-d3d::BoundingSphere::BoundingSphere()
-{
-	_radius = 0.0f;
-}
-
-float d3d::GetRandomFloat(float lowBound, float highBound)
-{
-	if( lowBound >= highBound ) // bad input
-		return lowBound;
-
-	// get random float in [0, 1] interval
-	float f = (rand() % 10000) * 0.0001f; 
-
-	// return float in [lowBound, highBound] interval. 
-	return (f * (highBound - lowBound)) + lowBound; 
-}
-
-void d3d::GetRandomVector(
-	  D3DXVECTOR3* out,
-	  D3DXVECTOR3* min,
-	  D3DXVECTOR3* max)
-{
-	out->x = GetRandomFloat(min->x, max->x);
-	out->y = GetRandomFloat(min->y, max->y);
-	out->z = GetRandomFloat(min->z, max->z);
-}
-
-DWORD d3d::FtoDw(float f)
-{
-	return *((DWORD*)&f);
-}
-
-float d3d::Lerp(float a, float b, float t)
-{
-	return a - (a*t) + (b*t);
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: d3dUtility.cpp
+// 
+// Author: Frank Luna (C) All Rights Reserved
+//
+// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
+//
+// Desc: Provides utility functions for simplifying common tasks.
+//
+// * Modified by William Cheung
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "d3dUtility.h"
+#include "random.h"
+
+// #include <algorithm> // for std::min, std::max
+
+// vertex formats
+const DWORD d3d::Vertex::FVF = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1;
+
+
+HWND d3d::InitD3D(
+	HINSTANCE hInstance,
+	int width, int height,
+	bool windowed,
+	D3DDEVTYPE deviceType,
+	IDirect3DDevice9** device)
+{
+	//
+	// Create the main application window.
+	//
+
+	WNDCLASS wc;
+
+	wc.style         = CS_HREDRAW | CS_VREDRAW;
+	wc.lpfnWndProc   = (WNDPROC)d3d::WndProc; 
+	wc.cbClsExtra    = 0;
+	wc.cbWndExtra    = 0;
+	wc.hInstance     = hInstance;
+	wc.hIcon         = LoadIcon(0, IDI_APPLICATION);
+	wc.hCursor       = LoadCursor(0, IDC_ARROW);
+	wc.hbrBackground = (HBRUSH)GetStockObject(WHITE_BRUSH);
+	wc.lpszMenuName  = 0;
+	wc.lpszClassName = "Direct3D9App";
+
+	if( !RegisterClass(&wc) ) 
+	{
+		::MessageBox(0, "RegisterClass() - FAILED", 0, 0);
+		return false;
+	}
+		
+	HWND hwnd = 0;
+	hwnd = ::CreateWindow("Direct3D9App", "Direct3D9App", 
+		WS_EX_TOPMOST,
+		0, 0, width, height,
+		0 /*parent hwnd*/, 0 /* menu */, hInstance, 0 /*extra*/); 
+
+	if( !hwnd )
+	{
+		::MessageBox(0, "CreateWindow() - FAILED", 0, 0);
+		return 0;
+	}
+
+	::ShowWindow(hwnd, SW_SHOW);
+	::UpdateWindow(hwnd);
+
+	//
+	// Init D3D: 
+	//
+
+	HRESULT hr = 0;
+
+	// Step 1: Create the IDirect3D9 object.
+
+	IDirect3D9* d3d9 = 0;
+    d3d9 = Direct3DCreate9(D3D_SDK_VERSION);
+
+    if( !d3d9 )
+	{
+		::MessageBox(0, "Direct3DCreate9() - FAILED", 0, 0);
+		return false;
+	}
+
+	// Step 2: Check for hardware vp.
+
+	D3DCAPS9 caps;
+	d3d9->GetDeviceCaps(D3DADAPTER_DEFAULT, deviceType, &caps);
+
+	int vp = 0;
+	if( caps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT )
+		vp = D3DCREATE_HARDWARE_VERTEXPROCESSING;
+	else
+		vp = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+
+	// Step 3: Fill out the D3DPRESENT_PARAMETERS structure.
+ 
+	D3DPRESENT_PARAMETERS d3dpp;
+	d3dpp.BackBufferWidth            = width;
+	d3dpp.BackBufferHeight           = height;
+	d3dpp.BackBufferFormat           = D3DFMT_A8R8G8B8;
+	d3dpp.BackBufferCount            = 1;
+	d3dpp.MultiSampleType            = D3DMULTISAMPLE_NONE;
+	d3dpp.MultiSampleQuality         = 0;
+	d3dpp.SwapEffect                 = D3DSWAPEFFECT_DISCARD; 
+	d3dpp.hDeviceWindow              = hwnd;
+	d3dpp.Windowed                   = windowed;
+	d3dpp.EnableAutoDepthStencil     = true; 
+	d3dpp.AutoDepthStencilFormat     = D3DFMT_D24S8;
+	d3dpp.Flags                      = 0;
+	d3dpp.FullScreen_RefreshRateInHz = D3DPRESENT_RATE_DEFAULT;
+	d3dpp.PresentationInterval       = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+	// Step 4: Create the device.
+
+	hr = d3d9->CreateDevice(
+		D3DADAPTER_DEFAULT, // primary adapter
+		deviceType,         // device type
+		hwnd,               // window associated with device
+		vp,                 // vertex processing
+	    &d3dpp,             // present parameters
+	    device);            // return created device
+
+	if( FAILED(hr) )
+	{
+		// try again using a 16-bit depth buffer
+		d3dpp.AutoDepthStencilFormat = D3DFMT_D16;
+		
+		hr = d3d9->CreateDevice(
+			D3DADAPTER_DEFAULT,
+			deviceType,
+			hwnd,
+			vp,
+			&d3dpp,
+			device);
+
+		if( FAILED(hr) )
+		{
+			d3d9->Release(); // done with d3d9 object
+			::MessageBox(0, "CreateDevice() - FAILED", 0, 0);
+			return false;
+		}
+	}
+
+	d3d9->Release(); // done with d3d9 object
+	
+	return hwnd;
+}
+
+int d3d::EnterMsgLoop( 
+	bool (*ptr_update)(float tickDelta),
+	bool (*ptr_display)(float alpha),
+	float ticksPerSecond,
+	int   maxCatchUp)
+{
+	MSG msg;
+	::ZeroMemory(&msg, sizeof(MSG));
+
+	timing::FixedStep step((long long)(1e9 / ticksPerSecond), maxCatchUp);
+
+	long long lastTime = timing::NowNs();
+
+	while(msg.message != WM_QUIT)
+	{
+		if(::PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+		{
+			::TranslateMessage(&msg);
+			::DispatchMessage(&msg);
+		}
+		else
+        {	
+			long long currTime  = timing::NowNs();
+			long long frameTime = currTime - lastTime;
+			lastTime = currTime;
+
+			GetFrameTimes().add(frameTime);
+
+			int ticks = step.advance(frameTime);
+			for(int i = 0; i < ticks; i++)
+				ptr_update(step.getTickDelta());
+
+			ptr_display(step.getAlpha());
+        }
+    }
+    return msg.wParam;
+}
+
+timing::FrameHistogram& d3d::GetFrameTimes()
+{
+	static timing::FrameHistogram frameTimes;
+	return frameTimes;
+}
+
+D3DLIGHT9 d3d::InitDirectionalLight(D3DXVECTOR3* direction, D3DXCOLOR* color)
+{
+	D3DLIGHT9 light;
+	::ZeroMemory(&light, sizeof(light));
+
+	light.Type      = D3DLIGHT_DIRECTIONAL;
+	light.Ambient   = *color * 0.4f;
+	light.Diffuse   = *color;
+	light.Specular  = *color * 0.6f;
+	light.Direction = *direction;
+
+	return light;
+}
+
+D3DLIGHT9 d3d::InitPointLight(D3DXVECTOR3* position, D3DXCOLOR* color)
+{
+	D3DLIGHT9 light;
+	::ZeroMemory(&light, sizeof(light));
+
+	light.Type      = D3DLIGHT_POINT;
+	light.Ambient   = *color * 0.4f;
+	light.Diffuse   = *color;
+	light.Specular  = *color * 0.6f;
+	light.Position  = *position;
+	light.Range        = 1000.0f;
+	light.Falloff      = 1.0f;
+	light.Attenuation0 = 1.0f;
+	light.Attenuation1 = 0.0f;
+	light.Attenuation2 = 0.0f;
+
+	return light;
+}
+
+D3DLIGHT9 d3d::InitSpotLight(D3DXVECTOR3* position, D3DXVECTOR3* direction, D3DXCOLOR* color)
+{
+	D3DLIGHT9 light;
+	::ZeroMemory(&light, sizeof(light));
+
+	light.Type      = D3DLIGHT_SPOT;
+	light.Ambient   = *color * 0.4f;
+	light.Diffuse   = *color;
+	light.Specular  = *color * 0.6f;
+	light.Position  = *position;
+	light.Direction = *direction;
+	light.Range        = 1000.0f;
+	light.Falloff      = 1.0f;
+	light.Attenuation0 = 1.0f;
+	light.Attenuation1 = 0.0f;
+	light.Attenuation2 = 0.0f;
+	light.Theta        = 0.5f;
+	light.Phi          = 0.7f;
+
+	return light;
+}
+
+D3DMATERIAL9 d3d::InitMtrl(D3DXCOLOR a, D3DXCOLOR d, D3DXCOLOR s, D3DXCOLOR e, float p)
+{
+	D3DMATERIAL9 mtrl;
+	mtrl.Ambient  = a;
+	mtrl.Diffuse  = d;
+	mtrl.Specular = s;
+	mtrl.Emissive = e;
+	mtrl.Power    = p;
+	return mtrl;
+}
+
+d3d::BoundingBox::BoundingBox()
+{
+	// infinite small 
+	_min.x = d3d::INF;
+	_min.y = d3d::INF;
+	_min.z = d3d::INF;
+
+	_max.x = -d3d::INF;
+	_max.y = -d3d::INF;
+	_max.z = -d3d::INF;
+}
+
+bool d3d::BoundingBox::isPointInside(D3DXVECTOR3& p)
+{
+	if( p.x >= _min.x && p.y >= _min.y && p.z >= _min.z &&
+		p.x <= _max.x && p.y <= _max.y && p.z <= _max.z )
+	{
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+d3d::BoundingSphere::BoundingSphere()
+{
+	_radius = 0.0f;
+}
+
+float d3d::GetRandomFloat(float lowBound, float highBound)
+{
+	// the calling thread's stream, seeded with rng::SetSeed
+	return rng::ThreadRandom().nextFloat(lowBound, highBound);
+}
+
+void d3d::GetRandomVector(
+	  D3DXVECTOR3* out,
+	  D3DXVECTOR3* min,
+	  D3DXVECTOR3* max)
+{
+	out->x = GetRandomFloat(min->x, max->x);
+	out->y = GetRandomFloat(min->y, max->y);
+	out->z = GetRandomFloat(min->z, max->z);
+}
+
+DWORD d3d::FtoDw(float f)
+{
+	return *((DWORD*)&f);
+}
+
+float d3d::Lerp(float a, float b, float t)
+{
+	return a - (a*t) + (b*t);
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frameTimer.cpp
+//
+// Author: William Cheung
+//
+// Desc: Frame timing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "frameTimer.h"
+#include <chrono>
+
+using namespace timing;
+
+// buckets are exact below 2^LINEAR_BITS us, and 2^SUB_BITS per power of two above
+static const int LINEAR_BITS = 6;
+static const int SUB_BITS    = 5;
+static const int MAX_BITS    = 40; // about 12 days, more is counted as that
+
+static const int NUM_BUCKETS = (1 << LINEAR_BITS) + (MAX_BITS - LINEAR_BITS) * (1 << SUB_BITS);
+
+long long timing::NowNs()
+{
+	// steady_clock is QueryPerformanceCounter on Windows
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//*****************************************************************************
+// FixedStep
+//***************
+
+FixedStep::FixedStep(long long tickNs, int maxCatchUp)
+{
+	_tickNs     = tickNs > 0 ? tickNs : 1;
+	_maxCatchUp = maxCatchUp > 1 ? maxCatchUp : 1;
+	_accumNs    = 0;
+	_droppedNs  = 0;
+}
+
+int FixedStep::advance(long long frameNs)
+{
+	if( frameNs > 0 )
+		_accumNs += frameNs;
+
+	long long due = _accumNs / _tickNs;
+	if( due > _maxCatchUp )
+	{
+		// keep the fraction of a tick so the blend does not jump
+		long long excess = (due - _maxCatchUp) * _tickNs;
+		_droppedNs += excess;
+		_accumNs   -= excess;
+		due         = _maxCatchUp;
+	}
+
+	_accumNs -= due * _tickNs;
+	return (int)due;
+}
+
+float FixedStep::getAlpha() const
+{
+	return (float)((double)_accumNs / (double)_tickNs);
+}
+
+//*****************************************************************************
+// FrameHistogram
+//***************
+
+FrameHistogram::FrameHistogram()
+{
+	_buckets.resize(NUM_BUCKETS);
+	reset();
+}
+
+void FrameHistogram::reset()
+{
+	for(int i = 0; i < (int)_buckets.size(); i++)
+		_buckets[i] = 0;
+
+	_count   = 0;
+	_totalNs = 0;
+	_maxNs   = 0;
+}
+
+int FrameHistogram::bucketOf(long long us)
+{
+	if( us < (1 << LINEAR_BITS) )
+		return us > 0 ? (int)us : 0;
+
+	int high = LINEAR_BITS;
+	while( high + 1 < MAX_BITS && (us >> (high + 1)) )
+		high++;
+
+	if( (us >> high) > 1 )
+		return NUM_BUCKETS - 1; // beyond the range
+
+	int sub = (int)(us >> (high - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+	return (1 << LINEAR_BITS) + (high - LINEAR_BITS) * (1 << SUB_BITS) + sub;
+}
+
+long long FrameHistogram::bucketMiddle(int bucket)
+{
+	if( bucket < (1 << LINEAR_BITS) )
+		return bucket;
+
+	int       high  = LINEAR_BITS + ((bucket - (1 << LINEAR_BITS)) >> SUB_BITS);
+	int       sub   = (bucket - (1 << LINEAR_BITS)) & ((1 << SUB_BITS) - 1);
+	long long width = 1LL << (high - SUB_BITS);
+
+	return (1LL << high) + sub * width + width / 2;
+}
+
+void FrameHistogram::add(long long ns)
+{
+	if( ns < 0 )
+		ns = 0;
+
+	_buckets[bucketOf(ns / 1000)]++;
+	_count++;
+	_totalNs += ns;
+	if( ns > _maxNs )
+		_maxNs = ns;
+}
+
+long long FrameHistogram::percentile(double p) const
+{
+	if( _count == 0 )
+		return 0;
+
+	// the rank of the frame wanted, 1 based
+	long long rank = (long long)(p * _count + 0.5);
+	if( rank < 1 )
+		rank = 1;
+	if( rank > _count )
+		rank = _count;
+
+	long long seen = 0;
+	for(int i = 0; i < (int)_buckets.size(); i++)
+	{
+		seen += _buckets[i];
+		if( seen >= rank )
+		{
+			long long ns = bucketMiddle(i) * 1000;
+			return ns < _maxNs ? ns : _maxNs;
+		}
+	}
+	return _maxNs;
+}
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frameTimer.h
+//
+// Author: William Cheung
+//
+// Desc: Frame timing: a monotonic nanosecond clock, the accumulator of a fixed time
+//       step loop and a histogram of frame times for percentiles.  Times are kept
+//       as integer nanoseconds so that they lose no precision however long the
+//       application runs.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __frameTimerH__
+#define __frameTimerH__
+
+#include <vector>
+
+namespace timing
+{
+	// Desc: Nanoseconds on a monotonic clock, from an arbitrary start.
+	long long NowNs();
+
+	class FixedStep
+	{
+	public:
+		// Desc: Ticks of tickNs each, at most maxCatchUp of them per frame.
+		FixedStep(long long tickNs, int maxCatchUp);
+
+		// Desc: Adds frameNs of real time and returns the number of ticks now due.
+		//       Time owed beyond maxCatchUp ticks is dropped, so that a slow frame
+		//       does not make the next ones slower still.
+		int advance(long long frameNs);
+
+		// Desc: Time accumulated toward the next tick, as a fraction of a tick in
+		//       [0, 1).  Rendering blends the last two ticks by it.
+		float getAlpha() const;
+
+		float     getTickDelta() const { return _tickNs * 1e-9f; } // seconds
+		long long getTickNs() const    { return _tickNs; }
+		long long getDroppedNs() const { return _droppedNs; }      // total time dropped
+
+	private:
+		long long _tickNs;
+		int       _maxCatchUp;
+		long long _accumNs;
+		long long _droppedNs;
+	};
+
+	// Log-linear buckets: exact to the microsecond below 64us, then 32 buckets
+	// per power of two, so any percentile is within about 3%.
+	class FrameHistogram
+	{
+	public:
+		FrameHistogram();
+
+		void add(long long ns);
+		void reset();
+
+		int       getCount() const   { return _count; }
+		long long getTotalNs() const { return _totalNs; }
+		long long getMaxNs() const   { return _maxNs; }
+
+		// Desc: Frame time below which fraction p of the frames took, in [0, 1].
+		//       0 if no frame was added.
+		long long percentile(double p) const;
+
+	private:
+		static int       bucketOf(long long us);
+		static long long bucketMiddle(int bucket); // in microseconds
+
+		std::vector<int> _buckets;
+		int              _count;
+		long long        _totalNs;
+		long long        _maxNs;
+	};
+}
+
+#endif // __frameTimerH__
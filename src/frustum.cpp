@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frustum.cpp
+//
+// Author: William Cheung
+//
+// Desc: The six planes of a view frustum and tests against them.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "frustum.h"
+#include <cmath>
+
+Frustum::Frustum()
+{
+	// everything is inside until extract is called
+	for(int p = 0; p < NUM_PLANES; p++)
+	{
+		_planes[p][0] = 0.0f;
+		_planes[p][1] = 0.0f;
+		_planes[p][2] = 0.0f;
+		_planes[p][3] = 1.0f;
+	}
+}
+
+void Frustum::extract(const float* m)
+{
+	// Clip space is the row vector times m, so column j of m gives clip
+	// coordinate j.  Inside means -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+	for(int k = 0; k < 4; k++)
+	{
+		float c0 = m[k * 4 + 0];
+		float c1 = m[k * 4 + 1];
+		float c2 = m[k * 4 + 2];
+		float c3 = m[k * 4 + 3];
+
+		_planes[LEFT][k]       = c3 + c0;
+		_planes[RIGHT][k]      = c3 - c0;
+		_planes[BOTTOM][k]     = c3 + c1;
+		_planes[TOP][k]        = c3 - c1;
+		_planes[NEAR_PLANE][k] = c2;
+		_planes[FAR_PLANE][k]  = c3 - c2;
+	}
+
+	// unit normals, so that plane distances are in world units
+	for(int p = 0; p < NUM_PLANES; p++)
+	{
+		float* q = _planes[p];
+		float length = ::sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+		if( length > 0.0f )
+		{
+			q[0] /= length;
+			q[1] /= length;
+			q[2] /= length;
+			q[3] /= length;
+		}
+	}
+}
+
+Frustum::Result Frustum::testBox(const float min[3], const float max[3], float margin) const
+{
+	Result result = INSIDE;
+
+	for(int p = 0; p < NUM_PLANES; p++)
+	{
+		const float* q = _planes[p];
+
+		// the box corners farthest along and against the plane normal
+		float farX  = q[0] >= 0.0f ? max[0] : min[0];
+		float farY  = q[1] >= 0.0f ? max[1] : min[1];
+		float farZ  = q[2] >= 0.0f ? max[2] : min[2];
+		float nearX = q[0] >= 0.0f ? min[0] : max[0];
+		float nearY = q[1] >= 0.0f ? min[1] : max[1];
+		float nearZ = q[2] >= 0.0f ? min[2] : max[2];
+
+		if( q[0] * farX + q[1] * farY + q[2] * farZ + q[3] < -margin )
+			return OUTSIDE;
+
+		if( q[0] * nearX + q[1] * nearY + q[2] * nearZ + q[3] < -margin )
+			result = INTERSECTS;
+	}
+
+	return result;
+}
+
+bool Frustum::testPoint(float x, float y, float z, float margin) const
+{
+	for(int p = 0; p < NUM_PLANES; p++)
+	{
+		const float* q = _planes[p];
+		if( q[0] * x + q[1] * y + q[2] * z + q[3] < -margin )
+			return false;
+	}
+	return true;
+}
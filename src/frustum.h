@@ -0,0 +1,38 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frustum.h
+//
+// Author: William Cheung
+//
+// Desc: The six planes of a view frustum, extracted from a view * projection matrix,
+//       and tests of points and boxes against them.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __frustumH__
+#define __frustumH__
+
+class Frustum
+{
+public:
+	enum Result { OUTSIDE, INTERSECTS, INSIDE };
+	enum Plane  { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, NUM_PLANES };
+
+	Frustum();
+
+	// Desc: Extracts the planes from a row-major matrix that transforms row vectors
+	//       to clip space (the Direct3D convention, e.g. world * view * projection),
+	//       given as 16 floats.
+	void extract(const float* m);
+
+	// Desc: Tests the axis aligned box [min, max] against the frustum grown by margin
+	//       on every side.
+	Result testBox(const float min[3], const float max[3], float margin = 0.0f) const;
+
+	bool testPoint(float x, float y, float z, float margin = 0.0f) const;
+
+	// normalized planes a x + b y + c z + d = 0, the positive side is inside
+	float _planes[NUM_PLANES][4];
+};
+
+#endif // __frustumH__
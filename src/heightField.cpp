@@ -0,0 +1,547 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightField.cpp
+//
+// Author: William Cheung
+//
+// Desc: Quantized terrain heights in tiles.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "heightField.h"
+#include "jobPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// the first element of v on a cache line boundary
+template<class T>
+static T* firstOnLine(std::vector<T>& v)
+{
+	size_t address = (size_t)&v[0];
+	size_t skip    = (HeightField::CACHE_LINE - address % HeightField::CACHE_LINE) % HeightField::CACHE_LINE;
+	return &v[0] + skip / sizeof(T);
+}
+
+HeightField::HeightField()
+{
+	_numRows     = 0;
+	_numCols     = 0;
+	_tilesPerRow = 0;
+	_tileRowSize = 0;
+	_scale       = 0.0f;
+	_offset      = 0.0f;
+	_originX     = 0.0f;
+	_originZ     = 0.0f;
+	_cellSpacing = 1.0f;
+	_size        = 0;
+	_ground      = 0;
+	_depth       = 0;
+	_normals     = 0;
+}
+
+void HeightField::init(int numRows, int numCols, float minHeight, float maxHeight)
+{
+	_numRows     = numRows > 0 ? numRows : 0;
+	_numCols     = numCols > 0 ? numCols : 0;
+	_tilesPerRow = (_numCols + TILE_SIZE - 1) >> TILE_SHIFT;
+	_tileRowSize = (size_t)_tilesPerRow * TILE_AREA;
+	_offset      = minHeight;
+	_scale       = maxHeight > minHeight ? (maxHeight - minHeight) / (float)MAX_SAMPLE : 0.0f;
+
+	// whole tiles, the ones on the far edges padded
+	int tilesPerCol = (_numRows + TILE_SIZE - 1) >> TILE_SHIFT;
+
+	_size = _tileRowSize * tilesPerCol;
+
+	_samples.assign(_size + CACHE_LINE / sizeof(unsigned short), 0);
+	_ground = firstOnLine(_samples);
+
+	_layer.clear();
+	_depth = 0;
+
+	_normalBytes.clear();
+	_normals = 0;
+}
+
+unsigned short HeightField::quantize(float height) const
+{
+	if( _scale <= 0.0f )
+		return 0;
+
+	float s = (height - _offset) / _scale + 0.5f;
+	if( !(s > 0.0f) )
+		return 0;
+	if( s >= (float)MAX_SAMPLE )
+		return MAX_SAMPLE;
+
+	return (unsigned short)s;
+}
+
+void HeightField::setGround(int row, int col, float height)
+{
+	_ground[index(row, col)] = quantize(height);
+}
+
+void HeightField::addLayer(int row, int col, float depth)
+{
+	if( !_depth )
+	{
+		_layer.assign(_size + CACHE_LINE / sizeof(float), 0.0f);
+		_depth = firstOnLine(_layer);
+	}
+
+	_depth[index(row, col)] += depth;
+}
+
+void HeightField::setLayer(int row, int col, float depth)
+{
+	if( !_depth )
+		addLayer(row, col, depth);
+	else
+		_depth[index(row, col)] = depth;
+}
+
+size_t HeightField::getMemoryUsed() const
+{
+	return _samples.size() * sizeof(unsigned short) + _layer.size() * sizeof(float) + _normalBytes.size();
+}
+
+void HeightField::setPlacement(float originX, float originZ, float cellSpacing)
+{
+	_originX     = originX;
+	_originZ     = originZ;
+	_cellSpacing = cellSpacing;
+}
+
+//
+// Sampling
+//
+// A point is moved into cells of the grid and split into the cell it is in and
+// its position (dx, dz) inside that cell; the height is found on the cell's upper
+// left or lower right triangle, as Terrain::getHeight finds it.  Points off the
+// grid look up the nearest cell, so that every read is inside the arrays, and
+// have their results replaced after.  Both paths do the same operations in the
+// same order.
+//
+
+// what the paths need of a field
+struct Sampler
+{
+	const unsigned short* ground;
+	const float*          depth;
+	int                   tileRowSize;
+	float                 scale, offset;
+	float                 originX, originZ;
+	float                 invSpacing, spacing;
+	int                   numCellsPerRow, numCellsPerCol;
+};
+
+static void sampleScalar(
+	const Sampler& s,
+	const float* x, const float* z, int begin, int count,
+	float* heights, float* nx, float* ny, float* nz)
+{
+	const int   TILE_SIZE = HeightField::TILE_SIZE;
+	const int   TILE_AREA = HeightField::TILE_AREA;
+	const float numCols   = (float)s.numCellsPerRow;
+	const float numRows   = (float)s.numCellsPerCol;
+	const float lastCol   = (float)(s.numCellsPerRow - 1);
+	const float lastRow   = (float)(s.numCellsPerCol - 1);
+	const float spacing2  = s.spacing * s.spacing;
+
+	for(int k = begin; k < count; k++)
+	{
+		float px = (x[k] - s.originX) * s.invSpacing;
+		float pz = (s.originZ - z[k]) * s.invSpacing;
+
+		float col = ::floorf(px);
+		float row = ::floorf(pz);
+
+		bool inside = col >= 0.0f && row >= 0.0f && col < numCols && row < numRows;
+
+		// the nearest cell, as _mm256_max_ps and _mm256_min_ps clamp, NaN included
+		float cc = col > 0.0f ? col : 0.0f;
+		float rc = row > 0.0f ? row : 0.0f;
+		int   c  = (int)(cc < lastCol ? cc : lastCol);
+		int   r  = (int)(rc < lastRow ? rc : lastRow);
+
+		// the corners, as HeightField::getCell finds them
+		int right = (c & (TILE_SIZE - 1)) != TILE_SIZE - 1 ? 1 : TILE_AREA - (TILE_SIZE - 1);
+		int down  = (r & (TILE_SIZE - 1)) != TILE_SIZE - 1 ? TILE_SIZE : s.tileRowSize - (TILE_AREA - TILE_SIZE);
+
+		int ia = (r >> HeightField::TILE_SHIFT) * s.tileRowSize + (c >> HeightField::TILE_SHIFT) * TILE_AREA +
+		         ((r & (TILE_SIZE - 1)) << HeightField::TILE_SHIFT) + (c & (TILE_SIZE - 1));
+		int ib = ia + right;
+		int ic = ia + down;
+		int id = ic + right;
+
+		float A = s.offset + s.scale * (float)s.ground[ia];
+		float B = s.offset + s.scale * (float)s.ground[ib];
+		float C = s.offset + s.scale * (float)s.ground[ic];
+		float D = s.offset + s.scale * (float)s.ground[id];
+
+		if( s.depth )
+		{
+			A = A + s.depth[ia];
+			B = B + s.depth[ib];
+			C = C + s.depth[ic];
+			D = D + s.depth[id];
+		}
+
+		float dx = px - col;
+		float dz = pz - row;
+
+		bool  upper = dz < 1.0f - dx;
+		float h;
+		if( upper )  // upper triangle ABC
+			h = A + (B - A) * dx + (C - A) * dz;
+		else         // lower triangle DCB
+			h = D + (C - D) * (1.0f - dx) + (B - D) * (1.0f - dz);
+
+		heights[k] = inside ? h : -FLT_MAX;
+
+		if( nx )
+		{
+			// the slopes of the triangle along x and down the rows
+			float gx = upper ? B - A : D - C;
+			float gz = upper ? C - A : D - B;
+
+			float inv = 1.0f / ::sqrtf(gx * gx + spacing2 + gz * gz);
+
+			nx[k] = inside ? -gx * inv       : 0.0f;
+			ny[k] = inside ? s.spacing * inv : 1.0f;
+			nz[k] = inside ? gz * inv        : 0.0f;
+		}
+	}
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET_AVX2
+static int sampleAVX2(
+	const Sampler& s,
+	const float* x, const float* z, int count,
+	float* heights, float* nx, float* ny, float* nz)
+{
+	const int TILE_SIZE = HeightField::TILE_SIZE;
+	const int TILE_AREA = HeightField::TILE_AREA;
+
+	const __m256  zero     = _mm256_setzero_ps();
+	const __m256  one      = _mm256_set1_ps(1.0f);
+	const __m256  sign     = _mm256_set1_ps(-0.0f);
+	const __m256  off      = _mm256_set1_ps(-FLT_MAX);
+	const __m256  numCols  = _mm256_set1_ps((float)s.numCellsPerRow);
+	const __m256  numRows  = _mm256_set1_ps((float)s.numCellsPerCol);
+	const __m256  lastCol  = _mm256_set1_ps((float)(s.numCellsPerRow - 1));
+	const __m256  lastRow  = _mm256_set1_ps((float)(s.numCellsPerCol - 1));
+	const __m256  originX  = _mm256_set1_ps(s.originX);
+	const __m256  originZ  = _mm256_set1_ps(s.originZ);
+	const __m256  inv      = _mm256_set1_ps(s.invSpacing);
+	const __m256  spacing  = _mm256_set1_ps(s.spacing);
+	const __m256  spacing2 = _mm256_set1_ps(s.spacing * s.spacing);
+	const __m256  scale    = _mm256_set1_ps(s.scale);
+	const __m256  offset   = _mm256_set1_ps(s.offset);
+
+	const __m256i mask     = _mm256_set1_epi32(TILE_SIZE - 1);
+	const __m256i low16    = _mm256_set1_epi32(0xffff);
+	const __m256i tileRow  = _mm256_set1_epi32(s.tileRowSize);
+	const __m256i rightIn  = _mm256_set1_epi32(1);
+	const __m256i rightOut = _mm256_set1_epi32(TILE_AREA - (TILE_SIZE - 1));
+	const __m256i downIn   = _mm256_set1_epi32(TILE_SIZE);
+	const __m256i downOut  = _mm256_set1_epi32(s.tileRowSize - (TILE_AREA - TILE_SIZE));
+
+	// a sample gathered as 32 bits, the one after it in the high half
+	const int* ground = (const int*)s.ground;
+
+	int k = 0;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m256 px = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), originX), inv);
+		__m256 pz = _mm256_mul_ps(_mm256_sub_ps(originZ, _mm256_loadu_ps(z + k)), inv);
+
+		__m256 col = _mm256_floor_ps(px);
+		__m256 row = _mm256_floor_ps(pz);
+
+		__m256 inside = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(col, zero, _CMP_GE_OQ), _mm256_cmp_ps(row, zero, _CMP_GE_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(col, numCols, _CMP_LT_OQ), _mm256_cmp_ps(row, numRows, _CMP_LT_OQ)));
+
+		__m256i c = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(col, zero), lastCol));
+		__m256i r = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(row, zero), lastRow));
+
+		__m256i ci = _mm256_and_si256(c, mask);
+		__m256i ri = _mm256_and_si256(r, mask);
+
+		__m256i right = _mm256_blendv_epi8(rightIn, rightOut, _mm256_cmpeq_epi32(ci, mask));
+		__m256i down  = _mm256_blendv_epi8(downIn,  downOut,  _mm256_cmpeq_epi32(ri, mask));
+
+		__m256i ia = _mm256_add_epi32(
+			_mm256_add_epi32(
+				_mm256_mullo_epi32(_mm256_srai_epi32(r, HeightField::TILE_SHIFT), tileRow),
+				_mm256_slli_epi32(_mm256_srai_epi32(c, HeightField::TILE_SHIFT), 2 * HeightField::TILE_SHIFT)),
+			_mm256_add_epi32(_mm256_slli_epi32(ri, HeightField::TILE_SHIFT), ci));
+		__m256i ib = _mm256_add_epi32(ia, right);
+		__m256i ic = _mm256_add_epi32(ia, down);
+		__m256i id = _mm256_add_epi32(ic, right);
+
+		__m256 A = _mm256_add_ps(offset, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(ground, ia, 2), low16))));
+		__m256 B = _mm256_add_ps(offset, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(ground, ib, 2), low16))));
+		__m256 C = _mm256_add_ps(offset, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(ground, ic, 2), low16))));
+		__m256 D = _mm256_add_ps(offset, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(ground, id, 2), low16))));
+
+		if( s.depth )
+		{
+			A = _mm256_add_ps(A, _mm256_i32gather_ps(s.depth, ia, 4));
+			B = _mm256_add_ps(B, _mm256_i32gather_ps(s.depth, ib, 4));
+			C = _mm256_add_ps(C, _mm256_i32gather_ps(s.depth, ic, 4));
+			D = _mm256_add_ps(D, _mm256_i32gather_ps(s.depth, id, 4));
+		}
+
+		__m256 dx = _mm256_sub_ps(px, col);
+		__m256 dz = _mm256_sub_ps(pz, row);
+
+		__m256 ex = _mm256_sub_ps(one, dx);
+		__m256 ez = _mm256_sub_ps(one, dz);
+
+		__m256 upper = _mm256_cmp_ps(dz, ex, _CMP_LT_OQ);
+
+		__m256 hu = _mm256_add_ps(_mm256_add_ps(A, _mm256_mul_ps(_mm256_sub_ps(B, A), dx)), _mm256_mul_ps(_mm256_sub_ps(C, A), dz));
+		__m256 hl = _mm256_add_ps(_mm256_add_ps(D, _mm256_mul_ps(_mm256_sub_ps(C, D), ex)), _mm256_mul_ps(_mm256_sub_ps(B, D), ez));
+
+		_mm256_storeu_ps(heights + k, _mm256_blendv_ps(off, _mm256_blendv_ps(hl, hu, upper), inside));
+
+		if( nx )
+		{
+			__m256 gx = _mm256_blendv_ps(_mm256_sub_ps(D, C), _mm256_sub_ps(B, A), upper);
+			__m256 gz = _mm256_blendv_ps(_mm256_sub_ps(D, B), _mm256_sub_ps(C, A), upper);
+
+			__m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), spacing2), _mm256_mul_ps(gz, gz)));
+			__m256 n   = _mm256_div_ps(one, len);
+
+			_mm256_storeu_ps(nx + k, _mm256_blendv_ps(zero, _mm256_mul_ps(_mm256_xor_ps(gx, sign), n), inside));
+			_mm256_storeu_ps(ny + k, _mm256_blendv_ps(one,  _mm256_mul_ps(spacing, n), inside));
+			_mm256_storeu_ps(nz + k, _mm256_blendv_ps(zero, _mm256_mul_ps(gz, n), inside));
+		}
+	}
+
+	_mm256_zeroupper();
+	return k;
+}
+
+#endif // SIMD_X86
+
+void HeightField::sample(
+	simd::Level level,
+	const float* x, const float* z, int count, float* heights,
+	float* nx, float* ny, float* nz) const
+{
+	if( _numRows < 2 || _numCols < 2 )
+	{
+		std::fill(heights, heights + count, -FLT_MAX);
+		if( nx )
+		{
+			std::fill(nx, nx + count, 0.0f);
+			std::fill(ny, ny + count, 1.0f);
+			std::fill(nz, nz + count, 0.0f);
+		}
+		return;
+	}
+
+	Sampler s;
+	s.ground         = _ground;
+	s.depth          = _depth;
+	s.tileRowSize    = (int)_tileRowSize;
+	s.scale          = _scale;
+	s.offset         = _offset;
+	s.originX        = _originX;
+	s.originZ        = _originZ;
+	s.invSpacing     = 1.0f / _cellSpacing;
+	s.spacing        = _cellSpacing;
+	s.numCellsPerRow = _numCols - 1;
+	s.numCellsPerCol = _numRows - 1;
+
+	int done = 0;
+
+#ifdef SIMD_X86
+	// there is no gather before AVX2, SSE2 takes the scalar path
+	if( level == simd::LEVEL_AVX2 )
+		done = sampleAVX2(s, x, z, count, heights, nx, ny, nz);
+#endif
+
+	sampleScalar(s, x, z, done, count, heights, nx, ny, nz);
+}
+
+void HeightField::sample(
+	const float* x, const float* z, int count, float* heights,
+	float* nx, float* ny, float* nz) const
+{
+	sample(simd::GetLevel(), x, z, count, heights, nx, ny, nz);
+}
+
+//
+// Cell normals
+//
+
+void HeightField::updateNormals(int minRow, int minCol, int maxRow, int maxCol, JobPool* pool)
+{
+	if( _numRows < 2 || _numCols < 2 )
+		return;
+
+	if( !_normals )
+	{
+		_normalBytes.assign(_size * 3 + CACHE_LINE, 0);
+		_normals = firstOnLine(_normalBytes);
+	}
+
+	if( minRow < 0 ) minRow = 0;
+	if( minCol < 0 ) minCol = 0;
+	if( maxRow > _numRows - 2 ) maxRow = _numRows - 2;
+	if( maxCol > _numCols - 2 ) maxCol = _numCols - 2;
+
+	if( minRow > maxRow || minCol > maxCol )
+		return;
+
+	if( !pool )
+	{
+		findNormals(minRow, minCol, maxRow, maxCol);
+		return;
+	}
+
+	// a row of tiles per job, so that no two jobs write the same tile
+	int firstTileRow = minRow >> TILE_SHIFT;
+	int lastTileRow  = maxRow >> TILE_SHIFT;
+
+	pool->parallelFor(firstTileRow, lastTileRow + 1, 1, [&](int, int begin, int)
+	{
+		int r0 = begin << TILE_SHIFT;
+		int r1 = r0 + TILE_SIZE - 1;
+		findNormals(r0 > minRow ? r0 : minRow, minCol, r1 < maxRow ? r1 : maxRow, maxCol);
+	});
+}
+
+void HeightField::findNormals(int minRow, int minCol, int maxRow, int maxCol)
+{
+	const float spacing2 = _cellSpacing * _cellSpacing;
+
+	for(int row = minRow; row <= maxRow; row++)
+	{
+		for(int col = minCol; col <= maxCol; col++)
+		{
+			// (-(B - A), spacing, C - A), the cross product of the cell's top
+			// and left edges divided by the spacing
+			float corners[4];
+			getCell(row, col, corners);
+
+			float gx  = corners[1] - corners[0];
+			float gz  = corners[2] - corners[0];
+			float inv = 127.0f / ::sqrtf(gx * gx + spacing2 + gz * gz);
+
+			float n[3] = { -gx * inv, _cellSpacing * inv, gz * inv };
+			for(int a = 0; a < 3; a++)
+				_normals[normalIndex(row, col, a)] = (signed char)::floorf(n[a] + 0.5f);
+		}
+	}
+}
+
+void HeightField::getNormal(int row, int col, float* n) const
+{
+	for(int a = 0; a < 3; a++)
+		n[a] = (float)_normals[normalIndex(row, col, a)] * (1.0f / 127.0f);
+}
+
+//
+// Shading: along each row of a tile the components of the normals of its cells
+// are consecutive, so the dot products are taken a run of up to TILE_SIZE cells
+// at a time.  The light is divided by 127 once, for normals kept as bytes.
+//
+
+static void shadeRunScalar(
+	const signed char* nx, const signed char* ny, const signed char* nz, int begin, int count,
+	float lx, float ly, float lz, float* out)
+{
+	for(int k = begin; k < count; k++)
+	{
+		float d = (float)nx[k] * lx + (float)ny[k] * ly + (float)nz[k] * lz;
+		out[k] = d > 0.0f ? d : 0.0f;
+	}
+}
+
+#ifdef SIMD_X86
+
+// four signed bytes to floats
+static inline __m128 loadBytes(const signed char* p)
+{
+	int bytes;
+	memcpy(&bytes, p, 4);
+
+	// each byte into the top of a 32 bit lane, then shifted down with its sign
+	__m128i v = _mm_cvtsi32_si128(bytes);
+	v = _mm_unpacklo_epi8(v, v);
+	v = _mm_unpacklo_epi16(v, v);
+	return _mm_cvtepi32_ps(_mm_srai_epi32(v, 24));
+}
+
+static int shadeRunSSE2(
+	const signed char* nx, const signed char* ny, const signed char* nz, int count,
+	float lx, float ly, float lz, float* out)
+{
+	const __m128 x    = _mm_set1_ps(lx);
+	const __m128 y    = _mm_set1_ps(ly);
+	const __m128 z    = _mm_set1_ps(lz);
+	const __m128 zero = _mm_setzero_ps();
+
+	int k = 0;
+	for(; k + 4 <= count; k += 4)
+	{
+		__m128 d = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(loadBytes(nx + k), x), _mm_mul_ps(loadBytes(ny + k), y)),
+			_mm_mul_ps(loadBytes(nz + k), z));
+
+		_mm_storeu_ps(out + k, _mm_max_ps(d, zero));
+	}
+	return k;
+}
+
+#endif // SIMD_X86
+
+void HeightField::shade(
+	simd::Level level, const float* toLight,
+	int row, int col, int numRows, int numCols, float* out, int outPitch) const
+{
+	float lx = toLight[0] * (1.0f / 127.0f);
+	float ly = toLight[1] * (1.0f / 127.0f);
+	float lz = toLight[2] * (1.0f / 127.0f);
+
+	for(int r = row; r < row + numRows; r++)
+	{
+		float* rowOut = out + (size_t)(r - row) * outPitch - col;
+
+		// the part of the row in each tile
+		for(int c = col; c < col + numCols; )
+		{
+			int end = ((c >> TILE_SHIFT) + 1) << TILE_SHIFT;
+			if( end > col + numCols )
+				end = col + numCols;
+
+			const signed char* nx = _normals + normalIndex(r, c, 0);
+			const signed char* ny = nx + TILE_AREA;
+			const signed char* nz = ny + TILE_AREA;
+
+			int done = 0;
+#ifdef SIMD_X86
+			if( level >= simd::LEVEL_SSE2 )
+				done = shadeRunSSE2(nx, ny, nz, end - c, lx, ly, lz, rowOut + c);
+#endif
+			shadeRunScalar(nx, ny, nz, done, end - c, lx, ly, lz, rowOut + c);
+
+			c = end;
+		}
+	}
+}
+
+void HeightField::shade(const float* toLight, int row, int col, int numRows, int numCols, float* out, int outPitch) const
+{
+	shade(simd::GetLevel(), toLight, row, col, numRows, numCols, out, outPitch);
+}
@@ -0,0 +1,216 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightField.h
+//
+// Author: William Cheung
+//
+// Desc: The heights of a grid of terrain vertices.  The ground is kept as 16 bit
+//       samples quantized over a range of heights, 2 bytes a vertex, and may carry
+//       a layer of float depth on top of it (the snow), made on first use.  Both
+//       are laid out in tiles of TILE_SIZE x TILE_SIZE vertices rather than row by
+//       row, so that the corners of a cell, and the vertices of a neighborhood,
+//       are most often on the same one or two cache lines however wide the grid
+//       is; the tiles start on cache line boundaries.  Heights at points
+//       between the vertices are sampled in bulk, the AVX2 path gathering the
+//       corners of eight cells at a time.  The normals of the cells can be kept
+//       too, a byte a component in the same tiles, for lighting the cells with
+//       a dot product each.  The tile arithmetic costs a random query 29 ns
+//       against 22 ns for row-major floats on terrainBench, where both fit in
+//       cache.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __heightFieldH__
+#define __heightFieldH__
+
+#include "simd.h"
+#include <cstddef>
+#include <vector>
+
+class JobPool;
+
+class HeightField
+{
+public:
+	static const int TILE_SHIFT = 3;
+	static const int TILE_SIZE  = 1 << TILE_SHIFT;
+	static const int TILE_AREA  = TILE_SIZE * TILE_SIZE;
+	static const int MAX_SAMPLE = 65535;
+	static const int CACHE_LINE = 64;
+
+	HeightField();
+
+	// Desc: Makes a field of numRows x numCols vertices, all at minHeight and
+	//       without a layer.  Ground heights are kept to the nearest of 65536 steps
+	//       from minHeight to maxHeight, those outside clamped to it.
+	void init(int numRows, int numCols, float minHeight, float maxHeight);
+
+	int   getNumRows() const { return _numRows; }
+	int   getNumCols() const { return _numCols; }
+	bool  isInside(int row, int col) const { return row >= 0 && col >= 0 && row < _numRows && col < _numCols; }
+
+	// ground height of sample s is getOffset() + s * getScale()
+	float getScale() const  { return _scale; }
+	float getOffset() const { return _offset; }
+
+	//
+	// Ground
+	//
+
+	unsigned short getSample(int row, int col) const { return _ground[index(row, col)]; }
+	void           setSample(int row, int col, unsigned short s) { _ground[index(row, col)] = s; }
+
+	float getGround(int row, int col) const { return _offset + _scale * (float)_ground[index(row, col)]; }
+	void  setGround(int row, int col, float height);
+
+	// Desc: The sample nearest height, clamped to the field's range.
+	unsigned short quantize(float height) const;
+
+	//
+	// Layer
+	//
+
+	bool  hasLayer() const { return _depth != 0; }
+	float getLayer(int row, int col) const { return _depth ? _depth[index(row, col)] : 0.0f; }
+	void  addLayer(int row, int col, float depth);
+	void  setLayer(int row, int col, float depth);
+
+	//
+	// Surface: the ground and the layer on it
+	//
+
+	float getHeight(int row, int col) const
+	{
+		size_t i = index(row, col);
+		float  h = _offset + _scale * (float)_ground[i];
+		return _depth ? h + _depth[i] : h;
+	}
+
+	// Desc: Heights of the corners of cell (row, col), which must be in the
+	//       field: corners[0] the upper left, [1] upper right, [2] lower left
+	//       and [3] lower right, as Terrain names them A, B, C and D.
+	void getCell(int row, int col, float* corners) const
+	{
+		// the step right and the step down from the upper left corner, within
+		// its tile or, on the tile's last column or row, into the next one
+		size_t a     = index(row, col);
+		size_t right = (col & (TILE_SIZE - 1)) != TILE_SIZE - 1 ? 1 : TILE_AREA - (TILE_SIZE - 1);
+		size_t down  = (row & (TILE_SIZE - 1)) != TILE_SIZE - 1 ? TILE_SIZE : _tileRowSize - (TILE_AREA - TILE_SIZE);
+
+		corners[0] = _offset + _scale * (float)_ground[a];
+		corners[1] = _offset + _scale * (float)_ground[a + right];
+		corners[2] = _offset + _scale * (float)_ground[a + down];
+		corners[3] = _offset + _scale * (float)_ground[a + down + right];
+
+		if( _depth )
+		{
+			corners[0] += _depth[a];
+			corners[1] += _depth[a + right];
+			corners[2] += _depth[a + down];
+			corners[3] += _depth[a + down + right];
+		}
+	}
+
+	//
+	// Sampling
+	//
+
+	// Desc: Places vertex (row, col) at (originX + col * cellSpacing, originZ -
+	//       row * cellSpacing) on the xz plane, as Terrain lays its vertices out.
+	//       Until called the field is at the origin with a spacing of 1.
+	void setPlacement(float originX, float originZ, float cellSpacing);
+
+	float getOriginX() const     { return _originX; }
+	float getOriginZ() const     { return _originZ; }
+	float getCellSpacing() const { return _cellSpacing; }
+
+	// Desc: Heights of the surface at the count points (x[k], z[k]), written to
+	//       heights[k], on the triangles Terrain draws.  Points off the field get
+	//       -FLT_MAX.  With nx, the normals of the triangles are written to
+	//       (nx[k], ny[k], nz[k]) too, (0, 1, 0) off the field.  The AVX2 path
+	//       gives bitwise the same results as the scalar one.
+	void sample(
+		const float* x, const float* z, int count, float* heights,
+		float* nx = 0, float* ny = 0, float* nz = 0) const;
+
+	// Desc: Same as above with an explicit instruction set, for comparing paths.
+	void sample(
+		simd::Level level,
+		const float* x, const float* z, int count, float* heights,
+		float* nx = 0, float* ny = 0, float* nz = 0) const;
+
+	//
+	// Cell normals: of the upper left triangle of each cell, the one
+	// Terrain::computeShade lights the cell by, from the surface
+	//
+
+	// Desc: Finds the normals of cells [minRow, maxRow] x [minCol, maxCol], clipped
+	//       to the grid, a row of tiles per job of pool if there is one.  Call
+	//       after the heights of their corners change.
+	void updateNormals(int minRow, int minCol, int maxRow, int maxCol, JobPool* pool = 0);
+
+	bool hasNormals() const { return _normals != 0; }
+
+	// Desc: The normal of cell (row, col) as kept, n[0..2], of about unit length.
+	void getNormal(int row, int col, float* n) const;
+
+	// Desc: Writes max(0, n . toLight) of cells [row, row + numRows) x
+	//       [col, col + numCols), whose normals must have been found, to out,
+	//       numCols of them every outPitch.  Only reads the field, so threads may
+	//       shade parts of it at once.  The SSE2 path gives bitwise the same
+	//       results as the scalar one.
+	void shade(const float* toLight, int row, int col, int numRows, int numCols, float* out, int outPitch) const;
+
+	// Desc: Same as above with an explicit instruction set, for comparing paths.
+	void shade(simd::Level level, const float* toLight, int row, int col, int numRows, int numCols, float* out, int outPitch) const;
+
+	// bytes the ground, the layer and the normals take
+	size_t getMemoryUsed() const;
+
+	// where vertex (row, col) is kept: tiles row by row, and within a tile
+	// its vertices row by row
+	size_t index(int row, int col) const
+	{
+		return (size_t)(row >> TILE_SHIFT) * _tileRowSize + (size_t)(col >> TILE_SHIFT) * TILE_AREA +
+			((row & (TILE_SIZE - 1)) << TILE_SHIFT) + (col & (TILE_SIZE - 1));
+	}
+
+private:
+	// not copyable, the arrays are used through pointers into them
+	HeightField(const HeightField&);
+	HeightField& operator=(const HeightField&);
+
+	// where component axis of the normal of cell (row, col) is kept: the three
+	// components of a tile's cells one after another, a cache line each
+	size_t normalIndex(int row, int col, int axis) const
+	{
+		size_t i = index(row, col);
+		return i * 3 - (i & (TILE_AREA - 1)) * 2 + axis * TILE_AREA;
+	}
+
+	void findNormals(int minRow, int minCol, int maxRow, int maxCol);
+
+	int    _numRows;
+	int    _numCols;
+	int    _tilesPerRow;
+	size_t _tileRowSize; // samples in a row of tiles
+	float  _scale;
+	float  _offset;
+	float  _originX;
+	float  _originZ;
+	float  _cellSpacing;
+
+	size_t _size;        // samples, whole tiles
+
+	// the arrays have a cache line to spare, and _ground and _depth are
+	// where the first line boundary in them is; the gathers of the AVX2 path
+	// read a sample past the last
+	std::vector<unsigned short> _samples;
+	std::vector<float>          _layer;
+	std::vector<signed char>    _normalBytes;
+	unsigned short*             _ground;
+	float*                      _depth;   // 0 without a layer
+	signed char*                _normals; // 0 until first found
+};
+
+#endif // __heightFieldH__
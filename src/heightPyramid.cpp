@@ -0,0 +1,436 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightPyramid.cpp
+//
+// Author: William Cheung
+//
+// Desc: Height bounds of blocks of terrain cells, for casting rays.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "heightPyramid.h"
+#include "jobPool.h"
+#include <cfloat>
+#include <cmath>
+
+HeightPyramid::HeightPyramid()
+{
+	_heights        = 0;
+	_numCellsPerRow = 0;
+	_numCellsPerCol = 0;
+}
+
+void HeightPyramid::build(const HeightField* heights)
+{
+	_heights        = heights;
+	_numCellsPerRow = heights->getNumCols() - 1;
+	_numCellsPerCol = heights->getNumRows() - 1;
+
+	_levels.clear();
+
+	if( _numCellsPerRow < 1 || _numCellsPerCol < 1 )
+		return;
+
+	// halving, rounded up, until one block is left
+	int numRows = (_numCellsPerCol + BLOCK_CELLS - 1) >> BLOCK_SHIFT;
+	int numCols = (_numCellsPerRow + BLOCK_CELLS - 1) >> BLOCK_SHIFT;
+	for(;;)
+	{
+		Level level;
+		level._numRows = numRows;
+		level._numCols = numCols;
+		level._bounds.assign(numRows * numCols * 2, 0.0f);
+		_levels.push_back(level);
+
+		if( numRows == 1 && numCols == 1 )
+			break;
+
+		numRows = (numRows + 1) / 2;
+		numCols = (numCols + 1) / 2;
+	}
+
+	refit(0, 0, _numCellsPerCol, _numCellsPerRow);
+}
+
+void HeightPyramid::fitBlock(int row, int col)
+{
+	// the block's vertices, its far edges included
+	int r0 = row << BLOCK_SHIFT;
+	int c0 = col << BLOCK_SHIFT;
+	int r1 = r0 + BLOCK_CELLS < _numCellsPerCol ? r0 + BLOCK_CELLS : _numCellsPerCol;
+	int c1 = c0 + BLOCK_CELLS < _numCellsPerRow ? c0 + BLOCK_CELLS : _numCellsPerRow;
+
+	float lo =  FLT_MAX;
+	float hi = -FLT_MAX;
+
+	for(int i = r0; i <= r1; i++)
+	{
+		for(int j = c0; j <= c1; j++)
+		{
+			float h = _heights->getHeight(i, j);
+			if( h < lo ) lo = h;
+			if( h > hi ) hi = h;
+		}
+	}
+
+	float* b = &_levels[0]._bounds[(row * _levels[0]._numCols + col) * 2];
+	b[0] = lo;
+	b[1] = hi;
+}
+
+void HeightPyramid::fitLevel(int level, int minRow, int minCol, int maxRow, int maxCol)
+{
+	const Level& below = _levels[level - 1];
+	Level&       l     = _levels[level];
+
+	for(int i = minRow; i <= maxRow; i++)
+	{
+		for(int j = minCol; j <= maxCol; j++)
+		{
+			float lo =  FLT_MAX;
+			float hi = -FLT_MAX;
+
+			// the quarters, those off the grid left out
+			for(int a = 2 * i; a <= 2 * i + 1 && a < below._numRows; a++)
+			{
+				for(int c = 2 * j; c <= 2 * j + 1 && c < below._numCols; c++)
+				{
+					const float* b = &below._bounds[(a * below._numCols + c) * 2];
+					if( b[0] < lo ) lo = b[0];
+					if( b[1] > hi ) hi = b[1];
+				}
+			}
+
+			float* b = &l._bounds[(i * l._numCols + j) * 2];
+			b[0] = lo;
+			b[1] = hi;
+		}
+	}
+}
+
+void HeightPyramid::refit(int minRow, int minCol, int maxRow, int maxCol)
+{
+	if( _levels.empty() || minRow > maxRow || minCol > maxCol )
+		return;
+
+	// the blocks of the cells on either side of the vertices
+	int r0 = minRow > 0 ? (minRow - 1) >> BLOCK_SHIFT : 0;
+	int c0 = minCol > 0 ? (minCol - 1) >> BLOCK_SHIFT : 0;
+	int r1 = (maxRow < _numCellsPerCol ? maxRow : _numCellsPerCol - 1) >> BLOCK_SHIFT;
+	int c1 = (maxCol < _numCellsPerRow ? maxCol : _numCellsPerRow - 1) >> BLOCK_SHIFT;
+
+	if( r0 > r1 || c0 > c1 )
+		return;
+
+	for(int i = r0; i <= r1; i++)
+		for(int j = c0; j <= c1; j++)
+			fitBlock(i, j);
+
+	// and the blocks above them
+	for(int level = 1; level < (int)_levels.size(); level++)
+	{
+		r0 >>= 1;
+		c0 >>= 1;
+		r1 >>= 1;
+		c1 >>= 1;
+		fitLevel(level, r0, c0, r1, c1);
+	}
+}
+
+size_t HeightPyramid::getMemoryUsed() const
+{
+	size_t bytes = 0;
+	for(int l = 0; l < (int)_levels.size(); l++)
+		bytes += _levels[l]._bounds.size() * sizeof(float);
+	return bytes;
+}
+
+//
+// Casting: in cells of the grid, a ray is u = _u + t * _du along a row and
+// v = _v + t * _dv down a column, at height _y + t * _dy.  Heights a rounding
+// error apart are taken as the same, so that a ray grazing the surface where
+// two triangles or two blocks meet is not lost between them.
+//
+
+static inline float slack(float height)
+{
+	return 1e-5f * (::fabsf(height) + 1.0f);
+}
+
+// clips [*t0, *t1] to where o + t * d is in [lo, hi]
+static inline bool clipSlab(float o, float d, float invD, float lo, float hi, float* t0, float* t1)
+{
+	if( d == 0.0f )
+		return o >= lo && o <= hi;
+
+	float a = (lo - o) * invD;
+	float b = (hi - o) * invD;
+	if( a > b )
+	{
+		float s = a;
+		a = b;
+		b = s;
+	}
+
+	if( a > *t0 ) *t0 = a;
+	if( b < *t1 ) *t1 = b;
+
+	return *t0 <= *t1;
+}
+
+bool HeightPyramid::intersect(const Ray& ray, float* t, Stats* stats) const
+{
+	if( _levels.empty() || !(ray._maxT >= 0.0f) )
+		return false;
+
+	float invSpacing = 1.0f / _heights->getCellSpacing();
+
+	GridRay g;
+	g._u     = (ray._origin[0] - _heights->getOriginX()) * invSpacing;
+	g._v     = (_heights->getOriginZ() - ray._origin[2]) * invSpacing;
+	g._y     = ray._origin[1];
+	g._du    =  ray._dir[0] * invSpacing;
+	g._dv    = -ray._dir[2] * invSpacing;
+	g._dy    =  ray._dir[1];
+	g._invDu = g._du != 0.0f ? 1.0f / g._du : 0.0f;
+	g._invDv = g._dv != 0.0f ? 1.0f / g._dv : 0.0f;
+
+	// The cells the segment spans, and the lowest level at which they are in
+	// at most 2 x 2 blocks: short rays start there rather than at the top.
+	float u1 = g._u + g._du * ray._maxT;
+	float v1 = g._v + g._dv * ray._maxT;
+
+	float uMin = g._u < u1 ? g._u : u1, uMax = g._u < u1 ? u1 : g._u;
+	float vMin = g._v < v1 ? g._v : v1, vMax = g._v < v1 ? v1 : g._v;
+
+	if( uMax < 0.0f || vMax < 0.0f || uMin > (float)_numCellsPerRow || vMin > (float)_numCellsPerCol )
+		return false;
+
+	int c0 = uMin > 0.0f ? (int)uMin : 0;
+	int r0 = vMin > 0.0f ? (int)vMin : 0;
+	int c1 = uMax < (float)(_numCellsPerRow - 1) ? (int)uMax : _numCellsPerRow - 1;
+	int r1 = vMax < (float)(_numCellsPerCol - 1) ? (int)vMax : _numCellsPerCol - 1;
+
+	// A segment across few cells walks them one by one: the bounds of the
+	// blocks around them would only be more to read.
+	if( (r1 - r0) + (c1 - c0) < DIRECT_CELLS )
+	{
+		float t0 = 0.0f, t1 = ray._maxT;
+		if( !clipSlab(g._u, g._du, g._invDu, 0.0f, (float)_numCellsPerRow, &t0, &t1) ||
+			!clipSlab(g._v, g._dv, g._invDv, 0.0f, (float)_numCellsPerCol, &t0, &t1) )
+			return false;
+
+		return intersectCells(r0, c0, r1, c1, t0, t1, g, t, stats);
+	}
+
+	int level = 0;
+	while( level + 1 < (int)_levels.size() &&
+		((r1 >> (level + BLOCK_SHIFT)) - (r0 >> (level + BLOCK_SHIFT)) > 1 ||
+		 (c1 >> (level + BLOCK_SHIFT)) - (c0 >> (level + BLOCK_SHIFT)) > 1) )
+		level++;
+
+	// nearest first, as for the quarters of a block
+	const Level& l = _levels[level];
+	int row     = r0 >> (level + BLOCK_SHIFT);
+	int col     = c0 >> (level + BLOCK_SHIFT);
+	int flipRow = g._dv < 0.0f ? 1 : 0;
+	int flipCol = g._du < 0.0f ? 1 : 0;
+
+	for(int q = 0; q < 4; q++)
+	{
+		int i = row + ((q >> 1) ^ flipRow);
+		int j = col + ((q & 1)  ^ flipCol);
+		if( i >= l._numRows || j >= l._numCols )
+			continue;
+
+		if( intersectNode(level, i, j, 0.0f, ray._maxT, g, t, stats) )
+			return true;
+	}
+
+	return false;
+}
+
+bool HeightPyramid::intersectNode(int level, int row, int col, float t0, float t1, const GridRay& ray, float* t, Stats* stats) const
+{
+	// the block's cells
+	int shift = level + BLOCK_SHIFT;
+	int r0    = row << shift;
+	int c0    = col << shift;
+	int r1    = (row + 1) << shift;
+	int c1    = (col + 1) << shift;
+
+	if( r1 > _numCellsPerCol ) r1 = _numCellsPerCol;
+	if( c1 > _numCellsPerRow ) c1 = _numCellsPerRow;
+
+	if( !clipSlab(ray._u, ray._du, ray._invDu, (float)c0, (float)c1, &t0, &t1) ||
+		!clipSlab(ray._v, ray._dv, ray._invDv, (float)r0, (float)r1, &t0, &t1) )
+		return false;
+
+	if( stats )
+		stats->_numNodes++;
+
+	// over the block or under it all the way across
+	const Level& l  = _levels[level];
+	const float* b  = &l._bounds[(row * l._numCols + col) * 2];
+	float        y0 = ray._y + ray._dy * t0;
+	float        y1 = ray._y + ray._dy * t1;
+
+	float hi = b[1] + slack(b[1]);
+	float lo = b[0] - slack(b[0]);
+	if( (y0 > hi && y1 > hi) || (y0 < lo && y1 < lo) )
+		return false;
+
+	if( level == 0 )
+		return intersectCells(r0, c0, r1 - 1, c1 - 1, t0, t1, ray, t, stats);
+
+	// The quarters nearest first: the one the ray starts in, the two beside
+	// it, of which it can only cross one, and the far one.  The first that is
+	// hit is hit nearest.
+	const Level& below = _levels[level - 1];
+	int flipRow = ray._dv < 0.0f ? 1 : 0;
+	int flipCol = ray._du < 0.0f ? 1 : 0;
+
+	for(int q = 0; q < 4; q++)
+	{
+		int i = 2 * row + ((q >> 1) ^ flipRow);
+		int j = 2 * col + ((q & 1)  ^ flipCol);
+		if( i >= below._numRows || j >= below._numCols )
+			continue;
+
+		if( intersectNode(level - 1, i, j, t0, t1, ray, t, stats) )
+			return true;
+	}
+
+	return false;
+}
+
+bool HeightPyramid::intersectCells(int r0, int c0, int r1, int c1, float t0, float t1, const GridRay& ray, float* t, Stats* stats) const
+{
+	// the cell the ray is in at t0, kept to the cells against rounding, and
+	// from it cell by cell along the ray
+	int i = (int)::floorf(ray._v + ray._dv * t0);
+	int j = (int)::floorf(ray._u + ray._du * t0);
+	i = i < r0 ? r0 : (i > r1 ? r1 : i);
+	j = j < c0 ? c0 : (j > c1 ? c1 : j);
+
+	int stepRow = ray._dv > 0.0f ? 1 : -1;
+	int stepCol = ray._du > 0.0f ? 1 : -1;
+
+	float ta = t0;
+	for(;;)
+	{
+		// where the ray crosses into the next row or column of cells
+		float tRow = ray._dv != 0.0f ? ((float)(i + (stepRow > 0)) - ray._v) * ray._invDv : FLT_MAX;
+		float tCol = ray._du != 0.0f ? ((float)(j + (stepCol > 0)) - ray._u) * ray._invDu : FLT_MAX;
+
+		float tb = tRow < tCol ? tRow : tCol;
+		if( tb > t1 ) tb = t1;
+		if( tb < ta ) tb = ta;
+
+		if( stats )
+			stats->_numCells++;
+
+		if( intersectCell(i, j, ta, tb, ray, t) )
+			return true;
+
+		if( tb >= t1 )
+			return false;
+
+		if( tCol < tRow )
+			j += stepCol;
+		else
+			i += stepRow;
+
+		if( i < r0 || i > r1 || j < c0 || j > c1 )
+			return false;
+
+		ta = tb;
+	}
+}
+
+bool HeightPyramid::intersectCell(int row, int col, float t0, float t1, const GridRay& ray, float* t) const
+{
+	//  A   B
+	//  *---*
+	//  | / |
+	//  *---*
+	//  C   D
+	float c[4];
+	_heights->getCell(row, col, c);
+
+	// the ray from the cell's upper left corner, in parts either side of the
+	// diagonal u + v = 1 between its triangles ABC and DCB
+	float u  = ray._u - (float)col;
+	float v  = ray._v - (float)row;
+	float uv = ray._du + ray._dv;
+
+	float ends[3];
+	int   numEnds = 0;
+	ends[numEnds++] = t0;
+	if( uv != 0.0f )
+	{
+		float td = (1.0f - u - v) / uv;
+		if( td > t0 && td < t1 )
+			ends[numEnds++] = td;
+	}
+	ends[numEnds++] = t1;
+
+	for(int k = 0; k + 1 < numEnds; k++)
+	{
+		float ta    = ends[k];
+		float tb    = ends[k + 1];
+		float mid   = 0.5f * (ta + tb);
+		bool  upper = (u + ray._du * mid) + (v + ray._dv * mid) < 1.0f;
+
+		// how far the ray is above the triangle's plane at either end
+		float f[2];
+		for(int e = 0; e < 2; e++)
+		{
+			float te = e ? tb : ta;
+			float pu = u + ray._du * te;
+			float pv = v + ray._dv * te;
+			float h  = upper ?
+				c[0] + (c[1] - c[0]) * pu + (c[2] - c[0]) * pv :
+				c[3] + (c[2] - c[3]) * (1.0f - pu) + (c[1] - c[3]) * (1.0f - pv);
+			f[e] = (ray._y + ray._dy * te) - h;
+		}
+
+		if( f[0] >= -slack(ray._y + ray._dy * ta) && f[1] <= 0.0f )
+		{
+			*t = f[0] > 0.0f ? ta + (tb - ta) * (f[0] / (f[0] - f[1])) : ta;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int HeightPyramid::intersect(const Ray* rays, int count, float* t, JobPool* pool) const
+{
+	// rays of a chunk are cast one after another, so that the blocks near the
+	// top of the pyramid stay in the cache
+	const int raysPerJob = 64;
+
+	if( pool )
+	{
+		pool->parallelFor(0, count, raysPerJob, [&](int, int begin, int end)
+		{
+			for(int k = begin; k < end; k++)
+				if( !intersect(rays[k], &t[k]) )
+					t[k] = FLT_MAX;
+		});
+	}
+	else
+	{
+		for(int k = 0; k < count; k++)
+			if( !intersect(rays[k], &t[k]) )
+				t[k] = FLT_MAX;
+	}
+
+	int numHits = 0;
+	for(int k = 0; k < count; k++)
+		if( t[k] != FLT_MAX )
+			numHits++;
+
+	return numHits;
+}
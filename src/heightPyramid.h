@@ -0,0 +1,113 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightPyramid.h
+//
+// Author: William Cheung
+//
+// Desc: The lowest and highest surface height over blocks of BLOCK_CELLS x
+//       BLOCK_CELLS cells of a HeightField, and over 2 x 2 of those blocks, and
+//       so on up to one for the whole field: a quadtree of height bounds for
+//       casting rays at the terrain.  A ray walks down it nearest block first,
+//       passing over every block it stays above or under without looking at
+//       the cells, so that a ray skimming a large terrain tests only the few
+//       cells it comes close to; a ray across only a few cells walks them
+//       directly.  Rays are segments in the space the field is placed in;
+//       many at once can be spread over a JobPool.  Does not depend on
+//       Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __heightPyramidH__
+#define __heightPyramidH__
+
+#include "heightField.h"
+#include <vector>
+
+class JobPool;
+
+class HeightPyramid
+{
+public:
+	// cells on a side of the pyramid's smallest blocks, whose cells are tested
+	// one by one
+	static const int BLOCK_SHIFT = 2;
+	static const int BLOCK_CELLS = 1 << BLOCK_SHIFT;
+
+	// rays across fewer rows and columns of cells than this walk the cells
+	// without looking at the blocks
+	static const int DIRECT_CELLS = 16;
+
+	// the segment from _origin to _origin + _maxT * _dir
+	struct Ray
+	{
+		float _origin[3];
+		float _dir[3];
+		float _maxT;
+	};
+
+	struct Stats
+	{
+		Stats()
+		{
+			_numNodes = 0;
+			_numCells = 0;
+		}
+
+		int _numNodes; // blocks of every size the rays were clipped to
+		int _numCells; // cells whose triangles they were tested against
+	};
+
+	HeightPyramid();
+
+	// Desc: Finds the bounds of every block of heights, which must outlive the
+	//       HeightPyramid and be placed with HeightField::setPlacement.
+	void build(const HeightField* heights);
+
+	// Desc: Finds them again for the blocks with a vertex in
+	//       [minRow, maxRow] x [minCol, maxCol], whose heights changed.
+	void refit(int minRow, int minCol, int maxRow, int maxCol);
+
+	// Desc: Finds where ray first goes from above the surface to on or under
+	//       it, on the triangles Terrain draws, and writes how far along it that
+	//       is to t, in lengths of _dir.  Returns false if it never does; a ray
+	//       that starts under the surface hits it only after coming out.
+	bool intersect(const Ray& ray, float* t, Stats* stats = 0) const;
+
+	// Desc: The same for count rays, a chunk of them per job of pool if there
+	//       is one, writing FLT_MAX to t[k] for those that miss.  Returns how
+	//       many hit.
+	int  intersect(const Ray* rays, int count, float* t, JobPool* pool = 0) const;
+
+	int    getNumLevels() const { return (int)_levels.size(); }
+	size_t getMemoryUsed() const;
+
+private:
+	// a level's blocks row by row, the lowest and highest height of each
+	struct Level
+	{
+		int                _numRows, _numCols;
+		std::vector<float> _bounds;
+	};
+
+	// a ray in cells of the grid: u along its rows, v down its columns
+	struct GridRay
+	{
+		float _u, _v, _y;
+		float _du, _dv, _dy;
+		float _invDu, _invDv;
+	};
+
+	void fitBlock(int row, int col);
+	void fitLevel(int level, int minRow, int minCol, int maxRow, int maxCol);
+
+	bool intersectNode(int level, int row, int col, float t0, float t1, const GridRay& ray, float* t, Stats* stats) const;
+	bool intersectCells(int r0, int c0, int r1, int c1, float t0, float t1, const GridRay& ray, float* t, Stats* stats) const;
+	bool intersectCell(int row, int col, float t0, float t1, const GridRay& ray, float* t) const;
+
+	const HeightField* _heights;
+	int                _numCellsPerRow;
+	int                _numCellsPerCol;
+	std::vector<Level> _levels; // blocks of BLOCK_CELLS cells first, one block last
+};
+
+#endif // __heightPyramidH__
@@ -0,0 +1,180 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightmapFile.cpp
+//
+// Author: William Cheung
+//
+// Desc: RAW heightmaps read in place from a mapped file.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "heightmapFile.h"
+#include "heightField.h"
+#include <cmath>
+
+HeightmapFile::HeightmapFile()
+{
+	_width       = 0;
+	_height      = 0;
+	_format      = FORMAT_8;
+	_tilesPerRow = 0;
+	_numTouched  = 0;
+}
+
+bool HeightmapFile::open(const char* path)
+{
+	close();
+
+	if( !_file.open(path, MappedFile::ACCESS_RANDOM) )
+		return false;
+
+	// n x n bytes, or n x n pairs of them
+	size_t size = _file.size();
+	for(int bytes = 1; bytes <= 2; bytes++)
+	{
+		size_t n = (size_t)(::sqrt((double)(size / bytes)) + 0.5);
+		if( n > 0 && n * n * bytes == size )
+			return setLayout((int)n, (int)n, bytes == 1 ? FORMAT_8 : FORMAT_16);
+	}
+
+	close();
+	return false;
+}
+
+bool HeightmapFile::open(const char* path, int width, int height, Format format)
+{
+	close();
+
+	if( !_file.open(path, MappedFile::ACCESS_RANDOM) )
+		return false;
+
+	return setLayout(width, height, format);
+}
+
+bool HeightmapFile::setLayout(int width, int height, Format format)
+{
+	size_t bytes = (size_t)width * height * (format == FORMAT_8 ? 1 : 2);
+	if( width <= 0 || height <= 0 || _file.size() < bytes )
+	{
+		close();
+		return false;
+	}
+
+	_width       = width;
+	_height      = height;
+	_format      = format;
+	_tilesPerRow = (width + TILE_SIZE - 1) / TILE_SIZE;
+
+	_touched.assign((size_t)_tilesPerRow * ((height + TILE_SIZE - 1) / TILE_SIZE), 0);
+	_numTouched = 0;
+
+	return true;
+}
+
+void HeightmapFile::close()
+{
+	_file.close();
+
+	_width       = 0;
+	_height      = 0;
+	_tilesPerRow = 0;
+	_numTouched  = 0;
+	_touched.clear();
+}
+
+int HeightmapFile::getSample(int row, int col) const
+{
+	size_t index = (size_t)row * _width + col;
+
+	if( _format == FORMAT_8 )
+		return _file.data()[index];
+
+	const unsigned char* p = _file.data() + index * 2;
+	return p[0] | (p[1] << 8);
+}
+
+void HeightmapFile::readRegion(int row, int col, int numRows, int numCols, unsigned short* out, int outPitch) const
+{
+	// tile by tile, each row of a tile a short run of the file
+	int tileRow0 = row / TILE_SIZE;
+	int tileCol0 = col / TILE_SIZE;
+	int tileRow1 = (row + numRows - 1) / TILE_SIZE;
+	int tileCol1 = (col + numCols - 1) / TILE_SIZE;
+
+	for(int tr = tileRow0; tr <= tileRow1; tr++)
+	{
+		int r0 = tr * TILE_SIZE > row ? tr * TILE_SIZE : row;
+		int r1 = (tr + 1) * TILE_SIZE < row + numRows ? (tr + 1) * TILE_SIZE : row + numRows;
+
+		for(int tc = tileCol0; tc <= tileCol1; tc++)
+		{
+			int c0 = tc * TILE_SIZE > col ? tc * TILE_SIZE : col;
+			int c1 = (tc + 1) * TILE_SIZE < col + numCols ? (tc + 1) * TILE_SIZE : col + numCols;
+
+			unsigned char& touched = _touched[(size_t)tr * _tilesPerRow + tc];
+			if( !touched )
+			{
+				touched = 1;
+				_numTouched++;
+			}
+
+			for(int r = r0; r < r1; r++)
+			{
+				unsigned short* dst = out + (size_t)(r - row) * outPitch + (c0 - col);
+				size_t          src = (size_t)r * _width + c0;
+
+				if( _format == FORMAT_8 )
+				{
+					const unsigned char* p = _file.data() + src;
+					for(int c = c0; c < c1; c++)
+						*dst++ = *p++;
+				}
+				else
+				{
+					const unsigned char* p = _file.data() + src * 2;
+					for(int c = c0; c < c1; c++, p += 2)
+						*dst++ = (unsigned short)(p[0] | (p[1] << 8));
+				}
+			}
+		}
+	}
+}
+
+bool HeightmapFile::readField(int numRows, int numCols, float heightScale, HeightField* heights) const
+{
+	// Only the rows of the corner are paged in.
+	bool opened = isOpen() && _width >= numCols && _height >= numRows;
+
+	// Heights are kept to 16 bits over the range of the file's samples, and
+	// no less than an 8 bit file's, also when there is none, and as much
+	// again, half below and half above, so that the ground can be edited past
+	// them.  8 bit samples keep all their precision; 16 bit ones lose their
+	// lowest bit.
+	int   maxSample = opened && getMaxSample() > 255 ? getMaxSample() : 255;
+	float range     = (float)maxSample * heightScale;
+	heights->init(numRows, numCols, -0.5f * range, 1.5f * range);
+
+	if( !opened )
+	{
+		// flat
+		for(int i = 0; i < numRows; i++)
+			for(int j = 0; j < numCols; j++)
+				heights->setGround(i, j, 0.0f);
+		return false;
+	}
+
+	// a band of rows at a time, a row of the field's tiles
+	std::vector<unsigned short> samples( HeightField::TILE_SIZE * numCols );
+
+	for(int row = 0; row < numRows; row += HeightField::TILE_SIZE)
+	{
+		int bandRows = numRows - row < HeightField::TILE_SIZE ? numRows - row : HeightField::TILE_SIZE;
+		readRegion(row, 0, bandRows, numCols, &samples[0], numCols);
+
+		for(int i = 0; i < bandRows; i++)
+			for(int j = 0; j < numCols; j++)
+				heights->setGround(row + i, j, (float)samples[i * numCols + j] * heightScale);
+	}
+
+	return true;
+}
@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: heightmapFile.h
+//
+// Author: William Cheung
+//
+// Desc: A RAW heightmap, 8 bit or 16 bit little endian samples row by row, read in
+//       place from a MappedFile.  Opening maps the file without reading it, so a
+//       heightmap of gigabytes opens at once; the OS pages samples in as regions
+//       are read.  Regions are read a tile of TILE_SIZE x TILE_SIZE samples at a
+//       time, so that the pages touched stay few however wide the file is, and
+//       the tiles read so far are counted.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __heightmapFileH__
+#define __heightmapFileH__
+
+#include "mappedFile.h"
+#include <vector>
+
+class HeightField;
+
+class HeightmapFile
+{
+public:
+	enum Format { FORMAT_8, FORMAT_16 };
+
+	static const int TILE_SIZE = 64;
+
+	HeightmapFile();
+
+	// Desc: Maps a square heightmap, its side and format found from the size of
+	//       the file: n x n bytes or n x n x 2.  Returns false if the file can not
+	//       be mapped or its size is neither.
+	bool open(const char* path);
+
+	// Desc: Maps a heightmap of width x height samples.  Returns false if the file
+	//       can not be mapped or holds fewer samples.
+	bool open(const char* path, int width, int height, Format format);
+
+	void close();
+
+	bool   isOpen() const    { return _file.isOpen(); }
+	int    getWidth() const  { return _width; }
+	int    getHeight() const { return _height; }
+	Format getFormat() const { return _format; }
+
+	// largest sample of the format, 255 or 65535
+	int getMaxSample() const { return _format == FORMAT_8 ? 255 : 65535; }
+
+	int getSample(int row, int col) const;
+
+	// Desc: Copies samples [row, row + numRows) x [col, col + numCols), which must
+	//       be in the heightmap, to out, numCols of them every outPitch.
+	void readRegion(int row, int col, int numRows, int numCols, unsigned short* out, int outPitch) const;
+
+	// Desc: Inits heights to numRows x numCols vertices, the upper left corner
+	//       of the heightmap, each sample heightScale high, a band of rows at a
+	//       time.  Returns false, leaving the field flat, if the heightmap is not
+	//       open or is smaller than that.
+	bool readField(int numRows, int numCols, float heightScale, HeightField* heights) const;
+
+	// tiles any read has touched, of the getNumTiles covering the heightmap
+	int getNumTiles() const        { return (int)_touched.size(); }
+	int getNumTilesTouched() const { return _numTouched; }
+
+private:
+	bool setLayout(int width, int height, Format format);
+
+	MappedFile                         _file;
+	int                                _width;
+	int                                _height;
+	Format                             _format;
+	int                                _tilesPerRow;
+	mutable std::vector<unsigned char> _touched;
+	mutable int                        _numTouched;
+};
+
+#endif // __heightmapFileH__
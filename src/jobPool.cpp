@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: jobPool.cpp
+//
+// Author: William Cheung
+//
+// Desc: A work-stealing thread pool for data parallel loops.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "jobPool.h"
+
+JobPool::JobPool(int numThreads)
+{
+	if( numThreads <= 0 )
+		numThreads = (int)std::thread::hardware_concurrency();
+	if( numThreads <= 0 )
+		numThreads = 1;
+
+	_generation = 0;
+	_quit       = false;
+	_func       = 0;
+	_begin      = 0;
+	_end        = 0;
+	_chunkSize  = 1;
+	_remaining  = 0;
+	_busy       = 0;
+
+	for(int i = 0; i < numThreads; i++)
+		_queues.push_back(new Queue);
+
+	// queue 0 is served by whoever calls parallelFor
+	for(int i = 1; i < numThreads; i++)
+		_threads.push_back(std::thread(&JobPool::workerMain, this, i));
+}
+
+JobPool::~JobPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(_wakeLock);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for(size_t i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+
+	for(size_t i = 0; i < _queues.size(); i++)
+		delete _queues[i];
+}
+
+void JobPool::parallelFor(int begin, int end, int chunkSize, const ChunkFunc& func)
+{
+	if( end <= begin )
+		return;
+	if( chunkSize <= 0 )
+		chunkSize = end - begin;
+
+	int numChunks = (end - begin + chunkSize - 1) / chunkSize;
+
+	// nothing to share, run it here
+	if( _threads.empty() || numChunks == 1 )
+	{
+		for(int c = 0; c < numChunks; c++)
+		{
+			int b = begin + c * chunkSize;
+			int e = b + chunkSize < end ? b + chunkSize : end;
+			func(c, b, e);
+		}
+		return;
+	}
+
+	_func      = &func;
+	_begin     = begin;
+	_end       = end;
+	_chunkSize = chunkSize;
+
+	// deal out contiguous runs of chunks, one run per thread, so that threads
+	// start on neighbouring memory and only steal when they run dry.
+	int numQueues = (int)_queues.size();
+	for(int q = 0; q < numQueues; q++)
+	{
+		int first = (int)((long long)numChunks * q / numQueues);
+		int last  = (int)((long long)numChunks * (q + 1) / numQueues);
+
+		std::lock_guard<std::mutex> guard(_queues[q]->lock);
+		for(int c = first; c < last; c++)
+			_queues[q]->chunks.push_back(c);
+	}
+
+	_remaining = numChunks;
+
+	{
+		std::lock_guard<std::mutex> guard(_wakeLock);
+		_busy = (int)_threads.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	while( _remaining.load() > 0 )
+	{
+		if( !runOne(0) )
+			std::this_thread::yield();
+	}
+
+	// workers may still be looking at _func, wait until they let go of it
+	while( _busy.load() > 0 )
+		std::this_thread::yield();
+
+	_func = 0;
+}
+
+void JobPool::workerMain(int self)
+{
+	unsigned int seen = 0;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(_wakeLock);
+			while( !_quit && _generation == seen )
+				_wake.wait(guard);
+
+			if( _quit )
+				return;
+
+			seen = _generation;
+		}
+
+		while( _remaining.load() > 0 )
+		{
+			if( !runOne(self) )
+				std::this_thread::yield();
+		}
+
+		_busy--;
+	}
+}
+
+bool JobPool::runOne(int self)
+{
+	int chunk = -1;
+
+	// own work first, newest chunk first
+	{
+		Queue* q = _queues[self];
+		std::lock_guard<std::mutex> guard(q->lock);
+		if( !q->chunks.empty() )
+		{
+			chunk = q->chunks.back();
+			q->chunks.pop_back();
+		}
+	}
+
+	// then steal the oldest chunk of another thread
+	int numQueues = (int)_queues.size();
+	for(int k = 1; chunk < 0 && k < numQueues; k++)
+	{
+		Queue* q = _queues[(self + k) % numQueues];
+		std::lock_guard<std::mutex> guard(q->lock);
+		if( !q->chunks.empty() )
+		{
+			chunk = q->chunks.front();
+			q->chunks.pop_front();
+		}
+	}
+
+	if( chunk < 0 )
+		return false;
+
+	int b = _begin + chunk * _chunkSize;
+	int e = b + _chunkSize < _end ? b + _chunkSize : _end;
+	(*_func)(chunk, b, e);
+
+	_remaining--;
+	return true;
+}
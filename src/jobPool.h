@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: jobPool.h
+//
+// Author: William Cheung
+//
+// Desc: A work-stealing thread pool for data parallel loops.  The range of a loop
+//       is cut into fixed size chunks which are dealt out to per-thread queues;
+//       a thread that runs out of chunks steals from the others.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __jobPoolH__
+#define __jobPoolH__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobPool
+{
+public:
+	// chunk is the index of the chunk, [begin, end) the part of the range it covers
+	typedef std::function<void(int chunk, int begin, int end)> ChunkFunc;
+
+	// Desc: Creates a pool running numThreads threads including the calling one.
+	//       0 means one per hardware thread.
+	explicit JobPool(int numThreads = 0);
+	~JobPool();
+
+	int getThreadCount() const { return (int)_queues.size(); }
+
+	// Desc: Runs func on every chunkSize sized chunk of [begin, end) and returns when
+	//       all of them are done.  The calling thread takes part.  Chunk boundaries
+	//       depend only on the arguments, never on the number of threads.  Not
+	//       reentrant: func must not call parallelFor on the same pool.
+	void parallelFor(int begin, int end, int chunkSize, const ChunkFunc& func);
+
+private:
+	JobPool(const JobPool&);
+	JobPool& operator=(const JobPool&);
+
+	struct Queue
+	{
+		std::mutex      lock;
+		std::deque<int> chunks;
+	};
+
+	void workerMain(int self);
+	bool runOne(int self);
+
+	std::vector<std::thread> _threads;
+	std::vector<Queue*>      _queues;  // _queues[0] belongs to the calling thread
+
+	std::mutex              _wakeLock;
+	std::condition_variable _wake;
+	unsigned int            _generation;
+	bool                    _quit;
+
+	// the loop being run
+	const ChunkFunc*        _func;
+	int                     _begin;
+	int                     _end;
+	int                     _chunkSize;
+	std::atomic<int>        _remaining; // chunks not finished yet
+	std::atomic<int>        _busy;      // workers still inside the loop
+};
+
+#endif // __jobPoolH__
@@ -1,393 +1,646 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: main.cpp
-// 
-// Author: William Cheung
-//          
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#include "d3dUtility.h"
-#include "psystem.h"
-#include "camera.h"
-#include <cstdlib>
-#include <ctime>
-
-#include "cube.h"
-#include "snowman.h"
-#include "terrain.h"
-
-#include <cstdio>
-
-//
-// Globals
-//
-
-IDirect3DDevice9*     Device = 0; 
-
-const int Width  = 800;
-const int Height = 600;
-
-psys::PSystem* Sno = 0;
-
-Camera TheCamera(Camera::AIRCRAFT);
-
-bool   IsOrbiting = false;  // is the camera orbiting
-
-HWND   HWnd       = NULL;
-bool   IsMousing  = false;  // are we using mouse to control
-
-bool DisplayBasicScene(IDirect3DDevice9* device);
-
-//
-// Framework Functions
-//
-bool Setup()
-{
-	// seed random number generator
-	srand((unsigned int)time(0));
-
-	//
-	// Create Snow System.
-	//
-
-	d3d::BoundingBox boundingBox;
-	boundingBox._min = D3DXVECTOR3(-50.0f, -20.0f, -50.0f);
-	boundingBox._max = D3DXVECTOR3( 50.0f,  50.0f,  50.0f);
-	Sno = new psys::Snow(&boundingBox, 6000);
-	Sno->init(Device, "snowflake.dds");
-
-	//
-	// Create basic scene.
-	//
-	DisplayBasicScene(Device);
-
-	//
-	// Set projection matrix.
-	//
-	D3DXMATRIX proj;
-	D3DXMatrixPerspectiveFovLH(
-			&proj,
-			D3DX_PI / 4.0f, // 45 - degree
-			(float)Width / (float)Height,
-			1.0f,
-			5000.0f);
-	Device->SetTransform(D3DTS_PROJECTION, &proj);
-
-	return true;
-}
-
-void HandleKeyboardInput(float timeDelta) {
-
-	if (!IsOrbiting) {
-		if (::GetAsyncKeyState('W') & 0x8000f)
-			TheCamera.walk(4.0f * timeDelta);
-
-		if (::GetAsyncKeyState('S') & 0x8000f)
-			TheCamera.walk(-4.0f * timeDelta);
-
-		if (::GetAsyncKeyState('A') & 0x8000f)
-			TheCamera.strafe(-4.0f * timeDelta);
-
-		if (::GetAsyncKeyState('D') & 0x8000f)
-			TheCamera.strafe(4.0f * timeDelta);
-
-		if (::GetAsyncKeyState('R') & 0x8000f)
-			TheCamera.fly(4.0f * timeDelta);
-
-		if (::GetAsyncKeyState('F') & 0x8000f)
-			TheCamera.fly(-4.0f * timeDelta);
-	}
-
-	if (::GetAsyncKeyState('X') & 0x8000f) // free the camera
-		IsOrbiting = false;
-
-	if (::GetAsyncKeyState(VK_UP) & 0x8000f)
-		TheCamera.pitch(1.0f * timeDelta);
-
-	if (::GetAsyncKeyState(VK_DOWN) & 0x8000f)
-		TheCamera.pitch(-1.0f * timeDelta);
-
-	if (::GetAsyncKeyState(VK_LEFT) & 0x8000f)
-		TheCamera.yaw(-1.0f * timeDelta);
-
-	if (::GetAsyncKeyState(VK_RIGHT) & 0x8000f)
-		TheCamera.yaw(1.0f * timeDelta);
-}
-
-void HandleMouseInput() {
-
-	static POINT lastMousePosition;
-
-	POINT currMousePosition;
-
-	GetCursorPos(&currMousePosition);
-	ScreenToClient(HWnd, &currMousePosition);
-
-	if (IsMousing)
-	{
-		int nXDiff = (currMousePosition.x - lastMousePosition.x);
-		int nYDiff = (currMousePosition.y - lastMousePosition.y);
-
-		D3DXVECTOR3 vRight, vLook, vUp;
-		TheCamera.getRight(&vRight), TheCamera.getLook(&vLook), TheCamera.getUp(&vUp);
-
-		D3DXMATRIX matRotation;
-
-		if (nYDiff != 0)
-		{
-			D3DXMatrixRotationAxis(&matRotation, &vRight, D3DXToRadian((float)nYDiff / 3.0f));
-			D3DXVec3TransformCoord(&vLook, &vLook, &matRotation);
-			D3DXVec3TransformCoord(&vUp, &vUp, &matRotation);
-		}
-
-		if (nXDiff != 0)
-		{
-			D3DXMatrixRotationAxis(&matRotation, &D3DXVECTOR3(0, 1, 0), D3DXToRadian((float)nXDiff / 3.0f));
-			D3DXVec3TransformCoord(&vLook, &vLook, &matRotation);
-			D3DXVec3TransformCoord(&vUp, &vUp, &matRotation);
-		}
-
-		TheCamera.setRight(&vRight), TheCamera.setLook(&vLook), TheCamera.setUp(&vUp);
-	}
-
-	lastMousePosition = currMousePosition;
-}
-
-void HandleRealTimeUserInput(float timeDelta)
-{
-	//
-	// Handle mouse input...
-	//
-	HandleMouseInput();
-
-	//
-	// Handle keyboard input...
-	//
-	HandleKeyboardInput(timeDelta);
-}
-
-bool DrawSkybox(IDirect3DDevice9* device, const Camera* camera) 
-{
-	static Cube skybox(device, "skybox.config", Cube::TEXTYPE_INTERNAL);
-	const float skyboxScale = 200.0f;
-	const float yOffsetToCamera = 0.0f;
-
-	device->SetRenderState(D3DRS_LIGHTING, FALSE);
-	device->LightEnable(0, false);
-
-	D3DXMATRIX P, T, S;
-	D3DXMatrixScaling(&S, skyboxScale, skyboxScale, skyboxScale);
-	D3DXVECTOR3 cameraPosition;
-	TheCamera.getPosition(&cameraPosition);
-	D3DXMatrixTranslation(&T, 
-		cameraPosition.x, cameraPosition.y + yOffsetToCamera, cameraPosition.z);
-	P = S * T;
-	skybox.draw(&P, &d3d::WHITE_MTRL);
-
-	return true;
-}
-
-//
-// Drawing Basic Scene
-//
-// Pass 0 to device for cleanup
-//
-bool DisplayBasicScene(IDirect3DDevice9* device)
-{
-	static bool                    isCreated = false;
-	static Snowman*                snowman = 0;
-	static Cube*                   crate = 0;
-	static Terrain*                terrain = 0;
-
-	static D3DXVECTOR3             lightDirection(-0.5f, -0.5f, -1.0f);
-	static D3DXCOLOR               lightColor(1.0f, 1.0f, 1.0f, 1.0f);
-	static D3DLIGHT9               light = d3d::InitDirectionalLight(&lightDirection, &lightColor);
-
-	if (device == 0) 
-	{
-		d3d::Delete<Snowman*>(snowman);
-		d3d::Delete<Cube*>(crate);
-		d3d::Delete<Terrain*>(terrain);
-	}
-	else if (!isCreated)
-	{
-		snowman = new Snowman(device);
-		crate = new Cube(device, "crate.config", Cube::TEXTYPE_BOTH_SIDES);
-
-		terrain = new Terrain(device, "castlehm257.raw", 20, 20, 10, 0.05f);
-		//D3DXVECTOR3 L = -lightDirection;
-		D3DXVECTOR3 L(0.5f, 1.0f, 0.5f);
-		terrain->genTexture(&L);
-
-		isCreated = true;
-	}
-	else
-	{
-		//
-		// Pre-Render Setup
-		//
-		device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
-		device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
-		device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_POINT);
-
-		device->SetLight(0, &light);
-		device->LightEnable(0, true);
-		device->SetRenderState(D3DRS_LIGHTING, TRUE);
-		device->SetRenderState(D3DRS_NORMALIZENORMALS, true);
-		device->SetRenderState(D3DRS_SPECULARENABLE, true);
-
-		//
-		// Render
-		//
-
-		D3DXMATRIX P, R, T, S, C;
-
-		// draw terrain
-		D3DXMatrixTranslation(&T, 0.0f, -12.5f, 0.0f);
-		terrain->draw(&T, false);
-
-		// draw crates and snowmen
-		D3DXMatrixTranslation(&C, 0.0f, 0.0f, 15.0f);
-
-		D3DXMatrixTranslation(&T, 0.0f, -2.0f, 0.0f);
-		P = T * C;
-		snowman->draw(&P);  // draw the 1st snowman
-
-		static float fDegree = 0.0f;
-		fDegree += 0.001f;
-		if (fDegree > 2.0f * D3DX_PI) fDegree = 0.0f;
-
-		D3DXMatrixTranslation(&T, 10.0f, -1.0f, 0.0f);
-		D3DXMatrixRotationY(&R, fDegree);
-		P = T * R * C;
-		crate->draw(&P, &d3d::WHITE_MTRL);
-
-		// collision detection
-		d3d::BoundingBox crateBox = crate->getBoundingBox();
-		D3DXVECTOR3 cameraPosition;
-		TheCamera.getPosition(&cameraPosition);
-		D3DXMATRIX X;
-		D3DXMatrixInverse(&X, 0, &P);
-		D3DXVec3TransformCoord(&cameraPosition, &cameraPosition, &X);
-		if (crateBox.isPointInside(cameraPosition)) 
-			IsOrbiting = true;
-
-		if (IsOrbiting) { 
-			// the camera orbits the 1st snowman
-			D3DXMatrixTranslation(&T, 0.0f, 2.0f, 0.0f);
-			D3DXVECTOR3 newPosition(0.0f, 0.0f, 0.0f);
-			P = P * T;
-			D3DXVec3TransformCoord(&newPosition, &newPosition, &P);
-			TheCamera.setPosition(&newPosition);
-		}
-
-		D3DXMatrixScaling(&S, 0.6, 0.6, 0.6);
-		D3DXMatrixTranslation(&T, 10.0f, 0.0f, 0.0f);
-		P = S * T * R * C;
-		snowman->draw(&P);  // draw the 2nd snowman	
-	}
-	return true;
-}
-
-void Cleanup()
-{
-	d3d::Delete<psys::PSystem*>(Sno);
-	DisplayBasicScene(0);
-}
-
-bool Display(float timeDelta)
-{
-	if( Device )
-	{
-		//
-		// Update the scene:
-		//
-
-		HandleRealTimeUserInput(timeDelta); 
-
-		D3DXMATRIX V;
-		TheCamera.getViewMatrix(&V);
-		Device->SetTransform(D3DTS_VIEW, &V);
-
-		Sno->update(timeDelta);
-
-		//
-		// Draw the scene:
-		//
-		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00000000, 1.0f, 0);
-		Device->BeginScene();
-
-		DrawSkybox(Device, &TheCamera);
-
-		DisplayBasicScene(Device);
-
-		// order important, render snow last.
-		D3DXMATRIX I;  D3DXMatrixIdentity(&I);
-		Device->SetTransform(D3DTS_WORLD, &I);
-		Sno->render();
-
-		Device->EndScene();
-		Device->Present(0, 0, 0, 0);
-	}
-	return true;
-}
-
-
-//
-// WndProc
-//
-LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
-{
-	switch( msg )
-	{
-	case WM_DESTROY:
-		::PostQuitMessage(0);
-		break;
-		
-	case WM_KEYDOWN:
-		if( wParam == VK_ESCAPE )
-			::DestroyWindow(hwnd);
-		break;
-
-	case WM_LBUTTONDOWN:
-		IsMousing = true;
-		break;
-	case WM_LBUTTONUP:
-		IsMousing = false;
-		break;
-	}
-		   
-	return ::DefWindowProc(hwnd, msg, wParam, lParam);
-}
-
-//
-// WinMain
-//
-int WINAPI WinMain(HINSTANCE hinstance,
-				   HINSTANCE prevInstance, 
-				   PSTR cmdLine,
-				   int showCmd)
-{
-	HWnd = d3d::InitD3D(hinstance,
-		Width, Height, true, D3DDEVTYPE_HAL, &Device);
-
-	if (!HWnd)
-	{
-		::MessageBox(0, "InitD3D() - FAILED", 0, 0);
-		return 0;
-	}
-		
-	if(!Setup())
-	{
-		::MessageBox(0, "Setup() - FAILED", 0, 0);
-		return 0;
-	}
-
-	d3d::EnterMsgLoop( Display );
-
-	Cleanup();
-
-	Device->Release();
-
-	return 0;
-}
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: main.cpp
+// 
+// Author: William Cheung
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "d3dUtility.h"
+#include "psystem.h"
+#include "particleWorld.h"
+#include "jobPool.h"
+#include "camera.h"
+#include "random.h"
+#include "windField.h"
+#include "particleRecord.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+
+#include "cube.h"
+#include "snowman.h"
+#include "terrain.h"
+
+#include <cstdio>
+
+//
+// Globals
+//
+
+IDirect3DDevice9*     Device = 0; 
+
+const int Width  = 800;
+const int Height = 600;
+
+psys::ParticleWorld* Particles = 0;   // owns the snow, the smoke and the powder puffs
+psys::ParticleSim*   Sno = 0;         // the snow, or its replay
+JobPool*             Jobs = 0;
+Terrain*             TheTerrain = 0;
+
+// the terrain is drawn this much lower than its own space
+const float    TerrainHeightOffset = -12.5f;
+
+// depth of snow each flake that lands on the terrain leaves
+const float    FlakeDepth = 0.0005f;
+
+WindField      TheWind;
+
+// chimneys smoking on the terrain, at x, z
+const float    Chimneys[][2] = { { -30.0f, 35.0f }, { 25.0f, 40.0f } };
+
+// the camera is stopped this far above the terrain rather than flying into it
+const float    CameraClearance = 0.5f;
+
+// the camera kicks up a puff of powder every PuffSpacing it moves this close to the ground
+const float    PuffHeight  = 2.0f;
+const float    PuffSpacing = 1.0f;
+D3DXVECTOR3    LastPuff(0.0f, 0.0f, 0.0f);
+
+// -record <file> records the snow and the camera, -replay <file> plays it back
+std::string    RecordFile;
+std::string    ReplayFile;
+psys::Recorder TheRecorder;
+psys::Replayer TheReplayer;
+psys::Replay*  Playback = 0;
+
+// -fused has the snow write its vertices during update, see ParticleSim::setFusedPacking
+bool           FusedPacking = false;
+
+Camera TheCamera(Camera::AIRCRAFT);
+
+// The simulation runs at a fixed tick while frames are drawn as often as they
+// can be, with the camera blended between its poses of the last two ticks.
+const float      TicksPerSecond = 60.0f;
+psys::CameraPose LastTickPose;
+Camera           ViewCamera(Camera::AIRCRAFT); // the blended camera drawn from
+
+bool   IsOrbiting = false;  // is the camera orbiting
+
+HWND   HWnd       = NULL;
+bool   IsMousing  = false;  // are we using mouse to control
+
+bool DisplayBasicScene(IDirect3DDevice9* device);
+
+void ParseCommandLine(const char* cmdLine)
+{
+	std::istringstream args(cmdLine);
+	std::string arg;
+	while( args >> arg )
+	{
+		if( arg == "-record" )
+			args >> RecordFile;
+		else if( arg == "-replay" )
+			args >> ReplayFile;
+		else if( arg == "-fused" )
+			FusedPacking = true;
+	}
+}
+
+psys::CameraPose GetCameraPose()
+{
+	D3DXVECTOR3 position, right, up, look;
+	TheCamera.getPosition(&position);
+	TheCamera.getRight(&right);
+	TheCamera.getUp(&up);
+	TheCamera.getLook(&look);
+
+	psys::CameraPose pose;
+	memcpy(pose._position, &position, sizeof(pose._position));
+	memcpy(pose._right,    &right,    sizeof(pose._right));
+	memcpy(pose._up,       &up,       sizeof(pose._up));
+	memcpy(pose._look,     &look,     sizeof(pose._look));
+	return pose;
+}
+
+void SetCameraPose(Camera* camera, const psys::CameraPose& pose)
+{
+	D3DXVECTOR3 position(pose._position), right(pose._right), up(pose._up), look(pose._look);
+	camera->setPosition(&position);
+	camera->setRight(&right);
+	camera->setUp(&up);
+	camera->setLook(&look);
+}
+
+// pose a of the way from a to b; the axes are made orthogonal again by getViewMatrix
+psys::CameraPose BlendCameraPose(const psys::CameraPose& from, const psys::CameraPose& to, float a)
+{
+	psys::CameraPose pose;
+	for(int i = 0; i < 3; i++)
+	{
+		pose._position[i] = from._position[i] + (to._position[i] - from._position[i]) * a;
+		pose._right[i]    = from._right[i]    + (to._right[i]    - from._right[i])    * a;
+		pose._up[i]       = from._up[i]       + (to._up[i]       - from._up[i])       * a;
+		pose._look[i]     = from._look[i]     + (to._look[i]     - from._look[i])     * a;
+	}
+	return pose;
+}
+
+//
+// Framework Functions
+//
+bool Setup()
+{
+	// seed random number generator
+	rng::SetSeed((unsigned long long)time(0));
+
+	Jobs      = new JobPool();
+	Particles = new psys::ParticleWorld();
+	Particles->setJobPool(Jobs);
+	if( !Particles->init(Device) )
+		return false;
+
+	//
+	// Create Snow System.
+	//
+
+	d3d::BoundingBox boundingBox;
+	boundingBox._min = D3DXVECTOR3(-50.0f, -20.0f, -50.0f);
+	boundingBox._max = D3DXVECTOR3( 50.0f,  50.0f,  50.0f);
+	psys::Snow* snow = 0;
+
+	// a replay draws with the live snow's setup, so that it costs the same to render
+	psys::RenderSetup setup = psys::Snow::defaultSetup();
+	setup._sorting      = true; // back to front, for the blending
+	setup._fusedPacking = FusedPacking;
+
+	if( !ReplayFile.empty() )
+	{
+		// play a recording back instead of simulating
+		if( !TheReplayer.open(ReplayFile.c_str()) )
+		{
+			::MessageBox(0, "Replayer::open() - FAILED", 0, 0);
+			return false;
+		}
+		Playback = new psys::Replay(&TheReplayer, 0.25f);
+		Playback->setRenderSetup(setup);
+		Sno = Playback;
+
+		if( !Particles->add(Playback, "snowflake.dds") )
+			return false;
+	}
+	else
+	{
+		snow = new psys::Snow(&boundingBox, 6000);
+		snow->setRenderSetup(setup);
+		Sno = snow;
+
+		//
+		// Create the wind, a coarse grid over the snow's box.
+		//
+
+		float windBase[3] = { -1.5f, 0.0f, 0.0f }; // slightly to the left, as the flakes used to fall
+		TheWind.setWind(windBase, 4.0f, 40.0f, 0.5f);
+		TheWind.setSeed(rng::ThreadRandom().next());
+		TheWind.init(boundingBox._min, boundingBox._max, 16, 8, 16);
+		snow->setWind(&TheWind);
+
+		// drawn by the world, along with the systems sharing its texture
+		if( !Particles->add(snow, "snowflake.dds") )
+			return false;
+	}
+
+	if( !RecordFile.empty() && !TheRecorder.open(RecordFile.c_str()) )
+	{
+		::MessageBox(0, "Recorder::open() - FAILED", 0, 0);
+		return false;
+	}
+
+	//
+	// Create basic scene.
+	//
+	DisplayBasicScene(Device);
+
+	// let the snow settle on the terrain
+	if( snow )
+		snow->setTerrain(TheTerrain, TerrainHeightOffset, FlakeDepth);
+
+	// the smoke shares the flake texture, so it is drawn along with the snow
+	for(int i = 0; i < (int)(sizeof(Chimneys) / sizeof(Chimneys[0])); i++)
+	{
+		float x = Chimneys[i][0], z = Chimneys[i][1];
+		D3DXVECTOR3 top(x, TheTerrain->getHeight(x, z) + TerrainHeightOffset + 3.0f, z);
+		if( !Particles->add(new psys::Smoke(&top, 300), "snowflake.dds") )
+			return false;
+	}
+
+	//
+	// Set projection matrix.
+	//
+	D3DXMATRIX proj;
+	D3DXMatrixPerspectiveFovLH(
+			&proj,
+			D3DX_PI / 4.0f, // 45 - degree
+			(float)Width / (float)Height,
+			1.0f,
+			5000.0f);
+	Device->SetTransform(D3DTS_PROJECTION, &proj);
+
+	LastTickPose = GetCameraPose();
+
+	return true;
+}
+
+void HandleKeyboardInput(float timeDelta) {
+
+	if (!IsOrbiting) {
+		if (::GetAsyncKeyState('W') & 0x8000f)
+			TheCamera.walk(4.0f * timeDelta);
+
+		if (::GetAsyncKeyState('S') & 0x8000f)
+			TheCamera.walk(-4.0f * timeDelta);
+
+		if (::GetAsyncKeyState('A') & 0x8000f)
+			TheCamera.strafe(-4.0f * timeDelta);
+
+		if (::GetAsyncKeyState('D') & 0x8000f)
+			TheCamera.strafe(4.0f * timeDelta);
+
+		if (::GetAsyncKeyState('R') & 0x8000f)
+			TheCamera.fly(4.0f * timeDelta);
+
+		if (::GetAsyncKeyState('F') & 0x8000f)
+			TheCamera.fly(-4.0f * timeDelta);
+	}
+
+	if (::GetAsyncKeyState('X') & 0x8000f) // free the camera
+		IsOrbiting = false;
+
+	if (::GetAsyncKeyState(VK_UP) & 0x8000f)
+		TheCamera.pitch(1.0f * timeDelta);
+
+	if (::GetAsyncKeyState(VK_DOWN) & 0x8000f)
+		TheCamera.pitch(-1.0f * timeDelta);
+
+	if (::GetAsyncKeyState(VK_LEFT) & 0x8000f)
+		TheCamera.yaw(-1.0f * timeDelta);
+
+	if (::GetAsyncKeyState(VK_RIGHT) & 0x8000f)
+		TheCamera.yaw(1.0f * timeDelta);
+}
+
+void HandleMouseInput() {
+
+	static POINT lastMousePosition;
+
+	POINT currMousePosition;
+
+	GetCursorPos(&currMousePosition);
+	ScreenToClient(HWnd, &currMousePosition);
+
+	if (IsMousing)
+	{
+		int nXDiff = (currMousePosition.x - lastMousePosition.x);
+		int nYDiff = (currMousePosition.y - lastMousePosition.y);
+
+		D3DXVECTOR3 vRight, vLook, vUp;
+		TheCamera.getRight(&vRight), TheCamera.getLook(&vLook), TheCamera.getUp(&vUp);
+
+		D3DXMATRIX matRotation;
+
+		if (nYDiff != 0)
+		{
+			D3DXMatrixRotationAxis(&matRotation, &vRight, D3DXToRadian((float)nYDiff / 3.0f));
+			D3DXVec3TransformCoord(&vLook, &vLook, &matRotation);
+			D3DXVec3TransformCoord(&vUp, &vUp, &matRotation);
+		}
+
+		if (nXDiff != 0)
+		{
+			D3DXMatrixRotationAxis(&matRotation, &D3DXVECTOR3(0, 1, 0), D3DXToRadian((float)nXDiff / 3.0f));
+			D3DXVec3TransformCoord(&vLook, &vLook, &matRotation);
+			D3DXVec3TransformCoord(&vUp, &vUp, &matRotation);
+		}
+
+		TheCamera.setRight(&vRight), TheCamera.setLook(&vLook), TheCamera.setUp(&vUp);
+	}
+
+	lastMousePosition = currMousePosition;
+}
+
+// stops the camera's move from *from where it comes within CameraClearance
+// of the terrain, however far it moved
+void CollideCamera(const D3DXVECTOR3* from)
+{
+	D3DXVECTOR3 to;
+	TheCamera.getPosition(&to);
+
+	// in terrain space, the camera lowered by the clearance
+	D3DXVECTOR3 origin(from->x, from->y - TerrainHeightOffset - CameraClearance, from->z);
+	D3DXVECTOR3 move = to - *from;
+
+	float t;
+	if( TheTerrain->intersect(&origin, &move, 1.0f, &t) )
+	{
+		// a little above where it would touch, to move on along level ground
+		D3DXVECTOR3 stop = *from + move * t;
+		stop.y += 0.05f;
+		TheCamera.setPosition(&stop);
+	}
+}
+
+void HandleRealTimeUserInput(float timeDelta)
+{
+	D3DXVECTOR3 from;
+	TheCamera.getPosition(&from);
+
+	//
+	// Handle mouse input...
+	//
+	HandleMouseInput();
+
+	//
+	// Handle keyboard input...
+	//
+	HandleKeyboardInput(timeDelta);
+
+	CollideCamera(&from);
+}
+
+bool DrawSkybox(IDirect3DDevice9* device, Camera* camera) 
+{
+	static Cube skybox(device, "skybox.config", Cube::TEXTYPE_INTERNAL);
+	const float skyboxScale = 200.0f;
+	const float yOffsetToCamera = 0.0f;
+
+	device->SetRenderState(D3DRS_LIGHTING, FALSE);
+	device->LightEnable(0, false);
+
+	D3DXMATRIX P, T, S;
+	D3DXMatrixScaling(&S, skyboxScale, skyboxScale, skyboxScale);
+	D3DXVECTOR3 cameraPosition;
+	camera->getPosition(&cameraPosition);
+	D3DXMatrixTranslation(&T, 
+		cameraPosition.x, cameraPosition.y + yOffsetToCamera, cameraPosition.z);
+	P = S * T;
+	skybox.draw(&P, &d3d::WHITE_MTRL);
+
+	return true;
+}
+
+//
+// Drawing Basic Scene
+//
+// Pass 0 to device for cleanup
+//
+bool DisplayBasicScene(IDirect3DDevice9* device)
+{
+	static bool                    isCreated = false;
+	static Snowman*                snowman = 0;
+	static Cube*                   crate = 0;
+
+	static D3DXVECTOR3             lightDirection(-0.5f, -0.5f, -1.0f);
+	static D3DXCOLOR               lightColor(1.0f, 1.0f, 1.0f, 1.0f);
+	static D3DLIGHT9               light = d3d::InitDirectionalLight(&lightDirection, &lightColor);
+
+	if (device == 0) 
+	{
+		d3d::Delete<Snowman*>(snowman);
+		d3d::Delete<Cube*>(crate);
+		d3d::Delete<Terrain*>(TheTerrain);
+	}
+	else if (!isCreated)
+	{
+		snowman = new Snowman(device);
+		crate = new Cube(device, "crate.config", Cube::TEXTYPE_BOTH_SIDES);
+
+		TheTerrain = new Terrain(device, "castlehm257.raw", 20, 20, 10, 0.05f);
+		TheTerrain->setJobPool(Jobs);
+		//D3DXVECTOR3 L = -lightDirection;
+		D3DXVECTOR3 L(0.5f, 1.0f, 0.5f);
+		TheTerrain->genTexture(&L);
+
+		isCreated = true;
+	}
+	else
+	{
+		//
+		// Pre-Render Setup
+		//
+		device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+		device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+		device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_POINT);
+
+		device->SetLight(0, &light);
+		device->LightEnable(0, true);
+		device->SetRenderState(D3DRS_LIGHTING, TRUE);
+		device->SetRenderState(D3DRS_NORMALIZENORMALS, true);
+		device->SetRenderState(D3DRS_SPECULARENABLE, true);
+
+		//
+		// Render
+		//
+
+		D3DXMATRIX P, R, T, S, C;
+
+		// draw terrain
+		D3DXMatrixTranslation(&T, 0.0f, TerrainHeightOffset, 0.0f);
+		TheTerrain->draw(&T, false);
+
+		// draw crates and snowmen
+		D3DXMatrixTranslation(&C, 0.0f, 0.0f, 15.0f);
+
+		D3DXMatrixTranslation(&T, 0.0f, -2.0f, 0.0f);
+		P = T * C;
+		snowman->draw(&P);  // draw the 1st snowman
+
+		static float fDegree = 0.0f;
+		fDegree += 0.001f;
+		if (fDegree > 2.0f * D3DX_PI) fDegree = 0.0f;
+
+		D3DXMatrixTranslation(&T, 10.0f, -1.0f, 0.0f);
+		D3DXMatrixRotationY(&R, fDegree);
+		P = T * R * C;
+		crate->draw(&P, &d3d::WHITE_MTRL);
+
+		// collision detection
+		d3d::BoundingBox crateBox = crate->getBoundingBox();
+		D3DXVECTOR3 cameraPosition;
+		TheCamera.getPosition(&cameraPosition);
+		D3DXMATRIX X;
+		D3DXMatrixInverse(&X, 0, &P);
+		D3DXVec3TransformCoord(&cameraPosition, &cameraPosition, &X);
+		if (crateBox.isPointInside(cameraPosition)) 
+			IsOrbiting = true;
+
+		if (IsOrbiting) { 
+			// the camera orbits the 1st snowman
+			D3DXMatrixTranslation(&T, 0.0f, 2.0f, 0.0f);
+			D3DXVECTOR3 newPosition(0.0f, 0.0f, 0.0f);
+			P = P * T;
+			D3DXVec3TransformCoord(&newPosition, &newPosition, &P);
+			TheCamera.setPosition(&newPosition);
+		}
+
+		D3DXMatrixScaling(&S, 0.6, 0.6, 0.6);
+		D3DXMatrixTranslation(&T, 10.0f, 0.0f, 0.0f);
+		P = S * T * R * C;
+		snowman->draw(&P);  // draw the 2nd snowman	
+	}
+	return true;
+}
+
+void Cleanup()
+{
+	TheRecorder.close();
+	d3d::Delete<psys::ParticleWorld*>(Particles); // before the terrain it snows on
+	d3d::Delete<JobPool*>(Jobs);
+	DisplayBasicScene(0);
+}
+
+// a camera skimming the ground kicks up the powder behind it
+void KickUpPowder()
+{
+	D3DXVECTOR3 position;
+	TheCamera.getPosition(&position);
+
+	float ground = TheTerrain->getHeight(position.x, position.z) + TerrainHeightOffset;
+	if( position.y - ground > PuffHeight )
+		return;
+
+	D3DXVECTOR3 moved = position - LastPuff;
+	if( D3DXVec3Length(&moved) < PuffSpacing )
+		return;
+
+	LastPuff = position;
+
+	D3DXVECTOR3 origin(position.x, ground, position.z);
+	Particles->add(new psys::Puff(&origin, 200), "snowflake.dds", true);
+}
+
+bool Update(float timeDelta)
+{
+	if( Device )
+	{
+		LastTickPose = GetCameraPose();
+
+		HandleRealTimeUserInput(timeDelta); 
+
+		KickUpPowder();
+
+		TheWind.update(timeDelta);
+		Particles->update(timeDelta); // the snow, the smoke and the puffs, in one batch
+
+		// a replay moves the camera the way it moved when recorded
+		if( Playback )
+			SetCameraPose(&TheCamera, Playback->getPose());
+
+		if( TheRecorder.isOpen() )
+			TheRecorder.writeFrame(Sno->getParticles(), GetCameraPose(), timeDelta);
+	}
+	return true;
+}
+
+// puts the frame time percentiles in the window's title about once a second
+void ShowFrameTimes()
+{
+	timing::FrameHistogram& frameTimes = d3d::GetFrameTimes();
+	if( frameTimes.getTotalNs() < 1000000000LL )
+		return;
+
+	char title[128];
+	sprintf(title, "Snow System - frame p50 %.2f ms, p99 %.2f ms, max %.2f ms",
+		frameTimes.percentile(0.50) * 1e-6,
+		frameTimes.percentile(0.99) * 1e-6,
+		frameTimes.getMaxNs() * 1e-6);
+	::SetWindowText(HWnd, title);
+
+	frameTimes.reset();
+}
+
+bool Display(float alpha)
+{
+	if( Device )
+	{
+		// draw from between the last two ticks, by alpha
+		SetCameraPose(&ViewCamera, BlendCameraPose(LastTickPose, GetCameraPose(), alpha));
+
+		D3DXMATRIX V;
+		ViewCamera.getViewMatrix(&V);
+		Device->SetTransform(D3DTS_VIEW, &V);
+
+		//
+		// Draw the scene:
+		//
+		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00000000, 1.0f, 0);
+		Device->BeginScene();
+
+		DrawSkybox(Device, &ViewCamera);
+
+		DisplayBasicScene(Device);
+
+		// order important, render particles last.
+		D3DXMATRIX I;  D3DXMatrixIdentity(&I);
+		Device->SetTransform(D3DTS_WORLD, &I);
+		Particles->render();
+
+		Device->EndScene();
+		Device->Present(0, 0, 0, 0);
+
+		ShowFrameTimes();
+	}
+	return true;
+}
+
+//
+// WndProc
+//
+LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+	switch( msg )
+	{
+	case WM_DESTROY:
+		::PostQuitMessage(0);
+		break;
+		
+	case WM_KEYDOWN:
+		if( wParam == VK_ESCAPE )
+			::DestroyWindow(hwnd);
+		break;
+
+	case WM_LBUTTONDOWN:
+		IsMousing = true;
+		break;
+	case WM_LBUTTONUP:
+		IsMousing = false;
+		break;
+	}
+		   
+	return ::DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+//
+// WinMain
+//
+int WINAPI WinMain(HINSTANCE hinstance,
+				   HINSTANCE prevInstance, 
+				   PSTR cmdLine,
+				   int showCmd)
+{
+	ParseCommandLine(cmdLine);
+
+	HWnd = d3d::InitD3D(hinstance,
+		Width, Height, true, D3DDEVTYPE_HAL, &Device);
+
+	if (!HWnd)
+	{
+		::MessageBox(0, "InitD3D() - FAILED", 0, 0);
+		return 0;
+	}
+		
+	if(!Setup())
+	{
+		::MessageBox(0, "Setup() - FAILED", 0, 0);
+		return 0;
+	}
+
+	d3d::EnterMsgLoop( Update, Display, TicksPerSecond );
+
+	Cleanup();
+
+	Device->Release();
+
+	return 0;
+}
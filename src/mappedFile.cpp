@@ -0,0 +1,141 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mappedFile.cpp
+//
+// Author: William Cheung
+//
+// Desc: A read-only view of a whole file mapped into memory.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	_data = 0;
+	_size = 0;
+#ifdef _WIN32
+	_file    = INVALID_HANDLE_VALUE;
+	_mapping = 0;
+#else
+	_fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path, Access access)
+{
+	close();
+
+	_file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		access == ACCESS_RANDOM ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if( _file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !::GetFileSizeEx(_file, &size) )
+	{
+		close();
+		return false;
+	}
+
+	// nothing to map, but the file is there
+	if( size.QuadPart == 0 )
+		return true;
+
+	_mapping = ::CreateFileMappingA(_file, 0, PAGE_READONLY, 0, 0, 0);
+	if( !_mapping )
+	{
+		close();
+		return false;
+	}
+
+	_data = (const unsigned char*)::MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	if( !_data )
+	{
+		close();
+		return false;
+	}
+
+	_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( _data )
+		::UnmapViewOfFile(_data);
+	if( _mapping )
+		::CloseHandle(_mapping);
+	if( _file != INVALID_HANDLE_VALUE )
+		::CloseHandle(_file);
+
+	_data    = 0;
+	_size    = 0;
+	_mapping = 0;
+	_file    = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const char* path, Access access)
+{
+	close();
+
+	_fd = ::open(path, O_RDONLY);
+	if( _fd < 0 )
+		return false;
+
+	struct stat info;
+	if( ::fstat(_fd, &info) != 0 )
+	{
+		close();
+		return false;
+	}
+
+	// nothing to map, but the file is there
+	if( info.st_size == 0 )
+		return true;
+
+	void* p = ::mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if( p == MAP_FAILED )
+	{
+		close();
+		return false;
+	}
+
+	_data = (const unsigned char*)p;
+	_size = (size_t)info.st_size;
+
+	::madvise(p, _size, access == ACCESS_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( _data )
+		::munmap((void*)_data, _size);
+	if( _fd >= 0 )
+		::close(_fd);
+
+	_data = 0;
+	_size = 0;
+	_fd   = -1;
+}
+
+#endif
@@ -0,0 +1,51 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mappedFile.h
+//
+// Author: William Cheung
+//
+// Desc: A read-only view of a whole file mapped into memory, so that large files can
+//       be read in place and paged in by the OS as they are touched.  Uses file
+//       mappings on Windows and mmap elsewhere.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __mappedFileH__
+#define __mappedFileH__
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	// how the file will be read, for the OS to read ahead or not
+	enum Access { ACCESS_SEQUENTIAL, ACCESS_RANDOM };
+
+	MappedFile();
+	~MappedFile();
+
+	// Desc: Maps the file at path, closing any file mapped before.  Returns false if
+	//       it can not be opened or mapped; an empty file maps to no data.
+	bool open(const char* path, Access access = ACCESS_SEQUENTIAL);
+	void close();
+
+	bool                 isOpen() const { return _data != 0; }
+	const unsigned char* data() const   { return _data; }
+	size_t               size() const   { return _size; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char* _data;
+	size_t               _size;
+
+#ifdef _WIN32
+	void* _file;     // HANDLE of the file
+	void* _mapping;  // HANDLE of the file mapping
+#else
+	int   _fd;
+#endif
+};
+
+#endif // __mappedFileH__
@@ -1,336 +1,628 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: pSystem.cpp
-// 
-// Author: Frank Luna (C) All Rights Reserved
-//
-// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
-//
-// Desc: Represents a geneal particle system.
-//          
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#include <cstdlib>
-#include "pSystem.h"
-
-using namespace psys;
-
-const DWORD Particle::FVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
-
-PSystem::PSystem()
-{
-	_device = 0;
-	_vb     = 0;
-	_tex    = 0;
-}
-
-PSystem::~PSystem()
-{
-	d3d::Release<IDirect3DVertexBuffer9*>(_vb);
-	d3d::Release<IDirect3DTexture9*>(_tex);
-}
-
-bool PSystem::init(IDirect3DDevice9* device, char* texFileName)
-{
-	// vertex buffer's size does not equal the number of particles in our system.  We
-	// use the vertex buffer to draw a portion of our particles at a time.  The arbitrary
-	// size we choose for the vertex buffer is specified by the _vbSize variable.
-
-	_device = device; // save a ptr to the device
-
-	HRESULT hr = 0;
-
-	hr = device->CreateVertexBuffer(
-		_vbSize * sizeof(Particle),
-		D3DUSAGE_DYNAMIC | D3DUSAGE_POINTS | D3DUSAGE_WRITEONLY,
-		Particle::FVF,
-		D3DPOOL_DEFAULT, // D3DPOOL_MANAGED can't be used with D3DUSAGE_DYNAMIC 
-		&_vb,
-		0);
-	
-	if(FAILED(hr))
-	{
-		::MessageBox(0, "CreateVertexBuffer() - FAILED", "PSystem", 0);
-		return false;
-	}
-
-	hr = D3DXCreateTextureFromFile(
-		device,
-		texFileName,
-		&_tex);
-
-	if(FAILED(hr))
-	{
-		::MessageBox(0, "D3DXCreateTextureFromFile() - FAILED", "PSystem", 0);
-		return false;
-	}
-
-	return true;
-}
-
-void PSystem::reset()
-{
-	std::list<Attribute>::iterator i;
-	for(i = _particles.begin(); i != _particles.end(); i++)
-	{
-		resetParticle( &(*i) );
-	}
-}
-
-void PSystem::addParticle()
-{
-	Attribute attribute;
-
-	resetParticle(&attribute);
-
-	_particles.push_back(attribute);
-}
-
-void PSystem::preRender()
-{
-	_device->SetRenderState(D3DRS_LIGHTING, false);
-	_device->SetRenderState(D3DRS_POINTSPRITEENABLE, true);
-	_device->SetRenderState(D3DRS_POINTSCALEENABLE, true); 
-	_device->SetRenderState(D3DRS_POINTSIZE, d3d::FtoDw(_size));
-	_device->SetRenderState(D3DRS_POINTSIZE_MIN, d3d::FtoDw(0.0f));
-
-	// control the size of the particle relative to distance
-	_device->SetRenderState(D3DRS_POINTSCALE_A, d3d::FtoDw(0.0f));
-	_device->SetRenderState(D3DRS_POINTSCALE_B, d3d::FtoDw(0.0f));
-	_device->SetRenderState(D3DRS_POINTSCALE_C, d3d::FtoDw(1.0f));
-		
-	// use alpha from texture
-	_device->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
-	_device->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
-
-	_device->SetRenderState(D3DRS_ALPHABLENDENABLE, true);
-	_device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
-    _device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
-}
-
-void PSystem::postRender()
-{
-	_device->SetRenderState(D3DRS_LIGHTING,          true);
-	_device->SetRenderState(D3DRS_POINTSPRITEENABLE, false);
-	_device->SetRenderState(D3DRS_POINTSCALEENABLE,  false);
-	_device->SetRenderState(D3DRS_ALPHABLENDENABLE,  false);
-}
-
-void PSystem::render()
-{
-	//
-	// Remarks:  The render method works by filling a section of the vertex buffer with data,
-	//           then we render that section.  While that section is rendering we lock a new
-	//           section and begin to fill that section.  Once that sections filled we render it.
-	//           This process continues until all the particles have been drawn.  The benifit
-	//           of this method is that we keep the video card and the CPU busy.  
-
-	if( !_particles.empty() )
-	{
-		//
-		// set render states
-		//
-
-		preRender();
-		
-		_device->SetTexture(0, _tex);
-		_device->SetFVF(Particle::FVF);
-		_device->SetStreamSource(0, _vb, 0, sizeof(Particle));
-
-		//
-		// render batches one by one
-		//
-
-		// start at beginning if we're at the end of the vb
-		if(_vbOffset >= _vbSize)
-			_vbOffset = 0;
-
-		Particle* v = 0;
-
-		_vb->Lock(
-			_vbOffset    * sizeof( Particle ),
-			_vbBatchSize * sizeof( Particle ),
-			(void**)&v,
-			_vbOffset ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD);
-
-		DWORD numParticlesInBatch = 0;
-
-		//
-		// Until all particles have been rendered.
-		//
-		std::list<Attribute>::iterator i;
-		for(i = _particles.begin(); i != _particles.end(); i++)
-		{
-			if( i->_isAlive )
-			{
-				//
-				// Copy a batch of the living particles to the
-				// next vertex buffer segment
-				//
-				v->_position = i->_position;
-				v->_color    = (D3DCOLOR)i->_color;
-				v++; // next element;
-
-				numParticlesInBatch++; //increase batch counter
-
-				// if this batch full?
-				if(numParticlesInBatch == _vbBatchSize) 
-				{
-					//
-					// Draw the last batch of particles that was
-					// copied to the vertex buffer. 
-					//
-					_vb->Unlock();
-
-					_device->DrawPrimitive(
-						D3DPT_POINTLIST,
-						_vbOffset,
-						_vbBatchSize);
-
-					//
-					// While that batch is drawing, start filling the
-					// next batch with particles.
-					//
-
-					// move the offset to the start of the next batch
-					_vbOffset += _vbBatchSize; 
-
-					// don't offset into memory thats outside the vb's range.
-					// If we're at the end, start at the beginning.
-					if(_vbOffset >= _vbSize) 
-						_vbOffset = 0;       
-
-					_vb->Lock(
-						_vbOffset    * sizeof( Particle ),
-						_vbBatchSize * sizeof( Particle ),
-						(void**)&v,
-						_vbOffset ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD);
-
-					numParticlesInBatch = 0; // reset for new batch
-				}	
-			}
-		}
-
-		_vb->Unlock();
-
-		// its possible that the LAST batch being filled never 
-		// got rendered because the condition 
-		// (numParticlesInBatch == _vbBatchSize) would not have
-		// been satisfied.  We draw the last partially filled batch now.
-		
-		if( numParticlesInBatch )
-		{
-			_device->DrawPrimitive(
-				D3DPT_POINTLIST,
-				_vbOffset,
-				numParticlesInBatch);
-		}
-
-		// next block
-		_vbOffset += _vbBatchSize; 
-
-		//
-		// reset render states
-		//
-
-		postRender();
-	}
-}
-
-bool PSystem::isEmpty()
-{
-	return _particles.empty();
-}
-
-bool PSystem::isDead()
-{
-	std::list<Attribute>::iterator i;
-	for(i = _particles.begin(); i != _particles.end(); i++)
-	{
-		// is there at least one living particle?  If yes,
-		// the system is not dead.
-		if( i->_isAlive )
-			return false;
-	}
-	// no living particles found, the system must be dead.
-	return true;
-}
-
-void PSystem::removeDeadParticles()
-{
-	std::list<Attribute>::iterator i;
-
-	i = _particles.begin();
-
-	while( i != _particles.end() )
-	{
-		if( i->_isAlive == false )
-		{
-			// erase returns the next iterator, so no need to
-		    // incrememnt to the next one ourselves.
-			i = _particles.erase(i); 
-		}
-		else
-		{
-			i++; // next in list
-		}
-	}
-}
-
-//*****************************************************************************
-// Snow System
-//***************
-
-Snow::Snow(d3d::BoundingBox* boundingBox, int numParticles)
-{
-	_boundingBox   = *boundingBox;
-	_size          = 0.25f;
-	_vbSize        = 2048;
-	_vbOffset      = 0; 
-	_vbBatchSize   = 512; 
-	
-	for(int i = 0; i < numParticles; i++)
-		addParticle();
-}
-
-void Snow::resetParticle(Attribute* attribute)
-{
-	attribute->_isAlive  = true;
-
-	// get random x, z coordinate for the position of the snow flake.
-	d3d::GetRandomVector(
-		&attribute->_position,
-		&_boundingBox._min,
-		&_boundingBox._max);
-
-	// no randomness for height (y-coordinate).  Snow flake
-	// always starts at the top of bounding box.
-	attribute->_position.y = _boundingBox._max.y; 
-
-	// snow flakes fall downwards and slightly to the left
-	attribute->_velocity.x = d3d::GetRandomFloat(0.0f, 1.0f) * -3.0f;
-	attribute->_velocity.y = d3d::GetRandomFloat(0.0f, 1.0f) * -10.0f;
-	attribute->_velocity.z = 0.0f;
-
-	// white snow flake
-	attribute->_color = d3d::WHITE;
-}
-
-void Snow::update(float timeDelta)
-{
-	std::list<Attribute>::iterator i;
-	for(i = _particles.begin(); i != _particles.end(); i++)
-	{
-		i->_position += i->_velocity * timeDelta;
-
-		// is the point outside bounds?
-		if( _boundingBox.isPointInside( i->_position ) == false ) 
-		{
-			// nope so kill it, but we want to recycle dead 
-			// particles, so respawn it instead.
-			resetParticle( &(*i) );
-		}
-	}
-}
-
-
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: pSystem.cpp
+// 
+// Author: Frank Luna (C) All Rights Reserved
+//
+// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
+//
+// Desc: Represents a geneal particle system.
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include "pSystem.h"
+#include "terrain.h"
+
+using namespace psys;
+
+const DWORD Particle::FVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+// PackParticles writes straight into Particle vertices
+static_assert(sizeof(Particle) == sizeof(PackedParticle), "Particle layout mismatch");
+
+//*****************************************************************************
+// Vertex Stream
+//***************
+
+VertexStream::VertexStream()
+{
+	_device       = 0;
+	_vb           = 0;
+	_size         = 0;
+	_offset       = 0;
+	_batchSize    = 0;
+	_numDrawCalls = 0;
+}
+
+VertexStream::~VertexStream()
+{
+	d3d::Release<IDirect3DVertexBuffer9*>(_vb);
+}
+
+bool VertexStream::init(IDirect3DDevice9* device, DWORD size, DWORD batchSize)
+{
+	_device    = device;
+	_size      = size;
+	_offset    = 0;
+	_batchSize = batchSize;
+
+	d3d::Release<IDirect3DVertexBuffer9*>(_vb);
+
+	HRESULT hr = device->CreateVertexBuffer(
+		_size * sizeof(Particle),
+		D3DUSAGE_DYNAMIC | D3DUSAGE_POINTS | D3DUSAGE_WRITEONLY,
+		Particle::FVF,
+		D3DPOOL_DEFAULT, // D3DPOOL_MANAGED can't be used with D3DUSAGE_DYNAMIC 
+		&_vb,
+		0);
+	
+	if(FAILED(hr))
+	{
+		::MessageBox(0, "CreateVertexBuffer() - FAILED", "PSystem", 0);
+		return false;
+	}
+	return true;
+}
+
+int VertexStream::draw(const DrawRun* runs, int count, int* numStateChanges)
+{
+	//
+	// Remarks:  The stream works by filling a section of the vertex buffer with data,
+	//           then we render that section.  While that section is rendering we lock a new
+	//           section and begin to fill that section.  Once that sections filled we render it.
+	//           This process continues until all the particles have been drawn.  The benifit
+	//           of this method is that we keep the video card and the CPU busy.  
+	//
+	//           A batch is drawn with one texture and point size, so a run of other
+	//           ones starts a new batch.
+
+	_numDrawCalls = 0;
+	if( numStateChanges )
+		*numStateChanges = 0;
+	if( count <= 0 || !_vb )
+		return 0;
+
+	_device->SetFVF(Particle::FVF);
+	_device->SetStreamSource(0, _vb, 0, sizeof(Particle));
+
+	// start at beginning if we're at the end of the vb
+	if(_offset >= _size)
+		_offset = 0;
+
+	Particle* v = 0;
+
+	_vb->Lock(
+		_offset    * sizeof( Particle ),
+		_batchSize * sizeof( Particle ),
+		(void**)&v,
+		_offset ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD);
+
+	DWORD              numParticlesInBatch = 0;
+	IDirect3DTexture9* batchTex            = 0;    // texture and point size of the batch
+	float              batchSize           = 0.0f;
+
+	//
+	// Until all particles have been rendered.
+	//
+	for(int i = 0; i < count; i++)
+	{
+		const DrawRun& run = runs[i];
+
+		if( i == 0 || run._tex != batchTex || run._size != batchSize )
+		{
+			if( numParticlesInBatch )
+			{
+				flushBatch(numParticlesInBatch, &v);
+				numParticlesInBatch = 0;
+			}
+
+			if( i == 0 || run._tex != batchTex )
+				_device->SetTexture(0, run._tex);
+			if( i == 0 || run._size != batchSize )
+				_device->SetRenderState(D3DRS_POINTSIZE, d3d::FtoDw(run._size));
+			if( numStateChanges )
+				(*numStateChanges)++;
+
+			batchTex  = run._tex;
+			batchSize = run._size;
+		}
+
+		const Particle* src  = (const Particle*)run._vertices;
+		DWORD           left = (DWORD)run._count;
+
+		while( left )
+		{
+			//
+			// Copy as much of the run as fits to the
+			// next vertex buffer segment
+			//
+			DWORD n = _batchSize - numParticlesInBatch;
+			if( n > left )
+				n = left;
+
+			::memcpy(v, src, n * sizeof(Particle));
+			v    += n;
+			src  += n;
+			left -= n;
+
+			numParticlesInBatch += n; //increase batch counter
+
+			// if this batch full?
+			if(numParticlesInBatch == _batchSize) 
+			{
+				flushBatch(_batchSize, &v);
+				numParticlesInBatch = 0; // reset for new batch
+			}	
+		}
+	}
+
+	_vb->Unlock();
+
+	// its possible that the LAST batch being filled never 
+	// got rendered because the condition 
+	// (numParticlesInBatch == _batchSize) would not have
+	// been satisfied.  We draw the last partially filled batch now.
+	
+	if( numParticlesInBatch )
+	{
+		_device->DrawPrimitive(
+			D3DPT_POINTLIST,
+			_offset,
+			numParticlesInBatch);
+		_numDrawCalls++;
+	}
+
+	// next block
+	_offset += _batchSize; 
+
+	return _numDrawCalls;
+}
+
+void VertexStream::flushBatch(DWORD count, Particle** v)
+{
+	//
+	// Draw the last batch of particles that was
+	// copied to the vertex buffer. 
+	//
+	_vb->Unlock();
+
+	_device->DrawPrimitive(
+		D3DPT_POINTLIST,
+		_offset,
+		count);
+	_numDrawCalls++;
+
+	//
+	// While that batch is drawing, start filling the
+	// next batch with particles.
+	//
+
+	// move the offset to the start of the next batch
+	_offset += _batchSize; 
+
+	// don't offset into memory thats outside the vb's range.
+	// If we're at the end, start at the beginning.
+	if(_offset >= _size) 
+		_offset = 0;       
+
+	_vb->Lock(
+		_offset    * sizeof( Particle ),
+		_batchSize * sizeof( Particle ),
+		(void**)v,
+		_offset ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD);
+}
+
+//*****************************************************************************
+// Particle System
+//***************
+
+PSystem::PSystem()
+{
+	_device      = 0;
+	_tex         = 0;
+	_vbSize      = 0;
+	_vbBatchSize = 0;
+}
+
+PSystem::~PSystem()
+{
+	d3d::Release<IDirect3DTexture9*>(_tex);
+}
+
+bool PSystem::init(IDirect3DDevice9* device, char* texFileName)
+{
+	IDirect3DTexture9* tex = 0;
+
+	HRESULT hr = D3DXCreateTextureFromFile(
+		device,
+		texFileName,
+		&tex);
+
+	if(FAILED(hr))
+	{
+		::MessageBox(0, "D3DXCreateTextureFromFile() - FAILED", "PSystem", 0);
+		return false;
+	}
+
+	bool ok = init(device, tex);
+	tex->Release(); // init holds its own reference
+	return ok;
+}
+
+bool PSystem::init(IDirect3DDevice9* device, IDirect3DTexture9* tex, bool ownStream)
+{
+	// vertex buffer's size does not equal the number of particles in our system.  We
+	// use the vertex buffer to draw a portion of our particles at a time.  The arbitrary
+	// size we choose for the vertex buffer is specified by the _vbSize variable.
+
+	_device = device; // save a ptr to the device
+
+	d3d::Release<IDirect3DTexture9*>(_tex);
+	_tex = tex;
+	_tex->AddRef();
+
+	if( !ownStream )
+		return true;
+
+	return _stream.init(device, _vbSize, _vbBatchSize);
+}
+
+void PSystem::reset()
+{
+	for(int i = 0; i < _particles.size(); i++)
+	{
+		Attribute attribute;
+		resetParticle(&attribute, _random);
+		writeParticle(i, attribute);
+	}
+}
+
+void PSystem::addParticle()
+{
+	// the store is sized by _maxParticles; a full system drops the particle.
+	int i = _particles.add();
+	if( i < 0 )
+		return;
+
+	Attribute attribute;
+
+	resetParticle(&attribute, _random);
+
+	writeParticle(i, attribute);
+}
+
+void PSystem::respawnParticles(const int* indices, int count, rng::Random& random)
+{
+	for(int k = 0; k < count; k++)
+	{
+		Attribute attribute;
+		resetParticle(&attribute, random);
+		writeParticle(indices[k], attribute);
+	}
+}
+
+void PSystem::writeParticle(int i, const Attribute& attribute)
+{
+	_particles._posX[i]     = attribute._position.x;
+	_particles._posY[i]     = attribute._position.y;
+	_particles._posZ[i]     = attribute._position.z;
+	_particles._velX[i]     = attribute._velocity.x;
+	_particles._velY[i]     = attribute._velocity.y;
+	_particles._velZ[i]     = attribute._velocity.z;
+	_particles._color[i]    = (D3DCOLOR)attribute._color;
+	_particles._age[i]      = attribute._age;
+	_particles._lifeTime[i] = attribute._lifeTime;
+
+	if( _particles.isPacked() )
+		repackParticles(i, i + 1);
+}
+
+void PSystem::readParticle(int i, Attribute* attribute)
+{
+	attribute->_position = D3DXVECTOR3(_particles._posX[i], _particles._posY[i], _particles._posZ[i]);
+	attribute->_velocity = D3DXVECTOR3(_particles._velX[i], _particles._velY[i], _particles._velZ[i]);
+	attribute->_color    = D3DXCOLOR((D3DCOLOR)_particles._color[i]);
+	attribute->_age      = _particles._age[i];
+	attribute->_lifeTime = _particles._lifeTime[i];
+}
+
+void PSystem::preRender()
+{
+	setPointStates(_device, _size);
+}
+
+void PSystem::postRender()
+{
+	resetPointStates(_device);
+}
+
+void PSystem::setPointStates(IDirect3DDevice9* device, float size)
+{
+	device->SetRenderState(D3DRS_LIGHTING, false);
+	device->SetRenderState(D3DRS_POINTSPRITEENABLE, true);
+	device->SetRenderState(D3DRS_POINTSCALEENABLE, true); 
+	device->SetRenderState(D3DRS_POINTSIZE, d3d::FtoDw(size));
+	device->SetRenderState(D3DRS_POINTSIZE_MIN, d3d::FtoDw(0.0f));
+
+	// control the size of the particle relative to distance
+	device->SetRenderState(D3DRS_POINTSCALE_A, d3d::FtoDw(0.0f));
+	device->SetRenderState(D3DRS_POINTSCALE_B, d3d::FtoDw(0.0f));
+	device->SetRenderState(D3DRS_POINTSCALE_C, d3d::FtoDw(1.0f));
+		
+	// use alpha from texture, faded by the vertex alpha of distant bands
+	device->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+	device->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+	device->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_MODULATE);
+
+	device->SetRenderState(D3DRS_ALPHABLENDENABLE, true);
+	device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+    device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+}
+
+void PSystem::resetPointStates(IDirect3DDevice9* device)
+{
+	device->SetRenderState(D3DRS_LIGHTING,          true);
+	device->SetRenderState(D3DRS_POINTSPRITEENABLE, false);
+	device->SetRenderState(D3DRS_POINTSCALEENABLE,  false);
+	device->SetRenderState(D3DRS_ALPHABLENDENABLE,  false);
+}
+
+void PSystem::collect(std::vector<DrawRun>* runs)
+{
+	D3DXMATRIX W, V, P;
+	_device->GetTransform(D3DTS_WORLD,      &W);
+	_device->GetTransform(D3DTS_VIEW,       &V);
+	_device->GetTransform(D3DTS_PROJECTION, &P);
+
+	size_t first = runs->size();
+	ParticleSim::collect((const float*)&W, (const float*)&V, (const float*)&P, runs);
+
+	for(size_t i = first; i < runs->size(); i++)
+		(*runs)[i]._tex = _tex;
+}
+
+void PSystem::render()
+{
+	//
+	// Remarks:  The particles in view are collected into runs of vertices (see collect),
+	//           which are then streamed through the vertex buffer a batch at a time (see
+	//           VertexStream::draw), each band with its own point size.
+	//
+
+	_runs.clear();
+	collect(&_runs);
+
+	// nothing in view, don't touch the vertex buffer at all
+	if( _runs.empty() )
+		return;
+
+	//
+	// set render states
+	//
+
+	preRender();
+
+	_stats._numDrawCalls = _stream.draw(&_runs[0], (int)_runs.size());
+
+	//
+	// reset render states
+	//
+
+	postRender();
+}
+
+bool PSystem::sharesRenderStates() const
+{
+	return true;
+}
+
+//*****************************************************************************
+// Snow System
+//***************
+
+Snow::Snow(d3d::BoundingBox* boundingBox, int numParticles)
+	: Snowfall((const float*)&boundingBox->_min, (const float*)&boundingBox->_max, numParticles)
+{
+	_terrain    = 0;
+	_flakeDepth = 0.0f;
+}
+
+void Snow::setTerrain(Terrain* terrain, float heightOffset, float flakeDepth)
+{
+	_terrain    = terrain;
+	_flakeDepth = flakeDepth;
+
+	setGround(terrain ? &terrain->getHeightField() : 0, heightOffset);
+}
+
+bool Snow::updatesSharedState() const
+{
+	return _terrain != 0;
+}
+
+void Snow::landed(const float* x, const float* z, int count)
+{
+	// the terrain is not thread safe, so this is only called on the updating thread
+	_terrain->depositSnow(x, z, count, _flakeDepth);
+}
+
+//*****************************************************************************
+// Smoke System
+//***************
+
+Smoke::Smoke(const D3DXVECTOR3* origin, int numParticles)
+{
+	_origin       = *origin;
+	_size         = 1.0f;
+	_vbSize       = 2048;
+	_vbBatchSize  = 512;
+	_maxParticles = numParticles;
+
+	// puffs live 4 seconds on average, keep the chimney at about numParticles
+	_emitRate = numParticles / 4.0f;
+
+	// the column is cut off above the roof
+	_boxMin[0] = _origin.x - 5.0f;
+	_boxMin[1] = _origin.y;
+	_boxMin[2] = _origin.z - 5.0f;
+	_boxMax[0] = _origin.x + 5.0f;
+	_boxMax[1] = _origin.y + 15.0f;
+	_boxMax[2] = _origin.z + 5.0f;
+
+	_particles.reserve(_maxParticles);
+}
+
+void Smoke::resetParticle(Attribute* attribute, rng::Random& random)
+{
+	attribute->_position.x = _origin.x + random.nextFloat(-0.2f, 0.2f);
+	attribute->_position.y = _origin.y;
+	attribute->_position.z = _origin.z + random.nextFloat(-0.2f, 0.2f);
+
+	// rises and spreads out
+	attribute->_velocity.x = random.nextFloat(-0.4f, 0.4f);
+	attribute->_velocity.y = random.nextFloat( 1.5f, 2.5f);
+	attribute->_velocity.z = random.nextFloat(-0.4f, 0.4f);
+
+	attribute->_lifeTime = random.nextFloat(3.0f, 5.0f);
+	attribute->_age      = 0.0f;
+
+	// grey smoke
+	attribute->_color = D3DXCOLOR(0.6f, 0.6f, 0.6f, 1.0f);
+}
+
+void Smoke::update(float timeDelta)
+{
+	emitParticles(timeDelta);
+	driftParticles(timeDelta);
+
+	_frame++;
+}
+
+//*****************************************************************************
+// Puff System
+//***************
+
+Puff::Puff(const D3DXVECTOR3* origin, int numParticles)
+{
+	_origin       = *origin;
+	_size         = 0.25f;
+	_vbSize       = 2048;
+	_vbBatchSize  = 512;
+	_maxParticles = numParticles;
+
+	// wide enough that nothing leaves it before it fades
+	_boxMin[0] = _origin.x - 5.0f;
+	_boxMin[1] = _origin.y - 5.0f;
+	_boxMin[2] = _origin.z - 5.0f;
+	_boxMax[0] = _origin.x + 5.0f;
+	_boxMax[1] = _origin.y + 5.0f;
+	_boxMax[2] = _origin.z + 5.0f;
+
+	_particles.reserve(_maxParticles);
+
+	addParticles(numParticles);
+}
+
+void Puff::resetParticle(Attribute* attribute, rng::Random& random)
+{
+	attribute->_position = _origin;
+
+	// thrown outward and up
+	attribute->_velocity.x = random.nextFloat(-1.5f, 1.5f);
+	attribute->_velocity.y = random.nextFloat( 0.5f, 2.0f);
+	attribute->_velocity.z = random.nextFloat(-1.5f, 1.5f);
+
+	attribute->_lifeTime = random.nextFloat(0.6f, 1.2f);
+	attribute->_age      = 0.0f;
+
+	// white powder
+	attribute->_color = d3d::WHITE;
+}
+
+void Puff::update(float timeDelta)
+{
+	driftParticles(timeDelta);
+
+	_frame++;
+}
+
+//*****************************************************************************
+// Replay System
+//***************
+
+Replay::Replay(Replayer* replayer, float size)
+{
+	_size        = size;
+	_vbSize      = 2048;
+	_vbBatchSize = 512;
+	_replayer    = replayer;
+	_nextFrame   = 0;
+
+	memset(&_pose, 0, sizeof(_pose));
+
+	// load the first frame so that the system is not empty before its first update
+	update(0.0f);
+}
+
+void Replay::resetParticle(Attribute* attribute, rng::Random& random)
+{
+	// particles come from the recording, there is nothing to spawn
+}
+
+void Replay::update(float timeDelta)
+{
+	//
+	// Remarks:  The frames are decoded into _recorded, as deltas apply to the order
+	//           they were recorded in, and copied from there into the store, whose
+	//           order is the system's own: the distance bands regroup it as they do
+	//           for the recorded system.  _age of each slot holds the index of the
+	//           recorded particle in it, which regrouping moves along.
+	//
+
+	// the recording is played at the rate it was recorded, one frame per update
+	if( _nextFrame >= _replayer->getFrameCount() )
+		_nextFrame = 0;
+
+	if( _replayer->readFrame(_nextFrame, &_recorded, &_pose, 0) )
+		_nextFrame++;
+	else
+		_recorded.clear();
+
+	int numParticles = _recorded.size();
+
+	// a change in count starts over in recorded order
+	if( _particles.size() != numParticles )
+	{
+		if( _particles.capacity() < numParticles )
+			_particles.reserve(numParticles);
+		_particles.resize(numParticles);
+		numParticles = _particles.size();
+
+		for(int i = 0; i < numParticles; i++)
+			_particles._age[i] = (float)i;
+
+		_lodDirty = true;
+	}
+	_maxParticles = _particles.capacity();
+
+	for(int i = 0; i < numParticles; i++)
+	{
+		int k = (int)_particles._age[i];
+
+		_particles._posX[i]  = _recorded._posX[k];
+		_particles._posY[i]  = _recorded._posY[k];
+		_particles._posZ[i]  = _recorded._posZ[k];
+		_particles._color[i] = _recorded._color[k];
+	}
+
+	updateLod();
+	repackParticles(0, numParticles);
+
+	_frame++;
+}
+
+const CameraPose& Replay::getPose() const
+{
+	return _pose;
+}
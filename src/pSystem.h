@@ -1,105 +1,224 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: pSystem.h
-// 
-// Author: Frank Luna (C) All Rights Reserved
-//
-// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
-//
-// Desc: Represents a geneal particle system.
-//          
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#ifndef __pSystemH__
-#define __pSystemH__
-
-#include "d3dUtility.h"
-#include "camera.h"
-#include <list>
-
-namespace psys
-{
-	struct Particle
-	{
-		D3DXVECTOR3 _position;
-		D3DCOLOR    _color;
-		static const DWORD FVF;
-	};
-	
-	struct Attribute
-	{
-		Attribute()
-		{
-			_lifeTime = 0.0f;
-			_age      = 0.0f;
-			_isAlive  = true;
-		}
-
-		D3DXVECTOR3 _position;     
-		D3DXVECTOR3 _velocity;     
-		D3DXVECTOR3 _acceleration; 
-		float       _lifeTime;     // how long the particle lives for before dying  
-		float       _age;          // current age of the particle  
-		D3DXCOLOR   _color;        // current color of the particle   
-		D3DXCOLOR   _colorFade;    // how the color fades with respect to time
-		bool        _isAlive;    
-	};
-
-
-	class PSystem
-	{
-	public:
-		PSystem();
-		virtual ~PSystem();
-
-		virtual bool init(IDirect3DDevice9* device, char* texFileName);
-		virtual void reset();
-		
-		// sometimes we don't want to free the memory of a dead particle,
-		// but rather respawn it instead.
-		virtual void resetParticle(Attribute* attribute) = 0;
-		virtual void addParticle();
-
-		virtual void update(float timeDelta) = 0;
-
-		virtual void preRender();
-		virtual void render();
-		virtual void postRender();
-
-		bool isEmpty();
-		bool isDead();
-
-	protected:
-		virtual void removeDeadParticles();
-
-	protected:
-		IDirect3DDevice9*       _device;
-		D3DXVECTOR3             _origin;
-		d3d::BoundingBox        _boundingBox;
-		float                   _emitRate;   // rate new particles are added to system
-		float                   _size;       // size of particles
-		IDirect3DTexture9*      _tex;
-		IDirect3DVertexBuffer9* _vb;
-		std::list<Attribute>    _particles;
-		int                     _maxParticles; // max allowed particles system can have
-
-		//
-		// Following three data elements used for rendering the p-system efficiently
-		//
-
-		DWORD _vbSize;      // size of vb
-		DWORD _vbOffset;    // offset in vb to lock   
-		DWORD _vbBatchSize; // number of vertices to lock starting at _vbOffset
-	};
-
-
-	class Snow : public PSystem
-	{
-	public:
-		Snow(d3d::BoundingBox* boundingBox, int numParticles);
-		void resetParticle(Attribute* attribute);
-		void update(float timeDelta);
-	};
-}
-
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: pSystem.h
+// 
+// Author: Frank Luna (C) All Rights Reserved
+//
+// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
+//
+// Desc: Represents a geneal particle system.
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __pSystemH__
+#define __pSystemH__
+
+#include "d3dUtility.h"
+#include "camera.h"
+#include "particleSim.h"
+#include "particleRecord.h"
+#include "snowfall.h"
+#include <vector>
+
+class Terrain;
+
+namespace psys
+{
+	struct Particle
+	{
+		D3DXVECTOR3 _position;
+		D3DCOLOR    _color;
+		static const DWORD FVF;
+	};
+	
+	// Desc: Spawn record filled in by resetParticle.  Only the hot part of it
+	//       (position, velocity, color, age and lifetime) is kept in the particle
+	//       store.  A particle is alive for as long as it is in the store.
+	struct Attribute
+	{
+		Attribute()
+		{
+			_lifeTime = 0.0f;
+			_age      = 0.0f;
+		}
+
+		D3DXVECTOR3 _position;     
+		D3DXVECTOR3 _velocity;     
+		D3DXVECTOR3 _acceleration; 
+		float       _lifeTime;     // how long the particle lives for before dying, <= 0 for ever
+		float       _age;          // current age of the particle  
+		D3DXCOLOR   _color;        // current color of the particle   
+		D3DXCOLOR   _colorFade;    // how the color fades with respect to time
+	};
+
+
+	// Desc: A dynamic vertex buffer that draw runs are streamed through a batch at
+	//       a time: while one batch is drawn the next one is filled.  Consecutive
+	//       runs of the same texture and point size share batches.
+	class VertexStream
+	{
+	public:
+		VertexStream();
+		~VertexStream();
+
+		// size vertices in all, locked batchSize at a time
+		bool init(IDirect3DDevice9* device, DWORD size, DWORD batchSize);
+
+		// Desc: Draws the runs in order, with the render states other than the
+		//       texture and point size already set, see PSystem::setPointStates.  Returns the number of
+		//       DrawPrimitive calls made; *numStateChanges, if given, is set to
+		//       the number of times the texture or point size was set.
+		int draw(const DrawRun* runs, int count, int* numStateChanges = 0);
+
+	private:
+		VertexStream(const VertexStream&);
+		VertexStream& operator=(const VertexStream&);
+
+		// draw the count vertices of the locked batch and lock the next one
+		void flushBatch(DWORD count, Particle** v);
+
+		IDirect3DDevice9*       _device;
+		IDirect3DVertexBuffer9* _vb;
+		DWORD                   _size;      // size of vb
+		DWORD                   _offset;    // offset in vb to lock
+		DWORD                   _batchSize; // number of vertices to lock starting at _offset
+		int                     _numDrawCalls;
+	};
+
+
+	// Desc: A particle system drawn with Direct3D: the simulation of ParticleSim
+	//       with the particles spawned one at a time by resetParticle, and a
+	//       texture and vertex buffer to draw them with.
+	class PSystem : public ParticleSim
+	{
+	public:
+		PSystem();
+		virtual ~PSystem();
+
+		virtual bool init(IDirect3DDevice9* device, char* texFileName);
+
+		// same with a texture shared with other systems, which is AddRef'd.
+		// Without ownStream no vertex buffer is made: the system's runs are only
+		// collected and drawn by its owner, and render draws nothing.
+		bool init(IDirect3DDevice9* device, IDirect3DTexture9* tex, bool ownStream = true);
+		virtual void reset();
+
+		// sometimes we don't want to free the memory of a dead particle,
+		// but rather respawn it instead.  All randomness must come from
+		// random so that respawns are reproducible.
+		virtual void resetParticle(Attribute* attribute, rng::Random& random) = 0;
+
+		// add one particle, dropped if the _maxParticles sized pool is full
+		virtual void addParticle();
+
+		// one virtual resetParticle call per particle
+		virtual void respawnParticles(const int* indices, int count, rng::Random& random);
+
+		virtual void preRender();
+		virtual void render();
+		virtual void postRender();
+
+		// Desc: ParticleSim::collect with the device's transforms, the runs
+		//       drawn with the system's texture.
+		void collect(std::vector<DrawRun>* runs);
+
+		// true for systems drawn with the render states of PSystem's preRender,
+		// whose runs can be drawn along with those of other such systems.  A
+		// system that overrides preRender or postRender must return false.
+		virtual bool sharesRenderStates() const;
+
+		// the render states of preRender and postRender, for drawing the runs of
+		// several systems, with size as the point size until a run sets its own
+		static void setPointStates(IDirect3DDevice9* device, float size);
+		static void resetPointStates(IDirect3DDevice9* device);
+
+	protected:
+		// copy a spawn record into / out of slot i of the particle store
+		void writeParticle(int i, const Attribute& attribute);
+		void readParticle(int i, Attribute* attribute);
+
+	protected:
+		IDirect3DDevice9*       _device;
+		D3DXVECTOR3             _origin;
+		IDirect3DTexture9*      _tex;
+
+		//
+		// Following data elements used for rendering the p-system efficiently
+		//
+
+		VertexStream         _stream;
+		DWORD                _vbSize;      // size of the stream's vb
+		DWORD                _vbBatchSize; // number of vertices locked at a time
+		std::vector<DrawRun> _runs;        // scratch for the runs of render
+	};
+
+
+	// Desc: The snowfall of the scene, drawn by a ParticleWorld, laying the
+	//       flakes that land on a terrain down as snow.
+	class Snow : public Snowfall
+	{
+	public:
+		Snow(d3d::BoundingBox* boundingBox, int numParticles);
+
+		// with a terrain, which it lays snow on
+		bool updatesSharedState() const;
+
+		// Flakes that fall onto terrain are respawned and leave flakeDepth of
+		// snow where they landed.  The terrain is drawn heightOffset higher
+		// than its own space, with x and z untouched.  0 for no terrain.
+		void setTerrain(Terrain* terrain, float heightOffset, float flakeDepth);
+
+	protected:
+		void landed(const float* x, const float* z, int count);
+
+	private:
+		Terrain* _terrain;
+		float    _flakeDepth;
+	};
+
+
+	// Smoke rising from a chimney at origin, thinning out as it goes.
+	class Smoke : public PSystem
+	{
+	public:
+		Smoke(const D3DXVECTOR3* origin, int numParticles);
+		void resetParticle(Attribute* attribute, rng::Random& random);
+		void update(float timeDelta);
+	};
+
+
+	// A burst of powder kicked up at origin that fades in about a second.  The
+	// system is dead once all of it has.
+	class Puff : public PSystem
+	{
+	public:
+		Puff(const D3DXVECTOR3* origin, int numParticles);
+		void resetParticle(Attribute* attribute, rng::Random& random);
+		void update(float timeDelta);
+	};
+
+
+	// Plays back a recording made with psys::Recorder.  Nothing is simulated,
+	// each update loads the next recorded frame, starting over after the last.
+	// Given the render setup of the recorded system it draws as that did, with
+	// the bands regrouped as often.
+	class Replay : public PSystem
+	{
+	public:
+		// replayer must be open and outlive the system
+		Replay(Replayer* replayer, float size);
+		void resetParticle(Attribute* attribute, rng::Random& random);
+		void update(float timeDelta);
+
+		// where the camera was for the frame loaded last
+		const CameraPose& getPose() const;
+
+	private:
+		Replayer*     _replayer;
+		ParticleStore _recorded;  // the frame loaded last, in recorded order
+		int           _nextFrame;
+		CameraPose    _pose;
+	};
+}
+
 #endif // __pSystemH__
\ No newline at end of file
@@ -0,0 +1,577 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleKernels.cpp
+//
+// Author: William Cheung
+//
+// Desc: Vectorized passes over a ParticleStore.
+//
+// Note: The scalar path must be compiled without contracting a * b + c into a fused
+//       multiply-add (the default for MSVC and for gcc without -mfma), otherwise it
+//       rounds differently from the vector paths.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleKernels.h"
+#include <cfloat>
+#include <vector>
+
+using namespace psys;
+
+// append base + k for every set bit k of mask
+static inline int appendMask(unsigned int mask, int base, int* out, int n)
+{
+	while( mask )
+	{
+		out[n++] = base + simd::LowestBit(mask);
+		mask &= mask - 1;
+	}
+	return n;
+}
+
+//
+// Integration
+//
+
+static int integrateScalar(
+	ParticleStore& s, int begin, int end, float dt,
+	const float* lo, const float* hi, int* escaped)
+{
+	int n = 0;
+	for(int i = begin; i < end; i++)
+	{
+		float x = s._posX[i] + s._velX[i] * dt;
+		float y = s._posY[i] + s._velY[i] * dt;
+		float z = s._posZ[i] + s._velZ[i] * dt;
+
+		s._posX[i] = x;
+		s._posY[i] = y;
+		s._posZ[i] = z;
+
+		bool inside = x >= lo[0] && y >= lo[1] && z >= lo[2] &&
+		              x <= hi[0] && y <= hi[1] && z <= hi[2];
+
+		if( !inside )
+			escaped[n++] = i;
+	}
+	return n;
+}
+
+#ifdef SIMD_X86
+
+static int integrateSSE2(
+	ParticleStore& s, int begin, int end, float dt,
+	const float* lo, const float* hi, int* escaped)
+{
+	const __m128 t    = _mm_set1_ps(dt);
+	const __m128 minX = _mm_set1_ps(lo[0]), maxX = _mm_set1_ps(hi[0]);
+	const __m128 minY = _mm_set1_ps(lo[1]), maxY = _mm_set1_ps(hi[1]);
+	const __m128 minZ = _mm_set1_ps(lo[2]), maxZ = _mm_set1_ps(hi[2]);
+
+	int n = 0;
+	int i = begin;
+	for(; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_add_ps(_mm_loadu_ps(s._posX + i), _mm_mul_ps(_mm_loadu_ps(s._velX + i), t));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(s._posY + i), _mm_mul_ps(_mm_loadu_ps(s._velY + i), t));
+		__m128 z = _mm_add_ps(_mm_loadu_ps(s._posZ + i), _mm_mul_ps(_mm_loadu_ps(s._velZ + i), t));
+
+		_mm_storeu_ps(s._posX + i, x);
+		_mm_storeu_ps(s._posY + i, y);
+		_mm_storeu_ps(s._posZ + i, z);
+
+		__m128 inside = _mm_and_ps(
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, minX), _mm_cmple_ps(x, maxX)),
+			           _mm_and_ps(_mm_cmpge_ps(y, minY), _mm_cmple_ps(y, maxY))),
+			_mm_and_ps(_mm_cmpge_ps(z, minZ), _mm_cmple_ps(z, maxZ)));
+
+		unsigned int outside = ~(unsigned int)_mm_movemask_ps(inside) & 0xf;
+		n = appendMask(outside, i, escaped, n);
+	}
+
+	return n + integrateScalar(s, i, end, dt, lo, hi, escaped + n);
+}
+
+SIMD_TARGET_AVX2
+static int integrateAVX2(
+	ParticleStore& s, int begin, int end, float dt,
+	const float* lo, const float* hi, int* escaped)
+{
+	const __m256 t    = _mm256_set1_ps(dt);
+	const __m256 minX = _mm256_set1_ps(lo[0]), maxX = _mm256_set1_ps(hi[0]);
+	const __m256 minY = _mm256_set1_ps(lo[1]), maxY = _mm256_set1_ps(hi[1]);
+	const __m256 minZ = _mm256_set1_ps(lo[2]), maxZ = _mm256_set1_ps(hi[2]);
+
+	int n = 0;
+	int i = begin;
+	for(; i + 8 <= end; i += 8)
+	{
+		// separate multiply and add, never FMA, to match the scalar path
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(s._posX + i), _mm256_mul_ps(_mm256_loadu_ps(s._velX + i), t));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(s._posY + i), _mm256_mul_ps(_mm256_loadu_ps(s._velY + i), t));
+		__m256 z = _mm256_add_ps(_mm256_loadu_ps(s._posZ + i), _mm256_mul_ps(_mm256_loadu_ps(s._velZ + i), t));
+
+		_mm256_storeu_ps(s._posX + i, x);
+		_mm256_storeu_ps(s._posY + i, y);
+		_mm256_storeu_ps(s._posZ + i, z);
+
+		__m256 inside = _mm256_and_ps(
+			_mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(x, minX, _CMP_GE_OQ), _mm256_cmp_ps(x, maxX, _CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(y, minY, _CMP_GE_OQ), _mm256_cmp_ps(y, maxY, _CMP_LE_OQ))),
+			_mm256_and_ps(_mm256_cmp_ps(z, minZ, _CMP_GE_OQ), _mm256_cmp_ps(z, maxZ, _CMP_LE_OQ)));
+
+		unsigned int outside = ~(unsigned int)_mm256_movemask_ps(inside) & 0xff;
+		n = appendMask(outside, i, escaped, n);
+	}
+
+	_mm256_zeroupper();
+
+	return n + integrateScalar(s, i, end, dt, lo, hi, escaped + n);
+}
+
+#endif // SIMD_X86
+
+int psys::IntegrateParticles(
+	simd::Level level,
+	ParticleStore& store,
+	int begin, int end,
+	float timeDelta,
+	const float boxMin[3],
+	const float boxMax[3],
+	int* escaped)
+{
+#ifdef SIMD_X86
+	switch( level )
+	{
+	case simd::LEVEL_AVX2:
+		return integrateAVX2(store, begin, end, timeDelta, boxMin, boxMax, escaped);
+	case simd::LEVEL_SSE2:
+		return integrateSSE2(store, begin, end, timeDelta, boxMin, boxMax, escaped);
+	default:
+		break;
+	}
+#endif
+	return integrateScalar(store, begin, end, timeDelta, boxMin, boxMax, escaped);
+}
+
+int psys::IntegrateParticles(
+	ParticleStore& store,
+	int begin, int end,
+	float timeDelta,
+	const float boxMin[3],
+	const float boxMax[3],
+	int* escaped)
+{
+	return IntegrateParticles(simd::GetLevel(), store, begin, end, timeDelta, boxMin, boxMax, escaped);
+}
+
+//
+// Wind
+//
+
+void psys::ApplyWind(
+	ParticleStore& store,
+	int begin, int end,
+	const float* wx, const float* wy, const float* wz,
+	float drag, float lift,
+	float timeDelta)
+{
+	// a plain loop over arrays, which compilers vectorize on their own
+	float* velX = store._velX + begin;
+	float* velY = store._velY + begin;
+	float* velZ = store._velZ + begin;
+
+	float d = drag * timeDelta;
+	float l = lift * timeDelta;
+
+	// past a full step the drag would overshoot the wind
+	if( d > 1.0f )
+		d = 1.0f;
+
+	for(int k = 0; k < end - begin; k++)
+	{
+		velX[k] += (wx[k] - velX[k]) * d;
+		velY[k] += wy[k] * l;
+		velZ[k] += (wz[k] - velZ[k]) * d;
+	}
+}
+
+//
+// Aging
+//
+
+int psys::AgeParticles(
+	ParticleStore& store,
+	int begin, int end,
+	float timeDelta,
+	int* expired)
+{
+	float*       age      = store._age;
+	const float* lifeTime = store._lifeTime;
+
+	int n = 0;
+	for(int i = begin; i < end; i++)
+	{
+		age[i] += timeDelta;
+
+		if( lifeTime[i] > 0.0f && age[i] >= lifeTime[i] )
+			expired[n++] = i;
+	}
+	return n;
+}
+
+void psys::FadeParticles(
+	ParticleStore& store,
+	int begin, int end)
+{
+	unsigned int* color    = store._color;
+	const float*  age      = store._age;
+	const float*  lifeTime = store._lifeTime;
+
+	for(int i = begin; i < end; i++)
+	{
+		if( lifeTime[i] <= 0.0f )
+			continue;
+
+		float left = 1.0f - age[i] / lifeTime[i];
+		if( left < 0.0f )
+			left = 0.0f;
+
+		unsigned int alpha = (unsigned int)(left * 255.0f);
+		color[i] = (color[i] & 0x00ffffff) | (alpha << 24);
+	}
+}
+
+//
+// Ground collision
+//
+
+int psys::CollideParticles(
+	const ParticleStore& store,
+	int begin, int end,
+	const float* ground,
+	float groundOffset,
+	int* landed)
+{
+	const float* posY = store._posY + begin;
+
+	int n = 0;
+	for(int k = 0; k < end - begin; k++)
+	{
+		if( posY[k] < ground[k] + groundOffset )
+			landed[n++] = begin + k;
+	}
+	return n;
+}
+
+//
+// Packing
+//
+
+int psys::PackParticles(
+	const ParticleStore& store,
+	int begin, int end,
+	PackedParticle* out)
+{
+	int n = 0;
+	for(int i = begin; i < end; i++)
+	{
+		out[n]._x     = store._posX[i];
+		out[n]._y     = store._posY[i];
+		out[n]._z     = store._posZ[i];
+		out[n]._color = store._color[i];
+		n++;
+	}
+	return n;
+}
+
+//
+// Level of detail
+//
+
+void psys::ClassifyParticles(
+	const ParticleStore& store,
+	int begin, int end,
+	const float eye[3],
+	const float* bandDistSq, int numBands,
+	unsigned char* key)
+{
+	for(int i = begin; i < end; i++)
+	{
+		float dx = store._posX[i] - eye[0];
+		float dy = store._posY[i] - eye[1];
+		float dz = store._posZ[i] - eye[2];
+		float d  = dx * dx + dy * dy + dz * dz;
+
+		int band = 0;
+		for(int b = 0; b < numBands; b++)
+			band += d >= bandDistSq[b];
+		key[i] = (unsigned char)band;
+	}
+}
+
+void psys::PartitionParticles(
+	ParticleStore& store,
+	int begin, int end,
+	unsigned char* key, int numKeys,
+	int* start)
+{
+	// count, then swap every particle straight into its key's region
+	// (American flag sort, one pass and no extra particle storage)
+	std::vector<int> next(numKeys + 1, 0);
+
+	for(int i = begin; i < end; i++)
+		next[key[i] + 1]++;
+
+	next[0] = begin;
+	for(int k = 0; k < numKeys; k++)
+		next[k + 1] += next[k];
+
+	for(int k = 0; k <= numKeys; k++)
+		start[k] = next[k];
+
+	for(int k = 0; k < numKeys; k++)
+	{
+		while( next[k] < start[k + 1] )
+		{
+			int i = next[k];
+			int j = key[i];
+
+			if( j == k )
+			{
+				next[k]++;
+				continue;
+			}
+
+			int dest = next[j]++;
+			store.swap(i, dest);
+
+			unsigned char t = key[i];
+			key[i]    = key[dest];
+			key[dest] = t;
+		}
+	}
+}
+
+//
+// Sorting
+//
+
+void psys::ComputeDepthKeys(
+	const ParticleStore& store,
+	int begin, int end,
+	const float axis[4],
+	float nearDepth, float farDepth,
+	unsigned short* key)
+{
+	float range = farDepth - nearDepth;
+	float scale = range > 0.0f ? 65535.0f / range : 0.0f;
+
+	// plain enough for the compiler to vectorize
+	for(int i = begin; i < end; i++)
+	{
+		float depth = store._posX[i] * axis[0] + store._posY[i] * axis[1] + store._posZ[i] * axis[2] + axis[3];
+		float k     = (farDepth - depth) * scale;
+
+		k = k > 0.0f ? (k < 65535.0f ? k : 65535.0f) : 0.0f;
+		key[i - begin] = (unsigned short)k;
+	}
+}
+
+//
+// Bounds
+//
+
+static void boundsScalar(const ParticleStore& s, int begin, int end, float* lo, float* hi)
+{
+	for(int i = begin; i < end; i++)
+	{
+		if( s._posX[i] < lo[0] ) lo[0] = s._posX[i];
+		if( s._posY[i] < lo[1] ) lo[1] = s._posY[i];
+		if( s._posZ[i] < lo[2] ) lo[2] = s._posZ[i];
+		if( s._posX[i] > hi[0] ) hi[0] = s._posX[i];
+		if( s._posY[i] > hi[1] ) hi[1] = s._posY[i];
+		if( s._posZ[i] > hi[2] ) hi[2] = s._posZ[i];
+	}
+}
+
+void psys::ComputeBounds(
+	const ParticleStore& store,
+	int begin, int end,
+	float min[3], float max[3])
+{
+	min[0] = min[1] = min[2] =  FLT_MAX;
+	max[0] = max[1] = max[2] = -FLT_MAX;
+
+	int i = begin;
+
+#ifdef SIMD_X86
+	if( simd::GetLevel() >= simd::LEVEL_SSE2 && end - begin >= 4 )
+	{
+		__m128 minX = _mm_set1_ps(FLT_MAX), maxX = _mm_set1_ps(-FLT_MAX);
+		__m128 minY = minX, maxY = maxX;
+		__m128 minZ = minX, maxZ = maxX;
+
+		for(; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(store._posX + i);
+			__m128 y = _mm_loadu_ps(store._posY + i);
+			__m128 z = _mm_loadu_ps(store._posZ + i);
+			minX = _mm_min_ps(minX, x); maxX = _mm_max_ps(maxX, x);
+			minY = _mm_min_ps(minY, y); maxY = _mm_max_ps(maxY, y);
+			minZ = _mm_min_ps(minZ, z); maxZ = _mm_max_ps(maxZ, z);
+		}
+
+		float lanes[6][4];
+		_mm_storeu_ps(lanes[0], minX); _mm_storeu_ps(lanes[3], maxX);
+		_mm_storeu_ps(lanes[1], minY); _mm_storeu_ps(lanes[4], maxY);
+		_mm_storeu_ps(lanes[2], minZ); _mm_storeu_ps(lanes[5], maxZ);
+
+		for(int k = 0; k < 4; k++)
+		{
+			for(int c = 0; c < 3; c++)
+			{
+				if( lanes[c][k] < min[c] )     min[c] = lanes[c][k];
+				if( lanes[3 + c][k] > max[c] ) max[c] = lanes[3 + c][k];
+			}
+		}
+	}
+#endif
+
+	boundsScalar(store, i, end, min, max);
+}
+
+//
+// Culling
+//
+
+static inline void packOne(const ParticleStore& s, int i, PackedParticle* out)
+{
+	out->_x     = s._posX[i];
+	out->_y     = s._posY[i];
+	out->_z     = s._posZ[i];
+	out->_color = s._color[i];
+}
+
+static int cullScalar(
+	const ParticleStore& s, int begin, int end,
+	const Frustum& frustum, float margin, PackedParticle* out)
+{
+	int n = 0;
+	for(int i = begin; i < end; i++)
+	{
+		if( frustum.testPoint(s._posX[i], s._posY[i], s._posZ[i], margin) )
+			packOne(s, i, out + n++);
+	}
+	return n;
+}
+
+#ifdef SIMD_X86
+
+static int cullSSE2(
+	const ParticleStore& s, int begin, int end,
+	const Frustum& frustum, float margin, PackedParticle* out)
+{
+	__m128 a[Frustum::NUM_PLANES], b[Frustum::NUM_PLANES], c[Frustum::NUM_PLANES], d[Frustum::NUM_PLANES];
+	for(int p = 0; p < Frustum::NUM_PLANES; p++)
+	{
+		a[p] = _mm_set1_ps(frustum._planes[p][0]);
+		b[p] = _mm_set1_ps(frustum._planes[p][1]);
+		c[p] = _mm_set1_ps(frustum._planes[p][2]);
+		d[p] = _mm_set1_ps(frustum._planes[p][3] + margin);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	int n = 0;
+	int i = begin;
+	for(; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(s._posX + i);
+		__m128 y = _mm_loadu_ps(s._posY + i);
+		__m128 z = _mm_loadu_ps(s._posZ + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for(int p = 0; p < Frustum::NUM_PLANES; p++)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)),
+			                         _mm_add_ps(_mm_mul_ps(c[p], z), d[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+		}
+
+		unsigned int mask = (unsigned int)_mm_movemask_ps(inside);
+		while( mask )
+		{
+			packOne(s, i + simd::LowestBit(mask), out + n++);
+			mask &= mask - 1;
+		}
+	}
+
+	return n + cullScalar(s, i, end, frustum, margin, out + n);
+}
+
+SIMD_TARGET_AVX2
+static int cullAVX2(
+	const ParticleStore& s, int begin, int end,
+	const Frustum& frustum, float margin, PackedParticle* out)
+{
+	__m256 a[Frustum::NUM_PLANES], b[Frustum::NUM_PLANES], c[Frustum::NUM_PLANES], d[Frustum::NUM_PLANES];
+	for(int p = 0; p < Frustum::NUM_PLANES; p++)
+	{
+		a[p] = _mm256_set1_ps(frustum._planes[p][0]);
+		b[p] = _mm256_set1_ps(frustum._planes[p][1]);
+		c[p] = _mm256_set1_ps(frustum._planes[p][2]);
+		d[p] = _mm256_set1_ps(frustum._planes[p][3] + margin);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	int n = 0;
+	int i = begin;
+	for(; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(s._posX + i);
+		__m256 y = _mm256_loadu_ps(s._posY + i);
+		__m256 z = _mm256_loadu_ps(s._posZ + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(int p = 0; p < Frustum::NUM_PLANES; p++)
+		{
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], x), _mm256_mul_ps(b[p], y)),
+			                            _mm256_add_ps(_mm256_mul_ps(c[p], z), d[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, zero, _CMP_GE_OQ));
+		}
+
+		unsigned int mask = (unsigned int)_mm256_movemask_ps(inside);
+		while( mask )
+		{
+			packOne(s, i + simd::LowestBit(mask), out + n++);
+			mask &= mask - 1;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	return n + cullScalar(s, i, end, frustum, margin, out + n);
+}
+
+#endif // SIMD_X86
+
+int psys::CullParticles(
+	const ParticleStore& store,
+	int begin, int end,
+	const Frustum& frustum, float margin,
+	PackedParticle* out)
+{
+#ifdef SIMD_X86
+	switch( simd::GetLevel() )
+	{
+	case simd::LEVEL_AVX2:
+		return cullAVX2(store, begin, end, frustum, margin, out);
+	case simd::LEVEL_SSE2:
+		return cullSSE2(store, begin, end, frustum, margin, out);
+	default:
+		break;
+	}
+#endif
+	return cullScalar(store, begin, end, frustum, margin, out);
+}
@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleKernels.h
+//
+// Author: William Cheung
+//
+// Desc: Passes over a ParticleStore, a chunk of particles at a time.  The few
+//       that have vector versions pick one by simd::GetLevel; the others are
+//       plain loops over the arrays, left to the compiler.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleKernelsH__
+#define __particleKernelsH__
+
+#include "particleStore.h"
+#include "simd.h"
+#include "frustum.h"
+
+namespace psys
+{
+	// Desc: Advances particles [begin, end) by velocity * timeDelta and tests the new
+	//       positions against the box [boxMin, boxMax] in the same pass.  The indices
+	//       of the particles that left the box are written to escaped, in increasing
+	//       order, and their number is returned.  escaped must have room for
+	//       end - begin entries.  Scalar, SSE2 and AVX2 versions, which give
+	//       bitwise identical positions and escaped lists (psysBench checks).
+	int IntegrateParticles(
+		ParticleStore& store,
+		int begin, int end,
+		float timeDelta,
+		const float boxMin[3],
+		const float boxMax[3],
+		int* escaped);
+
+	// Desc: Same as above with an explicit instruction set, for comparing paths.
+	//       A level the CPU lacks must not be asked for.
+	int IntegrateParticles(
+		simd::Level level,
+		ParticleStore& store,
+		int begin, int end,
+		float timeDelta,
+		const float boxMin[3],
+		const float boxMax[3],
+		int* escaped);
+
+	// Desc: Accelerates particles [begin, end) by the wind (wx, wy, wz)[i - begin]
+	//       sampled at their positions.  The horizontal velocity is dragged toward
+	//       the wind at rate drag per second; the vertical wind pushes with lift
+	//       per second, leaving the particle's own fall speed alone otherwise.
+	//       Scalar only.
+	void ApplyWind(
+		ParticleStore& store,
+		int begin, int end,
+		const float* wx, const float* wy, const float* wz,
+		float drag, float lift,
+		float timeDelta);
+
+	// Desc: Adds timeDelta to the age of particles [begin, end) and writes the indices
+	//       of those that reached their lifetime to expired, in increasing order.
+	//       Returns their number.  expired must have room for end - begin entries.
+	//       Scalar only.
+	int AgeParticles(
+		ParticleStore& store,
+		int begin, int end,
+		float timeDelta,
+		int* expired);
+
+	// Desc: Sets the alpha of particles [begin, end) that die of age to fall from
+	//       opaque at birth to clear at the end of their lifetime.  The rest of
+	//       their color is left alone.  Scalar only.
+	void FadeParticles(
+		ParticleStore& store,
+		int begin, int end);
+
+	// Desc: Writes the indices of the particles of [begin, end) that are below the
+	//       ground to landed, in increasing order, and returns their number.  The
+	//       ground under particle i is ground[i - begin] + groundOffset, as queried
+	//       for the whole chunk at once.  landed must have room for end - begin
+	//       entries.  Scalar only.
+	int CollideParticles(
+		const ParticleStore& store,
+		int begin, int end,
+		const float* ground,
+		float groundOffset,
+		int* landed);
+
+	// Desc: Writes the particles of [begin, end) to out, in order, and returns
+	//       how many were written.  out must have room for end - begin entries.
+	//       Scalar only.
+	int PackParticles(
+		const ParticleStore& store,
+		int begin, int end,
+		PackedParticle* out);
+
+	// Desc: Writes to key[i] the distance band of particle i of [begin, end), that is
+	//       the number of entries of bandDistSq (squared distances, increasing) that
+	//       its squared distance from eye reaches.  Scalar only.
+	void ClassifyParticles(
+		const ParticleStore& store,
+		int begin, int end,
+		const float eye[3],
+		const float* bandDistSq, int numBands,
+		unsigned char* key);
+
+	// Desc: Reorders particles [begin, end) in place so that their keys, which are
+	//       below numKeys, are increasing.  key is reordered along.  start receives
+	//       numKeys + 1 entries, the particles with key k ending up in
+	//       [start[k], start[k + 1]).  Scalar only.
+	void PartitionParticles(
+		ParticleStore& store,
+		int begin, int end,
+		unsigned char* key, int numKeys,
+		int* start);
+
+	// Desc: Writes to key[i - begin] the depth of particle i of [begin, end) along
+	//       axis, a x + b y + c z + d, mapped from [nearDepth, farDepth] to 65535 .. 0
+	//       so that increasing keys run back to front.  Depths outside are clamped.
+	//       Scalar only.
+	void ComputeDepthKeys(
+		const ParticleStore& store,
+		int begin, int end,
+		const float axis[4],
+		float nearDepth, float farDepth,
+		unsigned short* key);
+
+	// Desc: Computes the bounding box of the positions of particles [begin, end).
+	//       Scalar and SSE2 versions, which give the same box up to the sign
+	//       of a bound that is zero.
+	void ComputeBounds(
+		const ParticleStore& store,
+		int begin, int end,
+		float min[3], float max[3]);
+
+	// Desc: Like PackParticles, but only writes the particles within margin of the
+	//       frustum.  Returns how many were written.  Scalar, SSE2 and AVX2
+	//       versions; the vector ones add up the plane distances in another
+	//       order than Frustum::testPoint, which the scalar one uses, so they
+	//       may keep or drop a particle within rounding of a plane that it
+	//       would not.
+	int CullParticles(
+		const ParticleStore& store,
+		int begin, int end,
+		const Frustum& frustum, float margin,
+		PackedParticle* out);
+}
+
+#endif // __particleKernelsH__
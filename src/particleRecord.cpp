@@ -0,0 +1,466 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleRecord.cpp
+//
+// Author: William Cheung
+//
+// Desc: Recording and memory mapped playback of particle state.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleRecord.h"
+#include <cmath>
+#include <cstring>
+
+using namespace psys;
+
+//
+// File layout, little endian throughout:
+//
+//   FileHeader
+//   chunks: ChunkHeader, then _size bytes of payload padded to a multiple of 4
+//
+// The payload of a FRAME chunk is a FrameHeader followed by
+//
+//   snapshot: float x[n], y[n], z[n]; unsigned int color[n]
+//   delta:    short dx[n], dy[n], dz[n], padded to a multiple of 4 bytes;
+//             Jump jumps[numJumps]
+//
+// A delta moves particle i by (dx, dy, dz)[i] * quantum.  Particles that moved
+// further than a short can say, or changed color, are given exactly as jumps.
+// Chunks of unknown tags are skipped, so that later versions can add some.
+//
+
+static const char         FILE_MAGIC[4] = { 'P', 'R', 'E', 'C' };
+static const unsigned int FILE_VERSION  = 1;
+static const unsigned int TAG_FRAME     = 0x4d415246; // "FRAM"
+
+enum FrameKind { FRAME_SNAPSHOT, FRAME_DELTA };
+
+// positions are stored to this fraction of a unit in deltas
+static const float DELTA_QUANTUM = 1.0f / 1024.0f;
+
+struct FileHeader
+{
+	char         _magic[4];
+	unsigned int _version;
+	unsigned int _reserved[2];
+};
+
+struct ChunkHeader
+{
+	unsigned int _tag;
+	unsigned int _size;
+};
+
+struct FrameHeader
+{
+	unsigned int _frame;
+	unsigned int _kind;
+	unsigned int _numParticles;
+	unsigned int _numJumps;
+	float        _timeDelta;
+	float        _quantum;
+	CameraPose   _pose;
+};
+
+struct Jump
+{
+	unsigned int _index;
+	float        _x, _y, _z;
+	unsigned int _color;
+};
+
+static_assert(sizeof(FileHeader)  == 16, "FileHeader layout");
+static_assert(sizeof(ChunkHeader) == 8,  "ChunkHeader layout");
+static_assert(sizeof(FrameHeader) == 72, "FrameHeader layout");
+static_assert(sizeof(Jump)        == 20, "Jump layout");
+
+static size_t padded(size_t size)
+{
+	return (size + 3) & ~(size_t)3;
+}
+
+static size_t deltaArraysSize(size_t numParticles)
+{
+	return padded(numParticles * 3 * sizeof(short));
+}
+
+//*****************************************************************************
+// Recorder
+//***************
+
+Recorder::Recorder()
+{
+	_file             = 0;
+	_snapshotInterval = 60;
+	_numFrames        = 0;
+	_sinceSnapshot    = 0;
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::open(const char* path, int snapshotInterval)
+{
+	close();
+
+	_file = fopen(path, "wb");
+	if( !_file )
+		return false;
+
+	_snapshotInterval = snapshotInterval > 1 ? snapshotInterval : 1;
+	_numFrames        = 0;
+	_sinceSnapshot    = 0;
+	_x.clear();
+
+	FileHeader header;
+	memcpy(header._magic, FILE_MAGIC, 4);
+	header._version     = FILE_VERSION;
+	header._reserved[0] = 0;
+	header._reserved[1] = 0;
+
+	return write(&header, sizeof(header));
+}
+
+void Recorder::close()
+{
+	if( _file )
+		fclose(_file);
+	_file = 0;
+}
+
+bool Recorder::write(const void* data, size_t size)
+{
+	if( !_file )
+		return false;
+
+	if( size && fwrite(data, 1, size, _file) != size )
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool Recorder::writeFrame(const ParticleStore& store, const CameraPose& pose, float timeDelta)
+{
+	if( !_file )
+		return false;
+
+	int n = store.size();
+
+	FrameHeader header;
+	header._frame        = (unsigned int)_numFrames;
+	header._kind         = FRAME_DELTA;
+	header._numParticles = (unsigned int)n;
+	header._numJumps     = 0;
+	header._timeDelta    = timeDelta;
+	header._quantum      = DELTA_QUANTUM;
+	header._pose         = pose;
+
+	bool snapshot = _numFrames == 0 || n != (int)_x.size() || _sinceSnapshot >= _snapshotInterval;
+
+	if( !snapshot )
+	{
+		// quantize the moves against what the replayer has
+		const float inv = 1.0f / DELTA_QUANTUM;
+
+		_dx.resize(n);
+		_dy.resize(n);
+		_dz.resize(n);
+		_jumps.clear();
+
+		for(int i = 0; i < n; i++)
+		{
+			float qx = floorf((store._posX[i] - _x[i]) * inv + 0.5f);
+			float qy = floorf((store._posY[i] - _y[i]) * inv + 0.5f);
+			float qz = floorf((store._posZ[i] - _z[i]) * inv + 0.5f);
+
+			bool fits =
+				qx >= -32767.0f && qx <= 32767.0f &&
+				qy >= -32767.0f && qy <= 32767.0f &&
+				qz >= -32767.0f && qz <= 32767.0f;
+
+			if( fits && store._color[i] == _color[i] )
+			{
+				_dx[i] = (short)qx;
+				_dy[i] = (short)qy;
+				_dz[i] = (short)qz;
+			}
+			else
+			{
+				_dx[i] = _dy[i] = _dz[i] = 0;
+				_jumps.push_back(i);
+			}
+		}
+
+		// after a reshuffle of the store most particles jump; a snapshot
+		// is smaller once the jumps take more than the 10 bytes a particle
+		// the delta saves
+		if( deltaArraysSize(n) + _jumps.size() * sizeof(Jump) >= (size_t)n * 16 )
+			snapshot = true;
+	}
+
+	ChunkHeader chunk;
+	chunk._tag = TAG_FRAME;
+
+	if( snapshot )
+	{
+		header._kind = FRAME_SNAPSHOT;
+		chunk._size  = (unsigned int)(sizeof(FrameHeader) + (size_t)n * 16);
+
+		_x.assign(store._posX, store._posX + n);
+		_y.assign(store._posY, store._posY + n);
+		_z.assign(store._posZ, store._posZ + n);
+		_color.assign(store._color, store._color + n);
+
+		bool ok =
+			write(&chunk, sizeof(chunk)) &&
+			write(&header, sizeof(header)) &&
+			write(store._posX,  (size_t)n * 4) &&
+			write(store._posY,  (size_t)n * 4) &&
+			write(store._posZ,  (size_t)n * 4) &&
+			write(store._color, (size_t)n * 4);
+
+		if( !ok )
+			return false;
+
+		_sinceSnapshot = 0;
+	}
+	else
+	{
+		int numJumps = (int)_jumps.size();
+
+		header._numJumps = (unsigned int)numJumps;
+		chunk._size = (unsigned int)(sizeof(FrameHeader) + deltaArraysSize(n) + numJumps * sizeof(Jump));
+
+		// move the replayer's state along exactly as it will
+		for(int i = 0; i < n; i++)
+		{
+			_x[i] = _x[i] + (float)_dx[i] * DELTA_QUANTUM;
+			_y[i] = _y[i] + (float)_dy[i] * DELTA_QUANTUM;
+			_z[i] = _z[i] + (float)_dz[i] * DELTA_QUANTUM;
+		}
+
+		std::vector<Jump> jumps(numJumps);
+		for(int k = 0; k < numJumps; k++)
+		{
+			int i = _jumps[k];
+
+			jumps[k]._index = (unsigned int)i;
+			jumps[k]._x     = _x[i]     = store._posX[i];
+			jumps[k]._y     = _y[i]     = store._posY[i];
+			jumps[k]._z     = _z[i]     = store._posZ[i];
+			jumps[k]._color = _color[i] = store._color[i];
+		}
+
+		static const unsigned char pad[4] = { 0, 0, 0, 0 };
+		size_t arraysSize = (size_t)n * 3 * sizeof(short);
+
+		bool ok =
+			write(&chunk, sizeof(chunk)) &&
+			write(&header, sizeof(header)) &&
+			(n == 0 || write(&_dx[0], (size_t)n * sizeof(short))) &&
+			(n == 0 || write(&_dy[0], (size_t)n * sizeof(short))) &&
+			(n == 0 || write(&_dz[0], (size_t)n * sizeof(short))) &&
+			write(pad, deltaArraysSize(n) - arraysSize) &&
+			(numJumps == 0 || write(&jumps[0], numJumps * sizeof(Jump)));
+
+		if( !ok )
+			return false;
+
+		_sinceSnapshot++;
+	}
+
+	_numFrames++;
+	return true;
+}
+
+//*****************************************************************************
+// Replayer
+//***************
+
+Replayer::Replayer()
+{
+	_target  = 0;
+	_decoded = -1;
+}
+
+void Replayer::close()
+{
+	_file.close();
+	_frames.clear();
+	_snapshotOf.clear();
+	_target  = 0;
+	_decoded = -1;
+}
+
+bool Replayer::open(const char* path)
+{
+	close();
+
+	if( !_file.open(path) )
+		return false;
+
+	const unsigned char* data = _file.data();
+	size_t               size = _file.size();
+
+	FileHeader header;
+	if( size < sizeof(header) )
+	{
+		close();
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if( memcmp(header._magic, FILE_MAGIC, 4) != 0 || header._version != FILE_VERSION )
+	{
+		close();
+		return false;
+	}
+
+	// index the frames, checking that every chunk lies within the file and
+	// that every frame's payload is as large as its header says
+	int    lastSnapshot = -1;
+	size_t offset       = sizeof(header);
+
+	while( offset + sizeof(ChunkHeader) <= size )
+	{
+		ChunkHeader chunk;
+		memcpy(&chunk, data + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+
+		if( chunk._size > size - offset )
+			break; // cut short, keep the frames before
+
+		if( chunk._tag == TAG_FRAME && chunk._size >= sizeof(FrameHeader) )
+		{
+			FrameHeader frame;
+			memcpy(&frame, data + offset, sizeof(frame));
+
+			size_t n = frame._numParticles;
+			size_t expected = sizeof(FrameHeader) + (frame._kind == FRAME_SNAPSHOT ?
+				n * 16 : deltaArraysSize(n) + (size_t)frame._numJumps * sizeof(Jump));
+
+			bool valid = chunk._size == expected && n < 0x7fffffff &&
+				(frame._kind == FRAME_SNAPSHOT || frame._kind == FRAME_DELTA);
+
+			if( !valid )
+				break;
+
+			if( frame._kind == FRAME_SNAPSHOT )
+				lastSnapshot = (int)_frames.size();
+			else if( lastSnapshot < 0 )
+				break; // a delta with nothing to apply it to
+
+			_frames.push_back(offset);
+			_snapshotOf.push_back(lastSnapshot);
+		}
+
+		offset += padded(chunk._size);
+	}
+
+	if( _frames.empty() )
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool Replayer::readFrame(int frame, ParticleStore* store, CameraPose* pose, float* timeDelta)
+{
+	if( frame < 0 || frame >= (int)_frames.size() || !store )
+		return false;
+
+	// carry on from the frame decoded last if it is on the way
+	int start = _snapshotOf[frame];
+	if( store == _target && _decoded >= start && _decoded < frame )
+		start = _decoded + 1;
+
+	for(int f = start; f <= frame; f++)
+	{
+		if( !decodeFrame(f, store) )
+		{
+			_target  = 0;
+			_decoded = -1;
+			return false;
+		}
+	}
+
+	_target  = store;
+	_decoded = frame;
+
+	FrameHeader header;
+	memcpy(&header, _file.data() + _frames[frame], sizeof(header));
+
+	if( pose )
+		*pose = header._pose;
+	if( timeDelta )
+		*timeDelta = header._timeDelta;
+
+	return true;
+}
+
+bool Replayer::decodeFrame(int frame, ParticleStore* store)
+{
+	const unsigned char* p = _file.data() + _frames[frame];
+
+	FrameHeader header;
+	memcpy(&header, p, sizeof(header));
+	p += sizeof(header);
+
+	int n = (int)header._numParticles;
+
+	if( header._kind == FRAME_SNAPSHOT )
+	{
+		if( store->capacity() < n )
+			store->reserve(n);
+		if( store->capacity() < n )
+			return false;
+
+		store->resize(n);
+
+		// the arrays are copied straight out of the mapping
+		memcpy(store->_posX,  p,              (size_t)n * 4);
+		memcpy(store->_posY,  p + n * 4,      (size_t)n * 4);
+		memcpy(store->_posZ,  p + n * 8,      (size_t)n * 4);
+		memcpy(store->_color, p + n * 12,     (size_t)n * 4);
+		return true;
+	}
+
+	// a delta applies to the frame before it
+	if( store->size() != n )
+		return false;
+
+	const short* dx = (const short*)p;
+	const short* dy = dx + n;
+	const short* dz = dy + n;
+	float        q  = header._quantum;
+
+	for(int i = 0; i < n; i++)
+	{
+		store->_posX[i] = store->_posX[i] + (float)dx[i] * q;
+		store->_posY[i] = store->_posY[i] + (float)dy[i] * q;
+		store->_posZ[i] = store->_posZ[i] + (float)dz[i] * q;
+	}
+
+	const unsigned char* jumps = p + deltaArraysSize(n);
+	for(unsigned int k = 0; k < header._numJumps; k++)
+	{
+		Jump jump;
+		memcpy(&jump, jumps + k * sizeof(Jump), sizeof(jump));
+
+		if( jump._index >= (unsigned int)n )
+			return false;
+
+		store->_posX[jump._index]  = jump._x;
+		store->_posY[jump._index]  = jump._y;
+		store->_posZ[jump._index]  = jump._z;
+		store->_color[jump._index] = jump._color;
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleRecord.h
+//
+// Author: William Cheung
+//
+// Desc: Recording of particle state and camera poses frame by frame into a compact
+//       chunked binary file, and playback of such a file through a memory mapping.
+//       A full snapshot is written every so often and quantized deltas in between,
+//       so a replay can start at any frame by decoding from the snapshot before it.
+//       Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleRecordH__
+#define __particleRecordH__
+
+#include "particleStore.h"
+#include "mappedFile.h"
+#include <cstdio>
+#include <vector>
+
+namespace psys
+{
+	// Desc: Where the camera was for a frame, the vectors kept by Camera.
+	struct CameraPose
+	{
+		float _position[3];
+		float _right[3];
+		float _up[3];
+		float _look[3];
+	};
+
+	class Recorder
+	{
+	public:
+		Recorder();
+		~Recorder();
+
+		// Desc: Starts a recording at path, replacing the file.  A full snapshot is
+		//       written at least every snapshotInterval frames and whenever the
+		//       number of particles changes; deltas to the frame before otherwise.
+		bool open(const char* path, int snapshotInterval = 60);
+		void close();
+		bool isOpen() const { return _file != 0; }
+
+		// Desc: Appends the positions and colors of the particles of store, with the
+		//       camera pose and time step of the frame.  Returns false once a write
+		//       failed, after which the recording is closed.
+		bool writeFrame(const ParticleStore& store, const CameraPose& pose, float timeDelta);
+
+		int getFrameCount() const { return _numFrames; }
+
+	private:
+		Recorder(const Recorder&);
+		Recorder& operator=(const Recorder&);
+
+		bool write(const void* data, size_t size);
+
+		FILE* _file;
+		int   _snapshotInterval;
+		int   _numFrames;
+		int   _sinceSnapshot;   // frames written since the last snapshot
+
+		// The state a replayer will have decoded for the last frame.  Deltas are
+		// taken against it rather than the exact state, so that the rounding of
+		// one frame is made up for by the next instead of adding up.
+		std::vector<float>        _x, _y, _z;
+		std::vector<unsigned int> _color;
+
+		// scratch for encoding a delta
+		std::vector<short>        _dx, _dy, _dz;
+		std::vector<int>          _jumps;
+	};
+
+	class Replayer
+	{
+	public:
+		Replayer();
+
+		// Desc: Maps the recording at path and indexes its frames.  Returns false if
+		//       the file can not be mapped or is not a valid recording.
+		bool open(const char* path);
+		void close();
+
+		int getFrameCount() const { return (int)_frames.size(); }
+
+		// whether frame was recorded whole rather than as a delta
+		bool isSnapshot(int frame) const { return _snapshotOf[frame] == frame; }
+
+		// Desc: Decodes frame into store, which is grown as needed, and returns the
+		//       camera pose and time step it was recorded with.  Only positions and
+		//       colors are recorded.  Reading the frames in order decodes one delta
+		//       per call; other frames are decoded from the snapshot before them.
+		//       store must not be changed between calls.
+		bool readFrame(int frame, ParticleStore* store, CameraPose* pose, float* timeDelta);
+
+	private:
+		bool decodeFrame(int frame, ParticleStore* store);
+
+		MappedFile          _file;
+		std::vector<size_t> _frames;     // offset of each frame's chunk payload
+		std::vector<int>    _snapshotOf; // the snapshot frame each frame is decoded from
+		ParticleStore*      _target;     // store the last frame was decoded into
+		int                 _decoded;    // that frame, -1 for none
+	};
+}
+
+#endif // __particleRecordH__
@@ -0,0 +1,698 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleSim.cpp
+//
+// Author: William Cheung
+//
+// Desc: The part of a particle system that does not draw.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleSim.h"
+#include "particleKernels.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace psys;
+
+// frames between regroupings of the particles by distance band
+static const unsigned int LOD_REGROUP_INTERVAL = 8;
+
+// out = a * b, laid out like D3DXMATRIX
+static void multiply(const float* a, const float* b, float* out)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			out[i * 4 + j] =
+				a[i * 4 + 0] * b[0 * 4 + j] + a[i * 4 + 1] * b[1 * 4 + j] +
+				a[i * 4 + 2] * b[2 * 4 + j] + a[i * 4 + 3] * b[3 * 4 + j];
+		}
+	}
+}
+
+// the point m takes to the origin, for an affine m, as the last row of its
+// inverse; left alone when m is singular
+static void findEye(const float* m, float* eye)
+{
+	// the inverse of the upper 3 x 3, from its cofactors
+	float c[9] = {
+		m[5] * m[10] - m[6] * m[9], m[2] * m[9] - m[1] * m[10], m[1] * m[6] - m[2] * m[5],
+		m[6] * m[8] - m[4] * m[10], m[0] * m[10] - m[2] * m[8], m[2] * m[4] - m[0] * m[6],
+		m[4] * m[9] - m[5] * m[8],  m[1] * m[8] - m[0] * m[9],  m[0] * m[5] - m[1] * m[4] };
+
+	float det = m[0] * c[0] + m[1] * c[3] + m[2] * c[6];
+	if( det == 0.0f )
+		return;
+
+	// eye = -t * inverse, t the translation row
+	for(int j = 0; j < 3; j++)
+		eye[j] = -(m[12] * c[j] + m[13] * c[3 + j] + m[14] * c[6 + j]) / det;
+}
+
+LodBand::LodBand(float distance, int tickInterval, float fraction)
+{
+	_distance     = distance;
+	_tickInterval = tickInterval > 1 ? tickInterval : 1;
+	_fraction     = fraction > 0.0f ? (fraction < 1.0f ? fraction : 1.0f) : 0.0f;
+	_sizeScale    = _fraction > 0.0f ? 1.0f / sqrtf(_fraction) : 1.0f;
+	_alphaScale   = 1.0f;
+}
+
+LodBand::LodBand(float distance, int tickInterval, float fraction, float sizeScale)
+{
+	*this = LodBand(distance, tickInterval, fraction);
+
+	// the drawn particles cover _fraction * _sizeScale^2 of what the whole band
+	// would, fade them if that is more.
+	_sizeScale = sizeScale;
+
+	float coverage = _fraction * _sizeScale * _sizeScale;
+	if( coverage > 1.0f )
+		_alphaScale = 1.0f / coverage;
+}
+
+//*****************************************************************************
+// Particle Simulation
+//***************
+
+ParticleSim::ParticleSim()
+{
+	_emitRate     = 0.0f;
+	_emitAccum    = 0.0f;
+	_size         = 1.0f;
+	_maxParticles = 0;
+	_pool         = 0;
+	_frame        = 0;
+	_culling      = true;
+	_sorting      = false;
+	_lodDirty     = true;
+
+	for(int a = 0; a < 3; a++)
+	{
+		_boxMin[a] = 0.0f;
+		_boxMax[a] = 0.0f;
+		_viewer[a] = 0.0f;
+	}
+
+	_lodStart.assign(1, 0);
+
+	// derive the system's seed from the application's, see rng::SetSeed
+	rng::Random& random = rng::ThreadRandom();
+	unsigned long long high = random.next();
+	setSeed((high << 32) | random.next());
+}
+
+ParticleSim::~ParticleSim()
+{
+}
+
+void ParticleSim::setJobPool(JobPool* pool)
+{
+	_pool = pool;
+}
+
+void ParticleSim::setCulling(bool enable)
+{
+	_culling = enable;
+}
+
+void ParticleSim::setFusedPacking(bool enable)
+{
+	_particles.setPacked(enable);
+}
+
+void ParticleSim::setSorting(bool enable)
+{
+	_sorting = enable;
+}
+
+void ParticleSim::setRenderSetup(const RenderSetup& setup)
+{
+	_lodBands = setup._lodBands;
+	_lodDirty = true;
+
+	setSorting(setup._sorting);
+	setFusedPacking(setup._fusedPacking);
+}
+
+const ParticleSim::Stats& ParticleSim::getStats() const
+{
+	return _stats;
+}
+
+const ParticleStore& ParticleSim::getParticles() const
+{
+	return _particles;
+}
+
+void ParticleSim::setSeed(unsigned long long seed)
+{
+	_seed   = seed;
+	_frame  = 0;
+	_random = rng::Random(seed);
+}
+
+void ParticleSim::forEachChunk(int begin, int end, int firstChunk, const JobPool::ChunkFunc& func)
+{
+	if( _pool )
+	{
+		_pool->parallelFor(begin, end, CHUNK_SIZE, [&](int chunk, int b, int e)
+		{
+			func(firstChunk + chunk, b, e);
+		});
+		return;
+	}
+
+	for(int b = begin, chunk = firstChunk; b < end; b += CHUNK_SIZE, chunk++)
+	{
+		int e = b + CHUNK_SIZE < end ? b + CHUNK_SIZE : end;
+		func(chunk, b, e);
+	}
+}
+
+void ParticleSim::driftParticles(float timeDelta)
+{
+	int numParticles = _particles.size();
+	if( numParticles == 0 )
+		return;
+
+	updateLod();
+	prepareScratch(numParticles);
+
+	forEachDueChunk(timeDelta, [this](int chunk, int begin, int end, float timeDelta)
+	{
+		int numEscaped = IntegrateParticles(
+			_particles,
+			begin, end,
+			timeDelta,
+			_boxMin,
+			_boxMax,
+			&_escaped[begin]);
+
+		if( numEscaped )
+		{
+			rng::Random random = chunkStream(chunk);
+			respawnParticles(&_escaped[begin], numEscaped, random);
+		}
+
+		ageParticles(chunk, begin, end, timeDelta);
+		FadeParticles(_particles, begin, end);
+		repackParticles(begin, end);
+	});
+
+	removeDeadParticles();
+}
+
+void ParticleSim::updateLod()
+{
+	int numBands     = (int)_lodBands.size();
+	int numParticles = _particles.size();
+
+	if( numBands == 0 )
+	{
+		_lodStart.assign(1, 0);
+		return;
+	}
+
+	// The bands are regrouped now and then rather than every frame: flakes
+	// drift slowly across band boundaries, and in between a particle that was
+	// moved by a removal just runs at the wrong detail for a few frames.
+	if( !_lodDirty && _frame % LOD_REGROUP_INTERVAL != 0 )
+		return;
+
+	if( (int)_lodKeys.size() < numParticles )
+		_lodKeys.resize(numParticles);
+
+	std::vector<float> distSq(numBands);
+	for(int b = 1; b < numBands; b++)
+		distSq[b - 1] = _lodBands[b]._distance * _lodBands[b]._distance;
+
+	float eye[3] = { _viewer[0], _viewer[1], _viewer[2] };
+
+	forEachChunk(0, numParticles, 0, [&](int chunk, int begin, int end)
+	{
+		ClassifyParticles(_particles, begin, end, eye, &distSq[0], numBands - 1, &_lodKeys[0]);
+	});
+
+	_lodStart.resize(numBands + 1);
+	PartitionParticles(_particles, 0, numParticles, &_lodKeys[0], numBands, &_lodStart[0]);
+
+	// the bands hold other particles now, their last depth order is no use
+	for(int r = 0; r < (int)_sorters.size(); r++)
+		_sorters[r].invalidate();
+
+	_lodDirty = false;
+}
+
+void ParticleSim::lodRange(int r, int* begin, int* end)
+{
+	// removals since the regroup may have shrunk the store under the bands
+	int numParticles = _particles.size();
+	int last         = (int)_lodStart.size() - 1;
+
+	*begin = _lodStart[r];
+	*end   = r < last ? _lodStart[r + 1] : numParticles;
+
+	if( *begin > numParticles ) *begin = numParticles;
+	if( *end   > numParticles ) *end   = numParticles;
+}
+
+void ParticleSim::forEachDueChunk(float timeDelta, const TickFunc& func)
+{
+	int numRanges  = (int)_lodStart.size();
+	int firstChunk = 0;
+
+	for(int r = 0; r < numRanges; r++)
+	{
+		int begin, end;
+		lodRange(r, &begin, &end);
+
+		// the bands tick on different frames to spread the work evenly
+		int interval = r < (int)_lodBands.size() ? _lodBands[r]._tickInterval : 1;
+
+		if( (_frame + r) % interval == 0 )
+		{
+			float dt = timeDelta * interval;
+			forEachChunk(begin, end, firstChunk, [&](int chunk, int b, int e)
+			{
+				func(chunk, b, e, dt);
+			});
+		}
+
+		firstChunk += (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	}
+}
+
+rng::Random ParticleSim::chunkStream(int chunk)
+{
+	// one stream per (frame, chunk) pair, whichever thread runs the chunk
+	return rng::Random(_seed, ((unsigned long long)_frame << 32) | (unsigned int)chunk);
+}
+
+void ParticleSim::addParticles(int count)
+{
+	// claim the slots, then spawn them in batches
+	const int BLOCK = 256;
+	int indices[BLOCK];
+
+	while( count > 0 && !_particles.full() )
+	{
+		int n = 0;
+		while( n < BLOCK && n < count && !_particles.full() )
+			indices[n++] = _particles.add();
+
+		respawnParticles(indices, n, _random);
+		repackParticles(indices[0], indices[0] + n);
+		count -= n;
+	}
+}
+
+void ParticleSim::emitParticles(float timeDelta)
+{
+	if( _emitRate <= 0.0f )
+		return;
+
+	_emitAccum += _emitRate * timeDelta;
+
+	int count = (int)_emitAccum;
+	_emitAccum -= (float)count;
+
+	addParticles(count);
+}
+
+void ParticleSim::prepareScratch(int count)
+{
+	// every range may end in a partial chunk
+	int numChunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE + (int)_lodStart.size();
+
+	if( (int)_escaped.size() < count )
+	{
+		_escaped.resize(count);
+		_expired.resize(count);
+	}
+	_chunkExpired.assign(numChunks, 0);
+	_chunkBegin.resize(numChunks);
+}
+
+void ParticleSim::ageParticles(int chunk, int begin, int end, float timeDelta)
+{
+	_chunkBegin[chunk]   = begin;
+	_chunkExpired[chunk] = AgeParticles(_particles, begin, end, timeDelta, &_expired[begin]);
+}
+
+void ParticleSim::repackParticles(int begin, int end)
+{
+	if( _particles.isPacked() )
+		PackParticles(_particles, begin, end, _particles._packed + begin);
+}
+
+bool ParticleSim::updatesSharedState() const
+{
+	return false;
+}
+
+void ParticleSim::collect(const float* world, const float* view, const float* proj, std::vector<DrawRun>* runs)
+{
+	//
+	// Remarks:  The vertices are packed into _staging chunk by chunk, in parallel when
+	//           a job pool is set, so that filling a section of the vertex buffer is a
+	//           plain memory copy.  Chunks whose bounds are outside the view frustum are
+	//           skipped, the particles of chunks that straddle it are tested one by one.
+	//           With distance bands (see _lodBands) each band is packed as a range of
+	//           its own, with its own point size.
+	//
+	//           With fused packing the update has already written the vertices into the
+	//           store, and chunks wholly in view are copied to the vertex buffer from there
+	//           without going through _staging.
+	//
+	//           With sorting each range is ordered back to front before packing (see
+	//           sortRange), and the ranges are drawn from the farthest band in.
+
+	if( _particles.empty() )
+	{
+		_stats = Stats();
+		return;
+	}
+
+	//
+	// cull and pack the particles of every chunk
+	//
+
+	int numParticles = _particles.size();
+	int numRanges    = (int)_lodStart.size();
+
+	// the particles are given in world space
+	float WV[16], WVP[16];
+	multiply(world, view, WV);
+	multiply(WV, proj, WVP);
+
+	// the viewer in particle space, for the distance bands of the next update
+	findEye(WV, _viewer);
+
+	Frustum frustum;
+	frustum.extract(WVP);
+
+	// Of every band only the first _fraction of its particles is drawn.  The
+	// order within a band only changes when the bands are regrouped, so the
+	// same particles stay visible from frame to frame.
+	std::vector<int> drawEnd(numRanges);
+	std::vector<int> firstChunk(numRanges + 1);
+	int              numDrawn = 0;
+
+	firstChunk[0] = 0;
+	for(int r = 0; r < numRanges; r++)
+	{
+		int begin, end;
+		lodRange(r, &begin, &end);
+
+		if( r < (int)_lodBands.size() )
+			end = begin + (int)ceilf((end - begin) * _lodBands[r]._fraction);
+
+		drawEnd[r]        = end;
+		firstChunk[r + 1] = firstChunk[r] + (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		numDrawn         += end - begin;
+	}
+
+	int numChunks = firstChunk[numRanges];
+
+	if( (int)_staging.size() < numChunks * CHUNK_SIZE )
+		_staging.resize(numChunks * CHUNK_SIZE);
+	_chunkCounts.assign(numChunks, 0);
+	_chunkSource.resize(numChunks);
+	_chunkVerdict.resize(numChunks);
+	_chunkDepth.resize(numChunks * 2);
+
+	// view space depth of a point p is p . axis + axis[3]
+	float axis[4] = { WV[2], WV[6], WV[10], WV[14] };
+	int   numResorted = 0;
+
+	const PackedParticle* packed = _particles._packed;
+
+	std::atomic<int> numChunksCulled(0);
+
+	for(int r = 0; r < numRanges; r++)
+	{
+		int first, last;
+		lodRange(r, &first, &last);
+
+		float size = _size;
+		float fade = 1.0f;
+		if( r < (int)_lodBands.size() )
+		{
+			size *= _lodBands[r]._sizeScale;
+			fade  = _lodBands[r]._alphaScale;
+		}
+
+		// keep sprites whose center is just outside but which still show
+		float margin = size;
+
+		if( _sorting )
+		{
+			numResorted += sortRange(r, first, drawEnd[r], firstChunk[r],
+				frustum, margin, fade, axis, numChunksCulled);
+			continue;
+		}
+
+		// faded vertices are written to _staging, the store's are left alone
+		bool direct = packed && fade >= 1.0f;
+
+		forEachChunk(first, drawEnd[r], firstChunk[r], [&](int chunk, int begin, int end)
+		{
+			PackedParticle* out = (PackedParticle*)&_staging[chunk * CHUNK_SIZE];
+			int             n   = 0;
+
+			_chunkSource[chunk] = &_staging[chunk * CHUNK_SIZE];
+
+			Frustum::Result result = Frustum::INSIDE;
+			if( _culling )
+			{
+				// test the chunk as a whole first
+				float lo[3], hi[3];
+				ComputeBounds(_particles, begin, end, lo, hi);
+				result = frustum.testBox(lo, hi, margin);
+			}
+
+			switch( result )
+			{
+			case Frustum::OUTSIDE:
+				numChunksCulled++;
+				break;
+			case Frustum::INSIDE:
+				if( direct )
+				{
+					_chunkSource[chunk] = packed + begin;
+					n = end - begin;
+				}
+				else
+				{
+					n = PackParticles(_particles, begin, end, out);
+				}
+				break;
+			default:
+				n = CullParticles(_particles, begin, end, frustum, margin, out);
+				break;
+			}
+
+			if( fade < 1.0f )
+			{
+				for(int k = 0; k < n; k++)
+				{
+					unsigned int alpha = (unsigned int)((out[k]._color >> 24) * fade);
+					out[k]._color = (out[k]._color & 0x00ffffff) | (alpha << 24);
+				}
+			}
+
+			_chunkCounts[chunk] = n;
+		});
+	}
+
+	int numSubmitted = 0;
+	for(int chunk = 0; chunk < numChunks; chunk++)
+		numSubmitted += _chunkCounts[chunk];
+
+	_stats._numParticles    = numParticles;
+	_stats._numSubmitted    = numSubmitted;
+	_stats._numCulled       = numDrawn - numSubmitted;
+	_stats._numChunksCulled = numChunksCulled;
+	_stats._numDrawCalls    = 0;
+	_stats._numLodSkipped   = numParticles - numDrawn;
+	_stats._numResorted     = numResorted;
+
+	//
+	// hand out a run per chunk, in drawing order
+	//
+
+	for(int k = 0; k < numRanges; k++)
+	{
+		// sorted, the far bands go first
+		int r = _sorting ? numRanges - 1 - k : k;
+
+		float size = _size;
+		if( r < (int)_lodBands.size() )
+			size *= _lodBands[r]._sizeScale;
+
+		for(int chunk = firstChunk[r]; chunk < firstChunk[r + 1]; chunk++)
+		{
+			if( _chunkCounts[chunk] == 0 )
+				continue;
+
+			DrawRun run;
+			run._tex      = 0;
+			run._size     = size;
+			run._vertices = _chunkSource[chunk];
+			run._count    = _chunkCounts[chunk];
+			runs->push_back(run);
+		}
+	}
+}
+
+int ParticleSim::sortRange(
+	int r, int first, int end, int firstChunk,
+	const Frustum& frustum, float margin, float fade,
+	const float axis[4], std::atomic<int>& numChunksCulled)
+{
+	int numParticles = end - first;
+	if( numParticles <= 0 )
+		return 0;
+
+	int numChunks = (numParticles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	// test the chunks against the frustum, and find how deep the box of each
+	// reaches along the axis
+	forEachChunk(first, end, firstChunk, [&](int chunk, int begin, int end)
+	{
+		float lo[3], hi[3];
+		ComputeBounds(_particles, begin, end, lo, hi);
+
+		Frustum::Result result = _culling ? frustum.testBox(lo, hi, margin) : Frustum::INSIDE;
+		_chunkVerdict[chunk] = (unsigned char)result;
+
+		float nearDepth = axis[3], farDepth = axis[3];
+		for(int a = 0; a < 3; a++)
+		{
+			float l = lo[a] * axis[a], h = hi[a] * axis[a];
+			nearDepth += l < h ? l : h;
+			farDepth  += l < h ? h : l;
+		}
+		_chunkDepth[chunk * 2]     = nearDepth;
+		_chunkDepth[chunk * 2 + 1] = farDepth;
+	});
+
+	// the keys only need to tell apart the depths of the chunks in view
+	float nearDepth = FLT_MAX, farDepth = -FLT_MAX;
+	for(int chunk = firstChunk; chunk < firstChunk + numChunks; chunk++)
+	{
+		_chunkCounts[chunk] = 0;
+		_chunkSource[chunk] = &_staging[chunk * CHUNK_SIZE];
+
+		if( _chunkVerdict[chunk] == Frustum::OUTSIDE )
+		{
+			numChunksCulled++;
+			continue;
+		}
+		if( _chunkDepth[chunk * 2]     < nearDepth ) nearDepth = _chunkDepth[chunk * 2];
+		if( _chunkDepth[chunk * 2 + 1] > farDepth  ) farDepth  = _chunkDepth[chunk * 2 + 1];
+	}
+
+	if( nearDepth > farDepth )
+		return 0; // nothing in view
+
+	if( (int)_sortKeys.size() < numParticles )
+		_sortKeys.resize(numParticles);
+
+	// chunks out of view get any key, their particles are dropped below
+	forEachChunk(first, end, firstChunk, [&](int chunk, int begin, int end)
+	{
+		unsigned short* key = &_sortKeys[begin - first];
+
+		if( _chunkVerdict[chunk] == Frustum::OUTSIDE )
+			memset(key, 0, (end - begin) * sizeof(unsigned short));
+		else
+			ComputeDepthKeys(_particles, begin, end, axis, nearDepth, farDepth, key);
+	});
+
+	if( (int)_sorters.size() <= r )
+		_sorters.resize(r + 1);
+
+	const int* order = _sorters[r].sort(&_sortKeys[0], numParticles, _pool);
+
+	// pack the particles in view in sorted order, part k of the order
+	// into chunk firstChunk + k of _staging
+	const PackedParticle* packed = _particles._packed;
+
+	forEachChunk(0, numParticles, firstChunk, [&](int chunk, int begin, int end)
+	{
+		PackedParticle* out = (PackedParticle*)&_staging[chunk * CHUNK_SIZE];
+		int             n   = 0;
+
+		for(int k = begin; k < end; k++)
+		{
+			int item    = order[k];
+			int i       = first + item;
+			int verdict = _chunkVerdict[firstChunk + item / CHUNK_SIZE];
+
+			if( verdict == Frustum::OUTSIDE )
+				continue;
+
+			if( verdict == Frustum::INTERSECTS &&
+				!frustum.testPoint(_particles._posX[i], _particles._posY[i], _particles._posZ[i], margin) )
+				continue;
+
+			if( packed )
+			{
+				out[n] = packed[i];
+			}
+			else
+			{
+				out[n]._x     = _particles._posX[i];
+				out[n]._y     = _particles._posY[i];
+				out[n]._z     = _particles._posZ[i];
+				out[n]._color = _particles._color[i];
+			}
+
+			if( fade < 1.0f )
+			{
+				unsigned int alpha = (unsigned int)((out[n]._color >> 24) * fade);
+				out[n]._color = (out[n]._color & 0x00ffffff) | (alpha << 24);
+			}
+			n++;
+		}
+
+		_chunkCounts[chunk] = n;
+	});
+
+	return _sorters[r].getLastMethod() == DepthSorter::RADIX ? numParticles : 0;
+}
+
+bool ParticleSim::isEmpty()
+{
+	return _particles.empty();
+}
+
+bool ParticleSim::isDead()
+{
+	// dead particles leave the store as soon as they die, so the
+	// system is dead when no particle is left.
+	return _particles.empty();
+}
+
+void ParticleSim::removeDeadParticles()
+{
+	// Each chunk's list is increasing and later chunks hold higher indices,
+	// so walking the chunks backwards removes from the highest index down.
+	for(int chunk = (int)_chunkExpired.size() - 1; chunk >= 0; chunk--)
+	{
+		if( _chunkExpired[chunk] )
+		{
+			_particles.removeSorted(&_expired[_chunkBegin[chunk]], _chunkExpired[chunk]);
+			_chunkExpired[chunk] = 0;
+			_lodDirty = true;
+
+			for(int r = 0; r < (int)_sorters.size(); r++)
+				_sorters[r].invalidate();
+		}
+	}
+}
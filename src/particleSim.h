@@ -0,0 +1,261 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleSim.h
+//
+// Author: William Cheung
+//
+// Desc: The part of a particle system that does not draw: the store of particles
+//       and its update in chunks over a job pool, the distance bands, and the
+//       culling, sorting and packing of the particles in view into runs of
+//       vertices.  PSystem and ParticleWorld draw the runs with Direct3D; this
+//       part does not depend on it, so the headless tools run the same code.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleSimH__
+#define __particleSimH__
+
+#include "particleStore.h"
+#include "particleSort.h"
+#include "frustum.h"
+#include "jobPool.h"
+#include "random.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+struct IDirect3DTexture9;
+
+namespace psys
+{
+	// Desc: A distance band of the level of detail scheme.  The particles from
+	//       _distance away from the viewer up to the next band are updated every
+	//       _tickInterval frames, with a time step that much longer, and only
+	//       _fraction of them is drawn.  The drawn ones are made _sizeScale times
+	//       larger and _alphaScale times as opaque, so that the band covers about
+	//       as much of the screen as it would at full detail.
+	struct LodBand
+	{
+		LodBand(float distance, int tickInterval, float fraction);
+		LodBand(float distance, int tickInterval, float fraction, float sizeScale);
+
+		float _distance;
+		int   _tickInterval;
+		float _fraction;
+		float _sizeScale;  // 1 / sqrt(_fraction) unless given
+		float _alphaScale; // makes up for what _sizeScale leaves, at most 1
+	};
+
+
+	// Desc: How a system draws its particles.  A replay is given the setup of
+	//       the system it recorded, so that it costs the same to draw.
+	struct RenderSetup
+	{
+		RenderSetup() { _sorting = false; _fusedPacking = false; }
+
+		std::vector<LodBand> _lodBands;     // see ParticleSim::_lodBands
+		bool                 _sorting;      // see ParticleSim::setSorting
+		bool                 _fusedPacking; // see ParticleSim::setFusedPacking
+	};
+
+
+	// Desc: _count vertices drawn with one texture and point size.  Systems
+	//       collect the particles they show into runs so that the runs of
+	//       several systems can be drawn through one vertex buffer.
+	struct DrawRun
+	{
+		IDirect3DTexture9*    _tex;
+		float                 _size;
+		const PackedParticle* _vertices;
+		int                   _count;
+	};
+
+
+	class ParticleSim
+	{
+	public:
+		// Desc: What the last collect did with the particles.
+		struct Stats
+		{
+			Stats()
+			{
+				_numParticles    = 0;
+				_numSubmitted    = 0;
+				_numCulled       = 0;
+				_numChunksCulled = 0;
+				_numDrawCalls    = 0;
+				_numLodSkipped   = 0;
+				_numResorted     = 0;
+			}
+
+			int _numParticles;    // particles in the system
+			int _numSubmitted;    // particles written to the vertex buffer
+			int _numCulled;       // particles outside the view frustum
+			int _numChunksCulled; // chunks rejected as a whole
+			int _numDrawCalls;    // DrawPrimitive calls made
+			int _numLodSkipped;   // particles left out by the distance bands
+			int _numResorted;     // particles sorted from scratch rather than from the last order
+		};
+
+		// particles are simulated and packed in chunks of this many, each chunk
+		// possibly on another thread.  Chunking is independent of the thread count.
+		static const int CHUNK_SIZE = 4096;
+
+		ParticleSim();
+		virtual ~ParticleSim();
+
+		// spread update and collect over the threads of pool, 0 for none
+		void setJobPool(JobPool* pool);
+
+		// view frustum culling of particles in collect, on by default
+		void setCulling(bool enable);
+
+		// Fused packing, off by default: update writes every particle it
+		// moves as a vertex into the store while the particle is at hand, and
+		// collect copies the vertices of the chunks in view straight from there.
+		// Systems whose update does not repack its chunks must leave it off.
+		void setFusedPacking(bool enable);
+
+		// Back-to-front sorting, off by default: the particles in view are drawn
+		// sorted by view depth so that they blend correctly.  Each distance band
+		// is sorted on its own and the bands are drawn from the farthest in.
+		void setSorting(bool enable);
+
+		// the distance bands, sorting and fused packing all at once
+		void setRenderSetup(const RenderSetup& setup);
+
+		const Stats& getStats() const;
+
+		// the particles as of the last update, for recording
+		const ParticleStore& getParticles() const;
+
+		// seed of the random streams used for spawning particles
+		void setSeed(unsigned long long seed);
+
+		// respawn the particles of the store at the given indices in one call.
+		// Particles are recycled rather than freed; all randomness must come
+		// from random so that respawns are reproducible.
+		virtual void respawnParticles(const int* indices, int count, rng::Random& random) = 0;
+
+		// add count particles at once, for bursts.  Particles that do not fit
+		// in the _maxParticles sized pool are dropped.
+		void addParticles(int count);
+
+		virtual void update(float timeDelta) = 0;
+
+		// Desc: Culls, sorts and packs the particles in view of the transforms,
+		//       laid out like D3DXMATRIX, and appends the runs to draw them with,
+		//       in drawing order and without a texture, to runs.  The vertices
+		//       stay valid until the next update or collect.  Fills in the stats
+		//       but for the draw calls.
+		void collect(const float* world, const float* view, const float* proj, std::vector<DrawRun>* runs);
+
+		// true for systems whose update writes to something outside the system,
+		// such as a terrain, and so must not run alongside other systems' updates
+		virtual bool updatesSharedState() const;
+
+		// both O(1): the store only holds living particles
+		bool isEmpty();
+		bool isDead();
+
+	protected:
+		// chunk is numbered across all the ranges run in one frame
+		typedef std::function<void(int chunk, int begin, int end, float timeDelta)> TickFunc;
+
+		// add the particles due at _emitRate over timeDelta
+		void emitParticles(float timeDelta);
+
+		// age the particles of a chunk, remembering the ones that expired
+		void ageParticles(int chunk, int begin, int end, float timeDelta);
+
+		// remove the particles remembered by ageParticles with swap-with-last
+		virtual void removeDeadParticles();
+
+		// size the per-particle and per-chunk scratch arrays for count particles
+		void prepareScratch(int count);
+
+		// write the vertices of particles [begin, end) when fused packing is on
+		void repackParticles(int begin, int end);
+
+		// run func on the CHUNK_SIZE chunks of [begin, end), numbered from
+		// firstChunk, in parallel if a job pool was given
+		void forEachChunk(int begin, int end, int firstChunk, const JobPool::ChunkFunc& func);
+
+		// move every particle by its velocity and age it, fading it out over its
+		// lifetime.  Particles that leave the bounding box are respawned.
+		void driftParticles(float timeDelta);
+
+		// regroup the particles by distance band when it is due, see _lodBands
+		void updateLod();
+
+		// [begin, end) of range r of the store: band r, or for the last range
+		// the particles added since the bands were last regrouped
+		void lodRange(int r, int* begin, int* end);
+
+		// run func on the chunks of the ranges due for an update this frame,
+		// passing each the time step its band is due
+		void forEachDueChunk(float timeDelta, const TickFunc& func);
+
+		// sort the particles [first, end) of range r by depth along axis and
+		// pack the ones in view, in that order, into the chunks from firstChunk.
+		// Returns the number that had to be sorted from scratch.
+		int sortRange(
+			int r, int first, int end, int firstChunk,
+			const Frustum& frustum, float margin, float fade,
+			const float axis[4], std::atomic<int>& numChunksCulled);
+
+		// random stream owned by a chunk for the current frame
+		rng::Random chunkStream(int chunk);
+
+	protected:
+		float         _boxMin[3];  // bounding box the particles live in
+		float         _boxMax[3];
+		float         _emitRate;   // rate new particles are added to system
+		float         _emitAccum;  // fraction of a particle owed by _emitRate
+		float         _size;       // size of particles
+		ParticleStore _particles;
+		int           _maxParticles; // max allowed particles system can have, sizes _particles
+
+		std::vector<int> _escaped;      // scratch for indices of particles that left the box
+		std::vector<int> _expired;      // scratch for indices of particles that died of age
+		std::vector<int> _chunkExpired; // number of entries of _expired used by each chunk
+		std::vector<int> _chunkBegin;   // first particle of each chunk, where its entries start
+
+		JobPool*           _pool;
+		rng::Random        _random;      // stream for spawns outside of update
+		unsigned long long _seed;
+		unsigned int       _frame;       // number of updates so far, selects chunk streams
+
+		std::vector<PackedParticle>        _staging;     // vertices packed per chunk, CHUNK_SIZE apart
+		std::vector<int>                   _chunkCounts; // number of vertices packed for each chunk
+		std::vector<const PackedParticle*> _chunkSource; // where they are, _staging or the store
+
+		bool                         _sorting;
+		std::vector<DepthSorter>     _sorters;      // one per range, keeping its last order
+		std::vector<unsigned short>  _sortKeys;     // scratch for the depth key of each particle
+		std::vector<unsigned char>   _chunkVerdict; // scratch for the Frustum::Result of each chunk
+		std::vector<float>           _chunkDepth;   // scratch for the depth range of each chunk
+
+		bool  _culling;
+		Stats _stats;
+
+		//
+		// Level of detail, set up by subclasses
+		//
+
+		// bands by increasing distance, the first one starting at the viewer.
+		// No bands, the default, simulates and draws every particle every frame.
+		std::vector<LodBand> _lodBands;
+
+		std::vector<int>           _lodStart; // band b holds [_lodStart[b], _lodStart[b + 1])
+		std::vector<unsigned char> _lodKeys;  // scratch for the band of each particle
+		bool                       _lodDirty; // particles were removed since the last regroup
+		float                      _viewer[3]; // eye position of the last collect
+
+	private:
+		ParticleSim(const ParticleSim&);
+		ParticleSim& operator=(const ParticleSim&);
+	};
+}
+
+#endif // __particleSimH__
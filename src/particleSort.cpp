@@ -0,0 +1,274 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleSort.cpp
+//
+// Author: William Cheung
+//
+// Desc: Sorting of particles by depth keys.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleSort.h"
+#include <algorithm>
+
+using namespace psys;
+
+// An insertion sort of n items costs about n plus the number of places the items
+// have to move.  Past this many moves per item the radix sort is cheaper.
+static const int MAX_MOVES_PER_ITEM = 2;
+
+// Items whose key moved more than this since the last frame, as particles that
+// respawn do, would each cost an insertion sort up to the whole list; they are
+// taken out, sorted on their own and merged back in.  Past one in this many
+// items taken out the radix sort is cheaper.
+static const int MAX_KEY_STEP     = 256;
+static const int MAX_JUMPED_SHARE = 64;
+
+// Once the last order did not pay off it is only tried again this often: dense
+// particles or a moving camera shuffle the order too much for it to help, and
+// reading the keys through it costs a cache miss per item.
+static const int RETRY_INTERVAL = 16;
+
+DepthSorter::DepthSorter()
+{
+	_valid      = false;
+	_lastMethod = NONE;
+	_sinceTried = 0;
+}
+
+const int* DepthSorter::sort(const unsigned short* keys, int count, JobPool* pool)
+{
+	if( count <= 0 )
+	{
+		_lastMethod = NONE;
+		_valid      = false;
+		return 0;
+	}
+
+	bool tryLast = _valid && (int)_order.size() == count &&
+		(_lastMethod == INCREMENTAL || ++_sinceTried >= RETRY_INTERVAL);
+
+	// start from the last order, or from the items' own
+	if( tryLast )
+	{
+		_sinceTried = 0;
+	}
+	else
+	{
+		_order.resize(count);
+		for(int i = 0; i < count; i++)
+			_order[i] = i;
+	}
+
+	// the items in the last order, but for those whose key jumped, which
+	// go to _jumped, keyed in the high bits
+	int numKept = count;
+
+	if( tryLast )
+	{
+		_jumped.clear();
+		numKept = 0;
+
+		for(int i = 0; i < count; i++)
+		{
+			int item = _order[i];
+			int key  = keys[item];
+			int step = key - _keys[i];
+
+			if( step > MAX_KEY_STEP || step < -MAX_KEY_STEP )
+			{
+				_jumped.push_back(((unsigned long long)key << 32) | (unsigned int)item);
+				continue;
+			}
+			_order[numKept] = item;
+			_keys[numKept]  = (unsigned short)key;
+			numKept++;
+		}
+	}
+	else
+	{
+		_keys.resize(count);
+		for(int i = 0; i < count; i++)
+			_keys[i] = keys[_order[i]];
+	}
+
+	if( tryLast && (int)_jumped.size() <= count / MAX_JUMPED_SHARE && insertionSort(numKept) )
+	{
+		mergeJumped(numKept);
+		_lastMethod = INCREMENTAL;
+	}
+	else
+	{
+		// any order will do for the radix sort, the jumped items go last
+		for(int i = numKept; i < count; i++)
+		{
+			_order[i] = (int)(_jumped[i - numKept] & 0xffffffff);
+			_keys[i]  = (unsigned short)(_jumped[i - numKept] >> 32);
+		}
+		radixSort(count, pool);
+		_lastMethod = RADIX;
+	}
+
+	_valid = true;
+	return &_order[0];
+}
+
+bool DepthSorter::insertionSort(int count)
+{
+	unsigned short* keys  = &_keys[0];
+	int*            order = &_order[0];
+
+	long long budget = (long long)count * MAX_MOVES_PER_ITEM;
+
+	// every item out of place moves at least one place, so when many are
+	// there is no point starting
+	long long numDescents = 0;
+	for(int i = 1; i < count; i++)
+		numDescents += keys[i] < keys[i - 1];
+	if( numDescents > budget / 4 )
+		return false;
+
+	for(int i = 1; i < count; i++)
+	{
+		unsigned short key = keys[i];
+		if( keys[i - 1] <= key )
+			continue;
+
+		int item = order[i];
+		int j    = i;
+		while( j > 0 && keys[j - 1] > key )
+		{
+			keys[j]  = keys[j - 1];
+			order[j] = order[j - 1];
+			j--;
+		}
+		keys[j]  = key;
+		order[j] = item;
+
+		// too far from sorted, leave the rest to the radix sort, which
+		// does not mind that the first i items are in order
+		budget -= i - j;
+		if( budget < 0 )
+			return false;
+	}
+	return true;
+}
+
+void DepthSorter::mergeJumped(int numKept)
+{
+	if( _jumped.empty() )
+		return;
+
+	std::sort(_jumped.begin(), _jumped.end());
+
+	int count = numKept + (int)_jumped.size();
+	_orderTemp.resize(count);
+	_keysTemp.resize(count);
+
+	// the kept items first among equal keys, as they were
+	int i = 0, j = 0;
+	for(int k = 0; k < count; k++)
+	{
+		if( j == (int)_jumped.size() || (i < numKept && _keys[i] <= (_jumped[j] >> 32)) )
+		{
+			_orderTemp[k] = _order[i];
+			_keysTemp[k]  = _keys[i];
+			i++;
+		}
+		else
+		{
+			_orderTemp[k] = (int)(_jumped[j] & 0xffffffff);
+			_keysTemp[k]  = (unsigned short)(_jumped[j] >> 32);
+			j++;
+		}
+	}
+
+	_order.swap(_orderTemp);
+	_keys.swap(_keysTemp);
+}
+
+void DepthSorter::radixSort(int count, JobPool* pool)
+{
+	int numBlocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	_orderTemp.resize(count);
+	_keysTemp.resize(count);
+	_offsets.resize(numBlocks * 256);
+
+	int*            srcOrder = &_order[0];
+	unsigned short* srcKeys  = &_keys[0];
+	int*            dstOrder = &_orderTemp[0];
+	unsigned short* dstKeys  = &_keysTemp[0];
+	int*            offsets  = &_offsets[0];
+
+	auto forEachBlock = [&](const JobPool::ChunkFunc& func)
+	{
+		if( pool )
+		{
+			pool->parallelFor(0, count, BLOCK_SIZE, func);
+			return;
+		}
+		for(int b = 0, block = 0; b < count; b += BLOCK_SIZE, block++)
+			func(block, b, b + BLOCK_SIZE < count ? b + BLOCK_SIZE : count);
+	};
+
+	for(int shift = 0; shift < 16; shift += 8)
+	{
+		// count the digits of every block
+		forEachBlock([&](int block, int begin, int end)
+		{
+			int* histogram = &offsets[block * 256];
+			for(int d = 0; d < 256; d++)
+				histogram[d] = 0;
+			for(int i = begin; i < end; i++)
+				histogram[(srcKeys[i] >> shift) & 0xff]++;
+		});
+
+		// a digit every key shares does not reorder anything; depths within
+		// a band often share the high byte
+		int numDigits = 0;
+		for(int d = 0; d < 256; d++)
+		{
+			int total = 0;
+			for(int block = 0; block < numBlocks; block++)
+				total += offsets[block * 256 + d];
+			numDigits += total > 0;
+		}
+		if( numDigits <= 1 )
+			continue;
+
+		// turn the counts into where each block's items of each digit start,
+		// digit by digit and block by block within a digit to keep it stable
+		int next = 0;
+		for(int d = 0; d < 256; d++)
+		{
+			for(int block = 0; block < numBlocks; block++)
+			{
+				int n = offsets[block * 256 + d];
+				offsets[block * 256 + d] = next;
+				next += n;
+			}
+		}
+
+		forEachBlock([&](int block, int begin, int end)
+		{
+			int* offset = &offsets[block * 256];
+			for(int i = begin; i < end; i++)
+			{
+				int k = offset[(srcKeys[i] >> shift) & 0xff]++;
+				dstOrder[k] = srcOrder[i];
+				dstKeys[k]  = srcKeys[i];
+			}
+		});
+
+		int*            t = srcOrder; srcOrder = dstOrder; dstOrder = t;
+		unsigned short* u = srcKeys;  srcKeys  = dstKeys;  dstKeys  = u;
+	}
+
+	// after an odd number of passes the result is in the scratch
+	if( srcOrder != &_order[0] )
+	{
+		_order.swap(_orderTemp);
+		_keys.swap(_keysTemp);
+	}
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleSort.h
+//
+// Author: William Cheung
+//
+// Desc: Sorting of particles by 16 bit depth keys for back-to-front drawing.  An LSD
+//       radix sort, two passes of 8 bits, run in parallel on a job pool if one is
+//       given.  Because a scene changes little from one frame to the next, the
+//       order of the last sort is kept and tried first: if it is nearly right it
+//       is finished with an insertion sort, the few items whose keys jumped
+//       since (respawned particles) sorted apart and merged in.  Does not
+//       depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleSortH__
+#define __particleSortH__
+
+#include "jobPool.h"
+#include <vector>
+
+namespace psys
+{
+	class DepthSorter
+	{
+	public:
+		enum Method { NONE, INCREMENTAL, RADIX };
+
+		// items are sorted in blocks of this many in parallel, independent of the
+		// number of threads, so the result is too
+		static const int BLOCK_SIZE = 16384;
+
+		DepthSorter();
+
+		// Desc: Orders the items 0 .. count - 1 by increasing keys[i] and returns the
+		//       order, valid until the next call.  When the last sort was of count
+		//       items too and invalidate was not called since, it is taken as the
+		//       items' order of the last frame and tried first while it keeps paying
+		//       off, and every few frames otherwise.
+		const int* sort(const unsigned short* keys, int count, JobPool* pool = 0);
+
+		// Desc: The items were renumbered, the last order means nothing anymore.
+		void invalidate() { _valid = false; }
+
+		// how the last sort went
+		Method getLastMethod() const { return _lastMethod; }
+
+	private:
+		bool insertionSort(int count);
+		void mergeJumped(int numKept);
+		void radixSort(int count, JobPool* pool);
+
+		std::vector<int>            _order;     // items by increasing key
+		std::vector<unsigned short> _keys;      // their keys, in the same order
+		std::vector<int>            _orderTemp; // scratch of the radix passes
+		std::vector<unsigned short> _keysTemp;
+		std::vector<int>            _offsets;   // 256 per block, where each digit goes
+		std::vector<unsigned long long> _jumped; // key << 32 | item of items taken out of the last order
+		bool                        _valid;
+		Method                      _lastMethod;
+		int                         _sinceTried; // sorts since the last order was last tried
+	};
+}
+
+#endif // __particleSortH__
@@ -0,0 +1,214 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleStore.cpp
+//
+// Author: William Cheung
+//
+// Desc: Structure-of-arrays storage for the particles of a particle system.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleStore.h"
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+using namespace psys;
+
+static const size_t BYTE_ALIGNMENT = 32; // wide enough for 256-bit loads
+
+static void* alignedAlloc(size_t bytes)
+{
+#ifdef _MSC_VER
+	return _aligned_malloc(bytes, BYTE_ALIGNMENT);
+#else
+	void* p = 0;
+	if( posix_memalign(&p, BYTE_ALIGNMENT, bytes) != 0 )
+		return 0;
+	return p;
+#endif
+}
+
+static void alignedFree(void* p)
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+ParticleStore::ParticleStore()
+{
+	_block    = 0;
+	_size     = 0;
+	_capacity = 0;
+
+	_posX  = _posY = _posZ = 0;
+	_velX  = _velY = _velZ = 0;
+	_color = 0;
+	_age   = 0;
+	_lifeTime = 0;
+	_packed   = 0;
+}
+
+ParticleStore::~ParticleStore()
+{
+	setPacked(false);
+	release();
+}
+
+void ParticleStore::release()
+{
+	if( _block )
+		alignedFree(_block);
+
+	_block    = 0;
+	_size     = 0;
+	_capacity = 0;
+}
+
+void ParticleStore::reserve(int capacity)
+{
+	release();
+
+	if( capacity <= 0 )
+		return;
+
+	// round up so the tail of every array is a whole vector
+	size_t n = (size_t)((capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+
+	// 9 four-byte arrays
+	size_t wordArrayBytes = n * 4;
+	size_t totalBytes     = wordArrayBytes * 9;
+
+	_block = alignedAlloc(totalBytes);
+	if( !_block )
+		return;
+
+	::memset(_block, 0, totalBytes);
+
+	char* p = (char*)_block;
+	_posX  = (float*)p;        p += wordArrayBytes;
+	_posY  = (float*)p;        p += wordArrayBytes;
+	_posZ  = (float*)p;        p += wordArrayBytes;
+	_velX  = (float*)p;        p += wordArrayBytes;
+	_velY  = (float*)p;        p += wordArrayBytes;
+	_velZ  = (float*)p;        p += wordArrayBytes;
+	_color = (unsigned int*)p; p += wordArrayBytes;
+	_age   = (float*)p;        p += wordArrayBytes;
+	_lifeTime = (float*)p;
+
+	_capacity = capacity;
+
+	if( _packed )
+		allocatePacked();
+}
+
+void ParticleStore::allocatePacked()
+{
+	alignedFree(_packed);
+
+	size_t n = (size_t)((_capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+	_packed  = (PackedParticle*)alignedAlloc((n ? n : ALIGNMENT) * sizeof(PackedParticle));
+}
+
+void ParticleStore::setPacked(bool enable)
+{
+	if( !enable )
+	{
+		if( _packed )
+			alignedFree(_packed);
+		_packed = 0;
+		return;
+	}
+
+	if( _packed )
+		return;
+
+	allocatePacked();
+	if( !_packed )
+		return;
+
+	for(int i = 0; i < _size; i++)
+	{
+		_packed[i]._x     = _posX[i];
+		_packed[i]._y     = _posY[i];
+		_packed[i]._z     = _posZ[i];
+		_packed[i]._color = _color[i];
+	}
+}
+
+void ParticleStore::clear()
+{
+	_size = 0;
+}
+
+int ParticleStore::add()
+{
+	if( full() )
+		return -1;
+
+	return _size++;
+}
+
+void ParticleStore::resize(int count)
+{
+	if( count < 0 )
+		count = 0;
+	_size = count < _capacity ? count : _capacity;
+}
+
+template<class T> static inline void swapValues(T* a, int i, int j)
+{
+	T t = a[i];
+	a[i] = a[j];
+	a[j] = t;
+}
+
+void ParticleStore::swap(int i, int j)
+{
+	swapValues(_posX, i, j);
+	swapValues(_posY, i, j);
+	swapValues(_posZ, i, j);
+	swapValues(_velX, i, j);
+	swapValues(_velY, i, j);
+	swapValues(_velZ, i, j);
+	swapValues(_color, i, j);
+	swapValues(_age, i, j);
+	swapValues(_lifeTime, i, j);
+
+	if( _packed )
+		swapValues(_packed, i, j);
+}
+
+void ParticleStore::remove(int i)
+{
+	int last = --_size;
+	if( i == last )
+		return;
+
+	_posX[i]     = _posX[last];
+	_posY[i]     = _posY[last];
+	_posZ[i]     = _posZ[last];
+	_velX[i]     = _velX[last];
+	_velY[i]     = _velY[last];
+	_velZ[i]     = _velZ[last];
+	_color[i]    = _color[last];
+	_age[i]      = _age[last];
+	_lifeTime[i] = _lifeTime[last];
+
+	if( _packed )
+		_packed[i] = _packed[last];
+}
+
+void ParticleStore::removeSorted(const int* indices, int count)
+{
+	// Going from the highest index down, the particle moved into a freed
+	// slot always comes from past it, so it is never one still to be removed.
+	for(int k = count - 1; k >= 0; k--)
+		remove(indices[k]);
+}
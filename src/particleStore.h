@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleStore.h
+//
+// Author: William Cheung
+//
+// Desc: Structure-of-arrays storage for the particles of a particle system.  Every
+//       component lives in its own contiguous array so the per-frame passes only pull
+//       the data they touch through the cache.  The store does not depend on Direct3D.
+//
+//       The store is a preallocated pool: the living particles are always exactly
+//       the slots [0, size()), a dead particle's slot is refilled with the last one.
+//
+//       Optionally the store also keeps every particle as a render-ready vertex, so
+//       that the simulation can write vertices while it has the particle at hand
+//       and drawing does not have to walk the arrays again.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleStoreH__
+#define __particleStoreH__
+
+namespace psys
+{
+	// Desc: Point sprite vertex, laid out like psys::Particle (position followed by
+	//       a D3DCOLOR).
+	struct PackedParticle
+	{
+		float        _x, _y, _z;
+		unsigned int _color;
+	};
+
+	class ParticleStore
+	{
+	public:
+		// arrays are padded to a multiple of this many elements and aligned
+		// so that vector code may always process whole lanes.
+		static const int ALIGNMENT = 8;
+
+		ParticleStore();
+		~ParticleStore();
+
+		// Desc: Allocates room for capacity particles and empties the store.
+		void reserve(int capacity);
+
+		// Desc: Keeps a packed vertex of every particle in _packed, or drops them.
+		//       swap and remove move the vertices along with their particles, but
+		//       nothing else writes them: whoever moves or recolors particles
+		//       repacks them.  Enabling packs the particles there are.
+		void setPacked(bool enable);
+		bool isPacked() const { return _packed != 0; }
+
+		// Desc: Removes all particles, keeping the allocation.
+		void clear();
+
+		// Desc: Appends a particle and returns its index, or -1 if the store is full.
+		//       The new particle's data is undefined until written.
+		int  add();
+
+		// Desc: Sets the number of particles to count, clamped to the capacity.
+		//       Particles added this way are undefined until written.
+		void resize(int count);
+
+		// Desc: Exchanges particles i and j.
+		void swap(int i, int j);
+
+		// Desc: Removes particle i by moving the last particle into its slot.
+		void remove(int i);
+
+		// Desc: Removes the particles at the given indices, which must be in
+		//       increasing order.  Particles past the removed ones may move.
+		void removeSorted(const int* indices, int count);
+
+		int  size() const     { return _size; }
+		int  capacity() const { return _capacity; }
+		bool empty() const    { return _size == 0; }
+		bool full() const     { return _size >= _capacity; }
+
+	public:
+		float*         _posX;
+		float*         _posY;
+		float*         _posZ;
+		float*         _velX;
+		float*         _velY;
+		float*         _velZ;
+		unsigned int*  _color;  // packed ARGB, same layout as D3DCOLOR
+		float*         _age;
+		float*         _lifeTime; // <= 0 for particles that never die of age
+
+		PackedParticle* _packed;  // 0 unless setPacked(true)
+
+	private:
+		ParticleStore(const ParticleStore&);
+		ParticleStore& operator=(const ParticleStore&);
+
+		void release();
+		void allocatePacked();
+
+		void* _block;    // one allocation holding every array
+		int   _size;
+		int   _capacity;
+	};
+}
+
+#endif // __particleStoreH__
@@ -0,0 +1,269 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleWorld.cpp
+//
+// Author: William Cheung
+//
+// Desc: Owns the particle systems of a scene and runs them together.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particleWorld.h"
+#include <algorithm>
+
+using namespace psys;
+
+// size of the shared vertex buffer, and of the part locked at a time
+static const DWORD VB_SIZE       = 8192;
+static const DWORD VB_BATCH_SIZE = 2048;
+
+// Groups runs by texture, then by point size from the largest down.  Systems
+// with distance bands draw larger points farther away, so for them this
+// keeps the far bands first.  The sort is stable: within a group the runs
+// keep the order their systems gave them.
+struct RunOrder
+{
+	bool operator()(const DrawRun& a, const DrawRun& b) const
+	{
+		if( a._tex != b._tex )
+			return a._tex < b._tex;
+		return a._size > b._size;
+	}
+};
+
+ParticleWorld::ParticleWorld()
+{
+	_device   = 0;
+	_pool     = 0;
+	_grouping = false;
+}
+
+ParticleWorld::~ParticleWorld()
+{
+	for(int i = 0; i < (int)_systems.size(); i++)
+		d3d::Delete<ParticleSim*>(_systems[i]._system);
+
+	for(int i = 0; i < (int)_textures.size(); i++)
+		d3d::Release<IDirect3DTexture9*>(_textures[i]._tex);
+}
+
+bool ParticleWorld::init(IDirect3DDevice9* device)
+{
+	_device = device;
+	return _stream.init(device, VB_SIZE, VB_BATCH_SIZE);
+}
+
+void ParticleWorld::setJobPool(JobPool* pool)
+{
+	_pool = pool;
+}
+
+void ParticleWorld::setGrouping(bool enable)
+{
+	_grouping = enable;
+}
+
+IDirect3DTexture9* ParticleWorld::loadTexture(const char* texFileName)
+{
+	for(int i = 0; i < (int)_textures.size(); i++)
+	{
+		if( _textures[i]._fileName == texFileName )
+			return _textures[i]._tex;
+	}
+
+	Texture texture;
+	texture._fileName = texFileName;
+	texture._tex      = 0;
+
+	HRESULT hr = D3DXCreateTextureFromFile(
+		_device,
+		texFileName,
+		&texture._tex);
+
+	if(FAILED(hr))
+	{
+		::MessageBox(0, "D3DXCreateTextureFromFile() - FAILED", "ParticleWorld", 0);
+		return 0;
+	}
+
+	_textures.push_back(texture);
+	return texture._tex;
+}
+
+bool ParticleWorld::add(PSystem* system, const char* texFileName, bool removeWhenDead)
+{
+	IDirect3DTexture9* tex = loadTexture(texFileName);
+
+	// the systems drawn through the shared stream need no vertex buffer of their own
+	if( !tex || !system->init(_device, tex, !system->sharesRenderStates()) )
+	{
+		delete system;
+		return false;
+	}
+
+	addEntry(system, system, tex, removeWhenDead);
+	return true;
+}
+
+bool ParticleWorld::add(ParticleSim* system, const char* texFileName, bool removeWhenDead)
+{
+	IDirect3DTexture9* tex = loadTexture(texFileName);
+	if( !tex )
+	{
+		delete system;
+		return false;
+	}
+
+	addEntry(system, 0, tex, removeWhenDead);
+	return true;
+}
+
+void ParticleWorld::addEntry(ParticleSim* system, PSystem* drawn, IDirect3DTexture9* tex, bool removeWhenDead)
+{
+	Entry entry;
+	entry._system         = system;
+	entry._drawn          = drawn;
+	entry._tex            = tex;
+	entry._removeWhenDead = removeWhenDead;
+	_systems.push_back(entry);
+}
+
+void ParticleWorld::remove(ParticleSim* system)
+{
+	for(int i = 0; i < (int)_systems.size(); i++)
+	{
+		if( _systems[i]._system == system )
+		{
+			delete system;
+			_systems.erase(_systems.begin() + i);
+			return;
+		}
+	}
+}
+
+void ParticleWorld::update(float timeDelta)
+{
+	//
+	// Remarks:  A system of a few hundred particles is not worth splitting into
+	//           chunks, but a scene can have dozens of them.  They are updated
+	//           whole, each as one job of a single parallel loop over the systems,
+	//           while a system of more than one chunk splits its own update over
+	//           the pool as before.  The pool is not reentrant, so the batched
+	//           systems are run without it, which costs them nothing as they
+	//           would be a single job anyway.
+	//
+	//           Systems that write to shared state, such as snow laying itself on
+	//           the terrain, are never batched: they run one at a time on this
+	//           thread, so that no other system reads the terrain while it changes.
+	//
+
+	_batch.clear();
+
+	for(int i = 0; i < (int)_systems.size(); i++)
+	{
+		ParticleSim* system = _systems[i]._system;
+
+		if( _pool && (system->getParticles().size() >= BATCH_LIMIT || system->updatesSharedState()) )
+		{
+			system->setJobPool(_pool);
+			system->update(timeDelta);
+		}
+		else
+		{
+			system->setJobPool(0);
+			_batch.push_back(system);
+		}
+	}
+
+	int numBatched = (int)_batch.size();
+	if( _pool && numBatched > 1 )
+	{
+		_pool->parallelFor(0, numBatched, 1, [&](int /*chunk*/, int begin, int end)
+		{
+			for(int i = begin; i < end; i++)
+				_batch[i]->update(timeDelta);
+		});
+	}
+	else
+	{
+		for(int i = 0; i < numBatched; i++)
+			_batch[i]->update(timeDelta);
+	}
+
+	// bursts that have burnt out
+	for(int i = (int)_systems.size() - 1; i >= 0; i--)
+	{
+		if( _systems[i]._removeWhenDead && _systems[i]._system->isDead() )
+		{
+			delete _systems[i]._system;
+			_systems.erase(_systems.begin() + i);
+		}
+	}
+}
+
+void ParticleWorld::render()
+{
+	//
+	// Remarks:  Each system with the default render states hands over the runs of
+	//           vertices it would draw (see ParticleSim::collect).  The runs of all of
+	//           them are streamed through one vertex buffer, with the render states
+	//           set once for all and the texture and point size only when they
+	//           change from one run to the next.  Systems with render states of
+	//           their own draw themselves.
+	//
+	//           The runs are drawn system by system, in the order the systems were
+	//           added, each in its own back-to-front order.  With grouping on they
+	//           are grouped by texture and point size instead, which gives up the
+	//           order between systems; within a group each system's particles stay
+	//           in its own order.
+	//
+
+	_stats = Stats();
+	_stats._numSystems = (int)_systems.size();
+
+	_runs.clear();
+
+	D3DXMATRIX W, V, P;
+	_device->GetTransform(D3DTS_WORLD,      &W);
+	_device->GetTransform(D3DTS_VIEW,       &V);
+	_device->GetTransform(D3DTS_PROJECTION, &P);
+
+	for(int i = 0; i < (int)_systems.size(); i++)
+	{
+		ParticleSim* system = _systems[i]._system;
+		PSystem*     drawn  = _systems[i]._drawn;
+
+		if( !drawn || drawn->sharesRenderStates() )
+		{
+			int first = (int)_runs.size();
+			system->collect((const float*)&W, (const float*)&V, (const float*)&P, &_runs);
+
+			for(int k = first; k < (int)_runs.size(); k++)
+				_runs[k]._tex = _systems[i]._tex;
+		}
+		else
+		{
+			drawn->render();
+			_stats._numDrawCalls += drawn->getStats()._numDrawCalls;
+		}
+
+		_stats._numSubmitted += system->getStats()._numSubmitted;
+	}
+
+	_stats._numRuns = (int)_runs.size();
+
+	// nothing in view, don't touch the vertex buffer at all
+	if( _runs.empty() )
+		return;
+
+	if( _grouping )
+		std::stable_sort(_runs.begin(), _runs.end(), RunOrder());
+
+	PSystem::setPointStates(_device, _runs[0]._size);
+
+	int numStateChanges = 0;
+	_stats._numDrawCalls   += _stream.draw(&_runs[0], (int)_runs.size(), &numStateChanges);
+	_stats._numStateChanges = numStateChanges;
+
+	PSystem::resetPointStates(_device);
+}
@@ -0,0 +1,124 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particleWorld.h
+//
+// Author: William Cheung
+//
+// Desc: Owns the particle systems of a scene and runs them together.  The updates of
+//       the small systems are batched into one parallel loop over the systems, while
+//       the large ones spread their own chunks over the pool.  Systems drawn with the
+//       same render states share one vertex buffer, and consecutive runs of the same
+//       texture and point size share batches and state changes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particleWorldH__
+#define __particleWorldH__
+
+#include "pSystem.h"
+#include <string>
+#include <vector>
+
+namespace psys
+{
+	class ParticleWorld
+	{
+	public:
+		// Desc: What the last render call did.
+		struct Stats
+		{
+			Stats()
+			{
+				_numSystems      = 0;
+				_numSubmitted    = 0;
+				_numRuns         = 0;
+				_numStateChanges = 0;
+				_numDrawCalls    = 0;
+			}
+
+			int _numSystems;      // systems in the world
+			int _numSubmitted;    // particles written to vertex buffers
+			int _numRuns;         // runs of vertices collected from the systems
+			int _numStateChanges; // times the texture or point size was set
+			int _numDrawCalls;    // DrawPrimitive calls made, by all systems
+		};
+
+		// systems with fewer particles than this fit in one chunk and are updated
+		// whole, as one job of the batch; larger ones split their chunks over the pool
+		static const int BATCH_LIMIT = ParticleSim::CHUNK_SIZE;
+
+		ParticleWorld();
+		~ParticleWorld();
+
+		// Desc: Creates the shared vertex buffer.
+		bool init(IDirect3DDevice9* device);
+
+		// updates run on the threads of pool, 0 for none
+		void setJobPool(JobPool* pool);
+
+		// Grouping, off by default: the runs of all the shared systems are drawn
+		// grouped by texture and point size, for the fewest state changes, rather
+		// than system by system in the order they were added.  This gives up the
+		// back-to-front order between systems, so leave it off for blended ones.
+		void setGrouping(bool enable);
+
+		// Desc: Takes ownership of system and initializes it with the texture of
+		//       texFileName, which is loaded once for all the systems using it.
+		//       With removeWhenDead the system is deleted once it has no particle
+		//       left after an update, for bursts.  Returns false, having deleted
+		//       the system, if it could not be initialized.
+		bool add(PSystem* system, const char* texFileName, bool removeWhenDead = false);
+
+		// Desc: Same for a system that does not draw itself, such as psys::Snow:
+		//       its runs are always drawn through the shared vertex buffer.
+		bool add(ParticleSim* system, const char* texFileName, bool removeWhenDead = false);
+
+		// Desc: Deletes system, which must have been added.
+		void remove(ParticleSim* system);
+
+		// Desc: Updates every system by timeDelta.
+		void update(float timeDelta);
+
+		// Desc: Draws every system with the current transforms.
+		void render();
+
+		int getSystemCount() const { return (int)_systems.size(); }
+		ParticleSim* getSystem(int i) { return _systems[i]._system; }
+
+		const Stats& getStats() const { return _stats; }
+
+	private:
+		ParticleWorld(const ParticleWorld&);
+		ParticleWorld& operator=(const ParticleWorld&);
+
+		struct Entry
+		{
+			ParticleSim*       _system;
+			PSystem*           _drawn;  // the system if it can draw itself, else 0
+			IDirect3DTexture9* _tex;
+			bool               _removeWhenDead;
+		};
+
+		struct Texture
+		{
+			std::string        _fileName;
+			IDirect3DTexture9* _tex;
+		};
+
+		IDirect3DTexture9* loadTexture(const char* texFileName);
+
+		void addEntry(ParticleSim* system, PSystem* drawn, IDirect3DTexture9* tex, bool removeWhenDead);
+
+		IDirect3DDevice9*         _device;
+		JobPool*                  _pool;
+		std::vector<Entry>        _systems;
+		std::vector<Texture>      _textures; // loaded so far, by file name
+		VertexStream              _stream;
+		std::vector<ParticleSim*> _batch;    // scratch for the systems updated as one batch
+		std::vector<DrawRun>      _runs;     // scratch for the runs of the shared systems
+		bool                      _grouping;
+		Stats                     _stats;
+	};
+}
+
+#endif // __particleWorldH__
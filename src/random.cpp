@@ -0,0 +1,310 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: random.cpp
+//
+// Author: William Cheung
+//
+// Desc: Seedable random number streams based on xoshiro128+.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "random.h"
+#include "simd.h"
+#include <atomic>
+
+using namespace rng;
+
+// splitmix64, used to expand a seed into well mixed state words
+static unsigned long long splitMix(unsigned long long& x)
+{
+	unsigned long long z = (x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+Random::Random()
+{
+	seed(0);
+}
+
+Random::Random(unsigned long long seed)
+{
+	this->seed(seed);
+}
+
+Random::Random(unsigned long long seed, unsigned long long streamId)
+{
+	unsigned long long x = seed;
+	unsigned long long mixed = splitMix(x) ^ (streamId * 0xD1B54A32D192ED03ULL);
+	this->seed(mixed);
+}
+
+void Random::seed(unsigned long long seed)
+{
+	unsigned long long x = seed;
+	unsigned long long a = splitMix(x);
+	unsigned long long b = splitMix(x);
+
+	_s[0] = (unsigned int)a;
+	_s[1] = (unsigned int)(a >> 32);
+	_s[2] = (unsigned int)b;
+	_s[3] = (unsigned int)(b >> 32);
+
+	// the all zero state is the one state xoshiro can not leave
+	if( (_s[0] | _s[1] | _s[2] | _s[3]) == 0 )
+		_s[0] = 1;
+}
+
+//
+// Per-thread streams
+//
+
+static std::atomic<unsigned long long> s_seed(0);
+static std::atomic<unsigned int>       s_seedGeneration(1);
+static std::atomic<unsigned int>       s_numThreads(0);
+
+struct ThreadStream
+{
+	ThreadStream()
+	{
+		index      = s_numThreads++;
+		generation = 0;
+	}
+
+	Random       random;
+	unsigned int index;      // stream id of this thread
+	unsigned int generation; // seed generation random was seeded from
+};
+
+void rng::SetSeed(unsigned long long seed)
+{
+	s_seed = seed;
+	s_seedGeneration++;
+}
+
+unsigned long long rng::GetSeed()
+{
+	return s_seed;
+}
+
+Random& rng::ThreadRandom()
+{
+	static thread_local ThreadStream stream;
+
+	unsigned int generation = s_seedGeneration;
+	if( stream.generation != generation )
+	{
+		stream.random     = Random(s_seed, stream.index);
+		stream.generation = generation;
+	}
+	return stream.random;
+}
+
+//
+// Bulk generation
+//
+// Eight xoshiro128+ generators run side by side, one per lane, with their state
+// kept in structure-of-arrays form.  Step t writes out[8t + lane].  The SSE2 path
+// handles lanes 0-3 and 4-7 in two registers and the scalar path loops over the
+// lanes, so all three produce the same sequence.
+//
+
+static const int NUM_LANES = 8;
+
+// below this many values seeding the lanes costs more than it saves
+static const int MIN_BULK_COUNT = 4 * NUM_LANES;
+
+struct Lanes
+{
+	unsigned int s[4][NUM_LANES];
+
+	explicit Lanes(Random& random)
+	{
+		for(int j = 0; j < NUM_LANES; j++)
+		{
+			for(int k = 0; k < 4; k++)
+				s[k][j] = random.next();
+
+			if( (s[0][j] | s[1][j] | s[2][j] | s[3][j]) == 0 )
+				s[0][j] = 1;
+		}
+	}
+};
+
+static void fillScalar(Lanes& lanes, float* out, int numSteps, float low, float range)
+{
+	for(int t = 0; t < numSteps; t++)
+	{
+		for(int j = 0; j < NUM_LANES; j++)
+		{
+			unsigned int* s0 = &lanes.s[0][j];
+			unsigned int* s1 = &lanes.s[1][j];
+			unsigned int* s2 = &lanes.s[2][j];
+			unsigned int* s3 = &lanes.s[3][j];
+
+			unsigned int result = *s0 + *s3;
+			unsigned int u = *s1 << 9;
+
+			*s2 ^= *s0;
+			*s3 ^= *s1;
+			*s1 ^= *s2;
+			*s0 ^= *s3;
+			*s2 ^= u;
+			*s3 = (*s3 << 11) | (*s3 >> 21);
+
+			float f = (float)(result >> 8) * (1.0f / 16777216.0f);
+			out[t * NUM_LANES + j] = f * range + low;
+		}
+	}
+}
+
+#ifdef SIMD_X86
+
+static inline __m128 stepSSE2(__m128i* s, __m128 low, __m128 range)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+
+	__m128i result = _mm_add_epi32(s[0], s[3]);
+	__m128i u      = _mm_slli_epi32(s[1], 9);
+
+	s[2] = _mm_xor_si128(s[2], s[0]);
+	s[3] = _mm_xor_si128(s[3], s[1]);
+	s[1] = _mm_xor_si128(s[1], s[2]);
+	s[0] = _mm_xor_si128(s[0], s[3]);
+	s[2] = _mm_xor_si128(s[2], u);
+	s[3] = _mm_or_si128(_mm_slli_epi32(s[3], 11), _mm_srli_epi32(s[3], 21));
+
+	__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale);
+	return _mm_add_ps(_mm_mul_ps(f, range), low);
+}
+
+static void fillSSE2(Lanes& lanes, float* out, int numSteps, float low, float range)
+{
+	__m128i a[4], b[4]; // lanes 0-3 and lanes 4-7
+	for(int k = 0; k < 4; k++)
+	{
+		a[k] = _mm_loadu_si128((const __m128i*)&lanes.s[k][0]);
+		b[k] = _mm_loadu_si128((const __m128i*)&lanes.s[k][4]);
+	}
+
+	const __m128 vlow   = _mm_set1_ps(low);
+	const __m128 vrange = _mm_set1_ps(range);
+
+	for(int t = 0; t < numSteps; t++)
+	{
+		_mm_storeu_ps(out + t * NUM_LANES,     stepSSE2(a, vlow, vrange));
+		_mm_storeu_ps(out + t * NUM_LANES + 4, stepSSE2(b, vlow, vrange));
+	}
+
+	for(int k = 0; k < 4; k++)
+	{
+		_mm_storeu_si128((__m128i*)&lanes.s[k][0], a[k]);
+		_mm_storeu_si128((__m128i*)&lanes.s[k][4], b[k]);
+	}
+}
+
+SIMD_TARGET_AVX2
+static void fillAVX2(Lanes& lanes, float* out, int numSteps, float low, float range)
+{
+	__m256i s0 = _mm256_loadu_si256((const __m256i*)lanes.s[0]);
+	__m256i s1 = _mm256_loadu_si256((const __m256i*)lanes.s[1]);
+	__m256i s2 = _mm256_loadu_si256((const __m256i*)lanes.s[2]);
+	__m256i s3 = _mm256_loadu_si256((const __m256i*)lanes.s[3]);
+
+	const __m256 scale  = _mm256_set1_ps(1.0f / 16777216.0f);
+	const __m256 vlow   = _mm256_set1_ps(low);
+	const __m256 vrange = _mm256_set1_ps(range);
+
+	for(int t = 0; t < numSteps; t++)
+	{
+		__m256i result = _mm256_add_epi32(s0, s3);
+		__m256i u      = _mm256_slli_epi32(s1, 9);
+
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, u);
+		s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+
+		__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8)), scale);
+		_mm256_storeu_ps(out + t * NUM_LANES, _mm256_add_ps(_mm256_mul_ps(f, vrange), vlow));
+	}
+
+	_mm256_storeu_si256((__m256i*)lanes.s[0], s0);
+	_mm256_storeu_si256((__m256i*)lanes.s[1], s1);
+	_mm256_storeu_si256((__m256i*)lanes.s[2], s2);
+	_mm256_storeu_si256((__m256i*)lanes.s[3], s3);
+
+	_mm256_zeroupper();
+}
+
+#endif // SIMD_X86
+
+static void fillSteps(Lanes& lanes, float* out, int numSteps, float low, float range)
+{
+#ifdef SIMD_X86
+	switch( simd::GetLevel() )
+	{
+	case simd::LEVEL_AVX2:
+		fillAVX2(lanes, out, numSteps, low, range);
+		return;
+	case simd::LEVEL_SSE2:
+		fillSSE2(lanes, out, numSteps, low, range);
+		return;
+	default:
+		break;
+	}
+#endif
+	fillScalar(lanes, out, numSteps, low, range);
+}
+
+void rng::FillFloats(
+	Random& random,
+	float* out, int count,
+	float lowBound, float highBound)
+{
+	if( count <= 0 )
+		return;
+
+	if( lowBound >= highBound ) // bad input
+	{
+		for(int i = 0; i < count; i++)
+			out[i] = lowBound;
+		return;
+	}
+
+	if( count < MIN_BULK_COUNT )
+	{
+		for(int i = 0; i < count; i++)
+			out[i] = random.nextFloat(lowBound, highBound);
+		return;
+	}
+
+	Lanes lanes(random);
+	float range = highBound - lowBound;
+
+	// whole steps straight into out, the last partial step through a buffer
+	int numSteps = count / NUM_LANES;
+	fillSteps(lanes, out, numSteps, lowBound, range);
+
+	int done = numSteps * NUM_LANES;
+	if( done < count )
+	{
+		float tail[NUM_LANES];
+		fillSteps(lanes, tail, 1, lowBound, range);
+		for(int i = done; i < count; i++)
+			out[i] = tail[i - done];
+	}
+}
+
+void rng::FillVectors(
+	Random& random,
+	float* x, float* y, float* z, int count,
+	const float min[3], const float max[3])
+{
+	FillFloats(random, x, count, min[0], max[0]);
+	FillFloats(random, y, count, min[1], max[1]);
+	FillFloats(random, z, count, min[2], max[2]);
+}
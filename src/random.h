@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: random.h
+//
+// Author: William Cheung
+//
+// Desc: Seedable random number streams based on xoshiro128+.  A stream is a few
+//       words of state, so every thread or every chunk of work can own one and
+//       the results do not depend on how the work was scheduled.  Bulk fills run
+//       eight generators side by side with SSE2 or AVX2.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __randomH__
+#define __randomH__
+
+namespace rng
+{
+	class Random
+	{
+	public:
+		Random();
+		explicit Random(unsigned long long seed);
+
+		// Desc: Stream number streamId of the family identified by seed.  Different
+		//       ids give statistically independent streams.
+		Random(unsigned long long seed, unsigned long long streamId);
+
+		void seed(unsigned long long seed);
+
+		// Desc: Next 32 random bits.
+		unsigned int next()
+		{
+			unsigned int result = _s[0] + _s[3];
+			unsigned int t = _s[1] << 9;
+
+			_s[2] ^= _s[0];
+			_s[3] ^= _s[1];
+			_s[1] ^= _s[2];
+			_s[0] ^= _s[3];
+			_s[2] ^= t;
+			_s[3] = (_s[3] << 11) | (_s[3] >> 21);
+
+			return result;
+		}
+
+		// Desc: Random float in [0, 1) with 24 bits of resolution.
+		float nextFloat()
+		{
+			return (float)(next() >> 8) * (1.0f / 16777216.0f);
+		}
+
+		// Desc: Random float in [lowBound, highBound) interval, or lowBound if
+		//       the interval is empty.
+		float nextFloat(float lowBound, float highBound)
+		{
+			if( lowBound >= highBound ) // bad input
+				return lowBound;
+			return nextFloat() * (highBound - lowBound) + lowBound;
+		}
+
+	private:
+		unsigned int _s[4];
+	};
+
+	//
+	// Per-thread streams
+	//
+
+	// Desc: Seeds the family of per-thread streams.  Every thread's stream is
+	//       reseeded from it on that thread's next draw.
+	void SetSeed(unsigned long long seed);
+	unsigned long long GetSeed();
+
+	// Desc: The calling thread's own stream.  Threads get different streams of
+	//       the family chosen by SetSeed, so no state is shared between them.
+	Random& ThreadRandom();
+
+	//
+	// Bulk generation
+	//
+
+	// Desc: Fills out[0, count) with random floats in [lowBound, highBound), or with
+	//       lowBound if the interval is empty.  The values depend only on the state of
+	//       random and on count, never on the instruction set used.
+	void FillFloats(
+		Random& random,
+		float* out, int count,
+		float lowBound, float highBound);
+
+	// Desc: Fills the component arrays x, y and z with count random points inside the
+	//       box given by min and max.
+	void FillVectors(
+		Random& random,
+		float* x, float* y, float* z, int count,
+		const float min[3], const float max[3]);
+}
+
+#endif // __randomH__
@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simd.cpp
+//
+// Author: William Cheung
+//
+// Desc: Runtime selection of the instruction set used by the vectorized kernels.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simd.h"
+#include <atomic>
+
+// read from the jobs of any thread, so the first calls may race to detect;
+// they all store the same level
+static std::atomic<int> s_detected(-1);
+static std::atomic<int> s_level(-1);
+
+simd::Level simd::DetectLevel()
+{
+	int detected = s_detected.load();
+	if( detected != -1 )
+		return (Level)detected;
+
+	Level level = LEVEL_SCALAR;
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2    = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+
+	bool avx2 = false;
+	if( maxLeaf >= 7 && osxsave && avx )
+	{
+		// the OS must save the upper halves of the ymm registers
+		if( (_xgetbv(0) & 6) == 6 )
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+	}
+
+	if( avx2 )      level = LEVEL_AVX2;
+	else if( sse2 ) level = LEVEL_SSE2;
+#elif defined(SIMD_X86)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") )      level = LEVEL_AVX2;
+	else if( __builtin_cpu_supports("sse2") ) level = LEVEL_SSE2;
+#endif
+
+	s_detected.store(level);
+	return level;
+}
+
+simd::Level simd::GetLevel()
+{
+	int level = s_level.load();
+	if( level == -1 )
+	{
+		// a SetLevel that got in first wins
+		int detected = DetectLevel();
+		if( !s_level.compare_exchange_strong(level, detected) )
+			return (Level)level;
+		level = detected;
+	}
+	return (Level)level;
+}
+
+void simd::SetLevel(Level level)
+{
+	Level detected = DetectLevel();
+	s_level.store(level > detected ? detected : level);
+}
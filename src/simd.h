@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simd.h
+//
+// Author: William Cheung
+//
+// Desc: Runtime selection of the instruction set used by the vectorized kernels, and
+//       the macros those kernels are written with.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simdH__
+#define __simdH__
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit AVX instructions in functions that ask for them
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+namespace simd
+{
+	enum Level { LEVEL_SCALAR, LEVEL_SSE2, LEVEL_AVX2 };
+
+	// Desc: Returns the widest instruction set supported by this CPU.
+	Level DetectLevel();
+
+	// Desc: Returns / overrides the level used by the kernels.  Overriding with a
+	//       level the CPU does not support clamps it to the detected one.
+	Level GetLevel();
+	void  SetLevel(Level level);
+
+	// Desc: Index of the lowest set bit of a non zero mask.
+	inline int LowestBit(unsigned int bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return (int)index;
+#else
+		return __builtin_ctz(bits);
+#endif
+	}
+}
+
+#endif // __simdH__
@@ -0,0 +1,216 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: snowfall.cpp
+//
+// Author: William Cheung
+//
+// Desc: Snow falling through a box, drifting with the wind and settling on a
+//       height field.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "snowfall.h"
+#include "particleKernels.h"
+#include "heightField.h"
+#include "windField.h"
+
+using namespace psys;
+
+// opaque white, as a D3DCOLOR
+static const unsigned int FLAKE_COLOR = 0xffffffff;
+
+Snowfall::Snowfall(const float boxMin[3], const float boxMax[3], int numParticles)
+{
+	for(int j = 0; j < 3; j++)
+	{
+		_boxMin[j] = boxMin[j];
+		_boxMax[j] = boxMax[j];
+	}
+	_size         = 0.25f;
+	_maxParticles = numParticles;
+	_ground       = 0;
+	_groundOffset = 0.0f;
+	_wind         = 0;
+	_windDrag     = 1.5f;
+	_windLift     = 0.5f;
+
+	setRenderSetup(defaultSetup());
+
+	_particles.reserve(_maxParticles);
+
+	addParticles(numParticles);
+}
+
+void Snowfall::setGround(const HeightField* ground, float heightOffset)
+{
+	_ground       = ground;
+	_groundOffset = heightOffset;
+}
+
+void Snowfall::setWind(const WindField* wind)
+{
+	_wind = wind;
+}
+
+RenderSetup Snowfall::defaultSetup()
+{
+	RenderSetup setup;
+
+	// far flakes are hard to tell apart, simulate and draw fewer, larger ones
+	setup._lodBands.push_back(LodBand( 0.0f, 1, 1.0f));
+	setup._lodBands.push_back(LodBand(30.0f, 2, 0.5f));
+	setup._lodBands.push_back(LodBand(60.0f, 4, 0.25f));
+
+	return setup;
+}
+
+void Snowfall::landed(const float* /*x*/, const float* /*z*/, int /*count*/)
+{
+	// the flakes just melt away
+}
+
+void Snowfall::respawnParticles(const int* indices, int count, rng::Random& random)
+{
+	// Flakes start at a random x, z at the top of the box, falling downwards
+	// and slightly to the left.  The random numbers are generated in bulk and
+	// then scattered to the respawned slots.
+	const int BLOCK = 256;
+	float x[BLOCK], z[BLOCK], vx[BLOCK], vy[BLOCK];
+
+	for(int first = 0; first < count; first += BLOCK)
+	{
+		int n = count - first < BLOCK ? count - first : BLOCK;
+
+		rng::FillFloats(random, x,  n, _boxMin[0], _boxMax[0]);
+		rng::FillFloats(random, z,  n, _boxMin[2], _boxMax[2]);
+		rng::FillFloats(random, vx, n, -3.0f,  0.0f);
+		rng::FillFloats(random, vy, n, -10.0f, 0.0f);
+
+		for(int k = 0; k < n; k++)
+		{
+			int i = indices[first + k];
+
+			_particles._posX[i]     = x[k];
+			_particles._posY[i]     = _boxMax[1];
+			_particles._posZ[i]     = z[k];
+			_particles._velX[i]     = vx[k];
+			_particles._velY[i]     = vy[k];
+			_particles._velZ[i]     = 0.0f;
+			_particles._color[i]    = FLAKE_COLOR;
+			_particles._age[i]      = 0.0f;
+			_particles._lifeTime[i] = 0.0f;
+		}
+	}
+}
+
+void Snowfall::update(float timeDelta)
+{
+	emitParticles(timeDelta);
+
+	int numParticles = _particles.size();
+	if( numParticles == 0 )
+		return;
+
+	updateLod();
+	prepareScratch(numParticles);
+
+	if( _ground )
+	{
+		if( (int)_landed.size() < numParticles )
+		{
+			_groundHeights.resize(numParticles);
+			_landed.resize(numParticles);
+			_landedX.resize(numParticles);
+			_landedZ.resize(numParticles);
+		}
+		_chunkLanded.assign(_chunkExpired.size(), 0);
+	}
+
+	if( _wind && (int)_windX.size() < numParticles )
+	{
+		_windX.resize(numParticles);
+		_windY.resize(numParticles);
+		_windZ.resize(numParticles);
+	}
+
+	// distant bands tick less often, with a longer time step
+	forEachDueChunk(timeDelta, [this](int chunk, int begin, int end, float timeDelta)
+	{
+		// each chunk keeps its escapees in its own part of the scratch
+		int* escaped = &_escaped[begin];
+
+		// the wind acts as an acceleration, looked up for the whole chunk at once
+		if( _wind )
+		{
+			float* wx = &_windX[begin];
+			float* wy = &_windY[begin];
+			float* wz = &_windZ[begin];
+
+			_wind->sample(
+				&_particles._posX[begin], &_particles._posY[begin], &_particles._posZ[begin],
+				end - begin, wx, wy, wz);
+
+			ApplyWind(_particles, begin, end, wx, wy, wz, _windDrag, _windLift, timeDelta);
+		}
+
+		// integrate and bounds test in one vectorized pass
+		int numEscaped = IntegrateParticles(
+			_particles,
+			begin, end,
+			timeDelta,
+			_boxMin,
+			_boxMax,
+			escaped);
+
+		rng::Random random = chunkStream(chunk);
+
+		// the flakes outside the bounds are dead, but we want to
+		// recycle dead particles, so respawn them instead.
+		if( numEscaped )
+			respawnParticles(escaped, numEscaped, random);
+
+		// the flakes that hit the ground settle there and are recycled too.
+		// The heights under the whole chunk are looked up in one call.
+		if( _ground )
+		{
+			float* ground = &_groundHeights[begin];
+			int*   landed = &_landed[begin];
+
+			_ground->sample(&_particles._posX[begin], &_particles._posZ[begin], end - begin, ground);
+
+			int numLanded = CollideParticles(_particles, begin, end, ground, _groundOffset, landed);
+			if( numLanded )
+			{
+				for(int k = 0; k < numLanded; k++)
+				{
+					_landedX[begin + k] = _particles._posX[landed[k]];
+					_landedZ[begin + k] = _particles._posZ[landed[k]];
+				}
+				respawnParticles(landed, numLanded, random);
+			}
+			_chunkLanded[chunk] = numLanded;
+		}
+
+		ageParticles(chunk, begin, end, timeDelta);
+
+		// the chunk is still in cache, write its vertices now rather than in collect
+		repackParticles(begin, end);
+	});
+
+	// handed over in chunk order to keep the result independent of the threads
+	if( _ground )
+	{
+		for(int chunk = 0; chunk < (int)_chunkLanded.size(); chunk++)
+		{
+			if( _chunkLanded[chunk] )
+			{
+				int begin = _chunkBegin[chunk];
+				landed(&_landedX[begin], &_landedZ[begin], _chunkLanded[chunk]);
+			}
+		}
+	}
+
+	removeDeadParticles();
+
+	_frame++;
+}
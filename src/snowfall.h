@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: snowfall.h
+//
+// Author: William Cheung
+//
+// Desc: Snow falling through a box, drifting with the wind and settling on a
+//       height field.  Flakes that leave the box or land are respawned at its
+//       top.  Does not depend on Direct3D; psys::Snow draws it and lays the
+//       landed flakes on its terrain.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __snowfallH__
+#define __snowfallH__
+
+#include "particleSim.h"
+#include <vector>
+
+class HeightField;
+class WindField;
+
+namespace psys
+{
+	class Snowfall : public ParticleSim
+	{
+	public:
+		// numParticles flakes in the box [boxMin, boxMax]
+		Snowfall(const float boxMin[3], const float boxMax[3], int numParticles);
+
+		void respawnParticles(const int* indices, int count, rng::Random& random);
+		void update(float timeDelta);
+
+		// Flakes that fall onto ground are respawned, see landed.  The ground is
+		// heightOffset higher than the field, with x and z untouched.  0 for none.
+		void setGround(const HeightField* ground, float heightOffset);
+
+		// Flakes drift with the wind of the field, sampled for a chunk at a time.
+		// The field is updated by its owner before update is called.  0 for none.
+		void setWind(const WindField* wind);
+
+		// the setup snow is made with: its distance bands, no sorting or fused packing
+		static RenderSetup defaultSetup();
+
+	protected:
+		// Desc: Called by update with where the count flakes of a chunk landed
+		//       on the ground, chunk by chunk in order on the calling thread.
+		virtual void landed(const float* x, const float* z, int count);
+
+	private:
+		const HeightField* _ground;
+		float              _groundOffset;
+		std::vector<float> _groundHeights; // scratch for the height under each particle
+		std::vector<int>   _landed;        // scratch for indices of particles that landed
+		std::vector<float> _landedX;       // where they landed, handed to landed after the update
+		std::vector<float> _landedZ;
+		std::vector<int>   _chunkLanded;   // number of entries of _landed used by each chunk
+
+		const WindField*   _wind;
+		float              _windDrag;      // how fast flakes take up the horizontal wind, per second
+		float              _windLift;      // how much of the vertical wind reaches them, per second
+		std::vector<float> _windX;         // scratch for the wind at each particle
+		std::vector<float> _windY;
+		std::vector<float> _windZ;
+	};
+}
+
+#endif // __snowfallH__
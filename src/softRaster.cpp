@@ -0,0 +1,771 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softRaster.cpp
+//
+// Author: William Cheung
+//
+// Desc: A tiled CPU rasterizer for the fixed-function subset the project uses.
+//
+// Note: Like the particle kernels, the scalar and SSE2 coverage tests must round the
+//       same way, so this file is compiled without contracting into FMA.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "softRaster.h"
+#include "simd.h"
+#include <cmath>
+#include <cstdio>
+
+// largest point sprite drawn, in pixels, like a device's MaxPointSize
+static const float MAX_POINT_SIZE = 256.0f;
+
+// draw calls are set up in parallel in chunks of this many primitives
+static const int SETUP_CHUNK = 4096;
+
+// attribute planes of Primitive::_attr
+enum { ATTR_Z, ATTR_W, ATTR_U, ATTR_V, ATTR_R, ATTR_G, ATTR_B, ATTR_A, NUM_ATTRS };
+
+// row vector (x, y, z, w) times m
+static void transform(const float* m, float x, float y, float z, float w, float* out)
+{
+	for(int j = 0; j < 4; j++)
+		out[j] = x * m[j] + y * m[4 + j] + z * m[8 + j] + w * m[12 + j];
+}
+
+// out = a * b
+static void multiply(const float* a, const float* b, float* out)
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++)
+			out[i * 4 + j] = a[i * 4] * b[j] + a[i * 4 + 1] * b[4 + j] + a[i * 4 + 2] * b[8 + j] + a[i * 4 + 3] * b[12 + j];
+}
+
+static void identity(float* m)
+{
+	for(int i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+static void unpackColor(unsigned int argb, float* color)
+{
+	color[0] = ((argb >> 16) & 0xff) / 255.0f;
+	color[1] = ((argb >>  8) & 0xff) / 255.0f;
+	color[2] = ( argb        & 0xff) / 255.0f;
+	color[3] = ( argb >> 24        ) / 255.0f;
+}
+
+static inline unsigned int toByte(float x)
+{
+	if( x <= 0.0f ) return 0;
+	if( x >= 1.0f ) return 255;
+	return (unsigned int)(x * 255.0f + 0.5f);
+}
+
+static inline int wrap(int i, int n)
+{
+	i %= n;
+	return i < 0 ? i + n : i;
+}
+
+// bilinear, wrapping at the borders, into rgba
+static void sample(const SoftRaster::Texture* tex, float u, float v, float* out)
+{
+	float x  = u * tex->_width  - 0.5f;
+	float y  = v * tex->_height - 0.5f;
+	float fx = ::floorf(x);
+	float fy = ::floorf(y);
+	float ax = x - fx;
+	float ay = y - fy;
+
+	int x0 = wrap((int)fx,     tex->_width);
+	int x1 = wrap((int)fx + 1, tex->_width);
+	int y0 = wrap((int)fy,     tex->_height);
+	int y1 = wrap((int)fy + 1, tex->_height);
+
+	const unsigned int* row0 = &tex->_texels[y0 * tex->_width];
+	const unsigned int* row1 = &tex->_texels[y1 * tex->_width];
+
+	float t00[4], t10[4], t01[4], t11[4];
+	unpackColor(row0[x0], t00);
+	unpackColor(row0[x1], t10);
+	unpackColor(row1[x0], t01);
+	unpackColor(row1[x1], t11);
+
+	for(int c = 0; c < 4; c++)
+	{
+		float top    = t00[c] + (t10[c] - t00[c]) * ax;
+		float bottom = t01[c] + (t11[c] - t01[c]) * ax;
+		out[c] = top + (bottom - top) * ay;
+	}
+}
+
+SoftRaster::SoftRaster()
+{
+	_width    = 0;
+	_height   = 0;
+	_tilesX   = 0;
+	_tilesY   = 0;
+	_pool     = 0;
+	_numPrims = 0;
+	_tex      = 0;
+	_cull     = CULL_CCW;
+	_blend    = false;
+	_lighting = false;
+
+	identity(_world);
+	identity(_worldView);
+	identity(_worldViewProj);
+
+	_lightDir[0]     = 0.0f; _lightDir[1]     = -1.0f; _lightDir[2]     = 0.0f;
+	_lightDiffuse[0] = 1.0f; _lightDiffuse[1] =  1.0f; _lightDiffuse[2] = 1.0f;
+	_lightAmbient[0] = 0.0f; _lightAmbient[1] =  0.0f; _lightAmbient[2] = 0.0f;
+}
+
+bool SoftRaster::init(int width, int height)
+{
+	if( width <= 0 || height <= 0 )
+		return false;
+
+	_width  = width;
+	_height = height;
+	_tilesX = (width  + TILE_SIZE - 1) / TILE_SIZE;
+	_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	_color.assign(width * height, 0);
+	_depth.assign(width * height, 1.0f);
+	_bins.assign(_tilesX * _tilesY, std::vector<unsigned int>());
+	_numPrims = 0;
+
+	return true;
+}
+
+void SoftRaster::setJobPool(JobPool* pool)
+{
+	_pool = pool;
+}
+
+void SoftRaster::setTransform(const float world[16], const float view[16], const float proj[16])
+{
+	for(int i = 0; i < 16; i++)
+		_world[i] = world[i];
+
+	multiply(world, view, _worldView);
+	multiply(_worldView, proj, _worldViewProj);
+}
+
+void SoftRaster::setTexture(const Texture* tex)
+{
+	_tex = tex && tex->_width > 0 && tex->_height > 0 ? tex : 0;
+}
+
+void SoftRaster::setCullMode(Cull cull)
+{
+	_cull = cull;
+}
+
+void SoftRaster::setBlending(bool enable)
+{
+	_blend = enable;
+}
+
+void SoftRaster::setLighting(bool enable)
+{
+	_lighting = enable;
+}
+
+void SoftRaster::setLight(const float direction[3], const float diffuse[3], const float ambient[3])
+{
+	float length = ::sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+	if( length <= 0.0f )
+		length = 1.0f;
+
+	for(int k = 0; k < 3; k++)
+	{
+		_lightDir[k]     = direction[k] / length;
+		_lightDiffuse[k] = diffuse[k];
+		_lightAmbient[k] = ambient[k];
+	}
+}
+
+void SoftRaster::clear(unsigned int color, float depth)
+{
+	_color.assign(_color.size(), color);
+	_depth.assign(_depth.size(), depth);
+}
+
+//
+// Setup
+//
+
+void SoftRaster::drawTriangles(
+	const Vertex* vertices, int numVertices,
+	const unsigned int* indices, int numTriangles,
+	unsigned int color)
+{
+	if( numTriangles <= 0 || numVertices <= 0 )
+		return;
+
+	float vertexColor[4];
+	unpackColor(color, vertexColor);
+
+	//
+	// transform and light the vertices
+	//
+
+	if( (int)_clipped.size() < numVertices )
+		_clipped.resize(numVertices);
+
+	JobPool::ChunkFunc transformVertices = [&](int /*chunk*/, int begin, int end)
+	{
+		for(int i = begin; i < end; i++)
+		{
+			const Vertex& in  = vertices[i];
+			ClipVertex&   out = _clipped[i];
+
+			transform(_worldViewProj, in._x, in._y, in._z, 1.0f, out._pos);
+			out._u = in._u;
+			out._v = in._v;
+
+			if( _lighting )
+			{
+				// directional light on a white material, as the device does
+				float n[4];
+				transform(_world, in._nx, in._ny, in._nz, 0.0f, n);
+				float length = ::sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				float lambert = 0.0f;
+				if( length > 0.0f )
+					lambert = -(n[0] * _lightDir[0] + n[1] * _lightDir[1] + n[2] * _lightDir[2]) / length;
+				if( lambert < 0.0f )
+					lambert = 0.0f;
+
+				for(int c = 0; c < 3; c++)
+					out._color[c] = _lightAmbient[c] + _lightDiffuse[c] * lambert;
+				out._color[3] = 1.0f;
+			}
+			else
+			{
+				for(int c = 0; c < 4; c++)
+					out._color[c] = vertexColor[c];
+			}
+		}
+	};
+
+	if( _pool )
+		_pool->parallelFor(0, numVertices, SETUP_CHUNK, transformVertices);
+	else
+		transformVertices(0, 0, numVertices);
+
+	//
+	// clip and set up the triangles
+	//
+
+	int base = _numPrims;
+	_numPrims += numTriangles * 2;
+	if( (int)_prims.size() < _numPrims )
+		_prims.resize(_numPrims);
+
+	JobPool::ChunkFunc setup = [&](int /*chunk*/, int begin, int end)
+	{
+		for(int t = begin; t < end; t++)
+		{
+			Primitive* prims = &_prims[base + t * 2];
+			prims[0]._minX = prims[1]._minX = 1;
+			prims[0]._maxX = prims[1]._maxX = 0;
+
+			const ClipVertex* v[3] = {
+				&_clipped[indices[t * 3]], &_clipped[indices[t * 3 + 1]], &_clipped[indices[t * 3 + 2]] };
+
+			// all three outside one plane of the frustum
+			bool outside = false;
+			for(int j = 0; j < 2 && !outside; j++)
+			{
+				outside = (v[0]->_pos[j] < -v[0]->_pos[3] && v[1]->_pos[j] < -v[1]->_pos[3] && v[2]->_pos[j] < -v[2]->_pos[3]) ||
+				          (v[0]->_pos[j] >  v[0]->_pos[3] && v[1]->_pos[j] >  v[1]->_pos[3] && v[2]->_pos[j] >  v[2]->_pos[3]);
+			}
+			if( outside || (v[0]->_pos[2] > v[0]->_pos[3] && v[1]->_pos[2] > v[1]->_pos[3] && v[2]->_pos[2] > v[2]->_pos[3]) )
+				continue;
+
+			// clip against the near plane, z >= 0, which may leave a quad
+			ClipVertex clipped[4];
+			int        n = 0;
+			for(int k = 0; k < 3; k++)
+			{
+				const ClipVertex& a = *v[k];
+				const ClipVertex& b = *v[(k + 1) % 3];
+
+				if( a._pos[2] >= 0.0f )
+					clipped[n++] = a;
+
+				if( (a._pos[2] >= 0.0f) != (b._pos[2] >= 0.0f) )
+				{
+					float s = a._pos[2] / (a._pos[2] - b._pos[2]);
+
+					ClipVertex& c = clipped[n++];
+					for(int j = 0; j < 4; j++)
+					{
+						c._pos[j]   = a._pos[j]   + (b._pos[j]   - a._pos[j])   * s;
+						c._color[j] = a._color[j] + (b._color[j] - a._color[j]) * s;
+					}
+					c._u = a._u + (b._u - a._u) * s;
+					c._v = a._v + (b._v - a._v) * s;
+				}
+			}
+
+			if( n >= 3 )
+				setupTriangle(clipped, &prims[0]);
+			if( n == 4 )
+			{
+				ClipVertex second[3] = { clipped[0], clipped[2], clipped[3] };
+				setupTriangle(second, &prims[1]);
+			}
+		}
+	};
+
+	if( _pool )
+		_pool->parallelFor(0, numTriangles, SETUP_CHUNK, setup);
+	else
+		setup(0, 0, numTriangles);
+}
+
+void SoftRaster::setupTriangle(const ClipVertex* v, Primitive* prim)
+{
+	float sx[3], sy[3], attr[NUM_ATTRS][3];
+	for(int k = 0; k < 3; k++)
+	{
+		float iw = 1.0f / v[k]._pos[3];
+
+		sx[k] = (v[k]._pos[0] * iw + 1.0f) * 0.5f * _width;
+		sy[k] = (1.0f - v[k]._pos[1] * iw) * 0.5f * _height;
+
+		// perspective correct: everything but z is interpolated over w
+		attr[ATTR_Z][k] = v[k]._pos[2] * iw;
+		attr[ATTR_W][k] = iw;
+		attr[ATTR_U][k] = v[k]._u * iw;
+		attr[ATTR_V][k] = v[k]._v * iw;
+		for(int c = 0; c < 4; c++)
+			attr[ATTR_R + c][k] = v[k]._color[c] * iw;
+	}
+
+	// positive when clockwise on the screen, y pointing down
+	float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+	if( area == 0.0f )
+		return;
+	if( (_cull == CULL_CW && area > 0.0f) || (_cull == CULL_CCW && area < 0.0f) )
+		return;
+
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+
+	// edge k faces vertex k, and is positive on its side
+	for(int k = 0; k < 3; k++)
+	{
+		int a = (k + 1) % 3;
+		int b = (k + 2) % 3;
+
+		prim->_edgeA[k] = -(sy[b] - sy[a]) * sign;
+		prim->_edgeB[k] =  (sx[b] - sx[a]) * sign;
+		prim->_edgeC[k] = ((sy[b] - sy[a]) * sx[a] - (sx[b] - sx[a]) * sy[a]) * sign;
+
+		// pixels on an edge shared by two triangles go to exactly one of them,
+		// whose side of the edge has the opposite normal
+		prim->_inclusive[k] = prim->_edgeA[k] > 0.0f || (prim->_edgeA[k] == 0.0f && prim->_edgeB[k] > 0.0f);
+	}
+
+	// the edges over the area are the barycentric coordinates
+	float invArea = sign / area;
+	for(int i = 0; i < NUM_ATTRS; i++)
+	{
+		float dx = 0.0f, dy = 0.0f, c = 0.0f;
+		for(int k = 0; k < 3; k++)
+		{
+			dx += attr[i][k] * prim->_edgeA[k];
+			dy += attr[i][k] * prim->_edgeB[k];
+			c  += attr[i][k] * prim->_edgeC[k];
+		}
+		prim->_attr[i][0] = dx * invArea;
+		prim->_attr[i][1] = dy * invArea;
+		prim->_attr[i][2] = c  * invArea;
+	}
+
+	// pixels whose centers are in the bounds
+	float minX = sx[0], maxX = sx[0], minY = sy[0], maxY = sy[0];
+	for(int k = 1; k < 3; k++)
+	{
+		minX = sx[k] < minX ? sx[k] : minX;
+		maxX = sx[k] > maxX ? sx[k] : maxX;
+		minY = sy[k] < minY ? sy[k] : minY;
+		maxY = sy[k] > maxY ? sy[k] : maxY;
+	}
+
+	// clamped to the screen before converting, a vertex near the eye can be far off it
+	minX = minX < 0.0f ? 0.0f : minX;
+	minY = minY < 0.0f ? 0.0f : minY;
+	maxX = maxX > _width  ? (float)_width  : maxX;
+	maxY = maxY > _height ? (float)_height : maxY;
+	if( minX > maxX || minY > maxY )
+		return;
+
+	prim->_minX  = (int)::ceilf(minX - 0.5f);
+	prim->_minY  = (int)::ceilf(minY - 0.5f);
+	prim->_maxX  = (int)::floorf(maxX - 0.5f);
+	prim->_maxY  = (int)::floorf(maxY - 0.5f);
+	prim->_tex   = _tex;
+	prim->_blend = _blend;
+	prim->_point = false;
+}
+
+void SoftRaster::drawPoints(const psys::PackedParticle* points, int count, float size)
+{
+	if( count <= 0 )
+		return;
+
+	int base = _numPrims;
+	_numPrims += count;
+	if( (int)_prims.size() < _numPrims )
+		_prims.resize(_numPrims);
+
+	JobPool::ChunkFunc setup = [&](int /*chunk*/, int begin, int end)
+	{
+		for(int i = begin; i < end; i++)
+			setupPoint(points[i], size, &_prims[base + i]);
+	};
+
+	if( _pool )
+		_pool->parallelFor(0, count, SETUP_CHUNK, setup);
+	else
+		setup(0, 0, count);
+}
+
+void SoftRaster::setupPoint(const psys::PackedParticle& point, float size, Primitive* prim)
+{
+	prim->_minX = 1;
+	prim->_maxX = 0;
+
+	// a point is clipped by its center
+	float clip[4];
+	transform(_worldViewProj, point._x, point._y, point._z, 1.0f, clip);
+	if( clip[3] <= 0.0f ||
+		clip[0] < -clip[3] || clip[0] > clip[3] ||
+		clip[1] < -clip[3] || clip[1] > clip[3] ||
+		clip[2] < 0.0f     || clip[2] > clip[3] )
+		return;
+
+	// size / distance of the viewport height, POINTSCALE_A and _B being 0
+	float eye[4];
+	transform(_worldView, point._x, point._y, point._z, 1.0f, eye);
+	float distance = ::sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+
+	float pixels = distance > 0.0f ? _height * size / distance : MAX_POINT_SIZE;
+	if( pixels > MAX_POINT_SIZE )
+		pixels = MAX_POINT_SIZE;
+
+	float iw = 1.0f / clip[3];
+	float sx = (clip[0] * iw + 1.0f) * 0.5f * _width;
+	float sy = (1.0f - clip[1] * iw) * 0.5f * _height;
+
+	float left = sx - pixels * 0.5f;
+	float top  = sy - pixels * 0.5f;
+
+	prim->_edgeA[0] = left;
+	prim->_edgeA[1] = top;
+	prim->_edgeA[2] = pixels;
+
+	float color[4];
+	unpackColor(point._color, color);
+	for(int i = 0; i < NUM_ATTRS; i++)
+	{
+		prim->_attr[i][0] = 0.0f;
+		prim->_attr[i][1] = 0.0f;
+		prim->_attr[i][2] = 0.0f;
+	}
+	prim->_attr[ATTR_Z][2] = clip[2] * iw;
+	prim->_attr[ATTR_W][2] = 1.0f;
+	for(int c = 0; c < 4; c++)
+		prim->_attr[ATTR_R + c][2] = color[c];
+
+	int minX = (int)::ceilf(left - 0.5f);
+	int minY = (int)::ceilf(top  - 0.5f);
+	int maxX = (int)::ceilf(left + pixels - 0.5f) - 1;
+	int maxY = (int)::ceilf(top  + pixels - 0.5f) - 1;
+
+	prim->_minX  = minX < 0 ? 0 : minX;
+	prim->_minY  = minY < 0 ? 0 : minY;
+	prim->_maxX  = maxX >= _width  ? _width  - 1 : maxX;
+	prim->_maxY  = maxY >= _height ? _height - 1 : maxY;
+	prim->_tex   = _tex;
+	prim->_blend = _blend;
+	prim->_point = true;
+}
+
+//
+// Binning and shading
+//
+
+void SoftRaster::flush()
+{
+	_stats = Stats();
+
+	for(int t = 0; t < (int)_bins.size(); t++)
+		_bins[t].clear();
+
+	// binned in drawing order, so that each tile draws its primitives in it
+	for(int i = 0; i < _numPrims; i++)
+	{
+		const Primitive& prim = _prims[i];
+		if( prim._minX > prim._maxX || prim._minY > prim._maxY )
+			continue;
+
+		if( prim._point )
+			_stats._numPoints++;
+		else
+			_stats._numTriangles++;
+
+		int tx0 = prim._minX / TILE_SIZE, tx1 = prim._maxX / TILE_SIZE;
+		int ty0 = prim._minY / TILE_SIZE, ty1 = prim._maxY / TILE_SIZE;
+
+		for(int ty = ty0; ty <= ty1; ty++)
+		{
+			for(int tx = tx0; tx <= tx1; tx++)
+				_bins[ty * _tilesX + tx].push_back(i);
+		}
+		_stats._numBinned += (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+	}
+
+	// tiles cover pixels of their own, so they can be shaded in any order
+	JobPool::ChunkFunc shade = [this](int /*chunk*/, int begin, int end)
+	{
+		for(int t = begin; t < end; t++)
+			shadeTile(t);
+	};
+
+	int numTiles = _tilesX * _tilesY;
+	if( _pool )
+		_pool->parallelFor(0, numTiles, 1, shade);
+	else
+		shade(0, 0, numTiles);
+
+	_numPrims = 0;
+}
+
+void SoftRaster::shadeTile(int tile)
+{
+	int tileX0 = (tile % _tilesX) * TILE_SIZE;
+	int tileY0 = (tile / _tilesX) * TILE_SIZE;
+	int tileX1 = tileX0 + TILE_SIZE - 1 < _width  ? tileX0 + TILE_SIZE - 1 : _width  - 1;
+	int tileY1 = tileY0 + TILE_SIZE - 1 < _height ? tileY0 + TILE_SIZE - 1 : _height - 1;
+
+	const std::vector<unsigned int>& bin = _bins[tile];
+	for(int k = 0; k < (int)bin.size(); k++)
+	{
+		const Primitive& prim = _prims[bin[k]];
+
+		int x0 = prim._minX > tileX0 ? prim._minX : tileX0;
+		int y0 = prim._minY > tileY0 ? prim._minY : tileY0;
+		int x1 = prim._maxX < tileX1 ? prim._maxX : tileX1;
+		int y1 = prim._maxY < tileY1 ? prim._maxY : tileY1;
+
+		if( prim._point )
+			shadePoint(prim, x0, y0, x1, y1);
+		else
+			shadeTriangle(prim, x0, y0, x1, y1);
+	}
+}
+
+void SoftRaster::shadeTriangle(const Primitive& prim, int x0, int y0, int x1, int y1)
+{
+	//
+	// Remarks:  The edge functions and depth of a pixel are evaluated as a * x + (b * y + c)
+	//           by both paths, so that the SSE2 path covers and depth tests exactly
+	//           the pixels the scalar one does.  Only the pixels that pass are
+	//           interpolated and textured, one at a time.
+	//
+
+	const float* a = prim._edgeA;
+	const float* z = prim._attr[ATTR_Z];
+
+#ifdef SIMD_X86
+	bool sse2 = simd::GetLevel() >= simd::LEVEL_SSE2;
+
+	const __m128 zero  = _mm_setzero_ps();
+	const __m128 one   = _mm_set1_ps(1.0f);
+	const __m128 half  = _mm_set1_ps(0.5f);
+	const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+	const __m128 zdx = _mm_set1_ps(z[0]);
+#endif
+
+	for(int y = y0; y <= y1; y++)
+	{
+		float py = (float)y + 0.5f;
+
+		float row[3];
+		for(int k = 0; k < 3; k++)
+			row[k] = prim._edgeB[k] * py + prim._edgeC[k];
+		float zRow = z[1] * py + z[2];
+
+		float* depth = &_depth[y * _width];
+		int    x     = x0;
+
+#ifdef SIMD_X86
+		if( sse2 )
+		{
+			const __m128 r0 = _mm_set1_ps(row[0]), r1 = _mm_set1_ps(row[1]), r2 = _mm_set1_ps(row[2]);
+			const __m128 zr = _mm_set1_ps(zRow);
+
+			for(; x + 4 <= x1 + 1; x += 4)
+			{
+				// (float)x + 0.5f per lane, exactly as the scalar path computes it
+				__m128 px = _mm_add_ps(_mm_add_ps(_mm_set1_ps((float)x), lanes), half);
+
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+
+				__m128 in0 = prim._inclusive[0] ? _mm_cmpge_ps(e0, zero) : _mm_cmpgt_ps(e0, zero);
+				__m128 in1 = prim._inclusive[1] ? _mm_cmpge_ps(e1, zero) : _mm_cmpgt_ps(e1, zero);
+				__m128 in2 = prim._inclusive[2] ? _mm_cmpge_ps(e2, zero) : _mm_cmpgt_ps(e2, zero);
+
+				// depth in [0, 1] and less or equal to the buffer's
+				__m128 pz   = _mm_add_ps(_mm_mul_ps(zdx, px), zr);
+				__m128 pass = _mm_and_ps(_mm_cmpge_ps(pz, zero), _mm_cmple_ps(pz, one));
+				pass = _mm_and_ps(pass, _mm_cmple_ps(pz, _mm_loadu_ps(depth + x)));
+				pass = _mm_and_ps(pass, _mm_and_ps(in0, _mm_and_ps(in1, in2)));
+
+				unsigned int mask = (unsigned int)_mm_movemask_ps(pass);
+				if( !mask )
+					continue;
+
+				float lanesZ[4];
+				_mm_storeu_ps(lanesZ, pz);
+
+				while( mask )
+				{
+					int lane = simd::LowestBit(mask);
+					mask &= mask - 1;
+					shadePixel(prim, y * _width + x + lane, (float)(x + lane) + 0.5f, py, lanesZ[lane]);
+				}
+			}
+		}
+#endif
+
+		for(; x <= x1; x++)
+		{
+			float px = (float)x + 0.5f;
+
+			bool inside = true;
+			for(int k = 0; k < 3; k++)
+			{
+				float e = a[k] * px + row[k];
+				inside = inside && (prim._inclusive[k] ? e >= 0.0f : e > 0.0f);
+			}
+			if( !inside )
+				continue;
+
+			float pz = z[0] * px + zRow;
+			if( pz >= 0.0f && pz <= 1.0f && pz <= depth[x] )
+				shadePixel(prim, y * _width + x, px, py, pz);
+		}
+	}
+}
+
+void SoftRaster::shadePixel(const Primitive& prim, int i, float x, float y, float z)
+{
+	const float (*attr)[3] = prim._attr;
+
+	float w = 1.0f / (attr[ATTR_W][0] * x + (attr[ATTR_W][1] * y + attr[ATTR_W][2]));
+	float u = (attr[ATTR_U][0] * x + (attr[ATTR_U][1] * y + attr[ATTR_U][2])) * w;
+	float v = (attr[ATTR_V][0] * x + (attr[ATTR_V][1] * y + attr[ATTR_V][2])) * w;
+
+	float color[4];
+	for(int c = 0; c < 4; c++)
+		color[c] = (attr[ATTR_R + c][0] * x + (attr[ATTR_R + c][1] * y + attr[ATTR_R + c][2])) * w;
+
+	writePixel(prim, i, z, color, u, v);
+}
+
+void SoftRaster::shadePoint(const Primitive& prim, int x0, int y0, int x1, int y1)
+{
+	float left   = prim._edgeA[0];
+	float top    = prim._edgeA[1];
+	float invLen = 1.0f / prim._edgeA[2];
+	float z      = prim._attr[ATTR_Z][2];
+
+	for(int y = y0; y <= y1; y++)
+	{
+		float  v     = ((float)y + 0.5f - top) * invLen;
+		float* depth = &_depth[y * _width];
+
+		for(int x = x0; x <= x1; x++)
+		{
+			if( z > depth[x] )
+				continue;
+
+			float u = ((float)x + 0.5f - left) * invLen;
+
+			float color[4];
+			for(int c = 0; c < 4; c++)
+				color[c] = prim._attr[ATTR_R + c][2];
+
+			writePixel(prim, y * _width + x, z, color, u, v);
+		}
+	}
+}
+
+void SoftRaster::writePixel(const Primitive& prim, int i, float z, float* color, float u, float v)
+{
+	// texture modulated by the diffuse color, both color and alpha
+	if( prim._tex )
+	{
+		float texel[4];
+		sample(prim._tex, u, v, texel);
+		for(int c = 0; c < 4; c++)
+			color[c] *= texel[c];
+	}
+
+	if( prim._blend )
+	{
+		float target[4];
+		unpackColor(_color[i], target);
+
+		float alpha = color[3] < 0.0f ? 0.0f : (color[3] > 1.0f ? 1.0f : color[3]);
+		for(int c = 0; c < 4; c++)
+			color[c] = color[c] * alpha + target[c] * (1.0f - alpha);
+	}
+
+	_color[i] = (toByte(color[3]) << 24) | (toByte(color[0]) << 16) | (toByte(color[1]) << 8) | toByte(color[2]);
+	_depth[i] = z;
+}
+
+bool SoftRaster::writeTga(const char* fileName) const
+{
+	FILE* file = fopen(fileName, "wb");
+	if( !file )
+		return false;
+
+	// uncompressed true color, 8 bits of alpha, rows from the top
+	unsigned char header[18] = { 0 };
+	header[2]  = 2;
+	header[12] = (unsigned char)(_width  & 0xff);
+	header[13] = (unsigned char)(_width  >> 8);
+	header[14] = (unsigned char)(_height & 0xff);
+	header[15] = (unsigned char)(_height >> 8);
+	header[16] = 32;
+	header[17] = 0x28;
+
+	bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+	std::vector<unsigned char> row(_width * 4);
+	for(int y = 0; ok && y < _height; y++)
+	{
+		for(int x = 0; x < _width; x++)
+		{
+			unsigned int argb = _color[y * _width + x];
+			row[x * 4 + 0] = (unsigned char)(argb);
+			row[x * 4 + 1] = (unsigned char)(argb >> 8);
+			row[x * 4 + 2] = (unsigned char)(argb >> 16);
+			row[x * 4 + 3] = (unsigned char)(argb >> 24);
+		}
+		ok = fwrite(&row[0], 1, row.size(), file) == row.size();
+	}
+
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,176 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softRaster.h
+//
+// Author: William Cheung
+//
+// Desc: A CPU rasterizer for the part of the fixed-function pipeline the project
+//       draws with: textured triangle lists with directional lighting, as drawn by
+//       Terrain and Cube, and the alpha blended point sprites of PSystem.  Draws
+//       are queued, then flush bins them into screen tiles and shades the tiles in
+//       parallel on a job pool, the pixel coverage and depth tests with SSE2 where
+//       available.  Every pixel is written by one thread, in the order the draws
+//       were queued, so images do not depend on the number of threads or the
+//       instruction set.  Renders into memory; does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __softRasterH__
+#define __softRasterH__
+
+#include "jobPool.h"
+#include "particleStore.h"
+#include <vector>
+
+class SoftRaster
+{
+public:
+	// which winding is culled, as seen on the screen; D3DCULL_CCW by default
+	enum Cull { CULL_NONE, CULL_CW, CULL_CCW };
+
+	// the screen is binned into tiles of TILE_SIZE x TILE_SIZE pixels
+	static const int TILE_SIZE = 64;
+
+	struct Vertex
+	{
+		float _x, _y, _z;
+		float _nx, _ny, _nz; // only used with lighting
+		float _u, _v;
+	};
+
+	// ARGB texels, row by row from the top, sampled bilinearly with wrapping
+	struct Texture
+	{
+		Texture() { _width = 0; _height = 0; }
+
+		int                       _width;
+		int                       _height;
+		std::vector<unsigned int> _texels;
+	};
+
+	struct Stats
+	{
+		Stats()
+		{
+			_numTriangles = 0;
+			_numPoints    = 0;
+			_numBinned    = 0;
+		}
+
+		int _numTriangles; // triangles drawn, after culling and clipping
+		int _numPoints;    // point sprites drawn
+		int _numBinned;    // primitive references put into tiles
+	};
+
+	SoftRaster();
+
+	// Desc: Sizes the color and depth buffers.
+	bool init(int width, int height);
+
+	// shade on the threads of pool, 0 for none
+	void setJobPool(JobPool* pool);
+
+	//
+	// States, applying to the draws queued after they are set.  Matrices are laid
+	// out like D3DXMATRIX and transform row vectors.
+	//
+
+	void setTransform(const float world[16], const float view[16], const float proj[16]);
+	void setTexture(const Texture* tex);  // 0 for none
+	void setCullMode(Cull cull);
+	void setBlending(bool enable);        // source alpha over the target
+	void setLighting(bool enable);
+
+	// light coming along direction, lighting a white material
+	void setLight(const float direction[3], const float diffuse[3], const float ambient[3]);
+
+	// Desc: Fills the color and depth buffers, at once rather than queued.
+	void clear(unsigned int color, float depth);
+
+	// Desc: Queues an indexed triangle list.  Each of the numVertices vertices
+	//       is transformed and lit once, however many triangles share it.
+	//       Without lighting the vertices are given color (ARGB).
+	void drawTriangles(
+		const Vertex* vertices, int numVertices,
+		const unsigned int* indices, int numTriangles,
+		unsigned int color = 0xffffffff);
+
+	// Desc: Queues point sprites of size, scaled by distance as PSystem sets up
+	//       the device (POINTSCALE_C 1), with their texels modulated by the
+	//       points' colors.  Points whose center is clipped are not drawn.
+	void drawPoints(const psys::PackedParticle* points, int count, float size);
+
+	// Desc: Draws everything queued since the last flush.
+	void flush();
+
+	int getWidth() const  { return _width; }
+	int getHeight() const { return _height; }
+
+	// ARGB, row by row from the top; valid after flush
+	const unsigned int* getColorBuffer() const { return &_color[0]; }
+	const float*        getDepthBuffer() const { return &_depth[0]; }
+
+	// what the last flush drew
+	const Stats& getStats() const { return _stats; }
+
+	// Desc: Writes the color buffer as an uncompressed 32 bit TGA file.
+	bool writeTga(const char* fileName) const;
+
+private:
+	// a triangle or a point set up for rasterizing: edge functions and attribute
+	// planes over pixel centers.  A point's sprite starts at (_edgeA[0], _edgeA[1])
+	// and is _edgeA[2] pixels wide; its planes are flat.
+	struct Primitive
+	{
+		float _edgeA[3], _edgeB[3], _edgeC[3]; // a x + b y + c >= 0 inside
+		bool  _inclusive[3];                   // pixels on the edge are in
+		float _attr[8][3];                     // planes of z, 1/w, u/w, v/w, rgba/w
+		int   _minX, _minY, _maxX, _maxY;      // inclusive pixel bounds, empty if min > max
+		const Texture* _tex;
+		bool  _blend;
+		bool  _point;
+	};
+
+	// transformed vertex, in clip space
+	struct ClipVertex
+	{
+		float _pos[4];
+		float _u, _v;
+		float _color[4];
+	};
+
+	void setupTriangle(const ClipVertex* v, Primitive* prim);
+	void setupPoint(const psys::PackedParticle& point, float size, Primitive* prim);
+	void shadeTile(int tile);
+	void shadeTriangle(const Primitive& prim, int x0, int y0, int x1, int y1);
+	void shadePoint(const Primitive& prim, int x0, int y0, int x1, int y1);
+	void shadePixel(const Primitive& prim, int i, float x, float y, float z);
+	void writePixel(const Primitive& prim, int i, float z, float* color, float u, float v);
+
+	int                       _width;
+	int                       _height;
+	int                       _tilesX;
+	int                       _tilesY;
+	std::vector<unsigned int> _color;
+	std::vector<float>        _depth;
+	JobPool*                  _pool;
+
+	float          _worldViewProj[16];
+	float          _world[16];
+	float          _worldView[16];
+	const Texture* _tex;
+	Cull           _cull;
+	bool           _blend;
+	bool           _lighting;
+	float          _lightDir[3];
+	float          _lightDiffuse[3];
+	float          _lightAmbient[3];
+
+	std::vector<Primitive>                 _prims;    // in drawing order, two slots per triangle
+	int                                    _numPrims; // slots of _prims used, kept to spare clearing them
+	std::vector<ClipVertex>                _clipped;  // scratch for the vertices of a draw
+	std::vector<std::vector<unsigned int>> _bins;  // primitives of each tile, in drawing order
+	Stats                                  _stats;
+};
+
+#endif // __softRasterH__
@@ -1,518 +1,1174 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: terrain.cpp
-// 
-// Author: Frank Luna (C) All Rights Reserved
-//
-// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
-//
-// Desc: Represents a 3D terrain. 
-//
-// * Modified by William Cheung, Bugs Fixed
-//          
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#include "terrain.h"
-#include <fstream>
-#include <cmath>
-
-const DWORD Terrain::TerrainVertex::FVF = D3DFVF_XYZ | D3DFVF_TEX1;
-
-Terrain::Terrain(IDirect3DDevice9* device,
-				 std::string heightmapFileName,
-				 int numVertsPerRow,
-				 int numVertsPerCol,
-				 int cellSpacing,
-				 float heightScale)
-{
-	_device         = device;
-	_numVertsPerRow = numVertsPerRow;
-	_numVertsPerCol = numVertsPerCol;
-	_cellSpacing    = cellSpacing;
-
-	_numCellsPerRow = _numVertsPerRow - 1;
-	_numCellsPerCol = _numVertsPerCol - 1;
-
-	_width = _numCellsPerRow * _cellSpacing;
-	_depth = _numCellsPerCol * _cellSpacing;
-
-	_numVertices  = _numVertsPerRow * _numVertsPerCol;
-	_numTriangles = _numCellsPerRow * _numCellsPerCol * 2;
-
-	_heightScale = heightScale;
-
-	// load heightmap
-	if( !readRawFile(heightmapFileName) )
-	{
-		::MessageBox(0, "readRawFile - FAILED", 0, 0);
-		::PostQuitMessage(0);
-	}
-
-	// scale heights
-	for(int i = 0; i < _heightmap.size(); i++)
-		_heightmap[i] *= heightScale;
-
-	// compute the vertices
-	if( !computeVertices() )
-	{
-		::MessageBox(0, "computeVertices - FAILED", 0, 0);
-		::PostQuitMessage(0);
-	}
-
-	// compute the indices
-	if( !computeIndices() )
-	{
-		::MessageBox(0, "computeIndices - FAILED", 0, 0);
-		::PostQuitMessage(0);
-	}
-}
-
-Terrain::~Terrain()
-{
-	d3d::Release<IDirect3DVertexBuffer9*>(_vb);
-	d3d::Release<IDirect3DIndexBuffer9*>(_ib);
-	d3d::Release<IDirect3DTexture9*>(_tex);
-}
-
-int Terrain::getHeightmapEntry(int row, int col)
-{
-	int index = row * _numVertsPerRow + col;
-	if (index < _heightmap.size())
-		return _heightmap[row * _numVertsPerRow + col];
-	else return 0;
-}
-
-void Terrain::setHeightmapEntry(int row, int col, int value)
-{
-	int index = row * _numVertsPerRow + col;
-	if (index < _heightmap.size())
-		_heightmap[row * _numVertsPerRow + col] = value;
-}
-
-bool Terrain::computeVertices()
-{
-	HRESULT hr = 0;
-
-	hr = _device->CreateVertexBuffer(
-		_numVertices * sizeof(TerrainVertex),
-		D3DUSAGE_WRITEONLY,
-		TerrainVertex::FVF,
-		D3DPOOL_MANAGED,
-		&_vb,
-		0);
-
-	if(FAILED(hr))
-		return false;
-
-	// coordinates to start generating vertices at
-	int startX = -_width / 2;
-	int startZ =  _depth / 2;
-
-	// coordinates to end generating vertices at
-	int endX =  _width / 2;
-	int endZ = -_depth / 2;
-
-	// compute the increment size of the texture coordinates
-	// from one vertex to the next.
-	float uCoordIncrementSize = 1.0f / (float)_numCellsPerRow;
-	float vCoordIncrementSize = 1.0f / (float)_numCellsPerCol;
-
-	TerrainVertex* v = 0;
-	_vb->Lock(0, 0, (void**)&v, 0);
-
-	int i = 0;
-	for(int z = startZ; z >= endZ; z -= _cellSpacing)
-	{
-		int j = 0;
-		for(int x = startX; x <= endX; x += _cellSpacing)
-		{
-			// compute the correct index into the vertex buffer and heightmap
-			// based on where we are in the nested loop.
-			int index = i * _numVertsPerRow + j;
-
-			v[index] = TerrainVertex(
-				(float)x,
-				(float)_heightmap[index],
-				(float)z,
-				(float)j * uCoordIncrementSize,
-				(float)i * vCoordIncrementSize);
-
-			j++; // next column
-		}
-		i++; // next row
-	}
-
-	_vb->Unlock();
-
-	return true;
-}
-
-bool Terrain::computeIndices()
-{
-	HRESULT hr = 0;
-
-	hr = _device->CreateIndexBuffer(
-		_numTriangles * 3 * sizeof(WORD), // 3 indices per triangle
-		D3DUSAGE_WRITEONLY,
-		D3DFMT_INDEX16,
-		D3DPOOL_MANAGED,
-		&_ib,
-		0);
-
-	if(FAILED(hr))
-		return false;
-
-	WORD* indices = 0;
-	_ib->Lock(0, 0, (void**)&indices, 0);
-
-	// index to start of a group of 6 indices that describe the
-	// two triangles that make up a quad
-	int baseIndex = 0;
-
-	// loop through and compute the triangles of each quad
-	for(int i = 0; i < _numCellsPerCol; i++)
-	{
-		for(int j = 0; j < _numCellsPerRow; j++)
-		{
-			indices[baseIndex]     =   i   * _numVertsPerRow + j;
-			indices[baseIndex + 1] =   i   * _numVertsPerRow + j + 1;
-			indices[baseIndex + 2] = (i+1) * _numVertsPerRow + j;
-
-			indices[baseIndex + 3] = (i+1) * _numVertsPerRow + j;
-			indices[baseIndex + 4] =   i   * _numVertsPerRow + j + 1;
-			indices[baseIndex + 5] = (i+1) * _numVertsPerRow + j + 1;
-
-			// next quad
-			baseIndex += 6;
-		}
-	}
-
-	_ib->Unlock();
-
-	return true;
-}
-
-bool Terrain::loadTexture(std::string fileName)
-{
-	HRESULT hr = 0;
-
-	hr = D3DXCreateTextureFromFile(
-		_device,
-		fileName.c_str(),
-		&_tex);
-
-	if(FAILED(hr))
-		return false;
-
-	return true;
-}
-
-bool Terrain::genTexture(D3DXVECTOR3* directionToLight)
-{
-	// Method fills the top surface of a texture procedurally.  Then
-	// lights the top surface.  Finally, it fills the other mipmap
-	// surfaces based on the top surface data using D3DXFilterTexture.
-
-	HRESULT hr = 0;
-
-	// texel for each quad cell
-	int texWidth  = _numCellsPerRow;
-	int texHeight = _numCellsPerCol;
-
-	// create an empty texture
-	hr = D3DXCreateTexture(
-		_device,
-		texWidth, texHeight,
-		0, // create a complete mipmap chain
-		0, // usage
-		D3DFMT_X8R8G8B8,// 32 bit XRGB format
-		D3DPOOL_MANAGED, &_tex);
-
-	if(FAILED(hr))
-		return false;
-
-	D3DSURFACE_DESC textureDesc; 
-	_tex->GetLevelDesc(0 /*level*/, &textureDesc);
-
-	// make sure we got the requested format because our code 
-	// that fills the texture is hard coded to a 32 bit pixel depth.
-	if( textureDesc.Format != D3DFMT_X8R8G8B8 )
-		return false;
-		
-	D3DLOCKED_RECT lockedRect;
-	_tex->LockRect(0/*lock top surface*/, &lockedRect, 
-		0 /* lock entire tex*/, 0/*flags*/);         
-
-	DWORD* imageData = (DWORD*)lockedRect.pBits;
-	for(int i = 0; i < texHeight; i++)
-	{
-		for(int j = 0; j < texWidth; j++)
-		{
-			D3DXCOLOR c;
-
-			// get height of upper left vertex of quad.
-			float height = (float)getHeightmapEntry(i, j) / _heightScale;
-
-/*
-			if( (height) < 42.5f ) 		 c = d3d::BEACH_SAND;
-			else if( (height) < 85.0f )	 c = d3d::LIGHT_YELLOW_GREEN;
-			else if( (height) < 127.5f ) c = d3d::PUREGREEN;
-			else if( (height) < 170.0f ) c = d3d::DARK_YELLOW_GREEN;
-			else if( (height) < 212.5f ) c = d3d::DARKBROWN;
-			else	                     c = d3d::WHITE;
-*/
-
-			c = d3d::WHITE;
-
-			// fill locked data, note we divide the pitch by four because the
-			// pitch is given in bytes and there are 4 bytes per DWORD.
-			imageData[i * lockedRect.Pitch / 4 + j] = (D3DCOLOR)c;
-		}
-	}
-
-	_tex->UnlockRect(0);
-
-	if(!lightTerrain(directionToLight))
-	{
-		::MessageBox(0, "lightTerrain() - FAILED", 0, 0);
-		return false;
-	}
-	
-	hr = D3DXFilterTexture(
-		_tex,
-		0, // default palette
-		0, // use top level as source level
-		D3DX_DEFAULT); // default filter
-
-	if(FAILED(hr))
-	{
-		::MessageBox(0, "D3DXFilterTexture() - FAILED", 0, 0);
-		return false;
-	}
-
-	return true;
-}
-
-bool Terrain::lightTerrain(D3DXVECTOR3* directionToLight)
-{
-	HRESULT hr = 0;
-
-	D3DSURFACE_DESC textureDesc; 
-	_tex->GetLevelDesc(0 /*level*/, &textureDesc);
-
-	// make sure we got the requested format because our code that fills the
-	// texture is hard coded to a 32 bit pixel depth.
-	if( textureDesc.Format != D3DFMT_X8R8G8B8 )
-		return false;
-		
-	D3DLOCKED_RECT lockedRect;
-	_tex->LockRect(
-		0,          // lock top surface level in mipmap chain
-		&lockedRect,// pointer to receive locked data
-		0,          // lock entire texture image
-		0);         // no lock flags specified
-
-	DWORD* imageData = (DWORD*)lockedRect.pBits;
-	for(int i = 0; i < textureDesc.Height; i++)
-	{
-		for(int j = 0; j < textureDesc.Width; j++)
-		{
-			// index into texture, note we use the pitch and divide by 
-			// four since the pitch is given in bytes and there are 
-			// 4 bytes per DWORD.
-			int index = i * lockedRect.Pitch / 4 + j;
-
-			// get current color of quad
-			D3DXCOLOR c( imageData[index] );
-
-			// shade current quad
-			c *= computeShade(i, j, directionToLight);;
-
-			// save shaded color
-			imageData[index] = (D3DCOLOR)c;
-		}
-	}
-
-	_tex->UnlockRect(0);
-
-	return true;
-}
-
-float Terrain::computeShade(int cellRow, int cellCol, D3DXVECTOR3* directionToLight)
-{
-	// get heights of three vertices on the quad
-	float heightA = getHeightmapEntry(cellRow,   cellCol);
-	float heightB = getHeightmapEntry(cellRow,   cellCol+1);
-	float heightC = getHeightmapEntry(cellRow+1, cellCol);
-
-	// build two vectors on the quad
-	D3DXVECTOR3 u(_cellSpacing, heightB - heightA, 0.0f);
-	D3DXVECTOR3 v(0.0f,         heightC - heightA, -_cellSpacing);
-
-	// find the normal by taking the cross product of two
-	// vectors on the quad.
-	D3DXVECTOR3 n;
-	D3DXVec3Cross(&n, &u, &v);
-	D3DXVec3Normalize(&n, &n);
-
-	float cosine = D3DXVec3Dot(&n, directionToLight);
-
-	if(cosine < 0.0f)
-		cosine = 0.0f;
-
-	//cosine = (cosine + 1.0f) / 2.0f;
-
-	return cosine;
-}
-
-bool Terrain::readRawFile(std::string fileName)
-{
-	// Restriction: RAW file dimensions must be >= to the
-	// dimensions of the terrain.  That is a 128x128 RAW file
-	// can only be used with a terrain constructed with at most
-	// 128x128 vertices.
-
-	// A height for each vertex
-	std::vector<BYTE> in( _numVertices );
-
-	std::ifstream inFile(fileName.c_str(), std::ios_base::binary);
-
-	if( !inFile )
-		return false;
-
-	inFile.read(
-		(char*)&in[0], // buffer
-		in.size());// number of bytes to read into buffer
-
-	inFile.close();
-
-	// copy BYTE vector to int vector
-	_heightmap.resize( _numVertices );
-
-	for(int i = 0; i < in.size(); i++)
-		_heightmap[i] = in[i];
-
-	return true;
-}
-
-float Terrain::getHeight(float x, float z)
-{
-	// Translate on xz-plane by the transformation that takes
-	// the terrain START point to the origin.
-	x = ((float)_width / 2.0f) + x;
-	z = ((float)_depth / 2.0f) - z;
-
-	// Scale down by the transformation that makes the 
-	// cellspacing equal to one.  This is given by 
-	// 1 / cellspacing since; cellspacing * 1 / cellspacing = 1.
-	x /= (float)_cellSpacing;
-	z /= (float)_cellSpacing;
-
-	// From now on, we will interpret our positive z-axis as
-	// going in the 'down' direction, rather than the 'up' direction.
-	// This allows to extract the row and column simply by 'flooring'
-	// x and z:
-
-	float col = ::floorf(x);
-	float row = ::floorf(z);
-
-	// get the heights of the quad we're in:
-	// 
-    //  A   B
-    //  *---*
-    //  | / |
-    //  *---*  
-    //  C   D
-
-	float A = getHeightmapEntry(row,   col);
-	float B = getHeightmapEntry(row,   col+1);
-	float C = getHeightmapEntry(row+1, col);
-	float D = getHeightmapEntry(row+1, col+1);
-
-	//
-	// Find the triangle we are in:
-	//
-
-	// Translate by the transformation that takes the upper-left
-	// corner of the cell we are in to the origin.  Recall that our 
-	// cellspacing was nomalized to 1.  Thus we have a unit square
-	// at the origin of our +x -> 'right' and +z -> 'down' system.
-	float dx = x - col;
-	float dz = z - row;
-
-	// Note the below compuations of u and v are unneccessary, we really
-	// only need the height, but we compute the entire vector to emphasis
-	// the books discussion.
-	float height = 0.0f;
-	if(dz < 1.0f - dx)  // upper triangle ABC
-	{
-		float uy = B - A; // A->B
-		float vy = C - A; // A->C
-
-		// Linearly interpolate on each vector.  The height is the vertex
-		// height the vectors u and v originate from {A}, plus the heights
-		// found by interpolating on each vector u and v.
-		height = A + d3d::Lerp(0.0f, uy, dx) + d3d::Lerp(0.0f, vy, dz);
-	}
-	else // lower triangle DCB
-	{
-		float uy = C - D; // D->C
-		float vy = B - D; // D->B
-
-		// Linearly interpolate on each vector.  The height is the vertex
-		// height the vectors u and v originate from {D}, plus the heights
-		// found by interpolating on each vector u and v.
-		height = D + d3d::Lerp(0.0f, uy, 1.0f - dx) + d3d::Lerp(0.0f, vy, 1.0f - dz);
-	}
-
-	return height;
-}
-
-bool Terrain::draw(D3DXMATRIX* world, bool drawTris)
-{
-	HRESULT hr = 0;
-
-	if( _device )
-	{
-		_device->SetTransform(D3DTS_WORLD, world);
-
-		_device->SetStreamSource(0, _vb, 0, sizeof(TerrainVertex));
-		_device->SetFVF(TerrainVertex::FVF);
-		_device->SetIndices(_ib);
-		
-		_device->SetTexture(0, _tex);
-
-		// turn off lighting since we're lighting it ourselves
-		_device->SetRenderState(D3DRS_LIGHTING, false);
-
-		hr =_device->DrawIndexedPrimitive(
-			D3DPT_TRIANGLELIST,
-			0,
-			0,
-			_numVertices,
-			0,
-			_numTriangles);
-
-		_device->SetRenderState(D3DRS_LIGHTING, true);
-
-		if( drawTris )
-		{
-			_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
-			hr =_device->DrawIndexedPrimitive(
-				D3DPT_TRIANGLELIST,
-				0,
-				0,
-				_numVertices,
-				0,
-				_numTriangles);
-
-			_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
-		}
-
-		if(FAILED(hr))
-			return false;
-	}
-
-	return true;
-}
-
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: terrain.cpp
+// 
+// Author: Frank Luna (C) All Rights Reserved
+//
+// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
+//
+// Desc: Represents a 3D terrain. 
+//
+// * Modified by William Cheung, Bugs Fixed
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "terrain.h"
+#include "heightmapFile.h"
+#include "jobPool.h"
+#include <cmath>
+#include <climits>
+
+const DWORD Terrain::TerrainVertex::FVF = D3DFVF_XYZ | D3DFVF_TEX1;
+
+// depth of snow that hides the ground completely
+static const float SNOW_FULL_COVER = 1.0f;
+
+Terrain::Terrain(IDirect3DDevice9* device,
+				 std::string heightmapFileName,
+				 int numVertsPerRow,
+				 int numVertsPerCol,
+				 int cellSpacing,
+				 float heightScale)
+{
+	_device         = device;
+	_numVertsPerRow = numVertsPerRow;
+	_numVertsPerCol = numVertsPerCol;
+	_cellSpacing    = cellSpacing;
+
+	_numCellsPerRow = _numVertsPerRow - 1;
+	_numCellsPerCol = _numVertsPerCol - 1;
+
+	_width = _numCellsPerRow * _cellSpacing;
+	_depth = _numCellsPerCol * _cellSpacing;
+
+	_numVertices  = _numVertsPerRow * _numVertsPerCol;
+	_numTriangles = _numCellsPerRow * _numCellsPerCol * 2;
+
+	_heightScale = heightScale;
+
+	// load heightmap
+	if( !loadHeightmap(heightmapFileName) )
+	{
+		::MessageBox(0, "loadHeightmap - FAILED", 0, 0);
+		::PostQuitMessage(0);
+	}
+
+	// where getHeights finds the vertices
+	_heights.setPlacement(-(float)_width / 2.0f, (float)_depth / 2.0f, (float)_cellSpacing);
+
+	_tex         = 0;
+	_lightDir    = D3DXVECTOR3(0.0f, 1.0f, 0.0f);
+	_lightChanged = false;
+	_pool        = 0;
+	_edit.setField(&_heights);
+
+	// bounds for casting rays at the surface
+	_pyramid.build(&_heights);
+	_pyramidStale = false;
+
+	// split the grid into chunks, laid out as makeVertex lays out the vertices
+	_tree.build(_heights, (float)_cellSpacing, (float)(-_width / 2), (float)(_depth / 2));
+
+	chooseIndexFormat();
+
+	// errors of the chunks' levels of detail
+	_lod.build(&_tree, _heights);
+	_lodEnabled        = false;
+	_lodPixelError     = 2.0f;
+	_lodIb             = 0;
+	_lodIbSize         = 0;
+	_numTrianglesDrawn = 0;
+
+	// compute the vertices
+	if( !computeVertices() )
+	{
+		::MessageBox(0, "computeVertices - FAILED", 0, 0);
+		::PostQuitMessage(0);
+	}
+
+	// compute the indices
+	if( !computeIndices() )
+	{
+		::MessageBox(0, "computeIndices - FAILED", 0, 0);
+		::PostQuitMessage(0);
+	}
+}
+
+Terrain::~Terrain()
+{
+	d3d::Release<IDirect3DVertexBuffer9*>(_vb);
+	d3d::Release<IDirect3DIndexBuffer9*>(_ib);
+	d3d::Release<IDirect3DIndexBuffer9*>(_lodIb);
+	d3d::Release<IDirect3DTexture9*>(_tex);
+}
+
+float Terrain::getHeightmapEntry(int row, int col)
+{
+	if( _heights.isInside(row, col) )
+		return _heights.getGround(row, col);
+	else return 0.0f;
+}
+
+void Terrain::setHeightmapEntry(int row, int col, float value)
+{
+	_edit.setHeight(TerrainEdit::TARGET_GROUND, row, col, value);
+	_pyramidStale = true;
+}
+
+float Terrain::getSurfaceEntry(int row, int col)
+{
+	if( _heights.isInside(row, col) )
+		return _heights.getHeight(row, col);
+	else return 0.0f;
+}
+
+float Terrain::getSnowDepth(int row, int col)
+{
+	if( _heights.isInside(row, col) )
+		return _heights.getLayer(row, col);
+	else return 0.0f;
+}
+
+Terrain::TerrainVertex Terrain::makeVertex(int row, int col)
+{
+	// vertices start at the upper left corner (-width/2, depth/2)
+	int x = -_width / 2 + col * _cellSpacing;
+	int z =  _depth / 2 - row * _cellSpacing;
+
+	// compute the increment size of the texture coordinates
+	// from one vertex to the next.
+	float uCoordIncrementSize = 1.0f / (float)_numCellsPerRow;
+	float vCoordIncrementSize = 1.0f / (float)_numCellsPerCol;
+
+	return TerrainVertex(
+		(float)x,
+		_heights.getHeight(row, col),
+		(float)z,
+		(float)col * uCoordIncrementSize,
+		(float)row * vCoordIncrementSize);
+}
+
+void Terrain::chooseIndexFormat()
+{
+	D3DCAPS9 caps;
+	_device->GetDeviceCaps(&caps);
+
+	_maxPrimitives = caps.MaxPrimitiveCount > 0 && caps.MaxPrimitiveCount < INT_MAX ? (int)caps.MaxPrimitiveCount : INT_MAX;
+
+	// 16 bit indices into the grid while they fit, else 32 bit ones if the
+	// device takes them, else 16 bit ones into each chunk's own vertices
+	if( _numVertices <= 0x10000 )
+		_indexFormat = INDICES_16;
+	else if( caps.MaxVertexIndex >= (DWORD)(_numVertices - 1) )
+		_indexFormat = INDICES_32;
+	else
+		_indexFormat = INDICES_16_PER_CHUNK;
+
+	// where each chunk's vertices start, when the chunks have their own
+	int numChunks = _tree.getNumChunks();
+	_chunkVertex.assign(numChunks + 1, 0);
+
+	if( _indexFormat == INDICES_16_PER_CHUNK )
+	{
+		for(int k = 0; k < numChunks; k++)
+			_chunkVertex[k + 1] = _chunkVertex[k] + _tree.getNumChunkVertices(k);
+	}
+}
+
+bool Terrain::computeVertices()
+{
+	HRESULT hr = 0;
+
+	bool perChunk    = _indexFormat == INDICES_16_PER_CHUNK;
+	int  numVertices = perChunk ? _chunkVertex.back() : _numVertices;
+
+	hr = _device->CreateVertexBuffer(
+		numVertices * sizeof(TerrainVertex),
+		D3DUSAGE_WRITEONLY,
+		TerrainVertex::FVF,
+		D3DPOOL_MANAGED,
+		&_vb,
+		0);
+
+	if(FAILED(hr))
+		return false;
+
+	TerrainVertex* v = 0;
+	_vb->Lock(0, 0, (void**)&v, 0);
+
+	if( perChunk )
+	{
+		// chunk by chunk, the vertices on their shared edges repeated
+		for(int k = 0; k < _tree.getNumChunks(); k++)
+		{
+			const TerrainTree::Chunk& chunk = _tree.getChunk(k);
+			TerrainVertex* cv = v + _chunkVertex[k];
+
+			for(int i = chunk._row; i <= chunk._row + chunk._numRows; i++)
+				for(int j = chunk._col; j <= chunk._col + chunk._numCols; j++)
+					*cv++ = makeVertex(i, j);
+		}
+	}
+	else
+	{
+		for(int i = 0; i < _numVertsPerCol; i++)
+		{
+			for(int j = 0; j < _numVertsPerRow; j++)
+			{
+				// compute the correct index into the vertex buffer and heightmap
+				// based on where we are in the nested loop.
+				v[i * _numVertsPerRow + j] = makeVertex(i, j);
+			}
+		}
+	}
+
+	_vb->Unlock();
+
+	return true;
+}
+
+void Terrain::updateVertices(const TerrainEdit::Rect& rect)
+{
+	// only the runs of the buffer holding the rectangle's vertices, once for
+	// each chunk that has its own copy of them
+	TerrainEdit::findSpans(rect, _tree,
+		_indexFormat == INDICES_16_PER_CHUNK ? &_chunkVertex[0] : 0, &_spans);
+
+	for(int s = 0; s < (int)_spans.size(); s++)
+	{
+		const TerrainEdit::Span& span = _spans[s];
+
+		TerrainVertex* v = 0;
+		if( FAILED(_vb->Lock(
+			span._firstVertex * sizeof(TerrainVertex),
+			span._numVertices * sizeof(TerrainVertex),
+			(void**)&v, 0)) )
+			continue;
+
+		for(int i = 0; i < span._numRows; i++)
+		{
+			TerrainVertex* row = v + i * span._pitch;
+			for(int j = 0; j < span._numCols; j++)
+				row[j] = makeVertex(span._row + i, span._col + j);
+		}
+
+		_vb->Unlock();
+	}
+}
+
+bool Terrain::computeIndices()
+{
+	HRESULT hr = 0;
+
+	int numChunks = _tree.getNumChunks();
+	_chunkStart.resize(numChunks + 1);
+
+	// Into the grid every chunk has triangles of its own.  Into the chunks'
+	// own vertices the chunks of a size have the same indices, so they share
+	// them; there are at most four sizes, the far edges being smaller.
+	std::vector<int> shared;
+	int              numIndices = 0;
+
+	for(int k = 0; k < numChunks; k++)
+	{
+		if( _indexFormat == INDICES_16_PER_CHUNK )
+		{
+			const TerrainTree::Chunk& chunk = _tree.getChunk(k);
+
+			int s = 0;
+			while( s < (int)shared.size() &&
+				(_tree.getChunk(shared[s])._numRows != chunk._numRows ||
+				 _tree.getChunk(shared[s])._numCols != chunk._numCols) )
+				s++;
+
+			if( s < (int)shared.size() )
+			{
+				_chunkStart[k] = _chunkStart[shared[s]];
+				continue;
+			}
+			shared.push_back(k);
+		}
+
+		_chunkStart[k] = numIndices / 3;
+		numIndices += _tree.getNumChunkIndices(k);
+	}
+	_chunkStart[numChunks] = numIndices / 3;
+
+	bool wide = _indexFormat == INDICES_32;
+
+	hr = _device->CreateIndexBuffer(
+		numIndices * (wide ? sizeof(unsigned int) : sizeof(WORD)),
+		D3DUSAGE_WRITEONLY,
+		wide ? D3DFMT_INDEX32 : D3DFMT_INDEX16,
+		D3DPOOL_MANAGED,
+		&_ib,
+		0);
+
+	if(FAILED(hr))
+		return false;
+
+	void* indices = 0;
+	_ib->Lock(0, 0, &indices, 0);
+
+	// the triangles of each quad of each chunk, in the order of the tree
+	if( _indexFormat == INDICES_16_PER_CHUNK )
+	{
+		for(int s = 0; s < (int)shared.size(); s++)
+			_tree.writeIndices(shared[s], true, (WORD*)indices + _chunkStart[shared[s]] * 3);
+	}
+	else
+	{
+		for(int k = 0; k < numChunks; k++)
+		{
+			if( wide )
+				_tree.writeIndices(k, false, (unsigned int*)indices + _chunkStart[k] * 3);
+			else
+				_tree.writeIndices(k, false, (WORD*)indices + _chunkStart[k] * 3);
+		}
+	}
+
+	_ib->Unlock();
+
+	return true;
+}
+
+bool Terrain::loadTexture(std::string fileName)
+{
+	HRESULT hr = 0;
+
+	hr = D3DXCreateTextureFromFile(
+		_device,
+		fileName.c_str(),
+		&_tex);
+
+	if(FAILED(hr))
+		return false;
+
+	return true;
+}
+
+bool Terrain::genTexture(D3DXVECTOR3* directionToLight)
+{
+	// Method fills the top surface of a texture procedurally.  Then
+	// lights the top surface.  Finally, it fills the other mipmap
+	// surfaces based on the top surface data using D3DXFilterTexture.
+
+	HRESULT hr = 0;
+
+	// texel for each quad cell
+	int texWidth  = _numCellsPerRow;
+	int texHeight = _numCellsPerCol;
+
+	// create an empty texture
+	hr = D3DXCreateTexture(
+		_device,
+		texWidth, texHeight,
+		0, // create a complete mipmap chain
+		0, // usage
+		D3DFMT_X8R8G8B8,// 32 bit XRGB format
+		D3DPOOL_MANAGED, &_tex);
+
+	if(FAILED(hr))
+		return false;
+
+	D3DSURFACE_DESC textureDesc; 
+	_tex->GetLevelDesc(0 /*level*/, &textureDesc);
+
+	// make sure we got the requested format because our code 
+	// that fills the texture is hard coded to a 32 bit pixel depth.
+	if( textureDesc.Format != D3DFMT_X8R8G8B8 )
+		return false;
+		
+	D3DLOCKED_RECT lockedRect;
+	_tex->LockRect(0/*lock top surface*/, &lockedRect, 
+		0 /* lock entire tex*/, 0/*flags*/);         
+
+	DWORD* imageData = (DWORD*)lockedRect.pBits;
+	for(int i = 0; i < texHeight; i++)
+	{
+		for(int j = 0; j < texWidth; j++)
+		{
+			D3DXCOLOR c;
+
+			// get height of upper left vertex of quad.
+			float height = getHeightmapEntry(i, j) / _heightScale;
+
+/*
+			if( (height) < 42.5f ) 		 c = d3d::BEACH_SAND;
+			else if( (height) < 85.0f )	 c = d3d::LIGHT_YELLOW_GREEN;
+			else if( (height) < 127.5f ) c = d3d::PUREGREEN;
+			else if( (height) < 170.0f ) c = d3d::DARK_YELLOW_GREEN;
+			else if( (height) < 212.5f ) c = d3d::DARKBROWN;
+			else	                     c = d3d::WHITE;
+*/
+
+			c = d3d::WHITE;
+
+			// fill locked data, note we divide the pitch by four because the
+			// pitch is given in bytes and there are 4 bytes per DWORD.
+			imageData[i * lockedRect.Pitch / 4 + j] = (D3DCOLOR)c;
+		}
+	}
+
+	_tex->UnlockRect(0);
+
+	if(!lightTerrain(directionToLight))
+	{
+		::MessageBox(0, "lightTerrain() - FAILED", 0, 0);
+		return false;
+	}
+	
+	hr = D3DXFilterTexture(
+		_tex,
+		0, // default palette
+		0, // use top level as source level
+		D3DX_DEFAULT); // default filter
+
+	if(FAILED(hr))
+	{
+		::MessageBox(0, "D3DXFilterTexture() - FAILED", 0, 0);
+		return false;
+	}
+
+	return true;
+}
+
+bool Terrain::lightTerrain(D3DXVECTOR3* directionToLight)
+{
+	HRESULT hr = 0;
+
+	D3DSURFACE_DESC textureDesc; 
+	_tex->GetLevelDesc(0 /*level*/, &textureDesc);
+
+	// make sure we got the requested format because our code that fills the
+	// texture is hard coded to a 32 bit pixel depth.
+	if( textureDesc.Format != D3DFMT_X8R8G8B8 )
+		return false;
+		
+	D3DLOCKED_RECT lockedRect;
+	_tex->LockRect(
+		0,          // lock top surface level in mipmap chain
+		&lockedRect,// pointer to receive locked data
+		0,          // lock entire texture image
+		0);         // no lock flags specified
+
+	DWORD* imageData = (DWORD*)lockedRect.pBits;
+
+	// With one texel per cell, as genTexture asks for, keep the texels unlit
+	// to light them again as the snow or the light changes, from the normals
+	// of the cells.  Otherwise light them once, in place.
+	_lightDir = *directionToLight;
+	_groundTexels.clear();
+
+	if( textureDesc.Width == _numCellsPerRow && textureDesc.Height == _numCellsPerCol )
+	{
+		_groundTexels.resize(_numCellsPerRow * _numCellsPerCol);
+		for(int i = 0; i < _numCellsPerCol; i++)
+			for(int j = 0; j < _numCellsPerRow; j++)
+				_groundTexels[i * _numCellsPerRow + j] = imageData[i * lockedRect.Pitch / 4 + j];
+
+		_tex->UnlockRect(0);
+
+		_heights.updateNormals(0, 0, _numCellsPerCol - 1, _numCellsPerRow - 1, _pool);
+		_lightChanged = false;
+
+		return relightCells(0, 0, _numCellsPerCol - 1, _numCellsPerRow - 1);
+	}
+
+	for(int i = 0; i < textureDesc.Height; i++)
+	{
+		for(int j = 0; j < textureDesc.Width; j++)
+		{
+			// index into texture, note we use the pitch and divide by 
+			// four since the pitch is given in bytes and there are 
+			// 4 bytes per DWORD.
+			int index = i * lockedRect.Pitch / 4 + j;
+
+			// get current color of quad
+			D3DXCOLOR c( imageData[index] );
+
+			// shade current quad
+			c *= computeShade(i, j, directionToLight);;
+
+			// save shaded color
+			imageData[index] = (D3DCOLOR)c;
+		}
+	}
+
+	_tex->UnlockRect(0);
+
+	return true;
+}
+
+void Terrain::setLightDirection(D3DXVECTOR3* directionToLight)
+{
+	_lightDir     = *directionToLight;
+	_lightChanged = true;
+}
+
+void Terrain::setJobPool(JobPool* pool)
+{
+	_pool = pool;
+}
+
+bool Terrain::relightCells(int minRow, int minCol, int maxRow, int maxCol)
+{
+	int numRows = maxRow - minRow + 1;
+	int numCols = maxCol - minCol + 1;
+	if( numRows <= 0 || numCols <= 0 )
+		return true;
+
+	RECT rect = { minCol, minRow, maxCol + 1, maxRow + 1 };
+
+	D3DLOCKED_RECT lockedRect;
+	if( FAILED(_tex->LockRect(0, &lockedRect, &rect, 0)) )
+		return false;
+
+	DWORD* imageData = (DWORD*)lockedRect.pBits;
+	int    pitch     = lockedRect.Pitch / 4;
+
+	// a row of tiles of the field per job, so that jobs do not share the
+	// cache lines of the normals
+	const int rowsPerJob = HeightField::TILE_SIZE;
+
+	std::vector<float> shades(numRows * numCols);
+
+	auto lightRows = [&](int i0, int i1)
+	{
+		_heights.shade((const float*)&_lightDir, i0, minCol, i1 - i0, numCols,
+			&shades[(i0 - minRow) * numCols], numCols);
+
+		for(int i = i0; i < i1; i++)
+		{
+			const float* shade = &shades[(i - minRow) * numCols];
+			DWORD*       texel = &imageData[(i - minRow) * pitch];
+
+			for(int j = minCol; j <= maxCol; j++)
+			{
+				// the ground whitened by the snow on the cell, and lit as the
+				// surface of the snow is
+				D3DXCOLOR ground(_groundTexels[i * _numCellsPerRow + j]);
+				D3DXCOLOR c = ground;
+
+				if( _heights.hasLayer() )
+				{
+					float depth = 0.25f * (
+						_heights.getLayer(i,     j) + _heights.getLayer(i,     j + 1) +
+						_heights.getLayer(i + 1, j) + _heights.getLayer(i + 1, j + 1));
+
+					float cover = depth < SNOW_FULL_COVER ? depth / SNOW_FULL_COVER : 1.0f;
+					D3DXColorLerp(&c, &ground, &d3d::WHITE, cover);
+				}
+
+				texel[j - minCol] = (D3DCOLOR)(c * shade[j - minCol]);
+			}
+		}
+	};
+
+	if( _pool )
+	{
+		// tile rows of the field, the first and last cut to the cells
+		int first = minRow / rowsPerJob;
+		int last  = maxRow / rowsPerJob;
+
+		_pool->parallelFor(first, last + 1, 1, [&](int, int begin, int)
+		{
+			int i0 = begin * rowsPerJob;
+			int i1 = i0 + rowsPerJob;
+			lightRows(i0 > minRow ? i0 : minRow, i1 < maxRow + 1 ? i1 : maxRow + 1);
+		});
+	}
+	else
+	{
+		lightRows(minRow, maxRow + 1);
+	}
+
+	_tex->UnlockRect(0);
+
+	return true;
+}
+
+float Terrain::computeShade(int cellRow, int cellCol, D3DXVECTOR3* directionToLight)
+{
+	// get heights of three vertices on the quad, snow included
+	float corners[4];
+	_heights.getCell(cellRow, cellCol, corners);
+
+	float heightA = corners[0];
+	float heightB = corners[1];
+	float heightC = corners[2];
+
+	// build two vectors on the quad
+	D3DXVECTOR3 u(_cellSpacing, heightB - heightA, 0.0f);
+	D3DXVECTOR3 v(0.0f,         heightC - heightA, -_cellSpacing);
+
+	// find the normal by taking the cross product of two
+	// vectors on the quad.
+	D3DXVECTOR3 n;
+	D3DXVec3Cross(&n, &u, &v);
+	D3DXVec3Normalize(&n, &n);
+
+	float cosine = D3DXVec3Dot(&n, directionToLight);
+
+	if(cosine < 0.0f)
+		cosine = 0.0f;
+
+	//cosine = (cosine + 1.0f) / 2.0f;
+
+	return cosine;
+}
+
+bool Terrain::loadHeightmap(std::string fileName)
+{
+	// The terrain is the upper left corner of the heightmap, which must be at
+	// least as large, 8 or 16 bit.
+	HeightmapFile file;
+	file.open(fileName.c_str());
+
+	return file.readField(_numVertsPerCol, _numVertsPerRow, _heightScale, &_heights);
+}
+
+float Terrain::getHeight(float x, float z)
+{
+	// Translate on xz-plane by the transformation that takes
+	// the terrain START point to the origin.
+	x = ((float)_width / 2.0f) + x;
+	z = ((float)_depth / 2.0f) - z;
+
+	// Scale down by the transformation that makes the 
+	// cellspacing equal to one.  This is given by 
+	// 1 / cellspacing since; cellspacing * 1 / cellspacing = 1.
+	x /= (float)_cellSpacing;
+	z /= (float)_cellSpacing;
+
+	// From now on, we will interpret our positive z-axis as
+	// going in the 'down' direction, rather than the 'up' direction.
+	// This allows to extract the row and column simply by 'flooring'
+	// x and z:
+
+	float col = ::floorf(x);
+	float row = ::floorf(z);
+
+	// get the heights of the quad we're in:
+	// 
+    //  A   B
+    //  *---*
+    //  | / |
+    //  *---*  
+    //  C   D
+
+	float A, B, C, D;
+	if( row >= 0.0f && col >= 0.0f && row < (float)_numCellsPerCol && col < (float)_numCellsPerRow )
+	{
+		float corners[4];
+		_heights.getCell((int)row, (int)col, corners);
+
+		A = corners[0];
+		B = corners[1];
+		C = corners[2];
+		D = corners[3];
+	}
+	else
+	{
+		A = getSurfaceEntry(row,   col);
+		B = getSurfaceEntry(row,   col+1);
+		C = getSurfaceEntry(row+1, col);
+		D = getSurfaceEntry(row+1, col+1);
+	}
+
+	//
+	// Find the triangle we are in:
+	//
+
+	// Translate by the transformation that takes the upper-left
+	// corner of the cell we are in to the origin.  Recall that our 
+	// cellspacing was nomalized to 1.  Thus we have a unit square
+	// at the origin of our +x -> 'right' and +z -> 'down' system.
+	float dx = x - col;
+	float dz = z - row;
+
+	// Note the below compuations of u and v are unneccessary, we really
+	// only need the height, but we compute the entire vector to emphasis
+	// the books discussion.
+	float height = 0.0f;
+	if(dz < 1.0f - dx)  // upper triangle ABC
+	{
+		float uy = B - A; // A->B
+		float vy = C - A; // A->C
+
+		// Linearly interpolate on each vector.  The height is the vertex
+		// height the vectors u and v originate from {A}, plus the heights
+		// found by interpolating on each vector u and v.
+		height = A + d3d::Lerp(0.0f, uy, dx) + d3d::Lerp(0.0f, vy, dz);
+	}
+	else // lower triangle DCB
+	{
+		float uy = C - D; // D->C
+		float vy = B - D; // D->B
+
+		// Linearly interpolate on each vector.  The height is the vertex
+		// height the vectors u and v originate from {D}, plus the heights
+		// found by interpolating on each vector u and v.
+		height = D + d3d::Lerp(0.0f, uy, 1.0f - dx) + d3d::Lerp(0.0f, vy, 1.0f - dz);
+	}
+
+	return height;
+}
+
+void Terrain::getHeights(const float* x, const float* z, int count, float* heights,
+	float* nx, float* ny, float* nz)
+{
+	_heights.sample(x, z, count, heights, nx, ny, nz);
+}
+
+void Terrain::depositSnow(const float* x, const float* z, int count, float depth)
+{
+	const float startX     = (float)_width / 2.0f;
+	const float startZ     = (float)_depth / 2.0f;
+	const float invSpacing = 1.0f / (float)_cellSpacing;
+
+	for(int k = 0; k < count; k++)
+	{
+		float px = (startX + x[k]) * invSpacing;
+		float pz = (startZ - z[k]) * invSpacing;
+
+		int col = (int)::floorf(px);
+		int row = (int)::floorf(pz);
+
+		if( col < 0 || row < 0 || col >= _numCellsPerRow || row >= _numCellsPerCol )
+			continue;
+
+		// bilinear weights of the cell's corners
+		float dx = px - (float)col;
+		float dz = pz - (float)row;
+
+		addSnow(row,     col,     depth * (1.0f - dx) * (1.0f - dz));
+		addSnow(row,     col + 1, depth * dx          * (1.0f - dz));
+		addSnow(row + 1, col,     depth * (1.0f - dx) * dz);
+		addSnow(row + 1, col + 1, depth * dx          * dz);
+	}
+}
+
+void Terrain::addSnow(int row, int col, float depth)
+{
+	_heights.addLayer(row, col, depth);
+	_edit.touch(row, col, row, col);
+	_pyramidStale = true;
+}
+
+void Terrain::brush(TerrainEdit::Target target, TerrainEdit::Brush brush, float x, float z,
+	float radius, float amount, float height)
+{
+	// to cells from the upper left corner
+	float invSpacing = 1.0f / (float)_cellSpacing;
+	float col        = ((float)_width / 2.0f + x) * invSpacing;
+	float row        = ((float)_depth / 2.0f - z) * invSpacing;
+
+	_edit.brush(target, brush, row, col, radius * invSpacing, amount, height);
+	_pyramidStale = true;
+}
+
+void Terrain::stamp(TerrainEdit::Target target, TerrainEdit::Stamp stamp, float x, float z,
+	int numRows, int numCols, const float* values)
+{
+	float invSpacing = 1.0f / (float)_cellSpacing;
+	int   col        = (int)::floorf(((float)_width / 2.0f + x) * invSpacing + 0.5f);
+	int   row        = (int)::floorf(((float)_depth / 2.0f - z) * invSpacing + 0.5f);
+
+	_edit.stamp(target, stamp, row - numRows / 2, col - numCols / 2, numRows, numCols, values, numCols);
+	_pyramidStale = true;
+}
+
+void Terrain::refitPyramid()
+{
+	if( !_pyramidStale )
+		return;
+
+	// the rectangles hold every edit since the last draw, those already
+	// refitted for an earlier cast too
+	const std::vector<TerrainEdit::Rect>& dirty = _edit.getDirty();
+	for(int k = 0; k < (int)dirty.size(); k++)
+		_pyramid.refit(dirty[k]._minRow, dirty[k]._minCol, dirty[k]._maxRow, dirty[k]._maxCol);
+
+	_pyramidStale = false;
+}
+
+bool Terrain::intersect(const D3DXVECTOR3* origin, const D3DXVECTOR3* dir, float maxT, float* t)
+{
+	refitPyramid();
+
+	HeightPyramid::Ray ray;
+	ray._origin[0] = origin->x;
+	ray._origin[1] = origin->y;
+	ray._origin[2] = origin->z;
+	ray._dir[0]    = dir->x;
+	ray._dir[1]    = dir->y;
+	ray._dir[2]    = dir->z;
+	ray._maxT      = maxT;
+
+	return _pyramid.intersect(ray, t);
+}
+
+int Terrain::intersect(const HeightPyramid::Ray* rays, int count, float* t)
+{
+	refitPyramid();
+
+	return _pyramid.intersect(rays, count, t, _pool);
+}
+
+void Terrain::updateEdits()
+{
+	// before the rectangles are forgotten
+	refitPyramid();
+
+	const std::vector<TerrainEdit::Rect>& dirty = _edit.getDirty();
+
+	// the texture is relit whole in draw if the light moved too
+	bool relight = _tex && !_groundTexels.empty();
+
+	for(int k = 0; k < (int)dirty.size(); k++)
+	{
+		const TerrainEdit::Rect& rect = dirty[k];
+
+		updateVertices(rect);
+
+		// the cells touching the vertices, their normals and texels
+		if( relight )
+		{
+			int r0 = rect._minRow > 0 ? rect._minRow - 1 : 0;
+			int c0 = rect._minCol > 0 ? rect._minCol - 1 : 0;
+			int r1 = rect._maxRow < _numCellsPerCol ? rect._maxRow : _numCellsPerCol - 1;
+			int c1 = rect._maxCol < _numCellsPerRow ? rect._maxCol : _numCellsPerRow - 1;
+
+			_heights.updateNormals(r0, c0, r1, c1, _pool);
+			if( !_lightChanged && relightCells(r0, c0, r1, c1) )
+				filterTexture(r0, c0, r1, c1);
+		}
+
+		// the chunks' boxes and errors follow the heights
+		_tree.refit(_heights, rect._minRow, rect._minCol, rect._maxRow, rect._maxCol);
+		_lod.refit(_heights, rect._minRow, rect._minCol, rect._maxRow, rect._maxCol);
+	}
+
+	_edit.clearDirty();
+}
+
+// the average of four X8R8G8B8 texels, a channel at a time, rounded
+static DWORD averageTexels(DWORD a, DWORD b, DWORD c, DWORD d)
+{
+	DWORD rb = ((a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002) >> 2;
+	DWORD xg = (((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) +
+	            ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002) >> 2;
+	return (rb & 0x00ff00ff) | ((xg & 0x00ff00ff) << 8);
+}
+
+bool Terrain::filterTexture(int minRow, int minCol, int maxRow, int maxCol)
+{
+	// Every level below the top from the one above it, only over the texels
+	// the top's [minRow, maxRow] x [minCol, maxCol] fall on: a texel is the box
+	// filtered 2 x 2 above it, the last row and column repeated on levels
+	// of odd size.
+	int numLevels = (int)_tex->GetLevelCount();
+
+	for(int level = 1; level < numLevels; level++)
+	{
+		D3DSURFACE_DESC srcDesc, dstDesc;
+		_tex->GetLevelDesc(level - 1, &srcDesc);
+		_tex->GetLevelDesc(level,     &dstDesc);
+
+		minRow >>= 1;
+		minCol >>= 1;
+		maxRow = (maxRow >> 1) < (int)dstDesc.Height - 1 ? maxRow >> 1 : (int)dstDesc.Height - 1;
+		maxCol = (maxCol >> 1) < (int)dstDesc.Width  - 1 ? maxCol >> 1 : (int)dstDesc.Width  - 1;
+
+		// the last row or column of a level of odd size falls on no texel below
+		if( minRow > maxRow || minCol > maxCol )
+			break;
+
+		int srcRows = (int)srcDesc.Height;
+		int srcCols = (int)srcDesc.Width;
+
+		RECT srcRect = { 2 * minCol, 2 * minRow,
+			2 * maxCol + 2 < srcCols ? 2 * maxCol + 2 : srcCols,
+			2 * maxRow + 2 < srcRows ? 2 * maxRow + 2 : srcRows };
+		RECT dstRect = { minCol, minRow, maxCol + 1, maxRow + 1 };
+
+		D3DLOCKED_RECT src, dst;
+		if( FAILED(_tex->LockRect(level - 1, &src, &srcRect, D3DLOCK_READONLY)) )
+			return false;
+		if( FAILED(_tex->LockRect(level, &dst, &dstRect, 0)) )
+		{
+			_tex->UnlockRect(level - 1);
+			return false;
+		}
+
+		for(int i = minRow; i <= maxRow; i++)
+		{
+			// rows of the level above, relative to the locked rectangle
+			int i0 = 2 * i - srcRect.top;
+			int i1 = 2 * i + 1 < srcRows ? i0 + 1 : i0;
+
+			const DWORD* above = (const DWORD*)((const BYTE*)src.pBits + i0 * src.Pitch);
+			const DWORD* below = (const DWORD*)((const BYTE*)src.pBits + i1 * src.Pitch);
+			DWORD*       out   = (DWORD*)((BYTE*)dst.pBits + (i - minRow) * dst.Pitch);
+
+			for(int j = minCol; j <= maxCol; j++)
+			{
+				int j0 = 2 * j - srcRect.left;
+				int j1 = 2 * j + 1 < srcCols ? j0 + 1 : j0;
+
+				out[j - minCol] = averageTexels(above[j0], above[j1], below[j0], below[j1]);
+			}
+		}
+
+		_tex->UnlockRect(level);
+		_tex->UnlockRect(level - 1);
+	}
+
+	return true;
+}
+
+bool Terrain::draw(D3DXMATRIX* world, bool drawTris)
+{
+	HRESULT hr = 0;
+
+	if( _device )
+	{
+		// upload the edits and the snow that fell since the last draw
+		updateEdits();
+
+		// and light the texture from where the light is now
+		if( _lightChanged && _tex && !_groundTexels.empty() )
+		{
+			if( relightCells(0, 0, _numCellsPerCol - 1, _numCellsPerRow - 1) )
+				filterTexture(0, 0, _numCellsPerCol - 1, _numCellsPerRow - 1);
+			_lightChanged = false;
+		}
+
+		_device->SetTransform(D3DTS_WORLD, world);
+
+		// find the chunks in view, in terrain space
+		D3DXMATRIX V, P;
+		_device->GetTransform(D3DTS_VIEW,       &V);
+		_device->GetTransform(D3DTS_PROJECTION, &P);
+
+		D3DXMATRIX WVP = *world * V * P;
+
+		Frustum frustum;
+		frustum.extract((const float*)&WVP);
+		_tree.cull(frustum, &_visible);
+
+		bool lod = _lodEnabled;
+		if( lod )
+		{
+			// the viewer in terrain space, and the pixels a unit spans a unit away
+			D3DXMATRIX WV = *world * V;
+			D3DXMATRIX invWV;
+			D3DXMatrixInverse(&invWV, 0, &WV);
+			float eye[3] = { invWV._41, invWV._42, invWV._43 };
+
+			D3DVIEWPORT9 viewport;
+			_device->GetViewport(&viewport);
+			float screenScale = 0.5f * (float)viewport.Height * P._22;
+
+			_lod.select(_visible, eye, screenScale, _lodPixelError);
+
+			// without room for the indices, draw every chunk in full
+			lod = fillLodIndices();
+		}
+
+		_device->SetStreamSource(0, _vb, 0, sizeof(TerrainVertex));
+		_device->SetFVF(TerrainVertex::FVF);
+		_device->SetIndices(lod ? _lodIb : _ib);
+		
+		_device->SetTexture(0, _tex);
+
+		// turn off lighting since we're lighting it ourselves
+		_device->SetRenderState(D3DRS_LIGHTING, false);
+
+		hr = drawChunks(lod);
+
+		_device->SetRenderState(D3DRS_LIGHTING, true);
+
+		if( drawTris )
+		{
+			_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
+			hr = drawChunks(lod);
+
+			_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+		}
+
+		if(FAILED(hr))
+			return false;
+	}
+
+	return true;
+}
+
+void Terrain::setLod(bool enable, float maxPixelError)
+{
+	_lodEnabled    = enable;
+	_lodPixelError = maxPixelError;
+}
+
+bool Terrain::fillLodIndices()
+{
+	int numVisible = (int)_visible.size();
+	int numIndices = 0;
+
+	for(int i = 0; i < numVisible; i++)
+		numIndices += _lod.getMaxIndices(_visible[i]);
+
+	bool perChunk = _indexFormat == INDICES_16_PER_CHUNK;
+	bool wide     = _indexFormat == INDICES_32;
+	int  size     = wide ? sizeof(unsigned int) : sizeof(WORD);
+
+	// grown by half again when too small, so that it is seldom made again
+	if( numIndices > _lodIbSize )
+	{
+		d3d::Release<IDirect3DIndexBuffer9*>(_lodIb);
+		_lodIbSize = 0;
+
+		int capacity = numIndices + numIndices / 2;
+
+		HRESULT hr = _device->CreateIndexBuffer(
+			capacity * size,
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+			wide ? D3DFMT_INDEX32 : D3DFMT_INDEX16,
+			D3DPOOL_DEFAULT, // D3DPOOL_MANAGED can't be used with D3DUSAGE_DYNAMIC
+			&_lodIb,
+			0);
+
+		if( FAILED(hr) )
+		{
+			_lodIb = 0;
+			return false;
+		}
+		_lodIbSize = capacity;
+	}
+
+	_lodStart.resize(numVisible + 1);
+	_lodStart[0] = 0;
+
+	if( numIndices == 0 )
+		return true;
+
+	void* indices = 0;
+	if( FAILED(_lodIb->Lock(0, numIndices * size, &indices, D3DLOCK_DISCARD)) )
+		return false;
+
+	for(int i = 0; i < numVisible; i++)
+	{
+		int k     = _visible[i];
+		int start = _lodStart[i];
+
+		if( wide )
+			_lodStart[i + 1] = start + _lod.writeIndices(k, perChunk, (unsigned int*)indices + start);
+		else
+			_lodStart[i + 1] = start + _lod.writeIndices(k, perChunk, (WORD*)indices + start);
+	}
+
+	_lodIb->Unlock();
+
+	return true;
+}
+
+HRESULT Terrain::drawChunks(bool lod)
+{
+	HRESULT hr = D3D_OK;
+	int numVisible = (int)_visible.size();
+
+	_numTrianglesDrawn = 0;
+
+	if( lod && _indexFormat != INDICES_16_PER_CHUNK )
+	{
+		// the indices are into the grid, in as few calls as the device takes
+		int numTriangles = _lodStart[numVisible] / 3;
+
+		for(int first = 0; first < numTriangles; first += _maxPrimitives)
+		{
+			int count = numTriangles - first < _maxPrimitives ? numTriangles - first : _maxPrimitives;
+
+			HRESULT drawn = _device->DrawIndexedPrimitive(
+				D3DPT_TRIANGLELIST,
+				0,
+				0,
+				_numVertices,
+				first * 3,
+				count);
+
+			if( FAILED(drawn) )
+				hr = drawn;
+		}
+
+		_numTrianglesDrawn = numTriangles;
+		return hr;
+	}
+
+	if( _indexFormat == INDICES_16_PER_CHUNK )
+	{
+		// a call per chunk, its indices offset to its vertices
+		for(int i = 0; i < numVisible; i++)
+		{
+			int k = _visible[i];
+			const TerrainTree::Chunk& chunk = _tree.getChunk(k);
+
+			int start = lod ? _lodStart[i] : _chunkStart[k] * 3;
+			int count = lod ? (_lodStart[i + 1] - _lodStart[i]) / 3 : chunk._numRows * chunk._numCols * 2;
+			if( count == 0 )
+				continue;
+
+			HRESULT drawn = _device->DrawIndexedPrimitive(
+				D3DPT_TRIANGLELIST,
+				_chunkVertex[k],
+				0,
+				_tree.getNumChunkVertices(k),
+				start,
+				count);
+
+			if( FAILED(drawn) )
+				hr = drawn;
+
+			_numTrianglesDrawn += count;
+		}
+		return hr;
+	}
+
+	// chunks next to each other in the index buffer are drawn with one call,
+	// as many as the device takes; a subtree wholly in view is always such a run
+	for(int i = 0; i < numVisible; )
+	{
+		int first = _visible[i];
+		int end   = first + 1;
+		for(i++; i < numVisible && _visible[i] == end && _chunkStart[end + 1] - _chunkStart[first] <= _maxPrimitives; i++)
+			end++;
+
+		// the vertices the run's triangles use
+		int minVertex = INT_MAX;
+		int maxVertex = 0;
+		for(int k = first; k < end; k++)
+		{
+			const TerrainTree::Chunk& chunk = _tree.getChunk(k);
+
+			int lo = chunk._row * _numVertsPerRow + chunk._col;
+			int hi = (chunk._row + chunk._numRows) * _numVertsPerRow + chunk._col + chunk._numCols;
+			if( lo < minVertex ) minVertex = lo;
+			if( hi > maxVertex ) maxVertex = hi;
+		}
+
+		HRESULT drawn = _device->DrawIndexedPrimitive(
+			D3DPT_TRIANGLELIST,
+			0,
+			minVertex,
+			maxVertex - minVertex + 1,
+			_chunkStart[first] * 3,
+			_chunkStart[end] - _chunkStart[first]);
+
+		if( FAILED(drawn) )
+			hr = drawn;
+
+		_numTrianglesDrawn += _chunkStart[end] - _chunkStart[first];
+	}
+
+	return hr;
+}
@@ -1,86 +1,220 @@
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// 
-// File: terrain.h
-// 
-// Author: Frank Luna (C) All Rights Reserved
-//
-// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
-//
-// Desc: Represents a 3D terrain. 
-//
-// * Modified by William Cheung, Bugs Fixed
-//
-//////////////////////////////////////////////////////////////////////////////////////////////////
-
-#ifndef __terrainH__
-#define __terrainH__
-
-#include "d3dUtility.h"
-#include <string>
-#include <vector>
-
-class Terrain
-{
-public:
-	Terrain(
-		IDirect3DDevice9* device,
-		std::string heightmapFileName, 
-		int numVertsPerRow,  
-		int numVertsPerCol, 
-		int cellSpacing,    // space between cells
-		float heightScale);   
-
-	~Terrain();
-
-	int  getHeightmapEntry(int row, int col);
-	void setHeightmapEntry(int row, int col, int value);
-
-	float getHeight(float x, float z);
-
-	bool  loadTexture(std::string fileName);
-	bool  genTexture(D3DXVECTOR3* directionToLight);
-	bool  draw(D3DXMATRIX* world, bool drawTris);
-
-private:
-	IDirect3DDevice9*       _device;
-	IDirect3DTexture9*      _tex;
-	IDirect3DVertexBuffer9* _vb;
-	IDirect3DIndexBuffer9*  _ib;
-
-	int _numVertsPerRow;
-	int _numVertsPerCol;
-	int _cellSpacing;
-
-	int _numCellsPerRow;
-	int _numCellsPerCol;
-	int _width;
-	int _depth;
-	int _numVertices;
-	int _numTriangles;
-
-	float _heightScale;
-
-	std::vector<int> _heightmap;
-
-	// helper methods
-	bool  readRawFile(std::string fileName);
-	bool  computeVertices();
-	bool  computeIndices();
-	bool  lightTerrain(D3DXVECTOR3* directionToLight);
-	float computeShade(int cellRow, int cellCol, D3DXVECTOR3* directionToLight);
-
-	struct TerrainVertex
-	{
-		TerrainVertex(){}
-		TerrainVertex(float x, float y, float z, float u, float v)
-		{
-			_x = x; _y = y; _z = z; _u = u; _v = v;
-		}
-		float _x, _y, _z;
-		float _u, _v;
-
-		static const DWORD FVF;
-	};
-};
-
-#endif // __terrainH__
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: terrain.h
+// 
+// Author: Frank Luna (C) All Rights Reserved
+//
+// System: AMD Athlon 1800+ XP, 512 DDR, Geforce 3, Windows XP, MSVC++ 7.0 
+//
+// Desc: Represents a 3D terrain. 
+//
+// * Modified by William Cheung, Bugs Fixed
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __terrainH__
+#define __terrainH__
+
+#include "d3dUtility.h"
+#include "heightField.h"
+#include "heightPyramid.h"
+#include "terrainTree.h"
+#include "terrainLod.h"
+#include "terrainEdit.h"
+#include <string>
+#include <vector>
+
+class JobPool;
+
+class Terrain
+{
+public:
+	Terrain(
+		IDirect3DDevice9* device,
+		std::string heightmapFileName, 
+		int numVertsPerRow,  
+		int numVertsPerCol, 
+		int cellSpacing,    // space between cells
+		float heightScale);   
+
+	~Terrain();
+
+	// ground height of a vertex, without snow; a change shows on the next draw
+	float getHeightmapEntry(int row, int col);
+	void  setHeightmapEntry(int row, int col, float value);
+
+	float getHeight(float x, float z);
+
+	// Desc: Heights of the surface (ground plus snow) under the count points
+	//       (x[k], z[k]) of terrain space, written to heights[k].  Points off the
+	//       terrain get -FLT_MAX.  With nx, the surface normals there are written
+	//       to (nx[k], ny[k], nz[k]) too.  Meant for whole chunks of particles,
+	//       objects or rays at once; vectorized with HeightField::sample.
+	void getHeights(const float* x, const float* z, int count, float* heights,
+		float* nx = 0, float* ny = 0, float* nz = 0);
+
+	// the heights of the surface, ground plus snow, as getHeights samples them
+	const HeightField& getHeightField() const { return _heights; }
+
+	// Desc: Adds depth of snow at each of the count points (x[k], z[k]), shared
+	//       out over the four vertices around it.  The vertex buffer and texture
+	//       are brought up to date, over the touched region only, on the next draw.
+	void  depositSnow(const float* x, const float* z, int count, float depth);
+	float getSnowDepth(int row, int col);
+
+	// Desc: Edits the ground or the snow with a round brush of radius centered
+	//       at (x, z) of terrain space, as TerrainEdit::brush does in cells.
+	void  brush(TerrainEdit::Target target, TerrainEdit::Brush brush, float x, float z,
+		float radius, float amount, float height = 0.0f);
+
+	// Desc: Applies a stamp of numRows x numCols values, one per vertex, with
+	//       its middle on the vertex nearest (x, z); footprints and tracks.
+	void  stamp(TerrainEdit::Target target, TerrainEdit::Stamp stamp, float x, float z,
+		int numRows, int numCols, const float* values);
+
+	// Desc: Finds where the segment from origin to origin + maxT * dir, in
+	//       terrain space, first goes from above the surface (ground plus snow)
+	//       to on or under it, and writes how far along it that is to t, in
+	//       lengths of dir.  Returns false if it never does.  For picking,
+	//       camera collision and line of sight; see HeightPyramid.
+	bool  intersect(const D3DXVECTOR3* origin, const D3DXVECTOR3* dir, float maxT, float* t);
+
+	// Desc: The same for count segments at once, over the job pool, writing
+	//       FLT_MAX to t[k] for those that miss.  Returns how many hit.  Meant
+	//       for thousands a frame, as for sweeping particles.
+	int   intersect(const HeightPyramid::Ray* rays, int count, float* t);
+
+	bool  loadTexture(std::string fileName);
+	bool  genTexture(D3DXVECTOR3* directionToLight);
+
+	// Desc: Lights the texture genTexture made from a new direction, on the next
+	//       draw.  The normals of the cells are kept, so relighting is a dot
+	//       product a texel, cheap enough to move the sun every frame.
+	void  setLightDirection(D3DXVECTOR3* directionToLight);
+
+	// spread lighting over the threads of pool, 0 for none
+	void  setJobPool(JobPool* pool);
+
+	// Desc: Draws the chunks in view of the device's view and projection
+	//       transforms, with world as the terrain's transform.
+	bool  draw(D3DXMATRIX* world, bool drawTris);
+
+	// Desc: Turns level of detail on or off.  With it on, each chunk in view is
+	//       drawn with as few vertices as keep its error within maxPixelError
+	//       pixels on the screen.  Off by default.
+	void  setLod(bool enable, float maxPixelError = 2.0f);
+
+	// chunks and triangles drawn by the last draw
+	int   getNumChunksDrawn() const    { return (int)_visible.size(); }
+	int   getNumTrianglesDrawn() const { return _numTrianglesDrawn; }
+
+private:
+	IDirect3DDevice9*       _device;
+	IDirect3DTexture9*      _tex;
+	IDirect3DVertexBuffer9* _vb;
+	IDirect3DIndexBuffer9*  _ib;
+
+	int _numVertsPerRow;
+	int _numVertsPerCol;
+	int _cellSpacing;
+
+	int _numCellsPerRow;
+	int _numCellsPerCol;
+	int _width;
+	int _depth;
+	int _numVertices;
+	int _numTriangles;
+
+	float _heightScale;
+
+	// the ground of every vertex, and the snow on it as the field's layer
+	HeightField _heights;
+
+	//
+	// Lighting and edits
+	//
+
+	std::vector<DWORD> _groundTexels; // genTexture's texels before lighting, one per cell
+	D3DXVECTOR3        _lightDir;     // direction to light given to genTexture
+	bool               _lightChanged; // since the texture was lit
+	JobPool*           _pool;
+
+	// the vertices whose ground or snow changed since the last draw, brought
+	// up to date in the vertex buffer, the chunks' boxes and the texture
+	// region by region on the next one
+	TerrainEdit                    _edit;
+	std::vector<TerrainEdit::Span> _spans;
+
+	// bounds of the surface for casting rays, refitted over the dirty
+	// rectangles when an edit has left them stale
+	HeightPyramid                  _pyramid;
+	bool                           _pyramidStale;
+
+	//
+	// Chunks: the index buffer holds the triangles chunk by chunk in the
+	// order of _tree, chunk k's from triangle _chunkStart[k] on
+	//
+
+	TerrainTree      _tree;
+	std::vector<int> _chunkStart;
+	std::vector<int> _visible; // chunks in view, from the last draw
+
+	// Indices are 16 bit into the grid's vertices while there are at most
+	// 65536 of them.  Past that they are 32 bit, or, on devices without 32 bit
+	// indices, 16 bit into each chunk's own copy of its vertices, chunk k's
+	// from vertex _chunkVertex[k] on.  Chunks of the same size then share
+	// their indices, and _chunkStart gives where the shared ones are.
+	enum IndexFormat { INDICES_16, INDICES_32, INDICES_16_PER_CHUNK };
+
+	IndexFormat      _indexFormat;
+	std::vector<int> _chunkVertex;
+	int              _maxPrimitives; // per draw call
+
+	//
+	// Level of detail: the indices of the chunks in view at their levels are
+	// written to _lodIb every draw, chunk _visible[i]'s from index _lodStart[i]
+	// on; the vertices are the same as without
+	//
+
+	TerrainLod             _lod;
+	bool                   _lodEnabled;
+	float                  _lodPixelError;
+	IDirect3DIndexBuffer9* _lodIb;
+	int                    _lodIbSize; // indices it holds
+	std::vector<int>       _lodStart;
+	int                    _numTrianglesDrawn;
+
+	// helper methods
+	bool  loadHeightmap(std::string fileName);
+	void  chooseIndexFormat();
+	bool  computeVertices();
+	void  updateVertices(const TerrainEdit::Rect& rect);
+	float getSurfaceEntry(int row, int col);
+	void  addSnow(int row, int col, float depth);
+	void  updateEdits();
+	void  refitPyramid();
+	bool  relightCells(int minRow, int minCol, int maxRow, int maxCol);
+	bool  filterTexture(int minRow, int minCol, int maxRow, int maxCol);
+	bool  computeIndices();
+	bool  fillLodIndices();
+	HRESULT drawChunks(bool lod);
+	bool  lightTerrain(D3DXVECTOR3* directionToLight);
+	float computeShade(int cellRow, int cellCol, D3DXVECTOR3* directionToLight);
+
+	struct TerrainVertex
+	{
+		TerrainVertex(){}
+		TerrainVertex(float x, float y, float z, float u, float v)
+		{
+			_x = x; _y = y; _z = z; _u = u; _v = v;
+		}
+		float _x, _y, _z;
+		float _u, _v;
+
+		static const DWORD FVF;
+	};
+
+	TerrainVertex makeVertex(int row, int col);
+};
+
+#endif // __terrainH__
@@ -0,0 +1,308 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainEdit.cpp
+//
+// Author: William Cheung
+//
+// Desc: Edits of terrain heights, and the regions they leave to update.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "terrainEdit.h"
+#include <cmath>
+
+TerrainEdit::TerrainEdit()
+{
+	_heights = 0;
+}
+
+void TerrainEdit::setField(HeightField* heights)
+{
+	_heights = heights;
+	_dirty.clear();
+}
+
+float TerrainEdit::get(Target target, int row, int col) const
+{
+	return target == TARGET_LAYER ? _heights->getLayer(row, col) : _heights->getGround(row, col);
+}
+
+void TerrainEdit::set(Target target, int row, int col, float height)
+{
+	if( target == TARGET_LAYER )
+		_heights->setLayer(row, col, height > 0.0f ? height : 0.0f);
+	else
+		_heights->setGround(row, col, height);
+}
+
+void TerrainEdit::setHeight(Target target, int row, int col, float height)
+{
+	if( !_heights || !_heights->isInside(row, col) )
+		return;
+
+	set(target, row, col, height);
+	touch(row, col, row, col);
+}
+
+void TerrainEdit::brush(Target target, Brush brush, float row, float col, float radius, float amount, float height)
+{
+	if( !_heights || !(radius > 0.0f) )
+		return;
+
+	int numRows = _heights->getNumRows();
+	int numCols = _heights->getNumCols();
+
+	// the vertices within radius, on the grid
+	int r0 = (int)::ceilf(row - radius);
+	int c0 = (int)::ceilf(col - radius);
+	int r1 = (int)::floorf(row + radius);
+	int c1 = (int)::floorf(col + radius);
+
+	if( r0 < 0 ) r0 = 0;
+	if( c0 < 0 ) c0 = 0;
+	if( r1 > numRows - 1 ) r1 = numRows - 1;
+	if( c1 > numCols - 1 ) c1 = numCols - 1;
+
+	if( r0 > r1 || c0 > c1 )
+		return;
+
+	// smoothing reads the heights around each vertex as they were before the
+	// brush, a vertex further on every side
+	int sr0 = r0 > 0 ? r0 - 1 : 0;
+	int sc0 = c0 > 0 ? c0 - 1 : 0;
+	int sr1 = r1 < numRows - 1 ? r1 + 1 : r1;
+	int sc1 = c1 < numCols - 1 ? c1 + 1 : c1;
+	int pitch = sc1 - sc0 + 1;
+
+	if( brush == BRUSH_SMOOTH )
+	{
+		_scratch.resize((sr1 - sr0 + 1) * pitch);
+		for(int i = sr0; i <= sr1; i++)
+			for(int j = sc0; j <= sc1; j++)
+				_scratch[(i - sr0) * pitch + (j - sc0)] = get(target, i, j);
+	}
+
+	float invRadius2 = 1.0f / (radius * radius);
+
+	for(int i = r0; i <= r1; i++)
+	{
+		for(int j = c0; j <= c1; j++)
+		{
+			float dz = (float)i - row;
+			float dx = (float)j - col;
+			float d2 = (dx * dx + dz * dz) * invRadius2;
+			if( d2 >= 1.0f )
+				continue;
+
+			// 1 at the middle to 0 at the rim, flat at both
+			float w = (1.0f - d2) * (1.0f - d2);
+			float h = get(target, i, j);
+
+			switch( brush )
+			{
+			case BRUSH_RAISE:
+				h += amount * w;
+				break;
+
+			case BRUSH_FLATTEN:
+				h += (height - h) * amount * w;
+				break;
+
+			case BRUSH_SMOOTH:
+			{
+				const float* s = &_scratch[(i - sr0) * pitch + (j - sc0)];
+
+				float sum = 0.0f;
+				int   n   = 0;
+				if( i > sr0 ) { sum += s[-pitch]; n++; }
+				if( i < sr1 ) { sum += s[ pitch]; n++; }
+				if( j > sc0 ) { sum += s[-1];     n++; }
+				if( j < sc1 ) { sum += s[ 1];     n++; }
+
+				if( n > 0 )
+					h += (sum / (float)n - s[0]) * amount * w;
+				break;
+			}
+			}
+
+			set(target, i, j, h);
+		}
+	}
+
+	touch(r0, c0, r1, c1);
+}
+
+void TerrainEdit::stamp(Target target, Stamp stamp, int row, int col, int numRows, int numCols, const float* values, int pitch)
+{
+	if( !_heights )
+		return;
+
+	// the part of the stamp on the grid
+	int i0 = row < 0 ? -row : 0;
+	int j0 = col < 0 ? -col : 0;
+	int i1 = numRows;
+	int j1 = numCols;
+
+	if( row + i1 > _heights->getNumRows() ) i1 = _heights->getNumRows() - row;
+	if( col + j1 > _heights->getNumCols() ) j1 = _heights->getNumCols() - col;
+
+	if( i0 >= i1 || j0 >= j1 )
+		return;
+
+	for(int i = i0; i < i1; i++)
+	{
+		const float* v = values + i * pitch;
+
+		for(int j = j0; j < j1; j++)
+		{
+			float h = get(target, row + i, col + j);
+
+			switch( stamp )
+			{
+			case STAMP_ADD: h += v[j];                   break;
+			case STAMP_MIN: h  = v[j] < h ? v[j] : h;    break;
+			case STAMP_MAX: h  = v[j] > h ? v[j] : h;    break;
+			}
+
+			set(target, row + i, col + j, h);
+		}
+	}
+
+	touch(row + i0, col + j0, row + i1 - 1, col + j1 - 1);
+}
+
+static long long area(const TerrainEdit::Rect& r)
+{
+	return (long long)(r._maxRow - r._minRow + 1) * (r._maxCol - r._minCol + 1);
+}
+
+static TerrainEdit::Rect unite(const TerrainEdit::Rect& a, const TerrainEdit::Rect& b)
+{
+	TerrainEdit::Rect u;
+	u._minRow = a._minRow < b._minRow ? a._minRow : b._minRow;
+	u._minCol = a._minCol < b._minCol ? a._minCol : b._minCol;
+	u._maxRow = a._maxRow > b._maxRow ? a._maxRow : b._maxRow;
+	u._maxCol = a._maxCol > b._maxCol ? a._maxCol : b._maxCol;
+	return u;
+}
+
+// overlapping or side by side, so that they share cells
+static bool isNextTo(const TerrainEdit::Rect& a, const TerrainEdit::Rect& b)
+{
+	return a._minRow <= b._maxRow + 1 && b._minRow <= a._maxRow + 1 &&
+	       a._minCol <= b._maxCol + 1 && b._minCol <= a._maxCol + 1;
+}
+
+void TerrainEdit::touch(int minRow, int minCol, int maxRow, int maxCol)
+{
+	if( !_heights )
+		return;
+
+	Rect r;
+	r._minRow = minRow > 0 ? minRow : 0;
+	r._minCol = minCol > 0 ? minCol : 0;
+	r._maxRow = maxRow < _heights->getNumRows() - 1 ? maxRow : _heights->getNumRows() - 1;
+	r._maxCol = maxCol < _heights->getNumCols() - 1 ? maxCol : _heights->getNumCols() - 1;
+
+	if( r._minRow > r._maxRow || r._minCol > r._maxCol )
+		return;
+
+	// Take in every rectangle next to it or that costs nothing to, their
+	// union no bigger than the two apart; with too many kept, the one whose
+	// union with it is the least bigger.  The union may then be next to
+	// others, so look again.
+	for(;;)
+	{
+		int       merge    = -1;
+		int       cheapest = -1;
+		long long least    = 0;
+
+		for(int i = 0; i < (int)_dirty.size() && merge < 0; i++)
+		{
+			long long cost = area(unite(_dirty[i], r)) - area(_dirty[i]) - area(r);
+
+			if( isNextTo(_dirty[i], r) || cost <= 0 )
+				merge = i;
+			else if( cheapest < 0 || cost < least )
+			{
+				cheapest = i;
+				least    = cost;
+			}
+		}
+
+		if( merge < 0 && (int)_dirty.size() >= MAX_RECTS )
+			merge = cheapest;
+
+		if( merge < 0 )
+			break;
+
+		r = unite(_dirty[merge], r);
+		_dirty[merge] = _dirty.back();
+		_dirty.pop_back();
+	}
+
+	_dirty.push_back(r);
+}
+
+void TerrainEdit::findSpans(const Rect& rect, const TerrainTree& tree, const int* chunkVertex, std::vector<Span>* spans)
+{
+	spans->clear();
+
+	if( rect._minRow > rect._maxRow || rect._minCol > rect._maxCol )
+		return;
+
+	if( !chunkVertex )
+	{
+		// the rows of the rectangle, from its first vertex to its last
+		Span s;
+		s._row         = rect._minRow;
+		s._col         = rect._minCol;
+		s._numRows     = rect._maxRow - rect._minRow + 1;
+		s._numCols     = rect._maxCol - rect._minCol + 1;
+		s._pitch       = tree.getNumVertsPerRow();
+		s._firstVertex = s._row * s._pitch + s._col;
+		s._numVertices = (s._numRows - 1) * s._pitch + s._numCols;
+		spans->push_back(s);
+		return;
+	}
+
+	// every chunk with a cell touching the vertices has its own copy of them
+	int numCellsPerRow = tree.getNumVertsPerRow() - 1;
+	int numCellsPerCol = tree.getNumVertsPerCol() - 1;
+
+	int r0 = rect._minRow > 0 ? rect._minRow - 1 : 0;
+	int c0 = rect._minCol > 0 ? rect._minCol - 1 : 0;
+	int r1 = rect._maxRow < numCellsPerCol ? rect._maxRow : numCellsPerCol - 1;
+	int c1 = rect._maxCol < numCellsPerRow ? rect._maxCol : numCellsPerRow - 1;
+
+	for(int r = r0; r <= r1; )
+	{
+		int nextRow = r1 + 1;
+
+		for(int c = c0; c <= c1; )
+		{
+			int k = tree.getChunkAt(r, c);
+			const TerrainTree::Chunk& chunk = tree.getChunk(k);
+
+			int i0 = rect._minRow > chunk._row ? rect._minRow : chunk._row;
+			int i1 = rect._maxRow < chunk._row + chunk._numRows ? rect._maxRow : chunk._row + chunk._numRows;
+			int j0 = rect._minCol > chunk._col ? rect._minCol : chunk._col;
+			int j1 = rect._maxCol < chunk._col + chunk._numCols ? rect._maxCol : chunk._col + chunk._numCols;
+
+			Span s;
+			s._row         = i0;
+			s._col         = j0;
+			s._numRows     = i1 - i0 + 1;
+			s._numCols     = j1 - j0 + 1;
+			s._pitch       = chunk._numCols + 1;
+			s._firstVertex = chunkVertex[k] + (i0 - chunk._row) * s._pitch + (j0 - chunk._col);
+			s._numVertices = (s._numRows - 1) * s._pitch + s._numCols;
+			spans->push_back(s);
+
+			c       = chunk._col + chunk._numCols;
+			nextRow = chunk._row + chunk._numRows;
+		}
+
+		r = nextRow;
+	}
+}
@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainEdit.h
+//
+// Author: William Cheung
+//
+// Desc: Edits of a HeightField while the terrain is drawn: single vertices,
+//       round brushes that raise, flatten or smooth, and stamps of heights such
+//       as footprints and tracks, on the ground or on the layer of snow.  Each
+//       edit records the rectangle of vertices it changed; the rectangles are
+//       merged as they come in, so that the buffers made from the heights are
+//       brought up to date over a few small regions on the next frame, not
+//       rebuilt.  findSpans tells which runs of a vertex buffer laid out as
+//       Terrain lays its out hold a region.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __terrainEditH__
+#define __terrainEditH__
+
+#include "heightField.h"
+#include "terrainTree.h"
+#include <vector>
+
+class TerrainEdit
+{
+public:
+	// dirty rectangles kept apart before the closest two are merged
+	static const int MAX_RECTS = 16;
+
+	// vertices [_minRow, _maxRow] x [_minCol, _maxCol]
+	struct Rect
+	{
+		int _minRow, _minCol;
+		int _maxRow, _maxCol;
+	};
+
+	// A run of a vertex buffer, _numVertices from _firstVertex on, holding
+	// vertices [_row, _row + _numRows) x [_col, _col + _numCols) of the grid:
+	// vertex (row, col) at _firstVertex + (row - _row) * _pitch + (col - _col).
+	// The vertices in between that are not in the rectangle are left alone.
+	struct Span
+	{
+		int _firstVertex, _numVertices;
+		int _row, _col;
+		int _numRows, _numCols;
+		int _pitch;
+	};
+
+	enum Target
+	{
+		TARGET_GROUND, // the ground, kept to 65536 steps over the field's range
+		TARGET_LAYER   // the snow on it, never below 0
+	};
+
+	enum Brush
+	{
+		BRUSH_RAISE,   // adds amount, or takes it away if negative
+		BRUSH_FLATTEN, // moves amount of the way to height
+		BRUSH_SMOOTH   // moves amount of the way to the average of the 4 neighbors
+	};
+
+	enum Stamp
+	{
+		STAMP_ADD,     // adds the stamp's values
+		STAMP_MIN,     // lowers to them, as a foot pressing into snow
+		STAMP_MAX      // raises to them
+	};
+
+	TerrainEdit();
+
+	// Desc: Edits heights from now on, which must outlive the TerrainEdit, and
+	//       forgets the dirty rectangles.
+	void setField(HeightField* heights);
+
+	// Desc: Sets the ground or the snow of vertex (row, col), if in the grid.
+	void setHeight(Target target, int row, int col, float height);
+
+	// Desc: Applies brush to the vertices within radius of (row, col), in cells,
+	//       with a smooth falloff from its full amount at the middle to none at
+	//       the rim.  height is where BRUSH_FLATTEN flattens to; the others take
+	//       amount of the way as a fraction from 0 to 1.
+	void brush(Target target, Brush brush, float row, float col, float radius, float amount, float height = 0.0f);
+
+	// Desc: Applies the numRows x numCols values of a stamp, pitch floats a row,
+	//       to the vertices from (row, col) on; those off the grid are skipped.
+	void stamp(Target target, Stamp stamp, int row, int col, int numRows, int numCols, const float* values, int pitch);
+
+	// Desc: Marks vertices [minRow, maxRow] x [minCol, maxCol] as changed, for
+	//       heights changed some other way.
+	void touch(int minRow, int minCol, int maxRow, int maxCol);
+
+	// changed since the last clearDirty, no two of them overlapping or side by side
+	const std::vector<Rect>& getDirty() const { return _dirty; }
+	bool isDirty() const                      { return !_dirty.empty(); }
+	void clearDirty()                         { _dirty.clear(); }
+
+	// Desc: Writes to spans the runs of a vertex buffer to rewrite for the
+	//       vertices of rect.  Without chunkVertex, the buffer holds tree's grid
+	//       row by row; with it, each chunk of tree has its own copy of its
+	//       vertices, row by row from chunkVertex[chunk] on, and the vertices
+	//       on the chunks' shared edges are in more than one span.
+	static void findSpans(const Rect& rect, const TerrainTree& tree, const int* chunkVertex, std::vector<Span>* spans);
+
+private:
+	float get(Target target, int row, int col) const;
+	void  set(Target target, int row, int col, float height);
+
+	HeightField*       _heights;
+	std::vector<Rect>  _dirty;
+	std::vector<float> _scratch; // heights under a smoothing brush before it
+};
+
+#endif // __terrainEditH__
@@ -0,0 +1,278 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainLod.cpp
+//
+// Author: William Cheung
+//
+// Desc: Level of detail for terrain chunks.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "terrainLod.h"
+#include <cmath>
+#include <cstring>
+
+TerrainLod::TerrainLod()
+{
+	_tree = 0;
+}
+
+void TerrainLod::build(const TerrainTree* tree, const HeightField& heights)
+{
+	_tree = tree;
+
+	int numChunks = _tree->getNumChunks();
+
+	_errors.assign(numChunks * MAX_LEVELS, 0.0f);
+	_maxLevel.assign(numChunks, 0);
+	_level.assign(numChunks, -1);
+	_neighbors.assign(numChunks * NUM_SIDES, -1);
+
+	for(int k = 0; k < numChunks; k++)
+	{
+		const TerrainTree::Chunk& chunk = _tree->getChunk(k);
+
+		// the levels whose step divides the chunk; the chunks cut short on the
+		// far edges of the grid may have none past 0
+		int level = 0;
+		while( level + 1 < MAX_LEVELS &&
+			chunk._numRows % (2 << level) == 0 && chunk._numCols % (2 << level) == 0 )
+			level++;
+		_maxLevel[k] = (unsigned char)level;
+
+		int* n = &_neighbors[k * NUM_SIDES];
+		n[ABOVE] = _tree->getChunkAt(chunk._row - 1,              chunk._col);
+		n[BELOW] = _tree->getChunkAt(chunk._row + chunk._numRows, chunk._col);
+		n[LEFT]  = _tree->getChunkAt(chunk._row,                  chunk._col - 1);
+		n[RIGHT] = _tree->getChunkAt(chunk._row,                  chunk._col + chunk._numCols);
+
+		fitChunk(k, heights);
+	}
+}
+
+void TerrainLod::fitChunk(int chunk, const HeightField& heights)
+{
+	const TerrainTree::Chunk& c = _tree->getChunk(chunk);
+
+	float* errors = &_errors[chunk * MAX_LEVELS];
+
+	errors[0] = 0.0f;
+
+	for(int level = 1; level <= _maxLevel[chunk]; level++)
+	{
+		int   step    = 1 << level;
+		float invStep = 1.0f / (float)step;
+		float worst   = errors[level - 1];
+
+		// every vertex against the two triangles of the level's cell it is in,
+		// split as Terrain splits its quads
+		for(int i = 0; i <= c._numRows; i++)
+		{
+			int   ci = i < c._numRows ? i / step * step : c._numRows - step;
+			float dz = (float)(i - ci) * invStep;
+
+			for(int j = 0; j <= c._numCols; j++)
+			{
+				int   cj = j < c._numCols ? j / step * step : c._numCols - step;
+				float dx = (float)(j - cj) * invStep;
+
+				int   row = c._row + ci;
+				int   col = c._col + cj;
+				float A   = heights.getHeight(row,        col);
+				float B   = heights.getHeight(row,        col + step);
+				float C   = heights.getHeight(row + step, col);
+				float D   = heights.getHeight(row + step, col + step);
+
+				float surface;
+				if( dz < 1.0f - dx )  // upper triangle ABC
+					surface = A + (B - A) * dx + (C - A) * dz;
+				else                  // lower triangle DCB
+					surface = D + (C - D) * (1.0f - dx) + (B - D) * (1.0f - dz);
+
+				float error = ::fabsf(heights.getHeight(c._row + i, c._col + j) - surface);
+				if( error > worst )
+					worst = error;
+			}
+		}
+
+		errors[level] = worst;
+	}
+}
+
+void TerrainLod::refit(const HeightField& heights, int minRow, int minCol, int maxRow, int maxCol)
+{
+	if( !_tree || minRow > maxRow || minCol > maxCol )
+		return;
+
+	// the chunks of the cells on either side of the vertices
+	int r0 = minRow > 0 ? minRow - 1 : 0;
+	int c0 = minCol > 0 ? minCol - 1 : 0;
+
+	for(int r = r0; r <= maxRow; )
+	{
+		int k = _tree->getChunkAt(r, c0);
+		if( k < 0 )
+			break;
+
+		for(int c = c0; c <= maxCol; )
+		{
+			int n = _tree->getChunkAt(r, c);
+			if( n < 0 )
+				break;
+
+			fitChunk(n, heights);
+			c = _tree->getChunk(n)._col + _tree->getChunk(n)._numCols;
+		}
+
+		r = _tree->getChunk(k)._row + _tree->getChunk(k)._numRows;
+	}
+}
+
+void TerrainLod::select(const std::vector<int>& visible, const float eye[3], float screenScale, float maxPixelError)
+{
+	_level.assign(_level.size(), -1);
+	_stats = Stats();
+
+	for(int i = 0; i < (int)visible.size(); i++)
+	{
+		int k = visible[i];
+		const TerrainTree::Chunk& chunk = _tree->getChunk(k);
+
+		// distance from the eye to the nearest point of the chunk's box
+		float distance2 = 0.0f;
+		for(int a = 0; a < 3; a++)
+		{
+			float d = 0.0f;
+			if( eye[a] < chunk._min[a] ) d = chunk._min[a] - eye[a];
+			if( eye[a] > chunk._max[a] ) d = eye[a] - chunk._max[a];
+			distance2 += d * d;
+		}
+		float allowed = maxPixelError * ::sqrtf(distance2) / screenScale;
+
+		// the errors grow with the level
+		const float* errors = &_errors[k * MAX_LEVELS];
+		int level = 0;
+		while( level < _maxLevel[k] && errors[level + 1] <= allowed )
+			level++;
+
+		_level[k] = (signed char)level;
+
+		_stats._numChunks++;
+		_stats._numAtLevel[level]++;
+		_stats._numTriangles += (chunk._numRows >> level) * (chunk._numCols >> level) * 2;
+	}
+}
+
+int TerrainLod::getMaxIndices(int chunk) const
+{
+	const TerrainTree::Chunk& c = _tree->getChunk(chunk);
+	int level = _level[chunk] > 0 ? _level[chunk] : 0;
+	return (c._numRows >> level) * (c._numCols >> level) * 6;
+}
+
+int TerrainLod::sideStep(int chunk, Side side) const
+{
+	// the coarser of the chunk's step and its neighbor's, if that is in view;
+	// a neighbor out of view is not drawn, and neither is the edge it shares
+	int level    = _level[chunk];
+	int neighbor = _neighbors[chunk * NUM_SIDES + side];
+
+	if( neighbor >= 0 && _level[neighbor] > level )
+		level = _level[neighbor];
+
+	return 1 << level;
+}
+
+// twice the area of a triangle of a quad's corners, positive when its
+// winding is the grid's
+static int twiceArea(const int* r, const int* c, const int* t)
+{
+	return (c[t[1]] - c[t[0]]) * (r[t[2]] - r[t[0]]) - (r[t[1]] - r[t[0]]) * (c[t[2]] - c[t[0]]);
+}
+
+// a triangle that is either drawn facing the right way or, with two of its
+// corners on the same vertex, not drawn at all
+static bool isWhole(const int* r, const int* c, const int* v, const int* t)
+{
+	int area = twiceArea(r, c, t);
+	if( area > 0 )
+		return true;
+
+	bool collapsed = v[t[0]] == v[t[1]] || v[t[1]] == v[t[2]] || v[t[0]] == v[t[2]];
+	return area == 0 && collapsed;
+}
+
+template<class Index>
+int TerrainLod::writeChunkIndices(int chunk, bool local, Index* out) const
+{
+	const TerrainTree::Chunk& c = _tree->getChunk(chunk);
+
+	int step  = 1 << (_level[chunk] > 0 ? _level[chunk] : 0);
+	int pitch = local ? c._numCols + 1 : _tree->getNumVertsPerRow();
+	int first = local ? 0 : c._row * pitch + c._col;
+
+	int above = sideStep(chunk, ABOVE);
+	int below = sideStep(chunk, BELOW);
+	int left  = sideStep(chunk, LEFT);
+	int right = sideStep(chunk, RIGHT);
+
+	Index* start = out;
+
+	for(int i = 0; i < c._numRows; i += step)
+	{
+		for(int j = 0; j < c._numCols; j += step)
+		{
+			// the quad's corners, those on an edge shared with a coarser chunk
+			// moved back along it onto one of that chunk's vertices.  A coarser
+			// step divides the chunk, so corners of the chunk never move.
+			int r[4], col[4], v[4];
+			for(int n = 0; n < 4; n++)
+			{
+				r[n]   = i + (n >> 1) * step;
+				col[n] = j + (n & 1) * step;
+
+				if( r[n] == 0 )                 col[n] -= col[n] % above;
+				else if( r[n] == c._numRows )   col[n] -= col[n] % below;
+				if( col[n] == 0 )               r[n] -= r[n] % left;
+				else if( col[n] == c._numCols ) r[n] -= r[n] % right;
+
+				v[n] = first + r[n] * pitch + col[n];
+			}
+
+			// Split upper left / lower right, unless moving the corners folded or
+			// flattened a triangle, as happens next to a corner of the chunk where
+			// two coarser edges meet; then the other way, which keeps it whole.
+			int tri[2][3] = { { 0, 1, 2 }, { 2, 1, 3 } };
+			if( !isWhole(r, col, v, tri[0]) || !isWhole(r, col, v, tri[1]) )
+			{
+				int other[2][3] = { { 0, 1, 3 }, { 0, 3, 2 } };
+				if( isWhole(r, col, v, other[0]) && isWhole(r, col, v, other[1]) )
+					memcpy(tri, other, sizeof(tri));
+			}
+
+			// without the triangles flattened to a line or a point
+			for(int t = 0; t < 2; t++)
+			{
+				if( twiceArea(r, col, tri[t]) > 0 )
+				{
+					out[0] = (Index)v[tri[t][0]];
+					out[1] = (Index)v[tri[t][1]];
+					out[2] = (Index)v[tri[t][2]];
+					out += 3;
+				}
+			}
+		}
+	}
+
+	return (int)(out - start);
+}
+
+int TerrainLod::writeIndices(int chunk, bool local, unsigned short* out) const
+{
+	return writeChunkIndices(chunk, local, out);
+}
+
+int TerrainLod::writeIndices(int chunk, bool local, unsigned int* out) const
+{
+	return writeChunkIndices(chunk, local, out);
+}
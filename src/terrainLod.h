@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainLod.h
+//
+// Author: William Cheung
+//
+// Desc: Level of detail for the chunks of a TerrainTree (geomipmapping).  Level l of
+//       a chunk draws every 2^l-th vertex of it.  The error of a level, how far the
+//       chunk's vertices are above or below the surface it draws, is found once
+//       from the heights; every frame each chunk in view is given the coarsest
+//       level whose error, projected at the chunk's distance, stays within a
+//       budget of pixels.  Where a chunk meets a coarser one, its edge vertices
+//       are moved onto the coarser chunk's, so that no cracks open between them
+//       whatever the difference in levels.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __terrainLodH__
+#define __terrainLodH__
+
+#include "terrainTree.h"
+#include <vector>
+
+class TerrainLod
+{
+public:
+	// levels of a chunk of up to 2^(MAX_LEVELS - 1) cells on a side
+	static const int MAX_LEVELS = 8;
+
+	struct Stats
+	{
+		Stats()
+		{
+			_numChunks    = 0;
+			_numTriangles = 0;
+			for(int l = 0; l < MAX_LEVELS; l++)
+				_numAtLevel[l] = 0;
+		}
+
+		int _numChunks;              // chunks given a level by select
+		int _numTriangles;           // they draw, before stitching drops some
+		int _numAtLevel[MAX_LEVELS];
+	};
+
+	TerrainLod();
+
+	// Desc: Finds the errors of every level of every chunk of tree, from the
+	//       heights tree was built with.  The tree must outlive the TerrainLod.
+	void build(const TerrainTree* tree, const HeightField& heights);
+
+	// Desc: Finds them again for the chunks with a vertex in
+	//       [minRow, maxRow] x [minCol, maxCol], whose heights changed.
+	void refit(const HeightField& heights, int minRow, int minCol, int maxRow, int maxCol);
+
+	// Desc: Gives the visible chunks their levels for a viewer at eye, in the
+	//       tree's space.  screenScale is the pixels a unit spans a unit away,
+	//       viewport height / (2 tan(fovY / 2)).  The other chunks are left without.
+	void select(const std::vector<int>& visible, const float eye[3], float screenScale, float maxPixelError);
+
+	int getLevel(int chunk) const    { return _level[chunk]; }
+	int getMaxLevel(int chunk) const { return _maxLevel[chunk]; }
+
+	// worst error of a level of a chunk
+	float getError(int chunk, int level) const { return _errors[chunk * MAX_LEVELS + level]; }
+
+	// Desc: Most indices writeIndices can write for chunk at its level.
+	int getMaxIndices(int chunk) const;
+
+	// Desc: Writes the triangles of chunk at its level, its edges stitched to the
+	//       coarser chunks around it, and returns the number of indices written.
+	//       Triangles the stitching flattens are left out.  local is as for
+	//       TerrainTree::writeIndices.
+	int writeIndices(int chunk, bool local, unsigned short* out) const;
+	int writeIndices(int chunk, bool local, unsigned int* out) const;
+
+	// what the last select chose
+	const Stats& getStats() const { return _stats; }
+
+private:
+	enum Side { ABOVE, BELOW, LEFT, RIGHT, NUM_SIDES };
+
+	template<class Index>
+	int  writeChunkIndices(int chunk, bool local, Index* out) const;
+
+	void fitChunk(int chunk, const HeightField& heights);
+	int  sideStep(int chunk, Side side) const;
+
+	const TerrainTree*         _tree;
+	std::vector<float>         _errors;    // MAX_LEVELS per chunk, growing with the level
+	std::vector<unsigned char> _maxLevel;  // coarsest level whose step divides the chunk
+	std::vector<signed char>   _level;     // from select, -1 for chunks out of view
+	std::vector<int>           _neighbors; // NUM_SIDES per chunk, -1 off the grid
+	Stats                      _stats;
+};
+
+#endif // __terrainLodH__
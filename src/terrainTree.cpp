@@ -0,0 +1,302 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainTree.cpp
+//
+// Author: William Cheung
+//
+// Desc: Terrain chunks in a quadtree of bounding boxes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "terrainTree.h"
+#include <cfloat>
+
+TerrainTree::TerrainTree()
+{
+	_numVertsPerRow = 0;
+	_numVertsPerCol = 0;
+	_chunkCells     = CHUNK_CELLS;
+	_numChunkRows   = 0;
+	_numChunkCols   = 0;
+}
+
+void TerrainTree::build(
+	const HeightField& heights,
+	float cellSpacing, float originX, float originZ,
+	int chunkCells)
+{
+	_numVertsPerRow = heights.getNumCols();
+	_numVertsPerCol = heights.getNumRows();
+	_chunkCells     = chunkCells > 0 ? chunkCells : CHUNK_CELLS;
+
+	int numCellsPerRow = _numVertsPerRow - 1;
+	int numCellsPerCol = _numVertsPerCol - 1;
+
+	_numChunkCols = numCellsPerRow > 0 ? (numCellsPerRow + _chunkCells - 1) / _chunkCells : 0;
+	_numChunkRows = numCellsPerCol > 0 ? (numCellsPerCol + _chunkCells - 1) / _chunkCells : 0;
+
+	_chunks.clear();
+	_nodes.clear();
+	_chunkAt.assign(_numChunkRows * _numChunkCols, -1);
+
+	if( _numChunkRows == 0 || _numChunkCols == 0 )
+		return;
+
+	// the root covers a power of two chunks on a side; the quarters
+	// off the grid are left out
+	int size = 1;
+	while( size < _numChunkRows || size < _numChunkCols )
+		size *= 2;
+
+	_chunks.reserve(_numChunkRows * _numChunkCols);
+	_nodes.reserve(_numChunkRows * _numChunkCols * 4 / 3 + 1);
+	buildNode(0, 0, size);
+
+	for(int i = 0; i < (int)_chunks.size(); i++)
+	{
+		Chunk& chunk = _chunks[i];
+
+		chunk._min[0] = originX + chunk._col * cellSpacing;
+		chunk._max[0] = originX + (chunk._col + chunk._numCols) * cellSpacing;
+		chunk._min[2] = originZ - (chunk._row + chunk._numRows) * cellSpacing;
+		chunk._max[2] = originZ - chunk._row * cellSpacing;
+	}
+
+	refit(heights, 0, 0, _numVertsPerCol - 1, _numVertsPerRow - 1);
+}
+
+int TerrainTree::buildNode(int chunkRow, int chunkCol, int size)
+{
+	if( chunkRow >= _numChunkRows || chunkCol >= _numChunkCols )
+		return -1;
+
+	int index = (int)_nodes.size();
+	_nodes.push_back(Node());
+	_nodes[index]._first = (int)_chunks.size();
+
+	if( size == 1 )
+	{
+		Chunk chunk;
+		chunk._row     = chunkRow * _chunkCells;
+		chunk._col     = chunkCol * _chunkCells;
+		chunk._numRows = _chunkCells;
+		chunk._numCols = _chunkCells;
+
+		if( chunk._row + chunk._numRows > _numVertsPerCol - 1 )
+			chunk._numRows = _numVertsPerCol - 1 - chunk._row;
+		if( chunk._col + chunk._numCols > _numVertsPerRow - 1 )
+			chunk._numCols = _numVertsPerRow - 1 - chunk._col;
+
+		_chunkAt[chunkRow * _numChunkCols + chunkCol] = (int)_chunks.size();
+		_chunks.push_back(chunk);
+	}
+	else
+	{
+		// quarters in Z order
+		int half = size / 2;
+		buildNode(chunkRow,        chunkCol,        half);
+		buildNode(chunkRow,        chunkCol + half, half);
+		buildNode(chunkRow + half, chunkCol,        half);
+		buildNode(chunkRow + half, chunkCol + half, half);
+	}
+
+	_nodes[index]._end  = (int)_chunks.size();
+	_nodes[index]._skip = (int)_nodes.size();
+
+	return index;
+}
+
+void TerrainTree::fitChunk(Chunk& chunk, const HeightField& heights)
+{
+	float lo =  FLT_MAX;
+	float hi = -FLT_MAX;
+
+	// the chunk's vertices, its far edges included
+	for(int i = chunk._row; i <= chunk._row + chunk._numRows; i++)
+	{
+		for(int j = chunk._col; j <= chunk._col + chunk._numCols; j++)
+		{
+			float h = heights.getHeight(i, j);
+			if( h < lo ) lo = h;
+			if( h > hi ) hi = h;
+		}
+	}
+
+	chunk._min[1] = lo;
+	chunk._max[1] = hi;
+}
+
+void TerrainTree::refit(const HeightField& heights, int minRow, int minCol, int maxRow, int maxCol)
+{
+	if( _chunks.empty() || minRow > maxRow || minCol > maxCol )
+		return;
+
+	// a vertex is shared by the chunks of the cells on either side of it
+	int r0 = minRow > 0 ? (minRow - 1) / _chunkCells : 0;
+	int c0 = minCol > 0 ? (minCol - 1) / _chunkCells : 0;
+	int r1 = maxRow / _chunkCells;
+	int c1 = maxCol / _chunkCells;
+
+	if( r1 >= _numChunkRows ) r1 = _numChunkRows - 1;
+	if( c1 >= _numChunkCols ) c1 = _numChunkCols - 1;
+
+	for(int r = r0; r <= r1; r++)
+		for(int c = c0; c <= c1; c++)
+			fitChunk(_chunks[_chunkAt[r * _numChunkCols + c]], heights);
+
+	// only the nodes above the changed chunks, so that small edits cost little
+	// however big the tree
+	int size = 1;
+	while( size < _numChunkRows || size < _numChunkCols )
+		size *= 2;
+
+	refitNode(0, 0, 0, size, r0, c0, r1, c1);
+}
+
+void TerrainTree::refitNode(int index, int chunkRow, int chunkCol, int size, int r0, int c0, int r1, int c1)
+{
+	// chunks [chunkRow, chunkRow + size) x [chunkCol, chunkCol + size), as
+	// buildNode made it, against the changed ones
+	if( chunkRow > r1 || chunkCol > c1 || chunkRow + size <= r0 || chunkCol + size <= c0 )
+		return;
+
+	Node& node = _nodes[index];
+
+	if( node._skip == index + 1 )
+	{
+		const Chunk& chunk = _chunks[node._first];
+		for(int k = 0; k < 3; k++)
+		{
+			node._min[k] = chunk._min[k];
+			node._max[k] = chunk._max[k];
+		}
+		return;
+	}
+
+	// the quarters in Z order, those off the grid without a node
+	int half  = size / 2;
+	int child = index + 1;
+	for(int q = 0; q < 4; q++)
+	{
+		int row = chunkRow + (q >> 1) * half;
+		int col = chunkCol + (q & 1) * half;
+		if( row >= _numChunkRows || col >= _numChunkCols )
+			continue;
+
+		refitNode(child, row, col, half, r0, c0, r1, c1);
+		child = _nodes[child]._skip;
+	}
+
+	for(int k = 0; k < 3; k++)
+	{
+		node._min[k] =  FLT_MAX;
+		node._max[k] = -FLT_MAX;
+	}
+
+	for(int child = index + 1; child < node._skip; child = _nodes[child]._skip)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			if( _nodes[child]._min[k] < node._min[k] ) node._min[k] = _nodes[child]._min[k];
+			if( _nodes[child]._max[k] > node._max[k] ) node._max[k] = _nodes[child]._max[k];
+		}
+	}
+}
+
+int TerrainTree::cull(const Frustum& frustum, std::vector<int>* visible, Stats* stats) const
+{
+	visible->clear();
+
+	int numTested = 0;
+	int numNodes  = (int)_nodes.size();
+
+	for(int i = 0; i < numNodes; )
+	{
+		const Node& node = _nodes[i];
+		numTested++;
+
+		Frustum::Result result = frustum.testBox(node._min, node._max);
+
+		if( result == Frustum::OUTSIDE )
+		{
+			i = node._skip;
+		}
+		else if( result == Frustum::INSIDE || node._skip == i + 1 )
+		{
+			// the whole subtree is in view, without testing it further
+			for(int c = node._first; c < node._end; c++)
+				visible->push_back(c);
+			i = node._skip;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	if( stats )
+	{
+		stats->_numNodesTested  = numTested;
+		stats->_numChunksInView = (int)visible->size();
+	}
+
+	return (int)visible->size();
+}
+
+int TerrainTree::getChunkAt(int row, int col) const
+{
+	if( row < 0 || col < 0 || row >= _numVertsPerCol - 1 || col >= _numVertsPerRow - 1 )
+		return -1;
+
+	return _chunkAt[(row / _chunkCells) * _numChunkCols + col / _chunkCells];
+}
+
+int TerrainTree::getNumChunkVertices(int chunk) const
+{
+	const Chunk& c = _chunks[chunk];
+	return (c._numRows + 1) * (c._numCols + 1);
+}
+
+int TerrainTree::getNumChunkIndices(int chunk) const
+{
+	const Chunk& c = _chunks[chunk];
+	return c._numRows * c._numCols * 6;
+}
+
+template<class Index>
+void TerrainTree::writeChunkIndices(int chunk, bool local, Index* out) const
+{
+	const Chunk& c = _chunks[chunk];
+
+	// vertex (row, col) of the chunk is at first + row * pitch + col
+	int pitch = local ? c._numCols + 1 : _numVertsPerRow;
+	int first = local ? 0 : c._row * _numVertsPerRow + c._col;
+
+	for(int i = 0; i < c._numRows; i++)
+	{
+		for(int j = 0; j < c._numCols; j++)
+		{
+			int v = first + i * pitch + j;
+
+			out[0] = (Index)(v);
+			out[1] = (Index)(v + 1);
+			out[2] = (Index)(v + pitch);
+
+			out[3] = (Index)(v + pitch);
+			out[4] = (Index)(v + 1);
+			out[5] = (Index)(v + pitch + 1);
+
+			out += 6;
+		}
+	}
+}
+
+void TerrainTree::writeIndices(int chunk, bool local, unsigned short* out) const
+{
+	writeChunkIndices(chunk, local, out);
+}
+
+void TerrainTree::writeIndices(int chunk, bool local, unsigned int* out) const
+{
+	writeChunkIndices(chunk, local, out);
+}
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: terrainTree.h
+//
+// Author: William Cheung
+//
+// Desc: A terrain grid split into square chunks of cells, with a bounding box per
+//       chunk from the heights under it, arranged in a quadtree for culling the
+//       chunks against a view frustum.  The chunks are numbered in the order of
+//       the tree, so that every node covers a run of consecutive chunks and a
+//       whole node in view is one run.  Does not depend on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __terrainTreeH__
+#define __terrainTreeH__
+
+#include "frustum.h"
+#include "heightField.h"
+#include <vector>
+
+class TerrainTree
+{
+public:
+	// cells on a side of a chunk, unless build is given another size
+	static const int CHUNK_CELLS = 32;
+
+	// cells [_row, _row + _numRows) x [_col, _col + _numCols) of the grid; the
+	// chunks on the far edges are smaller when the grid does not divide evenly
+	struct Chunk
+	{
+		int   _row, _col;
+		int   _numRows, _numCols;
+		float _min[3], _max[3];
+	};
+
+	struct Stats
+	{
+		Stats()
+		{
+			_numNodesTested = 0;
+			_numChunksInView = 0;
+		}
+
+		int _numNodesTested;
+		int _numChunksInView;
+	};
+
+	TerrainTree();
+
+	// Desc: Splits the grid of heights into chunks.  Vertex (row, col) is at
+	//       (originX + col * cellSpacing, heights.getHeight(row, col),
+	//       originZ - row * cellSpacing), as Terrain lays its vertices out.  The
+	//       heights are not kept.
+	void build(
+		const HeightField& heights,
+		float cellSpacing, float originX, float originZ,
+		int chunkCells = CHUNK_CELLS);
+
+	// Desc: Brings the boxes up to date after the heights of vertices
+	//       [minRow, maxRow] x [minCol, maxCol] changed.
+	void refit(const HeightField& heights, int minRow, int minCol, int maxRow, int maxCol);
+
+	// Desc: Writes the chunks whose boxes are at least partly inside the frustum
+	//       to visible, in increasing order, and returns how many there are.
+	int cull(const Frustum& frustum, std::vector<int>* visible, Stats* stats = 0) const;
+
+	int          getNumVertsPerRow() const { return _numVertsPerRow; }
+	int          getNumVertsPerCol() const { return _numVertsPerCol; }
+	int          getNumChunks() const      { return (int)_chunks.size(); }
+	const Chunk& getChunk(int i) const     { return _chunks[i]; }
+
+	// chunk of the cell (row, col), -1 off the grid
+	int getChunkAt(int row, int col) const;
+
+	//
+	// Index streams: two triangles per cell, the quad's diagonal from its upper
+	// right corner to its lower left one, as Terrain has always drawn them
+	//
+
+	// vertices of chunk, its far edges included, and indices of its triangles
+	int getNumChunkVertices(int chunk) const;
+	int getNumChunkIndices(int chunk) const;
+
+	// Desc: Writes chunk's indices to out.  With local the indices are into the
+	//       chunk's own vertices, laid out row by row, so that they fit 16 bits for
+	//       any size of grid; otherwise they are into the whole grid, row by row,
+	//       and 16 bits only fit grids of up to 65536 vertices.
+	void writeIndices(int chunk, bool local, unsigned short* out) const;
+	void writeIndices(int chunk, bool local, unsigned int* out) const;
+
+private:
+	// The nodes are kept depth first, so the children of a node follow it and
+	// _skip is the node after its subtree; the walk of cull needs no stack.
+	struct Node
+	{
+		float _min[3], _max[3];
+		int   _first, _end; // chunks of the subtree
+		int   _skip;
+	};
+
+	template<class Index>
+	void writeChunkIndices(int chunk, bool local, Index* out) const;
+
+	int  buildNode(int chunkRow, int chunkCol, int size);
+	void fitChunk(Chunk& chunk, const HeightField& heights);
+	void refitNode(int index, int chunkRow, int chunkCol, int size, int r0, int c0, int r1, int c1);
+
+	int _numVertsPerRow;
+	int _numVertsPerCol;
+	int _chunkCells;
+	int _numChunkRows;
+	int _numChunkCols;
+
+	std::vector<Chunk> _chunks;
+	std::vector<Node>  _nodes;
+	std::vector<int>   _chunkAt; // chunk numbers by chunk row and column
+};
+
+#endif // __terrainTreeH__
@@ -0,0 +1,414 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: windField.cpp
+//
+// Author: William Cheung
+//
+// Desc: A coarse 3D grid of wind velocities driven by scrolling value noise.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "windField.h"
+#include <algorithm>
+#include <cmath>
+
+WindField::WindField()
+{
+	for(int c = 0; c < 3; c++)
+	{
+		_min[c]     = 0.0f;
+		_max[c]     = 1.0f;
+		_invStep[c] = 1.0f;
+		_base[c]    = 0.0f;
+	}
+	_numX = _numY = _numZ = 0;
+
+	_gustStrength = 0.0f;
+	_gustScale    = 1.0f;
+	_keyInterval  = 1.0f;
+	_seed         = 0;
+	_nextSlices   = 0;
+	_keyTime      = 0.0f;
+	_blend        = 0.0f;
+}
+
+void WindField::setWind(const float base[3], float gustStrength, float gustScale, float keyInterval)
+{
+	for(int c = 0; c < 3; c++)
+		_base[c] = base[c];
+
+	_gustStrength = gustStrength;
+	_gustScale    = gustScale   > 0.0f ? gustScale   : 1.0f;
+	_keyInterval  = keyInterval > 0.0f ? keyInterval : 1.0f;
+}
+
+void WindField::setSeed(unsigned int seed)
+{
+	_seed = seed;
+}
+
+void WindField::init(const float min[3], const float max[3], int numX, int numY, int numZ)
+{
+	_numX = numX > 2 ? numX : 2;
+	_numY = numY > 2 ? numY : 2;
+	_numZ = numZ > 2 ? numZ : 2;
+
+	int counts[3] = { _numX, _numY, _numZ };
+	for(int c = 0; c < 3; c++)
+	{
+		_min[c] = min[c];
+		_max[c] = max[c] > min[c] ? max[c] : min[c] + 1.0f;
+		_invStep[c] = (float)(counts[c] - 1) / (_max[c] - _min[c]);
+	}
+
+	int numPoints = getNumPoints();
+	Grid* grids[] = { &_from, &_to, &_next, &_current };
+	for(int g = 0; g < 4; g++)
+		for(int c = 0; c < 3; c++)
+			grids[g]->_v[c].assign(numPoints, 0.0f);
+
+	_keyTime    = 0.0f;
+	_blend      = 0.0f;
+	_nextSlices = 0;
+
+	buildSlices(&_from, 0.0f,         0, _numZ);
+	buildSlices(&_to,   _keyInterval, 0, _numZ);
+	_current = _from;
+}
+
+void WindField::update(float timeDelta)
+{
+	if( _numX == 0 || timeDelta <= 0.0f )
+		return;
+
+	_blend += timeDelta / _keyInterval;
+
+	while( _blend >= 1.0f )
+	{
+		// the next keyframe is needed now, finish it
+		buildSlices(&_next, _keyTime + 2.0f * _keyInterval, _nextSlices, _numZ);
+
+		// _from <- _to <- _next, the old _from is reused for the one after
+		std::swap(_from, _to);
+		std::swap(_to,   _next);
+
+		_keyTime   += _keyInterval;
+		_blend     -= 1.0f;
+		_nextSlices = 0;
+	}
+
+	// build the next keyframe in step with the blend, so that the work is
+	// spread evenly over the frames of an interval
+	int due = (int)ceilf(_blend * (float)_numZ);
+	if( due > _numZ )
+		due = _numZ;
+
+	if( due > _nextSlices )
+	{
+		buildSlices(&_next, _keyTime + 2.0f * _keyInterval, _nextSlices, due);
+		_nextSlices = due;
+	}
+
+	int numPoints = getNumPoints();
+	for(int c = 0; c < 3; c++)
+	{
+		const float* from = &_from._v[c][0];
+		const float* to   = &_to._v[c][0];
+		float*       cur  = &_current._v[c][0];
+
+		for(int i = 0; i < numPoints; i++)
+			cur[i] = from[i] + (to[i] - from[i]) * _blend;
+	}
+}
+
+void WindField::buildSlices(Grid* grid, float time, int firstSlice, int lastSlice)
+{
+	float step[3];
+	for(int c = 0; c < 3; c++)
+		step[c] = 1.0f / _invStep[c];
+
+	for(int k = firstSlice; k < lastSlice; k++)
+	{
+		for(int j = 0; j < _numY; j++)
+		{
+			for(int i = 0; i < _numX; i++)
+			{
+				float wind[3];
+				noiseWind(
+					_min[0] + (float)i * step[0],
+					_min[1] + (float)j * step[1],
+					_min[2] + (float)k * step[2],
+					time, wind);
+
+				int index = (k * _numY + j) * _numX + i;
+				for(int c = 0; c < 3; c++)
+					grid->_v[c][index] = wind[c];
+			}
+		}
+	}
+}
+
+void WindField::noiseWind(float x, float y, float z, float time, float out[3]) const
+{
+	// Two octaves of noise carried along by the base wind, the finer one a little
+	// faster.  The noise also drifts slowly upwards so that gusts change shape
+	// instead of just sliding by.
+	const float frequency[2] = { 1.0f, 2.3f };
+	const float speed[2]     = { 1.0f, 1.6f };
+	const float amplitude[2] = { 0.65f, 0.35f };
+
+	// gusts are mostly horizontal
+	const float axisScale[3] = { 1.0f, 0.3f, 1.0f };
+
+	float sum[3] = { 0.0f, 0.0f, 0.0f };
+
+	for(int o = 0; o < 2; o++)
+	{
+		float f  = frequency[o] / _gustScale;
+		float px = (x - _base[0] * time * speed[o]) * f;
+		float py = (y - _base[1] * time * speed[o]) * f - time * 0.2f * speed[o];
+		float pz = (z - _base[2] * time * speed[o]) * f;
+
+		for(int c = 0; c < 3; c++)
+			sum[c] += amplitude[o] * valueNoise(px, py, pz, (unsigned int)(c * 2 + o));
+	}
+
+	for(int c = 0; c < 3; c++)
+		out[c] = _base[c] + _gustStrength * axisScale[c] * sum[c];
+}
+
+// integer hash of a lattice point, mixed with the lowbias32 finalizer
+static inline unsigned int hashLattice(int x, int y, int z, unsigned int salt)
+{
+	unsigned int h = salt;
+	h ^= (unsigned int)x * 0x8da6b343u;
+	h ^= (unsigned int)y * 0xd8163841u;
+	h ^= (unsigned int)z * 0xcb1ab31fu;
+	h ^= h >> 16; h *= 0x7feb352du;
+	h ^= h >> 15; h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+// random value in [-1, 1] of a lattice point
+static inline float latticeValue(int x, int y, int z, unsigned int salt)
+{
+	return (float)(hashLattice(x, y, z, salt) >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static inline float smooth(float t)
+{
+	return t * t * (3.0f - 2.0f * t);
+}
+
+float WindField::valueNoise(float x, float y, float z, unsigned int salt) const
+{
+	salt = salt * 0x9e3779b9u + _seed;
+
+	float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+	int   ix = (int)fx,   iy = (int)fy,   iz = (int)fz;
+	float tx = smooth(x - fx);
+	float ty = smooth(y - fy);
+	float tz = smooth(z - fz);
+
+	float c000 = latticeValue(ix,     iy,     iz,     salt);
+	float c100 = latticeValue(ix + 1, iy,     iz,     salt);
+	float c010 = latticeValue(ix,     iy + 1, iz,     salt);
+	float c110 = latticeValue(ix + 1, iy + 1, iz,     salt);
+	float c001 = latticeValue(ix,     iy,     iz + 1, salt);
+	float c101 = latticeValue(ix + 1, iy,     iz + 1, salt);
+	float c011 = latticeValue(ix,     iy + 1, iz + 1, salt);
+	float c111 = latticeValue(ix + 1, iy + 1, iz + 1, salt);
+
+	float c00 = c000 + (c100 - c000) * tx;
+	float c10 = c010 + (c110 - c010) * tx;
+	float c01 = c001 + (c101 - c001) * tx;
+	float c11 = c011 + (c111 - c011) * tx;
+
+	float c0 = c00 + (c10 - c00) * ty;
+	float c1 = c01 + (c11 - c01) * ty;
+
+	return c0 + (c1 - c0) * tz;
+}
+
+//
+// Sampling
+//
+// A point is clamped to the grid, split into the cell (i, j, k) it is in and its
+// position (tx, ty, tz) inside that cell, and the cell's eight corners are blended
+// along x, then y, then z.  Both paths do the same operations in the same order.
+//
+
+static void sampleScalar(
+	const float* const* grid,
+	const float* min, const float* invStep,
+	int numX, int numY, int numZ,
+	const float* x, const float* y, const float* z, int begin, int count,
+	float* const* out)
+{
+	const float maxX = (float)(numX - 1);
+	const float maxY = (float)(numY - 1);
+	const float maxZ = (float)(numZ - 1);
+	const int   dy   = numX;
+	const int   dz   = numX * numY;
+
+	for(int k = begin; k < count; k++)
+	{
+		float fx = (x[k] - min[0]) * invStep[0];
+		float fy = (y[k] - min[1]) * invStep[1];
+		float fz = (z[k] - min[2]) * invStep[2];
+
+		fx = std::min(std::max(fx, 0.0f), maxX);
+		fy = std::min(std::max(fy, 0.0f), maxY);
+		fz = std::min(std::max(fz, 0.0f), maxZ);
+
+		// the last grid point belongs to the cell before it
+		int i = std::min((int)fx, numX - 2);
+		int j = std::min((int)fy, numY - 2);
+		int l = std::min((int)fz, numZ - 2);
+
+		float tx = fx - (float)i;
+		float ty = fy - (float)j;
+		float tz = fz - (float)l;
+
+		int base = l * dz + j * dy + i;
+
+		for(int c = 0; c < 3; c++)
+		{
+			const float* v = grid[c] + base;
+
+			float c00 = v[0]       + (v[1]           - v[0])      * tx;
+			float c10 = v[dy]      + (v[dy + 1]      - v[dy])     * tx;
+			float c01 = v[dz]      + (v[dz + 1]      - v[dz])     * tx;
+			float c11 = v[dz + dy] + (v[dz + dy + 1] - v[dz + dy]) * tx;
+
+			float c0 = c00 + (c10 - c00) * ty;
+			float c1 = c01 + (c11 - c01) * ty;
+
+			out[c][k] = c0 + (c1 - c0) * tz;
+		}
+	}
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET_AVX2
+static int sampleAVX2(
+	const float* const* grid,
+	const float* min, const float* invStep,
+	int numX, int numY, int numZ,
+	const float* x, const float* y, const float* z, int count,
+	float* const* out)
+{
+	const __m256  zero = _mm256_setzero_ps();
+	const __m256  maxX = _mm256_set1_ps((float)(numX - 1));
+	const __m256  maxY = _mm256_set1_ps((float)(numY - 1));
+	const __m256  maxZ = _mm256_set1_ps((float)(numZ - 1));
+	const __m256i lastX = _mm256_set1_epi32(numX - 2);
+	const __m256i lastY = _mm256_set1_epi32(numY - 2);
+	const __m256i lastZ = _mm256_set1_epi32(numZ - 2);
+	const __m256  minX = _mm256_set1_ps(min[0]);
+	const __m256  minY = _mm256_set1_ps(min[1]);
+	const __m256  minZ = _mm256_set1_ps(min[2]);
+	const __m256  invX = _mm256_set1_ps(invStep[0]);
+	const __m256  invY = _mm256_set1_ps(invStep[1]);
+	const __m256  invZ = _mm256_set1_ps(invStep[2]);
+	const int     dy   = numX;
+	const int     dz   = numX * numY;
+	const __m256i vdy  = _mm256_set1_epi32(dy);
+	const __m256i vdz  = _mm256_set1_epi32(dz);
+	const __m256i one  = _mm256_set1_epi32(1);
+
+	int k = 0;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m256 fx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), minX), invX);
+		__m256 fy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(y + k), minY), invY);
+		__m256 fz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + k), minZ), invZ);
+
+		fx = _mm256_min_ps(_mm256_max_ps(fx, zero), maxX);
+		fy = _mm256_min_ps(_mm256_max_ps(fy, zero), maxY);
+		fz = _mm256_min_ps(_mm256_max_ps(fz, zero), maxZ);
+
+		__m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(fx), lastX);
+		__m256i j = _mm256_min_epi32(_mm256_cvttps_epi32(fy), lastY);
+		__m256i l = _mm256_min_epi32(_mm256_cvttps_epi32(fz), lastZ);
+
+		__m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(i));
+		__m256 ty = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(j));
+		__m256 tz = _mm256_sub_ps(fz, _mm256_cvtepi32_ps(l));
+
+		__m256i b000 = _mm256_add_epi32(_mm256_add_epi32(
+			_mm256_mullo_epi32(l, vdz), _mm256_mullo_epi32(j, vdy)), i);
+		__m256i b100 = _mm256_add_epi32(b000, one);
+		__m256i b010 = _mm256_add_epi32(b000, vdy);
+		__m256i b110 = _mm256_add_epi32(b010, one);
+		__m256i b001 = _mm256_add_epi32(b000, vdz);
+		__m256i b101 = _mm256_add_epi32(b001, one);
+		__m256i b011 = _mm256_add_epi32(b001, vdy);
+		__m256i b111 = _mm256_add_epi32(b011, one);
+
+		for(int c = 0; c < 3; c++)
+		{
+			const float* v = grid[c];
+
+			__m256 v000 = _mm256_i32gather_ps(v, b000, 4);
+			__m256 v100 = _mm256_i32gather_ps(v, b100, 4);
+			__m256 v010 = _mm256_i32gather_ps(v, b010, 4);
+			__m256 v110 = _mm256_i32gather_ps(v, b110, 4);
+			__m256 v001 = _mm256_i32gather_ps(v, b001, 4);
+			__m256 v101 = _mm256_i32gather_ps(v, b101, 4);
+			__m256 v011 = _mm256_i32gather_ps(v, b011, 4);
+			__m256 v111 = _mm256_i32gather_ps(v, b111, 4);
+
+			__m256 c00 = _mm256_add_ps(v000, _mm256_mul_ps(_mm256_sub_ps(v100, v000), tx));
+			__m256 c10 = _mm256_add_ps(v010, _mm256_mul_ps(_mm256_sub_ps(v110, v010), tx));
+			__m256 c01 = _mm256_add_ps(v001, _mm256_mul_ps(_mm256_sub_ps(v101, v001), tx));
+			__m256 c11 = _mm256_add_ps(v011, _mm256_mul_ps(_mm256_sub_ps(v111, v011), tx));
+
+			__m256 c0 = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c10, c00), ty));
+			__m256 c1 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_sub_ps(c11, c01), ty));
+
+			_mm256_storeu_ps(out[c] + k, _mm256_add_ps(c0, _mm256_mul_ps(_mm256_sub_ps(c1, c0), tz)));
+		}
+	}
+
+	_mm256_zeroupper();
+	return k;
+}
+
+#endif // SIMD_X86
+
+void WindField::sample(
+	simd::Level level,
+	const float* x, const float* y, const float* z, int count,
+	float* wx, float* wy, float* wz) const
+{
+	if( _numX == 0 )
+	{
+		std::fill(wx, wx + count, 0.0f);
+		std::fill(wy, wy + count, 0.0f);
+		std::fill(wz, wz + count, 0.0f);
+		return;
+	}
+
+	const float* grid[3] = { &_current._v[0][0], &_current._v[1][0], &_current._v[2][0] };
+	float*       out[3]  = { wx, wy, wz };
+
+	int done = 0;
+
+#ifdef SIMD_X86
+	// there is no gather before AVX2, SSE2 takes the scalar path
+	if( level == simd::LEVEL_AVX2 )
+		done = sampleAVX2(grid, _min, _invStep, _numX, _numY, _numZ, x, y, z, count, out);
+#endif
+
+	sampleScalar(grid, _min, _invStep, _numX, _numY, _numZ, x, y, z, done, count, out);
+}
+
+void WindField::sample(
+	const float* x, const float* y, const float* z, int count,
+	float* wx, float* wy, float* wz) const
+{
+	sample(simd::GetLevel(), x, y, z, count, wx, wy, wz);
+}
@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: windField.h
+//
+// Author: William Cheung
+//
+// Desc: A coarse 3D grid of wind velocities driven by scrolling value noise.  The noise
+//       is only evaluated at the grid points, for keyframes a fraction of a second
+//       apart, and the next keyframe is built a few slices per update while the
+//       current two are blended.  Particles sample the blended grid in bulk with
+//       trilinear interpolation, never evaluating noise themselves.  Does not depend
+//       on Direct3D.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __windFieldH__
+#define __windFieldH__
+
+#include "simd.h"
+#include <vector>
+
+class WindField
+{
+public:
+	WindField();
+
+	// Desc: Covers the box [min, max] with numX * numY * numZ grid points, at least
+	//       two along each axis, and builds the first keyframes.  Positions outside
+	//       the box see the wind at its faces.
+	void init(const float min[3], const float max[3], int numX, int numY, int numZ);
+
+	// Desc: base is the steady wind.  Gusts add up to gustStrength to it, vary over
+	//       gustScale units of space and are carried along by the base wind.
+	//       keyInterval is the time between two keyframes.  Call before init.
+	void setWind(const float base[3], float gustStrength, float gustScale, float keyInterval);
+
+	void setSeed(unsigned int seed);
+
+	// Desc: Advances the field by timeDelta: blends the current keyframes and builds
+	//       the part of the next one that is due.
+	void update(float timeDelta);
+
+	// Desc: Wind velocity at the count points (x[k], y[k], z[k]), written to
+	//       (wx[k], wy[k], wz[k]).  The AVX2 path gathers the grid corners and gives
+	//       bitwise the same results as the scalar one.
+	void sample(
+		const float* x, const float* y, const float* z, int count,
+		float* wx, float* wy, float* wz) const;
+
+	// Desc: Same as above with an explicit instruction set, for comparing paths.
+	void sample(
+		simd::Level level,
+		const float* x, const float* y, const float* z, int count,
+		float* wx, float* wy, float* wz) const;
+
+	int getNumPoints() const { return _numX * _numY * _numZ; }
+
+private:
+	// one keyframe, component by component so that a gather reads one array
+	struct Grid
+	{
+		std::vector<float> _v[3];
+	};
+
+	void buildSlices(Grid* grid, float time, int firstSlice, int lastSlice);
+	void noiseWind(float x, float y, float z, float time, float out[3]) const;
+	float valueNoise(float x, float y, float z, unsigned int salt) const;
+
+	float        _min[3];
+	float        _max[3];
+	float        _invStep[3];  // grid points per unit along each axis
+	int          _numX, _numY, _numZ;
+
+	float        _base[3];
+	float        _gustStrength;
+	float        _gustScale;
+	float        _keyInterval;
+	unsigned int _seed;
+
+	Grid         _from;        // keyframe at _keyTime
+	Grid         _to;          // keyframe at _keyTime + _keyInterval
+	Grid         _next;        // keyframe at _keyTime + 2 _keyInterval, being built
+	Grid         _current;     // _from blended toward _to, what sample reads
+	int          _nextSlices;  // z slices of _next built so far
+	float        _keyTime;
+	float        _blend;       // (time - _keyTime) / _keyInterval, in [0, 1)
+};
+
+#endif // __windFieldH__